@@ -36,9 +36,11 @@ RTA_COLDEF  *rta_Col[RTA_MX_COL];
 int          rta_Ncol;
 
 extern struct RtaDbg rta_dbg;
+extern struct RtaStat rta_stat;
 static char  *ConfigDir = (char *) 0;
 
 static int is_reserved(char *pword);
+static int bad_length(char *buf);
 
 
 /***************************************************************
@@ -53,6 +55,8 @@ rta_init()
   int      i;          /* loop index */
   extern RTA_TBLDEF rta_tablesTable;
   extern RTA_TBLDEF rta_columnsTable;
+  extern RTA_TBLDEF rta_limitTable;
+  extern RTA_TBLDEF rta_pcacheTable;
   /* The stats and debug tables exist but we only expose them to
    * the user when DEBUG is enabled in the Makefile */
 #ifdef DEBUG
@@ -69,6 +73,8 @@ rta_init()
   /* add system and internal tables here */
   (void) rta_add_table(&rta_tablesTable);
   (void) rta_add_table(&rta_columnsTable);
+  (void) rta_add_table(&rta_limitTable);
+  (void) rta_add_table(&rta_pcacheTable);
 #ifdef DEBUG
   (void) rta_add_table(&rta_dbgTable);
   (void) rta_add_table(&rta_statTable);
@@ -231,7 +237,23 @@ rta_add_table(RTA_TBLDEF *ptbl)
         rta_log(LOC, Er_Col_Type, ptbl->cols[i].name);
       return (RTA_ERROR);
     }
-    if (ptbl->cols[i].flags > RTA_DISKSAVE + RTA_READONLY) {
+    if (ptbl->cols[i].flags >
+        RTA_DISKSAVE + RTA_READONLY + RTA_INDEXED + RTA_ORDERED + RTA_BITMAP) {
+      rta_stat.nrtaerr++;
+      if (rta_dbg.rtaerr)
+        rta_log(LOC, Er_Col_Flag, ptbl->cols[i].name);
+      return (RTA_ERROR);
+    }
+    if ((ptbl->cols[i].flags & RTA_INDEXED) &&
+        (ptbl->cols[i].type == RTA_FLOAT || ptbl->cols[i].type == RTA_PFLOAT
+        || ptbl->cols[i].type == RTA_DOUBLE)) {
+      rta_stat.nrtaerr++;
+      if (rta_dbg.rtaerr)
+        rta_log(LOC, Er_Col_Flag, ptbl->cols[i].name);
+      return (RTA_ERROR);
+    }
+    if ((ptbl->cols[i].flags & RTA_BITMAP) &&
+        ptbl->cols[i].type != RTA_UCHAR && ptbl->cols[i].type != RTA_SHORT) {
       rta_stat.nrtaerr++;
       if (rta_dbg.rtaerr)
         rta_log(LOC, Er_Col_Flag, ptbl->cols[i].name);
@@ -253,7 +275,9 @@ rta_add_table(RTA_TBLDEF *ptbl)
     return (RTA_ERROR);
   }
 
-  /* Everything looks OK.  Add table and columns */
+  /* Everything looks OK.  Add table and columns.  The saved
+     plans may point at a table this one replaces. */
+  rta_pcache_flush();
   rta_Tbl[rta_Ntbl++] = ptbl;
   rta_Tbl[0]->nrows = rta_Ntbl;
 
@@ -301,24 +325,50 @@ rta_add_table(RTA_TBLDEF *ptbl)
  **************************************************************/
 int
 rta_dbcommand(char *buf, int *nin, char *out, int *nout)
+{
+  return (rta_session_dbcommand((RTA_SESSION *) 0, buf, nin, out, nout));
+}
+
+/***************************************************************
+ * rta_session_dbcommand():  - Depacketize and execute any
+ * Postgres commands from one client.  The messages of the
+ * extended query protocol are handed to rta_ext_message().
+ * 
+ * Input:  sess - the client's session, NULL for the default
+ *         buf, nin, out, nout - as rta_dbcommand() above
+ * Return: as rta_dbcommand() above
+ **************************************************************/
+int
+rta_session_dbcommand(RTA_SESSION *sess, char *buf, int *nin, char *out,
+  int *nout)
 {
   extern struct RtaStat rta_stat;
   int      length;     /* length of the packet if old protocol */
+  int      ret;        /* return value */
+  int      pid;        /* process ID of BackendKeyData */
+  int      key;        /* secret key of BackendKeyData */
+  char    *pkey;       /* where the key goes in the reply */
+
+  /* Finish any SELECT waiting for room in the output buffer before
+     we look at new input */
+  ret = rta_ext_resume(sess, out, nout);
+  if (ret != RTA_NOCMD)
+    return (ret);
+
+  /* Notifications go out between commands */
+  out += rta_ext_notify(sess, out, nout);
+  if (*nin <= 0)
+    return (RTA_NOCMD);
 
   /* startup or cancel packet if first byte is zero */
   if ((int) buf[0] == 0) {
-    /* get length.  Enough bytes for a length? if not, consume no
-       input, write no output */
-    if (*nin < 4) {
-      return (RTA_NOCMD);
-    }
-    length = (int) ((unsigned int) (0xff & buf[3]) +
-      ((unsigned int) (0xff & buf[2]) << 8) +
-      ((unsigned int) (0xff & buf[1]) << 16));
-
-    /* Is the whole packet here? If not, consume no input, write no
-       output */
-    if (*nin < length) {
+    /* Get the length.  Is the whole packet here?  If not, consume
+       no input, write no output.  A bad length leaves no way to
+       find the next packet. */
+    length = rta_dbmsglen(buf, *nin);
+    if (length < 0)
+      return (bad_length(buf));
+    if (length == 0 || *nin < length) {
       return (RTA_NOCMD);
     }
 
@@ -359,7 +409,8 @@ rta_dbcommand(char *buf, int *nin, char *out, int *nout)
          'S', int32(length), "server_version", "7.4", null
          'S', int32(length), "session_authorization", null, "postgres", null
          'K', int32(length), int32(pid of backend), int32(secret key)
-         'Z', int32(length), 'I'   */
+         'Z', int32(length), 'I'
+         The process ID and secret key are those of the session. */
 
       unsigned char reply[164] = {
         'R',0x00,0x00,0x00,0x08,0x00,0x00,0x00,0x00,
@@ -390,14 +441,31 @@ rta_dbcommand(char *buf, int *nin, char *out, int *nout)
 
       *nin -= length;
       (void) memcpy(out, reply, 164);
+      rta_ext_keys(sess, &pid, &key);
+      pkey = &out[150];
+      rta_ad_int4(&pkey, pid);
+      rta_ad_int4(&pkey, key);
       *nout -= 164;
       rta_stat.nauth++;
       return (RTA_SUCCESS);
     }
-    else if (length == 16) {    /* a cancel request */
-      /* ignore the request for now */
+    else if (length == 16 &&
+        buf[4] == (char) 0x04 && buf[5] == (char) 0xd2 &&
+        buf[6] == (char) 0x16 && buf[7] == (char) 0x2e) {
+      /* A cancel request, '00 00 00 10 04 d2 16 2e', the process
+         ID, and the secret key, on a connection of its own.  There
+         is no reply and the connection is closed. */
+      pid = (int) ((unsigned int) (0xff & buf[11]) +
+        ((unsigned int) (0xff & buf[10]) << 8) +
+        ((unsigned int) (0xff & buf[9]) << 16) +
+        ((unsigned int) (0xff & buf[8]) << 24));
+      key = (int) ((unsigned int) (0xff & buf[15]) +
+        ((unsigned int) (0xff & buf[14]) << 8) +
+        ((unsigned int) (0xff & buf[13]) << 16) +
+        ((unsigned int) (0xff & buf[12]) << 24));
+      rta_ext_cancel(pid, key);
       *nin -= length;
-      return (RTA_SUCCESS);
+      return (RTA_CLOSE);
     }
     else {                      /* unknown, ignore, (log?) */
 
@@ -405,31 +473,42 @@ rta_dbcommand(char *buf, int *nin, char *out, int *nout)
       return (RTA_SUCCESS);
     }
   }
-  else if (buf[0] == 'Q') {     /* a query request */
+  else if (buf[0] == 'Q' ||     /* a query request */
+    buf[0] == 'P' || buf[0] == 'B' || buf[0] == 'D' || buf[0] == 'E' ||
+    buf[0] == 'C' || buf[0] == 'S' || buf[0] == 'H' ||
+    buf[0] == 'd' || buf[0] == 'c' || buf[0] == 'f') {
     /* the Postgres 0300 protocol has a 32 bit length after the 1 byte
-       command.  Verify that we have enough bytes to get the length */
-
-    if (*nin < 5) {
+       command.  Get the length, with one added for the 'Q', and
+       verify that we have all the bytes. */
+    length = rta_dbmsglen(buf, *nin);
+    if (length < 0)
+      return (bad_length(buf));
+    if (length == 0 || *nin < length) {
       return (RTA_NOCMD);
     }
 
-    /* Get length and verify that we have all the bytes. Note the quiet 
-       assumption that the length is 24 bits. */
-    length = (int) ((unsigned int) (0xff & buf[4]) +
-      ((unsigned int) (0xff & buf[3]) << 8) +
-      ((unsigned int) (0xff & buf[2]) << 16));
+    /* The extended query protocol: Parse, Bind, Execute, ... */
+    if (buf[0] != 'Q') {
+      ret = rta_ext_message(sess, buf[0], &buf[5], length - 5, out, nout);
+      if (ret == RTA_SUCCESS || ret == RTA_MORE || ret == RTA_YIELD)
+        *nin -= length;         /* to swallow the cmd */
+      return (ret);
+    }
 
-    /* add one to account for the 'Q' */
-    length++;
-    if (*nin < length) {
-      return (RTA_NOCMD);
+    /* Keep the query for the next call if there is no room for an
+       error and the ReadyForQuery that ends every query */
+    if (*nout < 100) {
+      rta_stat.nsqlerr++;
+      if (rta_dbg.sqlerr)
+        rta_log(LOC, Er_No_Space);
+      return (RTA_NOBUF);
     }
 
     /* Got a complete command; do it. (buf[5] since the SQL follows the 
-       'Q' and length) */
-    rta_SQL_string(&buf[5], (*nin - 5), out, nout);
+       'Q' and length.)  Pass only this packet's SQL since the input
+       may hold more than one command.  */
     *nin -= length;             /* to swallow the cmd */
-    return (RTA_SUCCESS);
+    return (rta_ext_query(sess, &buf[5], (length - 5), out, nout));
   }
   else if (buf[0] == 'X') {     /* a terminate request */
     return (RTA_CLOSE);
@@ -439,6 +518,138 @@ rta_dbcommand(char *buf, int *nin, char *out, int *nout)
   return (RTA_CLOSE);
 }
 
+/***************************************************************
+ * rta_dbmsglen():  - Give the length of the packet at the start
+ * of the input buffer.  The length is the full 32 bits sent by
+ * the client, with one added for the command byte if there is
+ * one.  A caller whose input buffer is too small for the packet
+ * can use this to grow the buffer.
+ * 
+ * Input:  buf - the input from the client
+ *         nin - the number of bytes in buf
+ * Return: the number of bytes in the packet, 0 if there are
+ *         too few bytes to tell, or -1 if the length is not
+ *         valid: less than the length field itself, or more
+ *         than RTA_MX_STARTUP bytes for a start-up packet and
+ *         RTA_MX_MSG bytes for others.
+ **************************************************************/
+int
+rta_dbmsglen(char *buf, int nin)
+{
+  unsigned int length;     /* the length field of the packet */
+  int      start;          /* ==1 if a start-up or cancel packet */
+
+  start = ((int) buf[0] == 0);
+  if (nin < ((start) ? 4 : 5))
+    return (0);
+  if (!start)
+    buf++;                      /* skip the command byte */
+  length = (unsigned int) (0xff & buf[3]) +
+    ((unsigned int) (0xff & buf[2]) << 8) +
+    ((unsigned int) (0xff & buf[1]) << 16) +
+    ((unsigned int) (0xff & buf[0]) << 24);
+
+  if (start)
+    return ((length < 8 || length > RTA_MX_STARTUP) ? -1 : (int) length);
+  return ((length < 4 || length > RTA_MX_MSG) ? -1 : (int) length + 1);
+}
+
+/***************************************************************
+ * bad_length():  - Log a packet with a bad length.  The client
+ * is out of step with us so the connection must be closed.
+ * 
+ * Input:  buf - the packet
+ * Return: RTA_CLOSE
+ **************************************************************/
+static int
+bad_length(char *buf)
+{
+  rta_stat.nsqlerr++;
+  if (rta_dbg.sqlerr)
+    rta_log(LOC, Er_Msg_Len, (int) (0xff & buf[0]));
+  return (RTA_CLOSE);
+}
+
+/***************************************************************
+ * rta_session_dbbatch():  - Execute all of the complete commands
+ * in the input buffer of a client.  We walk the buffer with an
+ * offset so the caller moves the unused tail only once.
+ * 
+ * Input:  sess - the client's session, NULL for the default
+ *         buf, nin, out, nout - as rta_dbcommand() above
+ *         ncmd - on exit, the number of commands executed
+ * Return: RTA_SUCCESS   - all of the input was used
+ *         RTA_NOCMD     - the input ends with a partial command
+ *         others        - as rta_dbcommand() above
+ **************************************************************/
+int
+rta_session_dbbatch(RTA_SESSION *sess, char *buf, int *nin, char *out,
+  int *nout, int *ncmd)
+{
+  int      nbuf;       /* size of the input on entry */
+  int      nfree;      /* free output space on entry */
+  int      ret;        /* rta_session_dbcommand() return */
+
+  nbuf = *nin;
+  nfree = *nout;
+  *ncmd = 0;
+  do {
+    ret = rta_session_dbcommand(sess, &buf[nbuf - *nin], nin,
+      &out[nfree - *nout], nout);
+    if (ret == RTA_SUCCESS)
+      (*ncmd)++;
+  } while (ret == RTA_SUCCESS);
+
+  /* Running out of input is not an error if it was all used */
+  if (ret == RTA_NOCMD && *nin == 0)
+    return (RTA_SUCCESS);
+  return (ret);
+}
+
+/***************************************************************
+ * rta_session_dbbatchv():  - Execute all of the complete commands
+ * in the input buffer of a client.  Long strings in the responses
+ * are left as holes in 'out' and are described by the iovec list
+ * instead.  See rta_ad_ref().
+ * 
+ * Input:  sess, buf, nin, out, nout, ncmd - as rta_session_dbbatch()
+ *         iov - the list to fill in
+ *         niov - on entry, the size of iov, on exit, entries used
+ * Return: RTA_ERROR if niov is less than 1, else as
+ *         rta_session_dbbatch() above
+ **************************************************************/
+int
+rta_session_dbbatchv(RTA_SESSION *sess, char *buf, int *nin, char *out,
+  int *nout, int *ncmd, struct iovec *iov, int *niov)
+{
+  extern struct Sql_Iov rta_iov;
+  int      nfree;      /* free output space on entry */
+  char    *end;        /* end of the output */
+  int      ret;        /* rta_session_dbbatch() return */
+
+  if (*niov < 1)
+    return (RTA_ERROR);
+
+  rta_iov.iov = iov;
+  rta_iov.niov = 0;
+  rta_iov.mxiov = *niov;
+  rta_iov.start = out;
+  rta_iov.base = out;
+  nfree = *nout;
+  ret = rta_session_dbbatch(sess, buf, nin, out, nout, ncmd);
+
+  /* The output after the last string */
+  end = &out[nfree - *nout];
+  if (end > rta_iov.base) {
+    iov[rta_iov.niov].iov_base = rta_iov.base;
+    iov[rta_iov.niov].iov_len = end - rta_iov.base;
+    rta_iov.niov++;
+  }
+  *niov = rta_iov.niov;
+  rta_iov.iov = (struct iovec *) 0;
+  return (ret);
+}
+
 /***************************************************************
  * rta_save():  - Save a table to file.  The save format is a
  * series of UPDATE commands saved in the file specified.  The
@@ -752,6 +963,8 @@ is_reserved(char *pword)
           !strcasecmp(pword, "WHERE") ||
           !strcasecmp(pword, "LIMIT") ||
           !strcasecmp(pword, "OFFSET") ||
+          !strcasecmp(pword, "LISTEN") ||
+          !strcasecmp(pword, "UNLISTEN") ||
           !strcasecmp(pword, "SET"));
 }
 
@@ -15,10 +15,28 @@
 #include <stdlib.h>
 #include <stdarg.h>             /* for va_arg */
 #include <string.h>
+#include <limits.h>             /* for INT_MAX */
 #include <syslog.h>
+#include <time.h>               /* for clock_gettime() */
 #include "do_sql.h"
 
 struct Sql_Cmd rta_cmd;
+struct Sql_Iov rta_iov;
+
+/* A count of SQL INSERTs and DELETEs on each table.  A stopped
+ * SELECT saves a row pointer and its row index.  If rows have
+ * been added or deleted since, the index may belong to another
+ * row, and a SELECT on a table with an iterator, or over rows
+ * found with an index, finds its row again by comparing
+ * pointers.  An ORDER BY also saves the value
+ * of its column and seeks back to it.  If the row is gone the
+ * SELECT fails rather than skip the rows after it. */
+static int     TblGen[RTA_MX_TBL];
+
+/* The budget of one call to a SELECT that can be resumed.  Zero
+ * is no limit.  See rta_budget(). */
+static int     BudRows;
+static int     BudUsecs;
 
 extern RTA_TBLDEF *rta_Tbl[];
 extern int rta_Ntbl;
@@ -33,18 +51,87 @@ static void     verify_select_list(char *, int *);
 static void     verify_update_list(char *, int *);
 static void     verify_insert_list(char *, int *);
 static void     verify_where_list(char *, int *);
+static void     verify_order(char *, int *);
+static int      where_match(void *, int);
 static void     verify_insert_callback(char *, int *);
 static void     verify_delete_callback(char *, int *);
 static void     do_update(char *, int *);
 static void     do_insert(char *, int *);
+static void    *new_row(void);
+static int      add_row(void *);
 static void     free_row(RTA_TBLDEF *, void *);
+static void     do_copy_start(char *, int *);
+static int      copy_text(char *, int, int *);
+static int      copy_binary(char *, int, int *);
+static int      copy_text_val(RTA_COLDEF *, void *, char *, int);
+static int      copy_bin_val(RTA_COLDEF *, void *, unsigned char *, int);
+static void    *col_data(RTA_COLDEF *, void *);
+static llong    get_net(unsigned char *, int);
 static void     do_delete(char *, int *);
+static void     do_listen(char *, int *);
 static void     do_select(char *, int *);
-static int      send_row_description(char *, int *);
+static int      budget_spent(int, int, llong);
+static int      row_stop(int);
+static llong    now_usecs(void);
+static void     verify_set(char *, int *);
+static void     do_set(char *, int *);
+static int      set_bit(char *);
 static void     do_delete(char *, int *);
-static void     ad_str(char **, int, char *, int);
-static void     ad_int2(char **, int);
-static void     ad_int4(char **, int);
+static int      cvt_value(RTA_COLDEF *, char *, int *, llong *, float *,
+                  double *);
+static char    *save_str(char **, char *);
+static int      ad_binary(char **, RTA_COLDEF *, void *);
+static void     ad_copy_text(char **, RTA_COLDEF *, void *);
+
+
+/***************************************************************
+ * The WHERE tests.  There is one function for each column type
+ * and relation, so the test of a row is a call through the
+ * phrase's test pointer with no switch on the type.  Numbers are
+ * compared directly in their own type; strings compare up to the
+ * length of the column.  WHR_TESTS() makes the six functions of
+ * a type from the left and right sides of the comparison, and
+ * WhrTests[] has them by column type and relation.
+ **************************************************************/
+#define WHR_TESTS(T, L, R)                                           \
+  static int T##_eq(void *pd, struct Sql_Val *pw) { return ((L) == (R)); } \
+  static int T##_ne(void *pd, struct Sql_Val *pw) { return ((L) != (R)); } \
+  static int T##_gt(void *pd, struct Sql_Val *pw) { return ((L) > (R)); }  \
+  static int T##_lt(void *pd, struct Sql_Val *pw) { return ((L) < (R)); }  \
+  static int T##_ge(void *pd, struct Sql_Val *pw) { return ((L) >= (R)); } \
+  static int T##_le(void *pd, struct Sql_Val *pw) { return ((L) <= (R)); }
+
+WHR_TESTS(whr_str, strncmp((char *) pd, pw->val, pw->pcol->length), 0)
+WHR_TESTS(whr_pstr, strncmp(*(char **) pd, pw->val, pw->pcol->length), 0)
+WHR_TESTS(whr_int, *(int *) pd, pw->ival)
+WHR_TESTS(whr_pint, **(int **) pd, pw->ival)
+WHR_TESTS(whr_short, *(short *) pd, pw->ival)
+WHR_TESTS(whr_uchar, *(unsigned char *) pd, pw->ival)
+WHR_TESTS(whr_long, *(llong *) pd, pw->lval)
+WHR_TESTS(whr_plong, **(llong **) pd, pw->lval)
+WHR_TESTS(whr_float, *(float *) pd, pw->fval)
+WHR_TESTS(whr_pfloat, **(float **) pd, pw->fval)
+WHR_TESTS(whr_double, *(double *) pd, pw->dval)
+
+/* In the order of RTA_EQ, RTA_NE, RTA_GT, RTA_LT, RTA_GE, RTA_LE */
+#define WHR_RELS(T)  {T##_eq, T##_ne, T##_gt, T##_lt, T##_ge, T##_le}
+
+/* In the order of the column types, RTA_STR to RTA_DOUBLE.  A
+   RTA_PTR is compared as an int. */
+static int    (*WhrTests[RTA_MXCOLTYPE + 1][6])(void *, struct Sql_Val *) = {
+  WHR_RELS(whr_str),            /* RTA_STR */
+  WHR_RELS(whr_int),            /* RTA_PTR */
+  WHR_RELS(whr_int),            /* RTA_INT */
+  WHR_RELS(whr_long),           /* RTA_LONG */
+  WHR_RELS(whr_pstr),           /* RTA_PSTR */
+  WHR_RELS(whr_pint),           /* RTA_PINT */
+  WHR_RELS(whr_plong),          /* RTA_PLONG */
+  WHR_RELS(whr_float),          /* RTA_FLOAT */
+  WHR_RELS(whr_pfloat),         /* RTA_PFLOAT */
+  WHR_RELS(whr_short),          /* RTA_SHORT */
+  WHR_RELS(whr_uchar),          /* RTA_UCHAR */
+  WHR_RELS(whr_double),         /* RTA_DOUBLE */
+};
 
 
 /***************************************************************
@@ -53,17 +140,20 @@ static void     ad_int4(char **, int);
  * clients.  The main program collects the SQL command from
  * the clients and calls rta_dbcommand() to handle the protocol
  * between the DB client and our embedded DB server.  The
- * routine rta_dbcommand() handles the actual SQL by setting up
- * a lex buffer and calling yyparse() to invoke the yacc/lex
- * scanner for our micro-SQL.  The scanner parses the command
- * and places the relevant information into the "sql_cmd"
- * structure.  If the parse of the command is successful, the
- * routine do_sql() is called to actually execute the command.
+ * routine rta_dbcommand() handles the actual SQL by calling
+ * rta_SQL_exec() in parse.c.  The parser for our micro-SQL
+ * scans the command in place and puts the relevant information
+ * into the "sql_cmd" structure.  If the parse of the command is
+ * successful, rta_verify_sql() checks it and rta_run_sql()
+ * actually executes it.  A command seen before is instead
+ * loaded from the plan cache in plancache.c and only run.
  **************************************************************/
 
 /***************************************************************
- * rta_do_sql(): - Execute the SQL select or update command in the
- * sql_cmd structure.
+ * rta_run_sql(): - Execute the SQL command in the sql_cmd
+ * structure for a simple query.  The command has been checked
+ * by rta_verify_sql(), either just now or when its plan was
+ * put in the plan cache.
  *
  * Input:        A buffer to store the output
  *               The number of free bytes in the buffer
@@ -72,8 +162,42 @@ static void     ad_int4(char **, int);
  *               callbacks are executed.
  ***************************************************************/
 void
-rta_do_sql(char *buf, int *nbuf)
+rta_run_sql(char *buf, int *nbuf)
+{
+  /* Parameters need the extended query protocol to give values */
+  if (rta_cmd.nparams) {
+    rta_send_error(LOC, E_NOPARAM);
+    return;
+  }
+
+  /* The command looks good.  The limits of the session start
+     now.  A SELECT starts with the Row Desc. */
+  rta_guard_arm();
+  if (rta_cmd.command == RTA_SELECT) {
+    buf += rta_send_row_description(buf, nbuf);
+    if (rta_cmd.err)
+      return;
+  }
+  rta_exec_sql(buf, nbuf);
+}
+
+/***************************************************************
+ * rta_verify_sql(): - Verify the tables, columns, and values of
+ * the command in the sql_cmd structure.  This is everything
+ * that can be checked before execution, and is split out so
+ * that a prepared statement is checked only once.
+ * On error, we output the error message and set the err flag.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The err flag and the output buffer on error
+ ***************************************************************/
+void
+rta_verify_sql(char *buf, int *nbuf)
 {
+  int      i;          /* loop index */
+
   switch (rta_cmd.command) {
     case RTA_SELECT:
       verify_table_name(buf, nbuf);
@@ -85,13 +209,7 @@ rta_do_sql(char *buf, int *nbuf)
       verify_where_list(buf, nbuf);
       if (rta_cmd.err)
         return;
-
-      /* The command looks good.  Send the Row Desc. */
-      buf += send_row_description(buf, nbuf);
-      if (rta_cmd.err)
-        return;
-      do_select(buf, nbuf);
-      rta_stat.nselect++;
+      verify_order(buf, nbuf);
       break;
 
     case RTA_UPDATE:
@@ -102,12 +220,6 @@ rta_do_sql(char *buf, int *nbuf)
       if (rta_cmd.err)
         return;
       verify_where_list(buf, nbuf);
-      if (rta_cmd.err)
-        return;
-
-      /* The command looks good. Update and do callbacks */
-      do_update(buf, nbuf);
-      rta_stat.nupdate++;
       break;
 
     case RTA_INSERT:
@@ -118,11 +230,6 @@ rta_do_sql(char *buf, int *nbuf)
       if (rta_cmd.err)
         return;
       verify_insert_list(buf, nbuf);
-      if (rta_cmd.err)
-        return;
-      /* The command looks good. INSERT the row. */
-      do_insert(buf, nbuf);
-      rta_stat.ninsert++;
       break;
 
     case RTA_DELETE:
@@ -133,13 +240,111 @@ rta_do_sql(char *buf, int *nbuf)
       if (rta_cmd.err)
         return;
       verify_delete_callback(buf, nbuf);
+      break;
+
+    case RTA_COPYOUT:
+      verify_table_name(buf, nbuf);
+      if (rta_cmd.err)
+        return;
+      verify_select_list(buf, nbuf);
+      if (rta_cmd.err)
+        return;
+
+      /* Binary COPY rows are sent like binary SELECT rows */
+      for (i = 0; i < rta_cmd.ncols; i++)
+        rta_cmd.cols[i].fmt = rta_cmd.copyfmt;
+      break;
+
+    case RTA_COPYIN:
+      verify_table_name(buf, nbuf);
+      if (rta_cmd.err)
+        return;
+      verify_insert_callback(buf, nbuf);
       if (rta_cmd.err)
         return;
-      /* The command looks good.  Delete the rows */
+      verify_select_list(buf, nbuf);
+      if (rta_cmd.err)
+        return;
+      for (i = 0; i < rta_cmd.ncols; i++) {
+        if (rta_cmd.cols[i].pcol->flags & RTA_READONLY) {
+          rta_send_error(LOC, E_NOWRITE, rta_cmd.cols[i].pcol->name);
+          return;
+        }
+      }
+      break;
+
+    case RTA_LISTEN:
+    case RTA_UNLISTEN:
+      /* Any name is a channel.  "*" is all channels in UNLISTEN. */
+      if (strlen(rta_cmd.tbl) >= RTA_MXTBLNAME ||
+          (rta_cmd.command == RTA_LISTEN && !strcmp(rta_cmd.tbl, "*")))
+        rta_send_error(LOC, E_BADPARSE);
+      break;
+
+    case RTA_SET:
+      verify_set(buf, nbuf);
+      break;
+
+    default:
+      syslog(LOG_ERR, "DB error: no SQL cmd\n");
+      rta_cmd.err = 1;
+      break;
+  }
+}
+
+/***************************************************************
+ * rta_exec_sql(): - Execute a verified command in the sql_cmd
+ * structure.  The row description of a SELECT is not sent here
+ * since the extended query protocol sends it only on request.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      Lots.  This is where the read and write
+ *               callbacks are executed.
+ ***************************************************************/
+void
+rta_exec_sql(char *buf, int *nbuf)
+{
+  switch (rta_cmd.command) {
+    case RTA_SELECT:
+    case RTA_COPYOUT:
+      if (rta_cmd.pr == (void *) 0)
+        rta_stat.nselect++;     /* count only the first part */
+      do_select(buf, nbuf);
+      break;
+
+    case RTA_UPDATE:
+      /* Update and do callbacks */
+      do_update(buf, nbuf);
+      rta_stat.nupdate++;
+      break;
+
+    case RTA_INSERT:
+      do_insert(buf, nbuf);
+      rta_stat.ninsert++;
+      break;
+
+    case RTA_COPYIN:
+      /* Rows arrive later in CopyData messages */
+      do_copy_start(buf, nbuf);
+      rta_stat.ninsert++;
+      break;
+
+    case RTA_DELETE:
       do_delete(buf, nbuf);
       rta_stat.ndelete++;
       break;
 
+    case RTA_LISTEN:
+    case RTA_UNLISTEN:
+      do_listen(buf, nbuf);
+      break;
+
+    case RTA_SET:
+      do_set(buf, nbuf);
+      break;
+
     default:
       syslog(LOG_ERR, "DB error: no SQL cmd\n");
       break;
@@ -206,26 +411,20 @@ verify_select_list(char *buf, int *nbuf)
   ncols = rta_cmd.ptbl->ncol;
 
   /* Handle the special case of a SELECT * FROM .... We look for the
-     '*', then for each column in the table, free any memory in
-     rta_cmd.cols, get the size of the column name, allocate memeory, copy
-     the column name, and put the pointer into rta_cmd.cols.  */
-  if (rta_cmd.cols[0][0] == '*') {
+     '*', then for each column in the table, put a pointer to the
+     column name into rta_cmd.cols.  */
+  if (rta_cmd.cols[0].name[0] == '*') {
     /* they are asking for the full column list */
+    if (rta_cmd_grow(ncols, 0)) {
+      rta_send_error(LOC, E_BADPARSE);
+      return;
+    }
     for (i = 0; i < ncols; i++) {
-      if (rta_cmd.cols[i])
-        free(rta_cmd.cols[i]);
-      rta_cmd.cols[i] = malloc(strlen(coldefs[i].name) + 1);
-      if (rta_cmd.cols[i] == (void *) 0) {
-        rta_stat.nsyserr++;
-        if (rta_dbg.syserr)
-          rta_log(LOC, Er_No_Mem);
-        rta_cmd.err = 1;
-        return;
-      }
-      strcpy(rta_cmd.cols[i], coldefs[i].name);
+      memset(&(rta_cmd.cols[i]), 0, sizeof(struct Sql_Val));
+      rta_cmd.cols[i].name = coldefs[i].name;
 
       /* Save pointer to the column in RTA_COLDEFS */
-      rta_cmd.pcol[i] = &(coldefs[i]);
+      rta_cmd.cols[i].pcol = &(coldefs[i]);
     }
 
     /* Give the command the correct # cols to display */
@@ -235,17 +434,14 @@ verify_select_list(char *buf, int *nbuf)
   /* OK, scan the columns definitions to verify that the columns in the 
      command are really columns in the table. Scan is ...for each col
      in select list ... */
-  for (j = 0; j < RTA_NCMDCOLS; j++) {
-    if (rta_cmd.cols[j] == (char *) 0) {
-      return;                   /* select list is OK */
-    }
+  for (j = 0; j < rta_cmd.ncols; j++) {
 
     /* Scan is ...for each column definition ... */
     for (i = 0; i < ncols; i++) {
       /* Is this column in the table of interest? */
-      if (!strncmp(rta_cmd.cols[j], coldefs[i].name, RTA_MXCOLNAME)) {
+      if (!strncmp(rta_cmd.cols[j].name, coldefs[i].name, RTA_MXCOLNAME)) {
         /* Save pointer to the column in RTA_COLDEFS */
-        rta_cmd.pcol[j] = &(coldefs[i]);
+        rta_cmd.cols[j].pcol = &(coldefs[i]);
 
         /* Compute length of output line */
         switch (coldefs[i].type) {
@@ -277,7 +473,7 @@ verify_select_list(char *buf, int *nbuf)
 
     /* We scanned column defs.  Error if not found */
     if (i == ncols) {
-      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j]);
+      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j].name);
       return;
     }
   }
@@ -315,38 +511,42 @@ verify_where_list(char *buf, int *nbuf)
   /* scan the columns definitions to verify that the columns in the
      command are really columns in the table. Scan is ...for each col
      in where list ... */
-  for (j = 0; j < RTA_NCMDCOLS; j++) {
-    if (rta_cmd.whrcols[j] == (char *) 0) {
-      return;
-    }
+  for (j = 0; j < rta_cmd.nwhrcols; j++) {
 
     /* Scan is ...for each column definition ... */
     for (i = 0; i < ncols; i++) {
       /* we are on a column def for the right table */
-      if (!strncmp(rta_cmd.whrcols[j], coldefs[i].name, RTA_MXCOLNAME)) {
+      if (!strncmp(rta_cmd.whr[j].name, coldefs[i].name, RTA_MXCOLNAME)) {
         /* column is valid, now check data type.  Must be string or
            num, if num, need val */
-        if ((coldefs[i].type == RTA_STR) ||
+        if (rta_cmd.whr[j].parm ||
+          (coldefs[i].type == RTA_STR) ||
           (coldefs[i].type == RTA_PSTR) ||
 	    (((coldefs[i].type == RTA_INT) || (coldefs[i].type == RTA_SHORT)
 	      || (coldefs[i].type == RTA_UCHAR)) &&
-	     (sscanf(rta_cmd.whrvals[j], "%d", &(rta_cmd.whrints[j])) == 1))
+	     (sscanf(rta_cmd.whr[j].val, "%d", &(rta_cmd.whr[j].ival)) == 1))
           || ((coldefs[i].type == RTA_PINT)
-            && (sscanf(rta_cmd.whrvals[j], "%d", &(rta_cmd.whrints[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%d", &(rta_cmd.whr[j].ival)) == 1))
           || ((coldefs[i].type == RTA_PTR)
-            && (sscanf(rta_cmd.whrvals[j], "%d", &(rta_cmd.whrints[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%d", &(rta_cmd.whr[j].ival)) == 1))
           || ((coldefs[i].type == RTA_LONG)
-            && (sscanf(rta_cmd.whrvals[j], "%lld", &(rta_cmd.whrlngs[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%lld",
+                  &(rta_cmd.whr[j].lval)) == 1))
           || ((coldefs[i].type == RTA_PLONG)
-            && (sscanf(rta_cmd.whrvals[j], "%lld", &(rta_cmd.whrlngs[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%lld",
+                  &(rta_cmd.whr[j].lval)) == 1))
           || ((coldefs[i].type == RTA_FLOAT)
-            && (sscanf(rta_cmd.whrvals[j], "%f", &(rta_cmd.whrflot[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%f", &(rta_cmd.whr[j].fval)) == 1))
           || ((coldefs[i].type == RTA_PFLOAT)
-            && (sscanf(rta_cmd.whrvals[j], "%f", &(rta_cmd.whrflot[j])) == 1))
+            && (sscanf(rta_cmd.whr[j].val, "%f", &(rta_cmd.whr[j].fval)) == 1))
           || ((coldefs[i].type == RTA_DOUBLE)
-            && (sscanf(rta_cmd.whrvals[j], "%lf", &(rta_cmd.whrdbl[j])) == 1))) {
-          /* Save WHERE column pointer for later use */
-          rta_cmd.pwhr[j] = &(coldefs[i]);
+            && (sscanf(rta_cmd.whr[j].val, "%lf",
+                  &(rta_cmd.whr[j].dval)) == 1))) {
+          /* Save WHERE column pointer and its tests for later use */
+          rta_cmd.whr[j].pcol = &(coldefs[i]);
+          rta_cmd.whr[j].test = WhrTests[coldefs[i].type][rta_cmd.whr[j].rel];
+          rta_cmd.whr[j].scan = (rta_cmd.ptbl->iterator || coldefs[i].readcb)
+            ? (ScanFn) 0 : rta_scan_fn(coldefs[i].type);
           break;
         }
 
@@ -358,7 +558,7 @@ verify_where_list(char *buf, int *nbuf)
 
     /* We scanned column defs.  Error if not found */
     if (i == ncols) {
-      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.whrcols[j]);
+      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.whr[j].name);
       return;
     }
   }
@@ -367,6 +567,42 @@ verify_where_list(char *buf, int *nbuf)
   return;
 }
 
+/***************************************************************
+ * verify_order(): - Verify the column of an ORDER BY.  The rows
+ * are not sorted; they come from the ordered index of the
+ * column, so it must have the RTA_ORDERED flag and no read
+ * callback.
+ * On error, we output the error message and set the err flag.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The err flag and the output buffer on error
+ ***************************************************************/
+static void
+verify_order(char *buf, int *nbuf)
+{
+  RTA_COLDEF  *pcol;       /* a column of the table */
+  int          i;          /* Loop index */
+
+  if (rta_cmd.order == (char *) 0)
+    return;
+  for (i = 0; i < rta_cmd.ptbl->ncol; i++) {
+    if (!strncmp(rta_cmd.order, rta_cmd.ptbl->cols[i].name, RTA_MXCOLNAME))
+      break;
+  }
+  if (i == rta_cmd.ptbl->ncol) {
+    rta_send_error(LOC, E_NOCOLUMN, rta_cmd.order);
+    return;
+  }
+  pcol = &(rta_cmd.ptbl->cols[i]);
+  if (!(pcol->flags & RTA_ORDERED) || pcol->readcb) {
+    rta_send_error(LOC, E_NOORDER, pcol->name);
+    return;
+  }
+  rta_cmd.porder = pcol;
+}
+
 /***************************************************************
  * verify_update_list(): - Verify the list of column to update
  * in an update statement.  We want to make sure everything is
@@ -396,18 +632,15 @@ verify_update_list(char *buf, int *nbuf)
   /* scan the columns definitions to verify that the columns in the
      command are really columns in the table. Scan is ...for each col
      in update list ... */
-  for (j = 0; j < RTA_NCMDCOLS; j++) {
-    if (rta_cmd.cols[j] == (char *) 0) {
-      return;
-    }
+  for (j = 0; j < rta_cmd.ncols; j++) {
 
     /* Scan is ...for each column definition ... */
     for (i = 0; i < ncols; i++) {
-      if (strncmp(rta_cmd.cols[j], coldefs[i].name, RTA_MXCOLNAME))
+      if (strncmp(rta_cmd.cols[j].name, coldefs[i].name, RTA_MXCOLNAME))
         continue;
 
       /* Save pointer to the column in RTA_COLDEFS */
-      rta_cmd.pcol[j] = &(coldefs[i]);
+      rta_cmd.cols[j].pcol = &(coldefs[i]);
 
       /* Verify that column is not read-only */
       if (coldefs[i].flags & RTA_READONLY) {
@@ -419,31 +652,37 @@ verify_update_list(char *buf, int *nbuf)
          a string, check the string length.  We do a '-1' to be sure
          there is room for a null at the end of the string.   */
       if ((coldefs[i].type == RTA_STR) || (coldefs[i].type == RTA_PSTR)) {
-        if (strlen(rta_cmd.updvals[j]) <= coldefs[i].length -1) {
+        if (rta_cmd.cols[j].parm ||
+          (strlen(rta_cmd.cols[j].val) <= coldefs[i].length -1)) {
           break;
         }
         rta_send_error(LOC, E_BIGSTR, coldefs[i].name);
         return;
       }
 
-      /* Verify conversion of int/long */
-      if ((((coldefs[i].type == RTA_INT) || (coldefs[i].type == RTA_SHORT)
+      /* Verify conversion of int/long.  Parameters are converted
+         when the values are bound to the prepared statement. */
+      if (rta_cmd.cols[j].parm ||
+        (((coldefs[i].type == RTA_INT) || (coldefs[i].type == RTA_SHORT)
 	    || (coldefs[i].type == RTA_UCHAR))
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_PINT)
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_PTR)
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_LONG)
-          && (sscanf(rta_cmd.updvals[j], "%lld", &(rta_cmd.updlngs[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%lld",
+                &(rta_cmd.cols[j].lval)) == 1))
         || ((coldefs[i].type == RTA_PLONG)
-          && (sscanf(rta_cmd.updvals[j], "%lld", &(rta_cmd.updlngs[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%lld",
+                &(rta_cmd.cols[j].lval)) == 1))
         || ((coldefs[i].type == RTA_FLOAT)
-          && (sscanf(rta_cmd.updvals[j], "%f", &(rta_cmd.updflot[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%f", &(rta_cmd.cols[j].fval)) == 1))
         || ((coldefs[i].type == RTA_PFLOAT)
-          && (sscanf(rta_cmd.updvals[j], "%f", &(rta_cmd.updflot[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%f", &(rta_cmd.cols[j].fval)) == 1))
         || ((coldefs[i].type == RTA_DOUBLE)
-          && (sscanf(rta_cmd.updvals[j], "%lf", &(rta_cmd.upddbl[j])) == 1))) {
+          && (sscanf(rta_cmd.cols[j].val, "%lf",
+                &(rta_cmd.cols[j].dval)) == 1))) {
         break;
       }
 
@@ -454,7 +693,7 @@ verify_update_list(char *buf, int *nbuf)
 
     /* We scanned column defs.  Error if not found */
     if (i == ncols) {
-      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j]);
+      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j].name);
       return;
     }
   }
@@ -494,24 +733,22 @@ verify_insert_list(char *buf, int *nbuf)
   /* scan the columns definitions to verify that the columns in the
      command are really columns in the table. Scan is ...for each col
      in update list ... */
-  for (j = 0; j < RTA_NCMDCOLS; j++) {
-    if (rta_cmd.cols[j] == (char *) 0) {
-      return;
-    }
+  for (j = 0; j < rta_cmd.ncols; j++) {
 
     /* Scan is ...for each column definition ... */
     for (i = 0; i < ncols; i++) {
-      if (strncmp(rta_cmd.cols[j], coldefs[i].name, RTA_MXCOLNAME))
+      if (strncmp(rta_cmd.cols[j].name, coldefs[i].name, RTA_MXCOLNAME))
         continue;
 
       /* Save pointer to the column in RTA_COLDEFS */
-      rta_cmd.pcol[j] = &(coldefs[i]);
+      rta_cmd.cols[j].pcol = &(coldefs[i]);
 
       /* Column exists. Now check data type.  If 
          a string, check the string length.  We do a '-1' to be sure
          there is room for a null at the end of the string.   */
       if ((coldefs[i].type == RTA_STR) || (coldefs[i].type == RTA_PSTR)) {
-        if (strlen(rta_cmd.updvals[j]) <= coldefs[i].length -1) {
+        if (rta_cmd.cols[j].parm ||
+          (strlen(rta_cmd.cols[j].val) <= coldefs[i].length -1)) {
           break;
         }
         rta_send_error(LOC, E_BIGSTR, coldefs[i].name);
@@ -524,24 +761,29 @@ verify_insert_list(char *buf, int *nbuf)
         return;
       }
 
-      /* Verify conversion of int/long */
-      if ((((coldefs[i].type == RTA_INT) || (coldefs[i].type == RTA_SHORT)
+      /* Verify conversion of int/long.  Parameters are converted
+         when the values are bound to the prepared statement. */
+      if (rta_cmd.cols[j].parm ||
+        (((coldefs[i].type == RTA_INT) || (coldefs[i].type == RTA_SHORT)
 	    || (coldefs[i].type == RTA_UCHAR))
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_PINT)
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_PTR)
-          && (sscanf(rta_cmd.updvals[j], "%d", &(rta_cmd.updints[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%d", &(rta_cmd.cols[j].ival)) == 1))
         || ((coldefs[i].type == RTA_LONG)
-          && (sscanf(rta_cmd.updvals[j], "%lld", &(rta_cmd.updlngs[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%lld",
+                &(rta_cmd.cols[j].lval)) == 1))
         || ((coldefs[i].type == RTA_PLONG)
-          && (sscanf(rta_cmd.updvals[j], "%lld", &(rta_cmd.updlngs[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%lld",
+                &(rta_cmd.cols[j].lval)) == 1))
         || ((coldefs[i].type == RTA_FLOAT)
-          && (sscanf(rta_cmd.updvals[j], "%f", &(rta_cmd.updflot[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%f", &(rta_cmd.cols[j].fval)) == 1))
         || ((coldefs[i].type == RTA_PFLOAT)
-          && (sscanf(rta_cmd.updvals[j], "%f", &(rta_cmd.updflot[j])) == 1))
+          && (sscanf(rta_cmd.cols[j].val, "%f", &(rta_cmd.cols[j].fval)) == 1))
         || ((coldefs[i].type == RTA_DOUBLE)
-          && (sscanf(rta_cmd.updvals[j], "%lf", &(rta_cmd.upddbl[j])) == 1))) {
+          && (sscanf(rta_cmd.cols[j].val, "%lf",
+                &(rta_cmd.cols[j].dval)) == 1))) {
         break;
       }
 
@@ -552,7 +794,7 @@ verify_insert_list(char *buf, int *nbuf)
 
     /* We scanned column defs.  Error if not found */
     if (i == ncols) {
-      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j]);
+      rta_send_error(LOC, E_NOCOLUMN, rta_cmd.cols[j].name);
       return;
     }
   }
@@ -609,8 +851,65 @@ verify_delete_callback(char *buf, int *nbuf)
 }
 
 
+/***************************************************************
+ * rta_budget(): - Set how many rows a SELECT or COPY TO STDOUT
+ * may scan, and for how long it may run, before it yields.
+ *
+ * Input:        The number of rows, 0 for any
+ *               The number of microseconds, 0 for any
+ * Output:       None
+ * Effects:      The SELECTs of later calls to rta_dbcommand()
+ ***************************************************************/
+void
+rta_budget(int nrows, int usecs)
+{
+  BudRows = (nrows > 0) ? nrows : 0;
+  BudUsecs = (usecs > 0) ? usecs : 0;
+}
+
+/***************************************************************
+ * where_match(): - Test a row against the WHERE clause.  The
+ * read callback of each column in the clause is run first.
+ * On error, we output the error message and set the err flag.
+ *
+ * Input:        Pointer to the row and its index
+ * Output:       1 if the row passes, 0 if not, -1 on error
+ * Effects:      The read callbacks are executed
+ ***************************************************************/
+static int
+where_match(void *pr, int rx)
+{
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  int      wx;             /* Where clause indeX */
+
+  for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+
+    /* execute read callback (if defined) on row */
+    /* the call back is expected to fill in the data */
+    /* and return zero on success. */
+    if (pw->pcol->readcb) {
+      if ((pw->pcol->readcb) (rta_cmd.tbl, pw->name, rta_cmd.sqlcmd,
+          pr, rx) != 0) {
+        rta_send_error(LOC, E_BADTRIG, pw->name);
+        return (-1);
+      }
+    }
+    if (!(pw->test) ((char *) pr + pw->pcol->offset, pw))
+      return (0);
+  }
+  return (1);
+}
+
 /***************************************************************
  * do_select(): - Execute a SELECT statement against the DB.
+ * COPY TO STDOUT uses the same row walk.  It starts with a
+ * CopyOutResponse instead of a row description and sends each
+ * row as a CopyData message.  Binary COPY rows have the same
+ * fields as a binary 'D' row.  Text COPY rows are a line of
+ * tab separated values.  If the caller can resume us we stop
+ * when the buffer is full or the budget of rta_budget() is used
+ * and save our place in rta_cmd.
  *
  * Input:        A buffer to store the output
  *               The number of free bytes in the buffer
@@ -623,10 +922,8 @@ do_select(char *buf, int *nbuf)
 {
   int      sr;         /* the Size of each Row in the table */
   int      rx;         /* Row indeX in for() loop */
-  int      wx;         /* Where clause indeX in for loop */
   void    *pr;         /* Pointer to the row in the table/column */
   void    *pd;         /* Pointer to the Data in the table/column */
-  llong    cmp;        /* has actual relation of col and val */
   int      dor;        /* DO Row == 1 if we should print row */
   int      npr = 0;    /* Number of output rows */
   char     nprstr[30]; /* string to hold ASCII of npr */
@@ -636,93 +933,177 @@ do_select(char *buf, int *nbuf)
   int      cx;         /* Column index while building Data pkt */
   int      n;          /* number of chars printed in sprintf() */
   int      count;      /* number of chars to send as string */
+  int      nthis = 0;  /* Number of rows output by this call */
+  int      copy;       /* ==1 if COPY TO STDOUT */
+  int      copytxt;    /* ==1 if COPY in text format */
+  int      nrow;       /* worst case bytes in one output row */
+  int      nscan = 0;  /* rows scanned by this call */
+  int      nstep = 1;  /* rows scanned by the last step */
+  llong    start = 0;  /* usecs when this call started */
+  int      nblk = 0;   /* WHERE phrases with a block scan */
+  unsigned long long bits = 0;  /* rows of the block that may pass */
+  int      bx = 0;     /* index of the first row of the block */
+  int      bend = 0;   /* index of the row after the block */
+  int      wx;         /* Where clause indeX */
+  struct Sql_Row *found;  /* rows found with an index */
+  int      nfound;     /* # rows found, or -1 if no index */
+  int      fx = 0;     /* index into found */
+  struct Sql_Row row;  /* next row of an ORDER BY */
+  int      moved;      /* ==1 if rows were added or deleted since pr */
 
   startbuf = buf;
+  copy = (rta_cmd.command == RTA_COPYOUT);
+  copytxt = (copy && !rta_cmd.copyfmt);
+
+  /* Escapes can double the size of a text COPY value */
+  nrow = (copytxt) ? 2 * rta_cmd.nlineout : rta_cmd.nlineout;
+
+  /* A COPY starts with the CopyOutResponse and, if binary, with the
+     file header.  Not on a resumed COPY (pr set). */
+  if (copy && rta_cmd.pr == (void *) 0) {
+    if (*nbuf < 7 + 2 * rta_cmd.ncols + 24 + 100) {
+      rta_send_error(LOC, E_FULLBUF);
+      return;
+    }
+    *buf++ = 'H';
+    rta_ad_int4(&buf, 4 + 1 + 2 + 2 * rta_cmd.ncols);
+    *buf++ = (char) rta_cmd.copyfmt;
+    rta_ad_int2(&buf, rta_cmd.ncols);
+    for (cx = 0; cx < rta_cmd.ncols; cx++)
+      rta_ad_int2(&buf, rta_cmd.copyfmt);
+    if (rta_cmd.copyfmt) {
+      *buf++ = 'd';
+      rta_ad_int4(&buf, 4 + 11 + 4 + 4);
+      (void) memcpy(buf, "PGCOPY\n\377\r\n", 11);  /* ends in a NULL */
+      buf += 11;
+      rta_ad_int4(&buf, 0);     /* flags */
+      rta_ad_int4(&buf, 0);     /* header extension length */
+    }
+  }
 
   /* We loop through all rows in the table in question applying the
      WHERE condition.  If a row matches we perform read callbacks on
      the selected columns and build a reply with the requested data */
   sr = rta_cmd.ptbl->rowlen;
-  rx = 0;
-  if (rta_cmd.ptbl->iterator)
+  rta_cmd.more = 0;
+  npr = rta_cmd.npr;
+  rx = rta_cmd.rx;
+  moved = (rta_cmd.pr && rta_cmd.gen != TblGen[rta_cmd.itbl]);
+
+  /* An ORDER BY walks the ordered index of its column.  Else a
+     'col = val' phrase on an indexed column, or a range on an
+     ordered column, may give us the rows to visit.  A resumed
+     SELECT starts at the first one not sent.  If rows have moved
+     that is the row at pr, which must still be found. */
+  nfound = (rta_cmd.porder) ? -1 : rta_index_find(&found, moved);
+  if (rta_cmd.porder) {
+    n = rta_index_first(&row, moved);
+    if (n == -2) {
+      rta_send_error(LOC, E_NORESUME, rta_cmd.tbl);
+      return;
+    }
+    if (n < 0) {
+      rta_send_error(LOC, E_NOMEM);
+      return;
+    }
+    pr = (n) ? row.pr : (void *) NULL;
+    if (pr)
+      rx = row.rx;
+  }
+  else if (nfound >= 0) {
+    while (fx < nfound && ((moved) ? found[fx].pr != rta_cmd.pr :
+        found[fx].rx < rx))
+      fx++;
+    if (moved && fx == nfound) {
+      rta_send_error(LOC, E_NORESUME, rta_cmd.tbl);
+      return;
+    }
+    pr = (fx < nfound) ? found[fx].pr : (void *) NULL;
+    if (pr)
+      rx = found[fx].rx;
+  }
+  else if (rta_cmd.pr) {
+    /* Resume a SELECT that stopped when the buffer filled.  If rows
+       were added or deleted since then, walk the iterator to the
+       row again.  The row is only compared, as it may be freed. */
+    pr = rta_cmd.pr;
+    if (rta_cmd.ptbl->iterator && moved) {
+      pr = (rta_cmd.ptbl->iterator) ((void *) NULL, rta_cmd.ptbl->it_info, 0);
+      for (rx = 0; pr && pr != rta_cmd.pr; rx++)
+        pr = (rta_cmd.ptbl->iterator) (pr, rta_cmd.ptbl->it_info, rx + 1);
+    }
+    else if (!rta_cmd.ptbl->iterator && rx >= rta_cmd.ptbl->nrows)
+      pr = (void *) NULL;
+    if (pr == (void *) NULL) {
+      rta_send_error(LOC, E_NORESUME, rta_cmd.tbl);
+      return;
+    }
+  }
+  else if (rta_cmd.ptbl->iterator)
     pr = (rta_cmd.ptbl->iterator) ((void *) NULL, rta_cmd.ptbl->it_info, rx);
   else
     pr = rta_cmd.ptbl->address;
+  if (BudUsecs && rta_cmd.canmore)
+    start = now_usecs();
+
+  /* The rows of a table without an iterator are tested against
+     the WHERE phrases that have a block scan a block at a time */
+  if (nfound < 0 && !rta_cmd.porder && !rta_cmd.ptbl->iterator) {
+    for (wx = 0; wx < rta_cmd.nwhrcols; wx++)
+      nblk += (rta_cmd.whr[wx].scan != (ScanFn) 0);
+    bend = rx;
+  }
 
   /* for each row ..... */
   while (pr) {
-    dor = 1;
-    for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
-      /* execute read callback (if defined) on row */
-      /* the call back is expected to fill in the data */
-      /* and return zero on success. */
-      if (rta_cmd.pwhr[wx]->readcb) {
-        if ((rta_cmd.pwhr[wx]->readcb) (rta_cmd.tbl, rta_cmd.whrcols[wx],
-            rta_cmd.sqlcmd, pr, rx) != 0) {
-          rta_send_error(LOC, E_BADTRIG, rta_cmd.whrcols[wx]);
-          return;
-        }
-      }
-
-      /* compute pointer to actual data */
-      pd = (char *)pr + rta_cmd.pwhr[wx]->offset;
+    /* Stop at this row if the call has used its budget.  The
+       caller runs other work and resumes us here. */
+    if (rta_cmd.canmore && (BudRows || BudUsecs) && nscan > 0 &&
+        budget_spent(nscan, nstep, start)) {
+      rta_cmd.more = RTA_MORE_YIELD;
+      break;
+    }
 
-      /* do comparison based on column data type */
-      switch (rta_cmd.pwhr[wx]->type) {
-        case RTA_STR:
-          cmp = strncmp((char *) pd, rta_cmd.whrvals[wx],
-			rta_cmd.pwhr[wx]->length);
-          break;
-        case RTA_PSTR:
-          cmp = strncmp(*(char **) pd, rta_cmd.whrvals[wx],
-			rta_cmd.pwhr[wx]->length);
-          break;
-        case RTA_INT:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_SHORT:
-          cmp = *((short *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_UCHAR:
-          cmp = *((unsigned char *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_PINT:
-          cmp = **((int **) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_LONG:
-          cmp = *((llong *) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_PLONG:
-          cmp = **((llong **) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_PTR:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_FLOAT:
-          cmp = *((float *) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_PFLOAT:
-          cmp = **((float **) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_DOUBLE:
-          cmp = *((double *) pd) - rta_cmd.whrdbl[wx];
-          break;
-        default:
-          cmp = 1;              /* assume no match */
-          break;
+    /* Skip over the rows of the block that the scans ruled out */
+    nstep = 1;
+    if (nblk) {
+      if (rx >= bend) {
+        bx = rx;
+        bend = rx + RTA_SCANBLK;
+        if (bend > rta_cmd.ptbl->nrows)
+          bend = rta_cmd.ptbl->nrows;
+        if (bend <= bx)
+          break;                /* the table has shrunk */
+        bits = rta_scan_block(pr, bend - bx);
       }
-      if (!(((cmp == 0) && (rta_cmd.whrrel[wx] == RTA_EQ ||
-              rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_LE)) ||
-          ((cmp != 0) && (rta_cmd.whrrel[wx] == RTA_NE)) ||
-          ((cmp < 0) && (rta_cmd.whrrel[wx] == RTA_LE ||
-              rta_cmd.whrrel[wx] == RTA_LT)) ||
-          ((cmp > 0) && (rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_GT)))) {
-        dor = 0;
-        break;
+      if ((bits >> (rx - bx)) == 0)
+        nstep = bend - rx;
+      else
+        nstep = __builtin_ctzll(bits >> (rx - bx));
+      if (rta_cmd.canmore && BudRows && nstep > BudRows - nscan)
+        nstep = BudRows - nscan;
+      if (nstep > 0) {
+        nscan += nstep;
+        if (row_stop(nstep))
+          return;
+        rx += nstep;
+        pr = (rx >= rta_cmd.ptbl->nrows) ? (void *) NULL :
+          (char *) rta_cmd.ptbl->address + (rx * sr);
+        continue;
       }
+      nstep = 1;
     }
+    nscan++;
+
+    /* Stop on a CancelRequest or a limit of the session */
+    if (row_stop(1))
+      return;
+
+    /* A row the scans passed is tested again only if the WHERE
+       has phrases without a scan */
+    dor = (nblk == rta_cmd.nwhrcols) ? 1 : where_match(pr, rx);
+    if (dor < 0)
+      return;
     if (dor && rta_cmd.offset)
       rta_cmd.offset--;
     else if (dor) {
@@ -732,112 +1113,157 @@ do_select(char *buf, int *nbuf)
         break;
       }
 
+      /* Stop if this is the last row the Execute message asked for */
+      if (rta_cmd.maxrows && !copy && nthis >= rta_cmd.maxrows) {
+        rta_cmd.more = RTA_MORE_SUSPEND;
+        break;
+      }
+
       /* Verify that the buffer has enough room for this row.  Note
          that we've been adding the maximum field length for each
          column into nlineout so that it now contains a worst case
-         line length for this table/row.  */
-      if (*nbuf - ((int) (buf - startbuf)) - rta_cmd.nlineout < 100) {
+         line length for this table/row.  If the caller can resume
+         the SELECT we stop here and continue on the next call. */
+      if (*nbuf - ((int) (buf - startbuf)) - nrow < 100) {
       /* 100 for CSELECT and margin */
+        if (rta_cmd.canmore) {
+          rta_cmd.more = RTA_MORE_FULL;
+          break;
+        }
         rta_send_error(LOC, E_FULLBUF);
         return;
       }
 
       /* At this point we have a row which passed the * WHERE clause,
          is greater than OFFSET and less * than LIMIT. So send it! */
-      *buf++ = 'D';             /* Data packet */
+      *buf++ = (copy) ? 'd' : 'D';  /* CopyData or Data packet */
       lenloc = buf;             /* Remember location for length */
       buf += 4;                 /* Response length goes here */
-      ad_int2(&buf, rta_cmd.ncols); /* # of cols in response */
+      if (!copytxt)
+        rta_ad_int2(&buf, rta_cmd.ncols); /* # of cols in response */
 
       for (cx = 0; cx < rta_cmd.ncols; cx++) {
         /* execute column read callback (if defined). callback will
            fill in the data if needed, and return 0 on success */
-        if (rta_cmd.pcol[cx]->readcb) {
-          if ((rta_cmd.pcol[cx]->readcb) (rta_cmd.tbl,
-            rta_cmd.pcol[cx]->name, rta_cmd.sqlcmd, pr, rx) != 0) {
-            rta_send_error(LOC, E_BADTRIG, rta_cmd.pcol[cx]->name);
+        if (rta_cmd.cols[cx].pcol->readcb) {
+          if ((rta_cmd.cols[cx].pcol->readcb) (rta_cmd.tbl,
+            rta_cmd.cols[cx].pcol->name, rta_cmd.sqlcmd, pr, rx) != 0) {
+            rta_send_error(LOC, E_BADTRIG, rta_cmd.cols[cx].pcol->name);
             return;
           }
         }
 
         /* compute pointer to actual data */
-        pd = (char *)pr + rta_cmd.pcol[cx]->offset;
-        switch ((rta_cmd.pcol[cx])->type) {
+        pd = (char *)pr + rta_cmd.cols[cx].pcol->offset;
+
+        /* Text COPY values are separated by tabs */
+        if (copytxt) {
+          if (cx)
+            *buf++ = '\t';
+          ad_copy_text(&buf, rta_cmd.cols[cx].pcol, pd);
+          continue;
+        }
+
+        /* Numbers in binary format are copied from the row */
+        if (rta_cmd.cols[cx].fmt && ad_binary(&buf, rta_cmd.cols[cx].pcol, pd))
+          continue;
+
+        switch ((rta_cmd.cols[cx].pcol)->type) {
           case RTA_STR:
             /* send 4 byte length.  Include the length */
             count = strlen(pd);  /* shorter of field length or strlen */
-            if (count > rta_cmd.pcol[cx]->length -1) {
-              count = rta_cmd.pcol[cx]->length -1;
+            if (count > rta_cmd.cols[cx].pcol->length -1) {
+              count = rta_cmd.cols[cx].pcol->length -1;
             }
-            ad_int4(&buf, count);
+            rta_ad_int4(&buf, count);
+            if (rta_ad_ref(&buf, pd, count))
+              break;
             nfree = *nbuf - (int)(buf - startbuf);
-            ad_str(&buf, nfree, pd, count);   /* send the response */
+            rta_ad_str(&buf, nfree, pd, count);   /* send the response */
             break;
           case RTA_PSTR:
             count = strlen(*(char **) pd);  /* shorter of field length or strlen */
-            if (count > rta_cmd.pcol[cx]->length -1) {
-              count = rta_cmd.pcol[cx]->length -1;
+            if (count > rta_cmd.cols[cx].pcol->length -1) {
+              count = rta_cmd.cols[cx].pcol->length -1;
             }
-            ad_int4(&buf, count);
+            rta_ad_int4(&buf, count);
+            if (rta_ad_ref(&buf, *(char **) pd, count))
+              break;
             /* send the response */
             nfree = *nbuf - (int)(buf - startbuf);
-            ad_str(&buf, nfree, *(char **) pd, count);
+            rta_ad_str(&buf, nfree, *(char **) pd, count);
             break;
           case RTA_INT:
             n = sprintf((buf + 4), "%d", *((int *) pd));
-            ad_int4(&buf, n);   /* send length */
+            rta_ad_int4(&buf, n);   /* send length */
             buf += n;
             break;
           case RTA_SHORT:
             n = sprintf((buf + 4), "%d", *((short *) pd));
-            ad_int4(&buf, n);   /* send length */
+            rta_ad_int4(&buf, n);   /* send length */
             buf += n;
             break;
           case RTA_UCHAR:
             n = sprintf((buf + 4), "%d", *((unsigned char *) pd));
-            ad_int4(&buf, n);   /* send length */
+            rta_ad_int4(&buf, n);   /* send length */
             buf += n;
             break;
           case RTA_PINT:
             n = sprintf((buf + 4), "%d", **((int **) pd));
-            ad_int4(&buf, n);   /* send length */
+            rta_ad_int4(&buf, n);   /* send length */
             buf += n;
             break;
           case RTA_LONG:
             n = sprintf((buf + 4), "%lld", *((llong *) pd));
-            ad_int4(&buf, n);
+            rta_ad_int4(&buf, n);
             buf += n;
             break;
           case RTA_PLONG:
             n = sprintf((buf + 4), "%lld", **((llong **) pd));
-            ad_int4(&buf, n);
+            rta_ad_int4(&buf, n);
             buf += n;
             break;
           case RTA_PTR:
             n = sprintf((buf + 4), "%d", *((int *) pd));
-            ad_int4(&buf, n);   /* send length */
+            rta_ad_int4(&buf, n);   /* send length */
             buf += n;
             break;
           case RTA_FLOAT:
             n = sprintf((buf + 4), "%20.10f", *((float *) pd));
-            ad_int4(&buf, n);
+            rta_ad_int4(&buf, n);
             buf += n;
             break;
           case RTA_PFLOAT:
             n = sprintf((buf + 4), "%20.10f", **((float **) pd));
-            ad_int4(&buf, n);
+            rta_ad_int4(&buf, n);
             buf += n;
             break;
           case RTA_DOUBLE:
             n = sprintf((buf + 4), "%20.10f", *((double *) pd));
-            ad_int4(&buf, n);
+            rta_ad_int4(&buf, n);
             buf += n;
             break;
         }
       }
+      if (copytxt)
+        *buf++ = '\n';
       /* now fill in 'D' response length */
-      ad_int4(&lenloc, (int) (buf - lenloc));
+      rta_ad_int4(&lenloc, (int) (buf - lenloc));
       npr++;
+      nthis++;
+    }
+    if (rta_cmd.porder) {
+      pr = (rta_index_next(&row)) ? row.pr : (void *) NULL;
+      if (pr)
+        rx = row.rx;
+      continue;
+    }
+    if (nfound >= 0) {
+      fx++;
+      pr = (fx < nfound) ? found[fx].pr : (void *) NULL;
+      if (pr)
+        rx = found[fx].rx;
+      continue;
     }
     rx++;
     if (rta_cmd.ptbl->iterator)
@@ -849,12 +1275,51 @@ do_select(char *buf, int *nbuf)
         pr = (char *) rta_cmd.ptbl->address + (rx * sr);
     }
   }
-  /* Add 'C', length(11), 'SELECT', NULL to output */
-  *buf++ = 'C';
-  ad_int4(&buf, 11);            /* 11= 4+strlen(SELECT)+1 */
-  nfree = *nbuf - (int)(buf - startbuf);
-  ad_str(&buf, nfree, "SELECT", 6);
-  *buf++ = 0x00;
+
+  /* Save our place if we stopped early.  There is no 'C' yet.
+     A yield after the last row of an Execute is a suspend. */
+  if (rta_cmd.more == RTA_MORE_YIELD && rta_cmd.maxrows && !copy &&
+      nthis >= rta_cmd.maxrows)
+    rta_cmd.more = RTA_MORE_SUSPEND;
+  if (rta_cmd.more) {
+    if (rta_cmd.porder && rta_index_mark() < 0) {
+      rta_send_error(LOC, E_NOMEM);
+      return;
+    }
+    rta_cmd.pr = pr;
+    rta_cmd.rx = rx;
+    rta_cmd.npr = npr;
+    rta_cmd.gen = TblGen[rta_cmd.itbl];
+    if (rta_cmd.more != RTA_MORE_SUSPEND && rta_cmd.maxrows)
+      rta_cmd.maxrows -= nthis;
+    *nbuf -= (int) (buf - startbuf);
+    return;
+  }
+
+  /* A COPY ends with the binary trailer, CopyDone, and 'COPY n' */
+  if (copy) {
+    if (rta_cmd.copyfmt) {
+      *buf++ = 'd';
+      rta_ad_int4(&buf, 4 + 2);
+      rta_ad_int2(&buf, -1);    /* field count of -1 ends the data */
+    }
+    *buf++ = 'c';
+    rta_ad_int4(&buf, 4);
+    n = sprintf(nprstr, "COPY %d", npr);
+    *buf++ = 'C';
+    rta_ad_int4(&buf, 4 + n + 1);
+    nfree = *nbuf - (int)(buf - startbuf);
+    rta_ad_str(&buf, nfree, nprstr, n);
+    *buf++ = 0x00;
+  }
+  else {
+    /* Add 'C', length(11), 'SELECT', NULL to output */
+    *buf++ = 'C';
+    rta_ad_int4(&buf, 11);          /* 11= 4+strlen(SELECT)+1 */
+    nfree = *nbuf - (int)(buf - startbuf);
+    rta_ad_str(&buf, nfree, "SELECT", 6);
+    *buf++ = 0x00;
+  }
 
   *nbuf -= (int) (buf - startbuf);
 
@@ -866,105 +1331,210 @@ do_select(char *buf, int *nbuf)
 }
 
 /***************************************************************
- * send_row_description(): - We have analyzed the select command
- * and it seems OK.  We start the reply by sending the row
- * description first.
+ * budget_spent(): - Check the rows scanned and the time used by
+ * a call to do_select() against the budget.  The clock is read
+ * only every RTA_NCHKCLOCK rows.
  *
- * Input:        A buffer to store the output
- *               The number of free bytes in the buffer
- * Output:       Returns the number of bytes written to buffer
- * Effects:      Lots.  This is where the write callbacks 
- *               are executed.
+ * Input:        The number of rows scanned
+ *               The number of them in the last step
+ *               The time the call started, in microseconds
+ * Output:       1 if the call should yield, else 0
+ * Effects:      None
  ***************************************************************/
 static int
-send_row_description(char *buf, int *nbuf)
+budget_spent(int nscan, int nstep, llong start)
 {
-  char    *startbuf;   /* used to compute response length */
-  int      nfree;      /* #bytes available in buf =nbuf -(buf-startbuf) */
-  int      i;          /* loop index */
-  int      size;       /* estimated/actual size of response */
+  if (BudRows && nscan >= BudRows)
+    return (1);
+  if (BudUsecs == 0 ||
+      (nstep < RTA_NCHKCLOCK && nscan % RTA_NCHKCLOCK >= nstep))
+    return (0);
+  return (now_usecs() - start >= BudUsecs);
+}
 
-  startbuf = buf;
+/***************************************************************
+ * rta_guard_arm(): - Start the limits of the session on a new
+ * statement.  A SELECT that resumes keeps the limits it had.
+ *
+ * Input:        None.  Uses rta_cmd.guard.
+ * Output:       None
+ * Effects:      The row count and deadline of the guard
+ ***************************************************************/
+void
+rta_guard_arm()
+{
+  struct Sql_Guard *pg;    /* limits of the session */
 
-  /* Verify that the buffer has enough room for this reply. (See the
-     Postgres protocol description for an understanding of the next
-     two lines.) */
-  size = 7;                     /* sizeof 'T', length, and int2 */
-  size += rta_cmd.ncols * (RTA_MXCOLNAME + 1 + 4 + 2 + 4 + 2 + 4 + 2);
+  pg = rta_cmd.guard;
+  if (pg == (struct Sql_Guard *) 0)
+    return;
+  pg->nscan = 0;
+  pg->deadline = (pg->timeout > 0) ?
+    now_usecs() + (llong) pg->timeout * 1000 : 0;
+}
 
-  if (*nbuf - size < 100) {     /* 100 just for safety */
-    rta_send_error(LOC, E_FULLBUF);
-    return ((int) (rta_cmd.out - startbuf)); /* ignored */
-  }
+/***************************************************************
+ * row_stop(): - Check, before each row of a SELECT, UPDATE, or
+ * DELETE, for a CancelRequest and for the limits of the session.
+ * The clock is read only every RTA_NCHKCLOCK rows.  A SELECT
+ * that skips rows the WHERE scans ruled out counts them here
+ * all at once.
+ *
+ * Input:        The number of rows.  Uses rta_cmd.
+ * Output:       1 if the command must stop, else 0
+ * Effects:      Sends the error if the command must stop
+ ***************************************************************/
+static int
+row_stop(int nrow)
+{
+  struct Sql_Guard *pg;    /* limits of the session */
+  char     maxstr[30];     /* the row limit as a string */
+
+  if (rta_cmd.cancel && *rta_cmd.cancel) {
+    rta_send_error(LOC, E_CANCEL);
+    return (1);
+  }
+  pg = rta_cmd.guard;
+  if (pg == (struct Sql_Guard *) 0)
+    return (0);
+  pg->nscan += nrow;
+  if (pg->maxscan > 0 && pg->nscan > pg->maxscan) {
+    (void) sprintf(maxstr, "%d", pg->maxscan);
+    rta_send_error(LOC, E_MAXSCAN, maxstr);
+    return (1);
+  }
+  if (pg->deadline &&
+      (nrow >= RTA_NCHKCLOCK || pg->nscan % RTA_NCHKCLOCK < nrow) &&
+      now_usecs() >= pg->deadline) {
+    rta_send_error(LOC, E_TIMEOUT);
+    return (1);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * now_usecs(): - Give the time of the monotonic clock.
+ *
+ * Input:        None
+ * Output:       The time in microseconds
+ * Effects:      None
+ ***************************************************************/
+static llong
+now_usecs()
+{
+  struct timespec now;     /* the current time */
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((llong) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+/***************************************************************
+ * rta_send_row_description(): - We have analyzed the select command
+ * and it seems OK.  We start the reply by sending the row
+ * description first.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       Returns the number of bytes written to buffer
+ * Effects:      Lots.  This is where the write callbacks 
+ *               are executed.
+ ***************************************************************/
+int
+rta_send_row_description(char *buf, int *nbuf)
+{
+  char    *startbuf;   /* used to compute response length */
+  int      nfree;      /* #bytes available in buf =nbuf -(buf-startbuf) */
+  int      i;          /* loop index */
+  int      size;       /* estimated/actual size of response */
+
+  startbuf = buf;
+
+  /* Verify that the buffer has enough room for this reply. (See the
+     Postgres protocol description for an understanding of the next
+     two lines.) */
+  size = 7;                     /* sizeof 'T', length, and int2 */
+  for (i = 0; i < rta_cmd.ncols; i++)
+    size += strlen(rta_cmd.cols[i].name) + 1 + 4 + 2 + 4 + 2 + 4 + 2;
+
+  if (*nbuf - size < 100) {     /* 100 just for safety */
+    rta_send_error(LOC, E_FULLBUF);
+    return ((int) (rta_cmd.out - startbuf)); /* ignored */
+  }
 
   /* Send the row description header */
   *buf++ = 'T';                 /* row description */
   buf += 4;                     /* put pkt length here later */
-  ad_int2(&buf, rta_cmd.ncols);     /* num fields */
+  rta_ad_int2(&buf, rta_cmd.ncols);     /* num fields */
 
   for (i = 0; i < rta_cmd.ncols; i++) {
     nfree = *nbuf - (int)(buf - startbuf);
-    ad_str(&buf, nfree, rta_cmd.cols[i], strlen(rta_cmd.cols[i]));  /* column name */
+    rta_ad_str(&buf, nfree, rta_cmd.cols[i].name,
+      strlen(rta_cmd.cols[i].name));      /* column name */
     *buf++ = (char) 0;          /* send the NULL */
 
     /* Add table index */
-    ad_int4(&buf, rta_cmd.itbl);
+    rta_ad_int4(&buf, rta_cmd.itbl);
 
     /* Add the column index */
-    ad_int2(&buf, i);
+    rta_ad_int2(&buf, i);
 
-    /* OIDs are tbl index times max col + col index */
-    ad_int4(&buf, (rta_cmd.itbl * RTA_NCMDCOLS) + i);
+    /* OIDs are tbl index times max col + col index.  Columns in
+       binary format need the real type so the client can decode
+       the value. */
+    if (rta_cmd.cols[i].fmt)
+      rta_ad_int4(&buf, rta_type_oid((rta_cmd.cols[i].pcol)->type));
+    else
+      rta_ad_int4(&buf, (rta_cmd.itbl * RTA_NCMDCOLS) + i);
 
     /* set size/modifier based on type */
-    switch ((rta_cmd.pcol[i])->type) {
+    switch ((rta_cmd.cols[i].pcol)->type) {
       case RTA_STR:
       case RTA_PSTR:
-        ad_int2(&buf, -1);      /* length */
-        ad_int4(&buf, 29);      /* type modifier */
+        rta_ad_int2(&buf, -1);      /* length */
+        rta_ad_int4(&buf, 29);      /* type modifier */
         break;
       case RTA_INT:
       case RTA_PINT:
-        ad_int2(&buf, sizeof(int)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(int)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_SHORT:
-        ad_int2(&buf, sizeof(short)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(short)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_UCHAR:
-        ad_int2(&buf, sizeof(unsigned char)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(unsigned char)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_LONG:
       case RTA_PLONG:
-        ad_int2(&buf, sizeof(llong)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(llong)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_FLOAT:
       case RTA_PFLOAT:
-        ad_int2(&buf, sizeof(float)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(float)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_DOUBLE:
-        ad_int2(&buf, sizeof(double)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(double)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
       case RTA_PTR:
-        ad_int2(&buf, sizeof(void *)); /* length */
-        ad_int4(&buf, -1);      /* type modifier */
+        rta_ad_int2(&buf, sizeof(void *)); /* length */
+        rta_ad_int4(&buf, -1);      /* type modifier */
         break;
     }
 
-    /* Add the format type.  0==text format */
-    ad_int2(&buf, 0);
+    /* Add the format type.  0==text format, 1==binary */
+    rta_ad_int2(&buf, rta_cmd.cols[i].fmt);
   }
   size = (int) (buf - startbuf); /* actual response size */
   *nbuf -= size;
 
   /* store packet length -1 (the 'T' is not included *) */
   startbuf++;                   /* skip over the 'T' */
-  ad_int4(&startbuf, (size - 1));
+  rta_ad_int4(&startbuf, (size - 1));
 
   return (size);
 }
@@ -985,6 +1555,7 @@ rta_send_error(char *filename, int lineno, char *fmt, char *arg)
   int      cnt;        /* a byte count of printed chars */
   int      len;        /* length of error message */
   char    *lenptr;     /* where to put the length */
+  char    *code;       /* SQLSTATE of the error */
 
   rta_cmd.err = 1;
   rta_stat.nsqlerr++;
@@ -1001,6 +1572,7 @@ rta_send_error(char *filename, int lineno, char *fmt, char *arg)
   /* pointing the output buffer back to its original value. */
   rta_cmd.out = rta_cmd.errout;         /* Reset any output so far */
   *(rta_cmd.nout) = rta_cmd.nerrout;
+  rta_iov_trim(rta_cmd.errout);
 
   /* The format of the error message is 'E', int32 for length, a series 
      of parameters including 'S'everity, error 'C'ode, and 'M'essage.
@@ -1010,9 +1582,21 @@ rta_send_error(char *filename, int lineno, char *fmt, char *arg)
   *rta_cmd.out++ = 'E';
   lenptr = rta_cmd.out;             /* msg length goes here */
   rta_cmd.out += 4;                 /* skip over length for now */
-  ad_str(&(rta_cmd.out), *rta_cmd.nout, "SERROR", 6); /* severity code */
+  rta_ad_str(&(rta_cmd.out), *rta_cmd.nout, "SERROR", 6); /* severity code */
   *rta_cmd.out++ = (char) 0;
-  ad_str(&(rta_cmd.out), *rta_cmd.nout, "C42601", 6); /* error code (syntax error) */
+  /* All errors are reported as syntax errors except those that
+     stop a statement, which clients look for by their code */
+  if (!strcmp(fmt, E_CANCELMSG) || !strcmp(fmt, E_TIMEOUTMSG))
+    code = "C57014";            /* query_canceled */
+  else if (!strcmp(fmt, E_MAXSCAN))
+    code = "C54000";            /* program_limit_exceeded */
+  else if (!strcmp(fmt, E_NOMEMMSG))
+    code = "C53200";            /* out_of_memory */
+  else if (!strcmp(fmt, E_NORESUME))
+    code = "C40001";            /* serialization_failure */
+  else
+    code = "C42601";            /* syntax_error */
+  rta_ad_str(&(rta_cmd.out), *rta_cmd.nout, code, 6); /* error code */
   *rta_cmd.out++ = (char) 0;
   *rta_cmd.out++ = 'M';
   cnt = snprintf(rta_cmd.out, *(rta_cmd.nout), fmt, arg);
@@ -1020,12 +1604,289 @@ rta_send_error(char *filename, int lineno, char *fmt, char *arg)
   rta_cmd.out++;                    /* to include the NULL */
   *rta_cmd.out++ = (char) 0;        /* terminate param list */
   len = (int) (rta_cmd.out - rta_cmd.errout) - 1; /* -1 to exclude E */
-  ad_int4(&lenptr, len);
+  rta_ad_int4(&lenptr, len);
   *rta_cmd.nout -= (int) (rta_cmd.out - rta_cmd.errout);
 
   return;
 }
 
+/***************************************************************
+ * rta_type_oid(): - Give the Postgres type OID for a librta
+ * column type.  Used to describe the parameters of a prepared
+ * statement.
+ *
+ * Input:        The column type, RTA_STR, RTA_INT, ...
+ * Output:       The Postgres OID of the matching type
+ * Effects:      None
+ ***************************************************************/
+int
+rta_type_oid(int type)
+{
+  switch (type) {
+    case RTA_SHORT:
+    case RTA_UCHAR:
+      return (RTA_OID_INT2);
+    case RTA_INT:
+    case RTA_PINT:
+    case RTA_PTR:
+      return (RTA_OID_INT4);
+    case RTA_LONG:
+    case RTA_PLONG:
+      return (RTA_OID_INT8);
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      return (RTA_OID_FLOAT4);
+    case RTA_DOUBLE:
+      return (RTA_OID_FLOAT8);
+    default:
+      return (RTA_OID_TEXT);
+  }
+}
+
+/***************************************************************
+ * cvt_value(): - Convert the text of a value to the data type
+ * of a column.  Strings need no conversion.  This is the same
+ * conversion the verify routines do for literal values.
+ *
+ * Input:        The column definition and text of the value
+ *               Where to put int, long, float and double values
+ * Output:       1 if the conversion succeeded, 0 on error
+ * Effects:      One of the int/long/float/double values
+ ***************************************************************/
+static int
+cvt_value(RTA_COLDEF *pcol, char *val, int *pint, llong *plng,
+  float *pflot, double *pdbl)
+{
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      return (1);
+    case RTA_INT:
+    case RTA_SHORT:
+    case RTA_UCHAR:
+    case RTA_PINT:
+    case RTA_PTR:
+      return (sscanf(val, "%d", pint) == 1);
+    case RTA_LONG:
+    case RTA_PLONG:
+      return (sscanf(val, "%lld", plng) == 1);
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      return (sscanf(val, "%f", pflot) == 1);
+    case RTA_DOUBLE:
+      return (sscanf(val, "%lf", pdbl) == 1);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * save_str(): - Copy a string into the string area of a plan.
+ *
+ * Input:        A **char to the next free byte in the plan
+ *               and the string to copy (may be NULL)
+ * Output:       Pointer to the copy, or NULL if str is NULL
+ * Effects:      Increments the **char past the copy
+ ***************************************************************/
+static char *
+save_str(char **pstr, char *str)
+{
+  char    *copy;       /* where the string went */
+
+  if (str == (char *) 0)
+    return ((char *) 0);
+  copy = *pstr;
+  strcpy(copy, str);
+  *pstr += strlen(str) + 1;
+  return (copy);
+}
+
+/***************************************************************
+ * rta_plan_save(): - Copy the verified command in sql_cmd into
+ * a plan that can be executed later without another parse or
+ * verify.  The plan, its columns, and its strings are in one
+ * block of memory.
+ *
+ * Input:        None.  Uses the rta_cmd structure.
+ * Output:       Pointer to the new plan or NULL if out of memory
+ * Effects:      None
+ ***************************************************************/
+struct Sql_Plan *
+rta_plan_save()
+{
+  struct Sql_Plan *pplan;  /* the new plan */
+  struct Sql_Val  *pval;   /* a column or WHERE phrase in plan */
+  char    *pstr;       /* next free byte in string area */
+  size_t   size;       /* size of the plan */
+  int      i;          /* loop index */
+
+  /* Compute the size of the plan and its strings */
+  size = sizeof(struct Sql_Plan) +
+    (rta_cmd.ncols + rta_cmd.nwhrcols) * sizeof(struct Sql_Val);
+  size += strlen(rta_cmd.sqlcmd) + 1 + strlen(rta_cmd.tbl) + 1;
+  for (i = 0; i < rta_cmd.ncols; i++) {
+    size += strlen(rta_cmd.cols[i].name) + 1;
+    if (rta_cmd.cols[i].val)
+      size += strlen(rta_cmd.cols[i].val) + 1;
+  }
+  for (i = 0; i < rta_cmd.nwhrcols; i++)
+    size += strlen(rta_cmd.whr[i].name) + 1 + strlen(rta_cmd.whr[i].val) + 1;
+  if (rta_cmd.order)
+    size += strlen(rta_cmd.order) + 1;
+  if (rta_cmd.okey.val)
+    size += strlen(rta_cmd.okey.val) + 1;
+
+  pplan = malloc(size);
+  if (pplan == (struct Sql_Plan *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    rta_cmd.err = 1;
+    return (pplan);
+  }
+  pplan->cols = (struct Sql_Val *) (pplan + 1);
+  pplan->whr = pplan->cols + rta_cmd.ncols;
+  pstr = (char *) (pplan->whr + rta_cmd.nwhrcols);
+
+  pplan->sqlcmd   = save_str(&pstr, rta_cmd.sqlcmd);
+  pplan->command  = rta_cmd.command;
+  pplan->tbl      = save_str(&pstr, rta_cmd.tbl);
+  pplan->ptbl     = rta_cmd.ptbl;
+  pplan->itbl     = rta_cmd.itbl;
+  pplan->limit    = rta_cmd.limit;
+  pplan->offset   = rta_cmd.offset;
+  pplan->nlineout = rta_cmd.nlineout;
+  pplan->nparams  = rta_cmd.nparams;
+  pplan->copyfmt  = rta_cmd.copyfmt;
+  pplan->order    = save_str(&pstr, rta_cmd.order);
+  pplan->porder   = rta_cmd.porder;
+  pplan->desc     = rta_cmd.desc;
+  pplan->ncols    = rta_cmd.ncols;
+  pplan->nwhrcols = rta_cmd.nwhrcols;
+  pplan->pr       = rta_cmd.pr;
+  pplan->rx       = rta_cmd.rx;
+  pplan->npr      = rta_cmd.npr;
+  pplan->maxrows  = rta_cmd.maxrows;
+  pplan->gen      = rta_cmd.gen;
+  pplan->okey     = rta_cmd.okey;
+  pplan->okey.val = save_str(&pstr, rta_cmd.okey.val);
+  if (rta_cmd.ncols)
+    memcpy(pplan->cols, rta_cmd.cols, rta_cmd.ncols * sizeof(struct Sql_Val));
+  if (rta_cmd.nwhrcols)
+    memcpy(pplan->whr, rta_cmd.whr, rta_cmd.nwhrcols * sizeof(struct Sql_Val));
+  for (i = 0; i < rta_cmd.ncols; i++) {
+    pval = &(pplan->cols[i]);
+    pval->name = save_str(&pstr, pval->name);
+    pval->val  = save_str(&pstr, pval->val);
+  }
+  for (i = 0; i < rta_cmd.nwhrcols; i++) {
+    pval = &(pplan->whr[i]);
+    pval->name = save_str(&pstr, pval->name);
+    pval->val  = save_str(&pstr, pval->val);
+  }
+  return (pplan);
+}
+
+/***************************************************************
+ * rta_plan_load(): - Load a saved plan into the sql_cmd
+ * structure so that it can be executed.  The strings in sql_cmd
+ * point into the plan, so the plan must not be freed until the
+ * next rta_dosql_init().  The plan was made from sql_cmd, whose
+ * lists never shrink, so its columns fit.
+ *
+ * Input:        Pointer to the plan
+ * Output:       void
+ * Effects:      The rta_cmd structure
+ ***************************************************************/
+void
+rta_plan_load(struct Sql_Plan *pplan)
+{
+  rta_dosql_init();
+  rta_cmd.plan     = pplan;
+  rta_cmd.sqlcmd   = pplan->sqlcmd;
+  rta_cmd.command  = pplan->command;
+  rta_cmd.tbl      = pplan->tbl;
+  rta_cmd.ptbl     = pplan->ptbl;
+  rta_cmd.itbl     = pplan->itbl;
+  rta_cmd.limit    = pplan->limit;
+  rta_cmd.offset   = pplan->offset;
+  rta_cmd.nlineout = pplan->nlineout;
+  rta_cmd.nparams  = pplan->nparams;
+  rta_cmd.copyfmt  = pplan->copyfmt;
+  rta_cmd.order    = pplan->order;
+  rta_cmd.porder   = pplan->porder;
+  rta_cmd.desc     = pplan->desc;
+  rta_cmd.ncols    = pplan->ncols;
+  rta_cmd.nwhrcols = pplan->nwhrcols;
+  rta_cmd.pr       = pplan->pr;
+  rta_cmd.rx       = pplan->rx;
+  rta_cmd.npr      = pplan->npr;
+  rta_cmd.maxrows  = pplan->maxrows;
+  rta_cmd.gen      = pplan->gen;
+  rta_cmd.okey     = pplan->okey;
+  if (pplan->ncols)
+    memcpy(rta_cmd.cols, pplan->cols, pplan->ncols * sizeof(struct Sql_Val));
+  if (pplan->nwhrcols)
+    memcpy(rta_cmd.whr, pplan->whr, pplan->nwhrcols * sizeof(struct Sql_Val));
+}
+
+/***************************************************************
+ * rta_plan_bind(): - Give values to the parameters of a
+ * prepared statement.  The values are checked and converted to
+ * the data type of their columns, and the result is saved as a
+ * new plan ready for execution.
+ * On error, we output the error message and set the err flag.
+ *
+ * Input:        The plan of the prepared statement
+ *               The text of the values, indexed by param # - 1
+ * Output:       Pointer to the bound plan or NULL on error
+ * Effects:      The rta_cmd structure
+ ***************************************************************/
+struct Sql_Plan *
+rta_plan_bind(struct Sql_Plan *pplan, char **vals)
+{
+  RTA_COLDEF  *pcol;       /* column of a value */
+  int          j;          /* loop index */
+
+  rta_plan_load(pplan);
+
+  for (j = 0; j < rta_cmd.ncols; j++) {
+    if (rta_cmd.cols[j].parm == 0)
+      continue;
+    pcol = rta_cmd.cols[j].pcol;
+    rta_cmd.cols[j].val = vals[rta_cmd.cols[j].parm - 1];
+    rta_cmd.cols[j].parm = 0;
+
+    /* Strings must leave room for the terminating null */
+    if ((pcol->type == RTA_STR) || (pcol->type == RTA_PSTR)) {
+      if (strlen(rta_cmd.cols[j].val) > pcol->length - 1) {
+        rta_send_error(LOC, E_BIGSTR, pcol->name);
+        return ((struct Sql_Plan *) 0);
+      }
+    }
+    else if (!cvt_value(pcol, rta_cmd.cols[j].val, &(rta_cmd.cols[j].ival),
+        &(rta_cmd.cols[j].lval), &(rta_cmd.cols[j].fval),
+        &(rta_cmd.cols[j].dval))) {
+      rta_send_error(LOC, E_BADPARSE);
+      return ((struct Sql_Plan *) 0);
+    }
+  }
+  for (j = 0; j < rta_cmd.nwhrcols; j++) {
+    if (rta_cmd.whr[j].parm == 0)
+      continue;
+    rta_cmd.whr[j].val = vals[rta_cmd.whr[j].parm - 1];
+    rta_cmd.whr[j].parm = 0;
+    if (!cvt_value(rta_cmd.whr[j].pcol, rta_cmd.whr[j].val,
+        &(rta_cmd.whr[j].ival), &(rta_cmd.whr[j].lval),
+        &(rta_cmd.whr[j].fval), &(rta_cmd.whr[j].dval))) {
+      rta_send_error(LOC, E_BADPARSE);
+      return ((struct Sql_Plan *) 0);
+    }
+  }
+  rta_cmd.nparams = 0;
+
+  return (rta_plan_save());
+}
+
 /***************************************************************
  * do_update(): - Execute the SQL update command in the
  * sql_cmd structure.
@@ -1041,11 +1902,9 @@ do_update(char *buf, int *nbuf)
 {
   int      sr;         /* the Size of each Row in the table */
   int      rx;         /* Row indeX in for() loop */
-  int      wx;         /* Where clause indeX in for loop */
   void    *pr;         /* Pointer to the row in the table/column */
   void    *pd;         /* Pointer to the Data in the table/column */
   void    *poldrow;    /* Pointer to copy of row before update */
-  llong cmp;           /* has actual relation of col and val */
   int      dor;        /* DO Row == 1 if we should update row */
   char    *startbuf;   /* used to compute response length */
   int      nfree;      /* #bytes available in buf =nbuf -(buf-startbuf) */
@@ -1054,91 +1913,41 @@ do_update(char *buf, int *nbuf)
   int      nru = 0;    /* =# rows updated */
   int      svt = 0;    /* Save table if == 1 */
   char    *tmark;      /* Address of U in "CUPDATE" if success */
+  struct Sql_Row *found;  /* rows found with an index */
+  int      nfound;     /* # rows found, or -1 if no index */
+  int      fx = 0;     /* index into found */
 
   startbuf = buf;
 
   /* We loop through all rows in the table in question applying the
      WHERE condition.  If a row matches we update the appropriate
-     columns and call any write callbacks */
+     columns and call any write callbacks.  An indexed column in
+     the WHERE may give us the rows to visit. */
   sr = rta_cmd.ptbl->rowlen;
   rx = 0;
-  if (rta_cmd.ptbl->iterator)
+  nfound = rta_index_find(&found, 0);
+  if (nfound >= 0) {
+    pr = (nfound > 0) ? found[0].pr : (void *) NULL;
+    if (pr)
+      rx = found[0].rx;
+  }
+  else if (rta_cmd.ptbl->iterator)
     pr = (rta_cmd.ptbl->iterator) ((void *) NULL, rta_cmd.ptbl->it_info, rx);
   else
     pr = rta_cmd.ptbl->address;
 
   /* for each row ..... */
   while (pr) {
-    dor = 1;
-    for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
-      /* The WHERE clause ...... execute read callback (if defined) on
-         row * the call back is expected to fill in the data */
-      if (rta_cmd.pwhr[wx]->readcb) {
-        if ((rta_cmd.pwhr[wx]->readcb) (rta_cmd.tbl, rta_cmd.whrcols[wx],
-            rta_cmd.sqlcmd, pr, rx) != 0) {
-          rta_send_error(LOC, E_BADTRIG, rta_cmd.whrcols[wx]);
-          return;
-        }
-      }
-
-      /* compute pointer to actual data */
-      pd = (char *)pr + rta_cmd.pwhr[wx]->offset;
-
-      /* do comparison based on column data type */
-      switch (rta_cmd.pwhr[wx]->type) {
-        case RTA_STR:
-          cmp = strncmp((char *) pd, rta_cmd.whrvals[wx],
-			rta_cmd.pwhr[wx]->length);
-          break;
-        case RTA_PSTR:
-          cmp = strcmp(*(char **) pd, rta_cmd.whrvals[wx]);
-          break;
-        case RTA_INT:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_SHORT:
-          cmp = *((short *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_UCHAR:
-          cmp = *((unsigned char *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_PINT:
-          cmp = **((int **) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_LONG:
-          cmp = *((llong *) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_PLONG:
-          cmp = **((llong **) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_FLOAT:
-          cmp = *((float *) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_PFLOAT:
-          cmp = **((float **) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_PTR:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_DOUBLE:
-          cmp = *((double *) pd) - rta_cmd.whrdbl[wx];
-          break;
-        default:
-          cmp = 1;              /* assume no match */
-          break;
-      }
-      if (!(((cmp == 0) && (rta_cmd.whrrel[wx] == RTA_EQ ||
-              rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_LE)) ||
-          ((cmp != 0) && (rta_cmd.whrrel[wx] == RTA_NE)) ||
-          ((cmp < 0) && (rta_cmd.whrrel[wx] == RTA_LE ||
-              rta_cmd.whrrel[wx] == RTA_LT)) ||
-          ((cmp > 0) && (rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_GT)))) {
-        dor = 0;
-        break;
-      }
+    /* Stop on a CancelRequest or a limit of the session.  The
+       rows already updated stay updated. */
+    if (row_stop(1)) {
+      if (nru > 0)
+        (void) rta_notify(rta_cmd.ptbl->name, "UPDATE");
+      return;
     }
+    dor = where_match(pr, rx);
+    if (dor < 0)
+      return;
     if (dor && rta_cmd.offset)
       rta_cmd.offset--;
     else if (dor) {             /* DO Row */
@@ -1163,52 +1972,52 @@ do_update(char *buf, int *nbuf)
       /* Scan the columns doing updates as needed */
       for (cx = 0; cx < rta_cmd.ncols; cx++) {
         /* compute pointer to actual data */
-        pd = (char *)pr + rta_cmd.pcol[cx]->offset;
+        pd = (char *)pr + rta_cmd.cols[cx].pcol->offset;
 
-        switch ((rta_cmd.pcol[cx])->type) {
+        switch ((rta_cmd.cols[cx].pcol)->type) {
           case RTA_STR:
-            strncpy((char *) pd, rta_cmd.updvals[cx],
-		    rta_cmd.pcol[cx]->length);
-            *(char *)(pd + rta_cmd.pcol[cx]->length -1) = (char) 0;
+            strncpy((char *) pd, rta_cmd.cols[cx].val,
+		    rta_cmd.cols[cx].pcol->length);
+            *(char *)(pd + rta_cmd.cols[cx].pcol->length -1) = (char) 0;
             break;
           case RTA_PSTR:
-            strncpy(*(char **) pd, rta_cmd.updvals[cx],
-		    rta_cmd.pcol[cx]->length);
-            *((*(char **) pd) + rta_cmd.pcol[cx]->length -1) = (char) 0;
+            strncpy(*(char **) pd, rta_cmd.cols[cx].val,
+		    rta_cmd.cols[cx].pcol->length);
+            *((*(char **) pd) + rta_cmd.cols[cx].pcol->length -1) = (char) 0;
             break;
           case RTA_INT:
-            *((int *) pd) = rta_cmd.updints[cx];
+            *((int *) pd) = rta_cmd.cols[cx].ival;
             break;
           case RTA_SHORT:
-            *((short *) pd) = rta_cmd.updints[cx];
+            *((short *) pd) = rta_cmd.cols[cx].ival;
             break;
           case RTA_UCHAR:
-            *((unsigned char *) pd) = rta_cmd.updints[cx];
+            *((unsigned char *) pd) = rta_cmd.cols[cx].ival;
             break;
           case RTA_PINT:
-            **((int **) pd) = rta_cmd.updints[cx];
+            **((int **) pd) = rta_cmd.cols[cx].ival;
             break;
           case RTA_LONG:
-            *((llong *) pd) = rta_cmd.updlngs[cx];
+            *((llong *) pd) = rta_cmd.cols[cx].lval;
             break;
           case RTA_PLONG:
-            **((llong **) pd) = rta_cmd.updlngs[cx];
+            **((llong **) pd) = rta_cmd.cols[cx].lval;
             break;
           case RTA_PTR:
             /* works only if INT and PTR are same size */
-            *((int *) pd) = rta_cmd.updints[cx];
+            *((int *) pd) = rta_cmd.cols[cx].ival;
             break;
           case RTA_FLOAT:
-            *((float *) pd) = rta_cmd.updflot[cx];
+            *((float *) pd) = rta_cmd.cols[cx].fval;
             break;
           case RTA_PFLOAT:
-            **((float **) pd) = rta_cmd.updflot[cx];
+            **((float **) pd) = rta_cmd.cols[cx].fval;
             break;
           case RTA_DOUBLE:
-            *((double *) pd) = rta_cmd.upddbl[cx];
+            *((double *) pd) = rta_cmd.cols[cx].dval;
             break;
         }
-        if (rta_cmd.pcol[cx]->flags & RTA_DISKSAVE)
+        if (rta_cmd.cols[cx].pcol->flags & RTA_DISKSAVE)
           svt = 1;
       }
 
@@ -1217,22 +2026,34 @@ do_update(char *buf, int *nbuf)
       for (cx = 0; cx < rta_cmd.ncols; cx++) {
         /* execute write callback (if defined) on row. callback will
            perform post processing on row and return zero on success */
-        if (rta_cmd.pcol[cx]->writecb) {
-          if ((rta_cmd.pcol[cx]->writecb) (rta_cmd.tbl, rta_cmd.pcol[cx]->name,
-              rta_cmd.sqlcmd, pr, rx, poldrow) != 0) {
+        if (rta_cmd.cols[cx].pcol->writecb) {
+          if ((rta_cmd.cols[cx].pcol->writecb) (rta_cmd.tbl,
+              rta_cmd.cols[cx].pcol->name, rta_cmd.sqlcmd, pr, rx,
+              poldrow) != 0) {
             /* restore row from saved image of it */
             memcpy(pr, poldrow, rta_cmd.ptbl->rowlen);
             free(poldrow);
-            rta_send_error(LOC, E_BADTRIG, rta_cmd.pcol[cx]->name);
+            rta_index_row(rta_cmd.itbl, pr);
+            rta_send_error(LOC, E_BADTRIG, rta_cmd.cols[cx].pcol->name);
+            if (nru > 0)        /* the rows before this one changed */
+              (void) rta_notify(rta_cmd.ptbl->name, "UPDATE");
             return;
           }
         }
       }
       if (poldrow)       /* free the image of the last row */
         free(poldrow);
+      rta_index_row(rta_cmd.itbl, pr);
       rta_cmd.limit--;       /* decrement row limit count */
       nru++;
     }
+    if (nfound >= 0) {
+      fx++;
+      pr = (fx < nfound) ? found[fx].pr : (void *) NULL;
+      if (pr)
+        rx = found[fx].rx;
+      continue;
+    }
     rx++;
     if (rta_cmd.ptbl->iterator)
       pr = (rta_cmd.ptbl->iterator) (pr, rta_cmd.ptbl->it_info, rx);
@@ -1248,16 +2069,20 @@ do_update(char *buf, int *nbuf)
   if (svt && rta_cmd.ptbl->savefile && strlen(rta_cmd.ptbl->savefile))
     rta_save(rta_cmd.ptbl, rta_cmd.ptbl->savefile);
 
+  /* Tell the clients that LISTEN on the table */
+  if (nru > 0)
+    (void) rta_notify(rta_cmd.ptbl->name, "UPDATE");
+
   /* Send the update complete message */
   *buf++ = 'C';
   tmark = buf;                  /* Save length location */
   buf += 4;
   nfree = *nbuf - (int)(buf - startbuf);
-  ad_str(&buf, nfree, "UPDATE", 6);
+  rta_ad_str(&buf, nfree, "UPDATE", 6);
   n = sprintf(buf, " %d", nru); /* # rows affected */
   buf += n;
   *buf++ = 0x00;
-  ad_int4(&tmark, (buf - tmark));
+  rta_ad_int4(&tmark, (buf - tmark));
 
   *nbuf -= (int) (buf - startbuf);
 
@@ -1296,6 +2121,106 @@ do_insert(char *buf, int *nbuf)
   /* - Allocate memory for the row and fill it in             */
   /* - Call the insert callback to tie row to table           */
   /* - If the callback succeeds, call all the write callbacks */
+  pr = new_row();
+  if (pr == (void *) 0)
+    return;
+
+  /* Go through the values passed in and update the row. */
+  for (cx = 0; cx < rta_cmd.ncols; cx++) {
+    /* compute pointer to actual data */
+    pd = (char *)pr + rta_cmd.cols[cx].pcol->offset;
+    switch ((rta_cmd.cols[cx].pcol)->type) {
+      case RTA_STR:
+        strncpy((char *) pd, rta_cmd.cols[cx].val,
+          rta_cmd.cols[cx].pcol->length);
+        *(char *)(pd + rta_cmd.cols[cx].pcol->length -1) = (char) 0;
+        break;
+      case RTA_PSTR:
+        strncpy(*(char **) pd, rta_cmd.cols[cx].val,
+          rta_cmd.cols[cx].pcol->length);
+        *((*(char **) pd) + rta_cmd.cols[cx].pcol->length -1) = (char) 0;
+        break;
+      case RTA_INT:
+        *((int *) pd) = rta_cmd.cols[cx].ival;
+        break;
+      case RTA_SHORT:
+        *((short *) pd) = rta_cmd.cols[cx].ival;
+        break;
+      case RTA_UCHAR:
+        *((unsigned char *) pd) = rta_cmd.cols[cx].ival;
+        break;
+      case RTA_PINT:
+        **((int **) pd) = rta_cmd.cols[cx].ival;
+        break;
+      case RTA_LONG:
+        *((llong *) pd) = rta_cmd.cols[cx].lval;
+        break;
+      case RTA_PLONG:
+        **((llong **) pd) = rta_cmd.cols[cx].lval;
+        break;
+      case RTA_PTR:
+        /* works only if INT and PTR are same size */
+        *((int *) pd) = rta_cmd.cols[cx].ival;
+        break;
+      case RTA_FLOAT:
+        *((float *) pd) = rta_cmd.cols[cx].fval;
+        break;
+      case RTA_PFLOAT:
+        **((float **) pd) = rta_cmd.cols[cx].fval;
+        break;
+      case RTA_DOUBLE:
+        *((double *) pd) = rta_cmd.cols[cx].dval;
+        break;
+    }
+  }
+
+  /* Attach the row and run the write callbacks */
+  rx = add_row(pr);
+  if (rx < 0)
+    return;
+  for (cx = 0; cx < rta_cmd.ptbl->ncol; cx++) {
+    if (rta_cmd.ptbl->cols[cx].flags & RTA_DISKSAVE)
+      svt = 1;
+  }
+
+  /* Save the table to disk if needed */
+  if (svt && rta_cmd.ptbl->savefile && strlen(rta_cmd.ptbl->savefile))
+    rta_save(rta_cmd.ptbl, rta_cmd.ptbl->savefile);
+  (void) rta_notify(rta_cmd.ptbl->name, "INSERT");
+
+  /* Send the INSERT complete message */
+  *buf++ = 'C';
+  tmark = buf;                  /* Save length location */
+  buf += 4;
+  nfree = *nbuf - (int)(buf - startbuf);
+  rta_ad_str(&buf, nfree, "INSERT", 6);
+  n = sprintf(buf, " %d 1", rx);
+  buf += n;
+  *buf++ = 0x00;
+  rta_ad_int4(&tmark, (buf - tmark));
+
+  *nbuf -= (int) (buf - startbuf);
+
+  /* Log SQL if trace is on.  (+7 skips over 'INSERT ') */
+  if (rta_dbg.trace)
+    rta_log(LOC, Er_Trace_SQL, rta_cmd.sqlcmd, (tmark + 7));
+}
+
+
+/***************************************************************
+ * new_row(): - Allocate and initialize a row for the table in
+ * the sql_cmd structure.  Pointer types get their memory here.
+ *
+ * Input:        None
+ * Output:       Pointer to the new row or NULL on error
+ * Effects:      Sets the err flag on error
+ ***************************************************************/
+static void *
+new_row(void)
+{
+  void    *pr;         /* Pointer to the row in the table/column */
+  void    *pd;         /* Pointer to the Data in the table/column */
+  int      cx;         /* Column index */
 
   /* Allocate row and then allocate space for each pointer type */
   pr = malloc(rta_cmd.ptbl->rowlen);
@@ -1304,7 +2229,7 @@ do_insert(char *buf, int *nbuf)
     if (rta_dbg.syserr)
       rta_log(LOC, Er_No_Mem);
     rta_cmd.err = 1;
-    return;
+    return ((void *) 0);
   }
   (void) memset(pr, 0, rta_cmd.ptbl->rowlen);
 
@@ -1327,7 +2252,7 @@ do_insert(char *buf, int *nbuf)
             rta_log(LOC, Er_No_Mem);
           rta_cmd.err = 1;
           free_row(rta_cmd.ptbl, pr);
-          return;
+          return ((void *) 0);
         }
         (void) memset(*(char **)pd, 0, rta_cmd.ptbl->cols[cx].length);
         break;
@@ -1342,7 +2267,7 @@ do_insert(char *buf, int *nbuf)
             rta_log(LOC, Er_No_Mem);
           rta_cmd.err = 1;
           free_row(rta_cmd.ptbl, pr);
-          return;
+          return ((void *) 0);
         }
         **(int **) pd = (int) 0;
         break;
@@ -1357,7 +2282,7 @@ do_insert(char *buf, int *nbuf)
             rta_log(LOC, Er_No_Mem);
           rta_cmd.err = 1;
           free_row(rta_cmd.ptbl, pr);
-          return;
+          return ((void *) 0);
         }
         **(llong **) pd = (llong) 9;
         break;
@@ -1376,7 +2301,7 @@ do_insert(char *buf, int *nbuf)
             rta_log(LOC, Er_No_Mem);
           rta_cmd.err = 1;
           free_row(rta_cmd.ptbl, pr);
-          return;
+          return ((void *) 0);
         }
         **(float **) pd = (float) 0.0;
         break;
@@ -1392,56 +2317,26 @@ do_insert(char *buf, int *nbuf)
         break;
     }
   }
-  /* We have allocated memory for all of the row's pointer
-     types.  From this point on we need to be careful to 
-     delete this memory if anything goes wrong with the insert */
 
-  /* Go through the values passed in and update the row. */
-  for (cx = 0; cx < rta_cmd.ncols; cx++) {
-    /* compute pointer to actual data */
-    pd = (char *)pr + rta_cmd.pcol[cx]->offset;
-    switch ((rta_cmd.pcol[cx])->type) {
-      case RTA_STR:
-        strncpy((char *) pd, rta_cmd.updvals[cx], rta_cmd.pcol[cx]->length);
-        *(char *)(pd + rta_cmd.pcol[cx]->length -1) = (char) 0;
-        break;
-      case RTA_PSTR:
-        strncpy(*(char **) pd, rta_cmd.updvals[cx], rta_cmd.pcol[cx]->length);
-        *((*(char **) pd) + rta_cmd.pcol[cx]->length -1) = (char) 0;
-        break;
-      case RTA_INT:
-        *((int *) pd) = rta_cmd.updints[cx];
-        break;
-      case RTA_SHORT:
-        *((short *) pd) = rta_cmd.updints[cx];
-        break;
-      case RTA_UCHAR:
-        *((unsigned char *) pd) = rta_cmd.updints[cx];
-        break;
-      case RTA_PINT:
-        **((int **) pd) = rta_cmd.updints[cx];
-        break;
-      case RTA_LONG:
-        *((llong *) pd) = rta_cmd.updlngs[cx];
-        break;
-      case RTA_PLONG:
-        **((llong **) pd) = rta_cmd.updlngs[cx];
-        break;
-      case RTA_PTR:
-        /* works only if INT and PTR are same size */
-        *((int *) pd) = rta_cmd.updints[cx];
-        break;
-      case RTA_FLOAT:
-        *((float *) pd) = rta_cmd.updflot[cx];
-        break;
-      case RTA_PFLOAT:
-        **((float **) pd) = rta_cmd.updflot[cx];
-        break;
-      case RTA_DOUBLE:
-        *((double *) pd) = rta_cmd.upddbl[cx];
-        break;
-    }
-  }
+  return (pr);
+}
+
+
+/***************************************************************
+ * add_row(): - Give a filled in row to the table's insert
+ * callback and then run the write callbacks on it.  The row is
+ * freed or deleted if anything fails.
+ *
+ * Input:        Pointer to the row from new_row()
+ * Output:       The row index from the insert callback or -1
+ *               if the row was rejected.
+ * Effects:      Sends the error message on failure
+ ***************************************************************/
+static int
+add_row(void *pr)
+{
+  int      cx;         /* Column index */
+  int      rx;         /* row index returned from the insert cb */
 
   /* The row is complete.  Call the insert callback to attach it
      to the rest of the table structure.  On failure, free the
@@ -1450,8 +2345,10 @@ do_insert(char *buf, int *nbuf)
   if (rx < 0) {
     free_row(rta_cmd.ptbl, pr);
     rta_send_error(LOC, E_BADINSERT, rta_cmd.ptbl->name);
-    return;
+    return (-1);
   }
+  TblGen[rta_cmd.itbl]++;
+  rta_index_stale(rta_cmd.itbl);
 
   /* Do all write callbacks after row is added to table */
   for (cx = 0; cx < rta_cmd.ptbl->ncol; cx++) {
@@ -1463,33 +2360,12 @@ do_insert(char *buf, int *nbuf)
         /* on error, send error message to user and delete row */
         rta_send_error(LOC, E_BADTRIG, rta_cmd.ptbl->cols[cx].name);
         rta_cmd.ptbl->deletecb(rta_cmd.ptbl->name, rta_cmd.sqlcmd, pr);
-        return;
+        return (-1);
       }
     }
-    if (rta_cmd.ptbl->cols[cx].flags & RTA_DISKSAVE)
-      svt = 1;
   }
 
-  /* Save the table to disk if needed */
-  if (svt && rta_cmd.ptbl->savefile && strlen(rta_cmd.ptbl->savefile))
-    rta_save(rta_cmd.ptbl, rta_cmd.ptbl->savefile);
-
-  /* Send the INSERT complete message */
-  *buf++ = 'C';
-  tmark = buf;                  /* Save length location */
-  buf += 4;
-  nfree = *nbuf - (int)(buf - startbuf);
-  ad_str(&buf, nfree, "INSERT", 6);
-  n = sprintf(buf, " %d 1", rx);
-  buf += n;
-  *buf++ = 0x00;
-  ad_int4(&tmark, (buf - tmark));
-
-  *nbuf -= (int) (buf - startbuf);
-
-  /* Log SQL if trace is on.  (+7 skips over 'INSERT ') */
-  if (rta_dbg.trace)
-    rta_log(LOC, Er_Trace_SQL, rta_cmd.sqlcmd, (tmark + 7));
+  return (rx);
 }
 
 
@@ -1531,6 +2407,633 @@ free_row(RTA_TBLDEF *ptbl, void *pr)
   free((char *) pr);
 }
 
+/***************************************************************
+ * do_copy_start(): - Start a COPY FROM STDIN.  We tell the
+ * client to send its rows with a CopyInResponse and then stop
+ * as a full SELECT does.  The session feeds the CopyData
+ * messages to rta_copy_in() and ends with rta_copy_done().
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      Sets rta_cmd.more to RTA_MORE_COPYIN
+ ***************************************************************/
+static void
+do_copy_start(char *buf, int *nbuf)
+{
+  int      i;          /* column index */
+
+  /* Only a session can give us the rows */
+  if (!rta_cmd.canmore) {
+    rta_send_error(LOC, E_NOCOPYIN);
+    return;
+  }
+
+  /* Send the CopyInResponse with the format of each column */
+  *buf++ = 'G';
+  rta_ad_int4(&buf, 4 + 1 + 2 + (2 * rta_cmd.ncols));
+  *buf++ = (char) rta_cmd.copyfmt;
+  rta_ad_int2(&buf, rta_cmd.ncols);
+  for (i = 0; i < rta_cmd.ncols; i++)
+    rta_ad_int2(&buf, rta_cmd.copyfmt);
+  *nbuf -= 8 + (2 * rta_cmd.ncols);
+
+  rta_cmd.npr = 0;              /* rows copied so far */
+  rta_cmd.more = RTA_MORE_COPYIN;
+}
+
+/***************************************************************
+ * do_listen(): - Start or stop sending the client notifications
+ * on a channel.  Only a client session can receive them.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The channels of the session
+ ***************************************************************/
+static void
+do_listen(char *buf, int *nbuf)
+{
+  char    *tag;        /* the CommandComplete tag */
+
+  if (!rta_cmd.canmore) {
+    rta_send_error(LOC, E_NOLISTEN);
+    return;
+  }
+  if (rta_ext_listen(rta_cmd.tbl, (rta_cmd.command == RTA_LISTEN)) < 0) {
+    rta_cmd.err = 1;
+    return;
+  }
+
+  tag = (rta_cmd.command == RTA_LISTEN) ? "LISTEN" : "UNLISTEN";
+  *buf++ = 'C';
+  rta_ad_int4(&buf, 4 + strlen(tag) + 1);
+  rta_ad_str(&buf, *nbuf - 5, tag, strlen(tag));
+  *nbuf -= 5 + strlen(tag) + 1;
+
+  if (rta_dbg.trace)
+    rta_log(LOC, Er_Trace_SQL, rta_cmd.sqlcmd, tag);
+}
+
+/***************************************************************
+ * verify_set(): - Verify the name and the value of a SET.  The
+ * value is converted to rta_cmd.cols[0].ival, with -1 for DEFAULT.
+ * A statement_timeout may have a unit of ms, s, min, or h.
+ * On error, we output the error message and set the err flag.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The err flag and the output buffer on error
+ ***************************************************************/
+static void
+verify_set(char *buf, int *nbuf)
+{
+  int      bit;        /* the RTA_SET_* of the setting */
+  char    *val;        /* the text of the value */
+  char    *end;        /* the unit after the number */
+  llong    n;          /* the value */
+  llong    unit = 1;   /* ms in a unit of statement_timeout */
+
+  bit = set_bit(rta_cmd.tbl);
+  if (bit == 0) {
+    rta_send_error(LOC, E_NOSETTING, rta_cmd.tbl);
+    return;
+  }
+  val = rta_cmd.cols[0].val;
+  if (rta_cmd.cols[0].parm) {
+    rta_send_error(LOC, E_BADPARSE);
+    return;
+  }
+  if (!strcasecmp(val, "DEFAULT")) {
+    rta_cmd.cols[0].ival = -1;
+    return;
+  }
+
+  n = strtoll(val, &end, 10);
+  if (bit == RTA_SET_TIMEOUT && *end) {
+    if (!strcasecmp(end, "s"))
+      unit = 1000;
+    else if (!strcasecmp(end, "min"))
+      unit = 60 * 1000;
+    else if (!strcasecmp(end, "h"))
+      unit = 60 * 60 * 1000;
+    else if (strcasecmp(end, "ms"))
+      unit = 0;
+  }
+  else if (*end)
+    unit = 0;
+  if (end == val || unit == 0 || n < 0 || n > INT_MAX / unit) {
+    rta_send_error(LOC, E_BADSETTING, rta_cmd.tbl);
+    return;
+  }
+  rta_cmd.cols[0].ival = (int) (n * unit);
+}
+
+/***************************************************************
+ * do_set(): - Change a setting of the session.  Only a client
+ * session has settings.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The settings of the session
+ ***************************************************************/
+static void
+do_set(char *buf, int *nbuf)
+{
+  if (!rta_cmd.canmore) {
+    rta_send_error(LOC, E_NOSET);
+    return;
+  }
+  rta_ext_set(set_bit(rta_cmd.tbl), rta_cmd.cols[0].ival);
+
+  *buf++ = 'C';
+  rta_ad_int4(&buf, 4 + 3 + 1);
+  rta_ad_str(&buf, *nbuf - 5, "SET", 3);
+  *nbuf -= 5 + 3 + 1;
+
+  if (rta_dbg.trace)
+    rta_log(LOC, Er_Trace_SQL, rta_cmd.sqlcmd, "SET");
+}
+
+/***************************************************************
+ * set_bit(): - Find a setting of SET by name.  Case does not
+ * matter.
+ *
+ * Input:        The name
+ * Output:       The RTA_SET_* of the setting, or 0 if unknown
+ * Effects:      None
+ ***************************************************************/
+static int
+set_bit(char *name)
+{
+  if (!strcasecmp(name, "statement_timeout"))
+    return (RTA_SET_TIMEOUT);
+  if (!strcasecmp(name, "max_rows_scanned"))
+    return (RTA_SET_MAXSCAN);
+  return (0);
+}
+
+/***************************************************************
+ * rta_copy_in(): - Insert the rows in the data of COPY FROM
+ * STDIN.  Each value is converted once directly into a new row
+ * and the row goes to the insert callback as for an INSERT.
+ * A row that is not complete is left for the next call.  The
+ * plan of the COPY must be loaded into rta_cmd.
+ *
+ * Input:        The data and its length
+ *               Pointer to the copy state.  It is zero at the
+ *               start of the COPY, one after the binary header,
+ *               and two once the end of the data was seen.
+ * Output:       The number of bytes used, or -1 on error
+ * Effects:      Rows are added to the table and counted in
+ *               rta_cmd.npr.  Errors go to the output buffer.
+ ***************************************************************/
+int
+rta_copy_in(char *data, int len, int *phdr)
+{
+  if (*phdr == 2)
+    return (len);               /* ignore data after the end */
+  if (rta_cmd.copyfmt)
+    return (copy_binary(data, len, phdr));
+  return (copy_text(data, len, phdr));
+}
+
+/***************************************************************
+ * copy_text(): - Insert the complete lines of text COPY data.
+ * Values are separated by tabs and \N is a NULL value which
+ * leaves the column zero.  A line of just \. ends the data.
+ *
+ * Input:        The data, its length, and the copy state
+ * Output:       The number of bytes used, or -1 on error
+ * Effects:      Rows are added to the table
+ ***************************************************************/
+static int
+copy_text(char *data, int len, int *phdr)
+{
+  char    *line;       /* start of the current line */
+  char    *eol;        /* the newline at the end of line */
+  char    *p;          /* start of the current value */
+  char    *pv;         /* end of the current value */
+  void    *pr;         /* the new row */
+  int      n;          /* length of the line */
+  int      cx;         /* column index */
+  int      mxline;     /* longest valid line */
+
+  line = data;
+  while ((eol = memchr(line, '\n', len - (line - data))) != (char *) 0) {
+    n = (int) (eol - line);
+    if (n > 0 && line[n - 1] == '\r')
+      n--;
+    if (n == 2 && line[0] == '\\' && line[1] == '.') {
+      *phdr = 2;
+      return (len);
+    }
+
+    pr = new_row();
+    if (pr == (void *) 0)
+      return (-1);
+    p = line;
+    for (cx = 0; cx < rta_cmd.ncols; cx++) {
+      if (cx != 0) {
+        if (p == line + n) {
+          free_row(rta_cmd.ptbl, pr);
+          rta_send_error(LOC, E_COPYCOLS, rta_cmd.tbl);
+          return (-1);
+        }
+        p++;                    /* skip the tab */
+      }
+      pv = memchr(p, '\t', n - (p - line));
+      if (pv == (char *) 0)
+        pv = line + n;
+      if (!(pv - p == 2 && p[0] == '\\' && p[1] == 'N') &&
+        copy_text_val(rta_cmd.cols[cx].pcol,
+          col_data(rta_cmd.cols[cx].pcol, pr), p, (int) (pv - p)) < 0) {
+        free_row(rta_cmd.ptbl, pr);
+        return (-1);
+      }
+      p = pv;
+    }
+    if (p != line + n) {
+      free_row(rta_cmd.ptbl, pr);
+      rta_send_error(LOC, E_COPYCOLS, rta_cmd.tbl);
+      return (-1);
+    }
+    if (add_row(pr) < 0)
+      return (-1);
+    rta_cmd.npr++;
+    line = eol + 1;
+  }
+
+  /* Refuse to wait for a line longer than any valid line */
+  mxline = 2;
+  for (cx = 0; cx < rta_cmd.ncols; cx++)
+    mxline += (4 * rta_cmd.cols[cx].pcol->length) + MX_FLOT_STRING + 1;
+  if (len - (line - data) > mxline) {
+    rta_send_error(LOC, E_COPYCOLS, rta_cmd.tbl);
+    return (-1);
+  }
+  return ((int) (line - data));
+}
+
+/***************************************************************
+ * copy_text_val(): - Convert one text COPY value into a row.
+ * Strings are unescaped as they are copied.  Numbers are copied
+ * to a terminated buffer before they are read, since a value
+ * need not be followed by anything in the COPY data, and the row
+ * is set only if the whole value is a number.
+ *
+ * Input:        The column, pointer to its data in the row,
+ *               the value and its length
+ * Output:       0 on success, -1 on error
+ * Effects:      The row
+ ***************************************************************/
+static int
+copy_text_val(RTA_COLDEF *pcol, void *pd, char *val, int n)
+{
+  char    *ps;         /* the string in the row */
+  char     num[64];    /* a number value, terminated */
+  char    *end;        /* end of the number */
+  llong    lv = 0;     /* an integer value */
+  double   dv = 0;     /* a double value */
+  float    fv = 0;     /* a float value */
+  int      i;          /* index into val */
+  int      j;          /* index into ps */
+  int      c;          /* the next character */
+
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      ps = (char *) pd;
+      for (i = 0, j = 0; i < n; i++) {
+        if (j >= pcol->length - 1) {
+          rta_send_error(LOC, E_BIGSTR, pcol->name);
+          return (-1);
+        }
+        c = val[i];
+        if (c == '\\' && i + 1 < n) {
+          c = val[++i];
+          switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            default:
+              if (c >= '0' && c <= '7') {
+                c -= '0';
+                if (i + 1 < n && val[i + 1] >= '0' && val[i + 1] <= '7')
+                  c = (c << 3) + (val[++i] - '0');
+                if (i + 1 < n && val[i + 1] >= '0' && val[i + 1] <= '7')
+                  c = (c << 3) + (val[++i] - '0');
+              }
+              break;
+          }
+        }
+        ps[j++] = (char) c;
+      }
+      ps[j] = (char) 0;
+      return (0);
+  }
+
+  if (n == 0 || n >= (int) sizeof(num)) {
+    rta_send_error(LOC, E_BADCOPY, pcol->name);
+    return (-1);
+  }
+  memcpy(num, val, n);
+  num[n] = (char) 0;
+  switch (pcol->type) {
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      fv = strtof(num, &end);
+      break;
+    case RTA_DOUBLE:
+      dv = strtod(num, &end);
+      break;
+    default:
+      lv = strtoll(num, &end, 10);
+      break;
+  }
+  if (end != num + n) {
+    rta_send_error(LOC, E_BADCOPY, pcol->name);
+    return (-1);
+  }
+
+  switch (pcol->type) {
+    case RTA_INT:
+    case RTA_PINT:
+    case RTA_PTR:
+      /* works only if INT and PTR are same size */
+      *((int *) pd) = (int) lv;
+      break;
+    case RTA_SHORT:
+      *((short *) pd) = (short) lv;
+      break;
+    case RTA_UCHAR:
+      *((unsigned char *) pd) = (unsigned char) lv;
+      break;
+    case RTA_LONG:
+    case RTA_PLONG:
+      *((llong *) pd) = lv;
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      *((float *) pd) = fv;
+      break;
+    case RTA_DOUBLE:
+      *((double *) pd) = dv;
+      break;
+  }
+  return (0);
+}
+
+/***************************************************************
+ * copy_binary(): - Insert the complete tuples of binary COPY
+ * data.  The data starts with the header of the Postgres binary
+ * COPY format and ends with a tuple count of -1.
+ *
+ * Input:        The data, its length, and the copy state
+ * Output:       The number of bytes used, or -1 on error
+ * Effects:      Rows are added to the table
+ ***************************************************************/
+static int
+copy_binary(char *data, int len, int *phdr)
+{
+  unsigned char *p;    /* the current tuple */
+  void    *pr;         /* the new row */
+  int      used = 0;   /* bytes used so far */
+  int      off;        /* offset of a field in the tuple */
+  int      flen;       /* length of a field */
+  int      cx;         /* column index */
+
+  /* Signature, flags, and header extension */
+  if (*phdr == 0) {
+    if (len < 19)
+      return (0);
+    p = (unsigned char *) data;
+    if (memcmp(p, "PGCOPY\n\377\r\n", 11) ||
+      get_net(&p[15], 4) > RTA_MXCOPYEXT) {
+      rta_send_error(LOC, E_BADMSG);
+      return (-1);
+    }
+    if (len - 19 < get_net(&p[15], 4))
+      return (0);
+    used = 19 + (int) get_net(&p[15], 4);
+    *phdr = 1;
+  }
+
+  while (len - used >= 2) {
+    p = (unsigned char *) &data[used];
+    if ((short) get_net(p, 2) == -1) {
+      *phdr = 2;
+      return (len);
+    }
+    if ((short) get_net(p, 2) != rta_cmd.ncols) {
+      rta_send_error(LOC, E_COPYCOLS, rta_cmd.tbl);
+      return (-1);
+    }
+
+    /* Wait for the whole tuple */
+    off = 2;
+    for (cx = 0; cx < rta_cmd.ncols; cx++) {
+      if (len - used - off < 4)
+        return (used);
+      flen = (int) get_net(&p[off], 4);
+      if (flen < -1 || flen > rta_cmd.cols[cx].pcol->length + 8) {
+        rta_send_error(LOC, E_BADCOPY, rta_cmd.cols[cx].pcol->name);
+        return (-1);
+      }
+      off += 4 + ((flen > 0) ? flen : 0);
+      if (off > len - used)
+        return (used);
+    }
+
+    pr = new_row();
+    if (pr == (void *) 0)
+      return (-1);
+    off = 2;
+    for (cx = 0; cx < rta_cmd.ncols; cx++) {
+      flen = (int) get_net(&p[off], 4);
+      off += 4;
+      if (flen < 0)
+        continue;               /* NULL leaves the column zero */
+      if (copy_bin_val(rta_cmd.cols[cx].pcol,
+          col_data(rta_cmd.cols[cx].pcol, pr), &p[off], flen) < 0) {
+        free_row(rta_cmd.ptbl, pr);
+        return (-1);
+      }
+      off += flen;
+    }
+    if (add_row(pr) < 0)
+      return (-1);
+    rta_cmd.npr++;
+    used += off;
+  }
+  return (used);
+}
+
+/***************************************************************
+ * copy_bin_val(): - Copy one binary COPY value into a row.  The
+ * size of a number must be that of its column.
+ *
+ * Input:        The column, pointer to its data in the row,
+ *               the value and its length
+ * Output:       0 on success, -1 on error
+ * Effects:      The row
+ ***************************************************************/
+static int
+copy_bin_val(RTA_COLDEF *pcol, void *pd, unsigned char *val, int n)
+{
+  union {
+    float    f;
+    int      i;
+  } u4;                /* the bits of a float */
+  union {
+    double   d;
+    llong    l;
+  } u8;                /* the bits of a double */
+
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      if (n > pcol->length - 1) {
+        rta_send_error(LOC, E_BIGSTR, pcol->name);
+        return (-1);
+      }
+      memcpy(pd, val, n);
+      ((char *) pd)[n] = (char) 0;
+      return (0);
+    case RTA_SHORT:
+      if (n != 2)
+        break;
+      *((short *) pd) = (short) get_net(val, 2);
+      return (0);
+    case RTA_UCHAR:
+      if (n != 2)
+        break;
+      *((unsigned char *) pd) = (unsigned char) get_net(val, 2);
+      return (0);
+    case RTA_INT:
+    case RTA_PINT:
+    case RTA_PTR:
+      if (n != 4)
+        break;
+      *((int *) pd) = (int) get_net(val, 4);
+      return (0);
+    case RTA_LONG:
+    case RTA_PLONG:
+      if (n != 8)
+        break;
+      *((llong *) pd) = get_net(val, 8);
+      return (0);
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      if (n != 4)
+        break;
+      u4.i = (int) get_net(val, 4);
+      *((float *) pd) = u4.f;
+      return (0);
+    case RTA_DOUBLE:
+      if (n != 8)
+        break;
+      u8.l = get_net(val, 8);
+      *((double *) pd) = u8.d;
+      return (0);
+  }
+  rta_send_error(LOC, E_BADCOPY, pcol->name);
+  return (-1);
+}
+
+/***************************************************************
+ * col_data(): - Get the address of a column's value in a row.
+ * For the pointer types this is the memory from new_row().
+ *
+ * Input:        The column and the row
+ * Output:       Pointer to the value
+ * Effects:      None
+ ***************************************************************/
+static void *
+col_data(RTA_COLDEF *pcol, void *pr)
+{
+  void    *pd;         /* Pointer to the Data in the row */
+
+  pd = (char *) pr + pcol->offset;
+  switch (pcol->type) {
+    case RTA_PSTR:
+    case RTA_PINT:
+    case RTA_PLONG:
+    case RTA_PFLOAT:
+      return (*(void **) pd);
+  }
+  return (pd);
+}
+
+/***************************************************************
+ * get_net(): - Get a network byte order integer
+ *
+ * Input:        Pointer to the bytes and the number of bytes
+ * Output:       The value.  Only 8 byte values can be negative.
+ * Effects:      None
+ ***************************************************************/
+static llong
+get_net(unsigned char *p, int n)
+{
+  unsigned long long v = 0;    /* the value */
+
+  while (n-- > 0)
+    v = (v << 8) | *p++;
+  return ((llong) v);
+}
+
+/***************************************************************
+ * rta_copy_done(): - Finish a COPY FROM STDIN.  The table is
+ * saved to disk once for all of the rows.
+ *
+ * Input:        A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      Sends the COPY complete message
+ ***************************************************************/
+void
+rta_copy_done(char *buf, int *nbuf)
+{
+  char    *startbuf;   /* used to compute response length */
+  char    *tmark;      /* Address of the length of the reply */
+  int      nfree;      /* #bytes available in buf */
+  int      svt = 0;    /* Save table if == 1 */
+  int      cx;         /* column index */
+  int      n;          /* number of chars printed in sprintf() */
+
+  startbuf = buf;
+  for (cx = 0; cx < rta_cmd.ptbl->ncol; cx++) {
+    if (rta_cmd.ptbl->cols[cx].flags & RTA_DISKSAVE)
+      svt = 1;
+  }
+  if (svt && rta_cmd.npr && rta_cmd.ptbl->savefile &&
+    strlen(rta_cmd.ptbl->savefile))
+    rta_save(rta_cmd.ptbl, rta_cmd.ptbl->savefile);
+
+  /* Send the COPY complete message */
+  *buf++ = 'C';
+  tmark = buf;
+  buf += 4;
+  nfree = *nbuf - (int) (buf - startbuf);
+  rta_ad_str(&buf, nfree, "COPY", 4);
+  n = sprintf(buf, " %d", rta_cmd.npr);
+  buf += n;
+  *buf++ = 0x00;
+  rta_ad_int4(&tmark, (buf - tmark));
+
+  *nbuf -= (int) (buf - startbuf);
+
+  /* Log SQL if trace is on.  (+4 skips over the length) */
+  if (rta_dbg.trace)
+    rta_log(LOC, Er_Trace_SQL, rta_cmd.sqlcmd, (tmark + 4));
+}
+
+
 /***************************************************************
  * do_delete(): - Execute a DELETE statement against the DB.
  *
@@ -1545,11 +3048,8 @@ do_delete(char *buf, int *nbuf)
 {
   int      sr;         /* the Size of each Row in the table */
   int      rx;         /* Row indeX in for() loop */
-  int      wx;         /* Where clause indeX in for loop */
   void    *pr;         /* Pointer to the row in the table/column */
   void    *newpr;      /* Pointer to the next row in the table/column */
-  void    *pd;         /* Pointer to the Data in the table/column */
-  llong cmp;           /* has actual relation of col and val */
   int      dor;        /* DO Row == 1 if we should delete row */
   char    *startbuf;   /* used to compute response length */
   int      nfree;      /* #bytes available in buf =nbuf -(buf-startbuf) */
@@ -1558,98 +3058,52 @@ do_delete(char *buf, int *nbuf)
   int      svt = 0;    /* Save table if == 1 */
   int      cx;         /* Column indeX for looking for DISKSAVE cols */
   char    *tmark;      /* Address of D in "CDELETE" if success */
+  struct Sql_Row *found;  /* rows found with an index */
+  int      nfound;     /* # rows found, or -1 if no index */
+  int      fx = 0;     /* index into found */
 
   startbuf = buf;
 
   /* We loop through all rows in the table in question applying the
-     WHERE condition.  If a row matches we call the delete callback */
+     WHERE condition.  If a row matches we call the delete callback.
+     An indexed column in the WHERE may give us the rows to visit. */
   sr = rta_cmd.ptbl->rowlen;
   rx = 0;
-  if (rta_cmd.ptbl->iterator) 
+  nfound = rta_index_find(&found, 0);
+  if (nfound >= 0) {
+    pr = (nfound > 0) ? found[0].pr : (void *) NULL;
+    if (pr)
+      rx = found[0].rx;
+  }
+  else if (rta_cmd.ptbl->iterator) 
     pr = (rta_cmd.ptbl->iterator) ((void *) NULL, rta_cmd.ptbl->it_info, rx);
   else
     pr = rta_cmd.ptbl->address;
   /* for each row ..... */
   while (pr) {
-    dor = 1;
-    for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
-      /* The WHERE clause ...... execute read callback (if defined) on
-         row * the call back is expected to fill in the data */
-      if (rta_cmd.pwhr[wx]->readcb) {
-        if ((rta_cmd.pwhr[wx]->readcb) (rta_cmd.tbl, rta_cmd.whrcols[wx],
-            rta_cmd.sqlcmd, pr, rx) != 0) {
-          rta_send_error(LOC, E_BADTRIG, rta_cmd.whrcols[wx]);
-          return;
-        }
-      }
-
-      /* compute pointer to actual data */
-      pd = (char *)pr + rta_cmd.pwhr[wx]->offset;
-
-      /* do comparison based on column data type */
-      switch (rta_cmd.pwhr[wx]->type) {
-        case RTA_STR:
-          cmp = strncmp((char *) pd, rta_cmd.whrvals[wx],
-			rta_cmd.pwhr[wx]->length);
-          break;
-        case RTA_PSTR:
-          cmp = strcmp(*(char **) pd, rta_cmd.whrvals[wx]);
-          break;
-        case RTA_INT:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_SHORT:
-          cmp = *((short *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_UCHAR:
-          cmp = *((unsigned char *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_PINT:
-          cmp = **((int **) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_LONG:
-          cmp = *((llong *) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_PLONG:
-          cmp = **((llong **) pd) - rta_cmd.whrlngs[wx];
-          break;
-        case RTA_FLOAT:
-          cmp = *((float *) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_PFLOAT:
-          cmp = **((float **) pd) - rta_cmd.whrflot[wx];
-          break;
-        case RTA_PTR:
-          cmp = *((int *) pd) - rta_cmd.whrints[wx];
-          break;
-        case RTA_DOUBLE:
-          cmp = *((double *) pd) - rta_cmd.whrdbl[wx];
-          break;
-        default:
-          cmp = 1;              /* assume no match */
-          break;
-      }
-      if (!(((cmp == 0) && (rta_cmd.whrrel[wx] == RTA_EQ ||
-              rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_LE)) ||
-          ((cmp != 0) && (rta_cmd.whrrel[wx] == RTA_NE)) ||
-          ((cmp < 0) && (rta_cmd.whrrel[wx] == RTA_LE ||
-              rta_cmd.whrrel[wx] == RTA_LT)) ||
-          ((cmp > 0) && (rta_cmd.whrrel[wx] == RTA_GE ||
-              rta_cmd.whrrel[wx] == RTA_GT)))) {
-        dor = 0;
-        break;
-      }
+    /* Stop on a CancelRequest or a limit of the session */
+    if (row_stop(1)) {
+      if (nrd > 0)
+        (void) rta_notify(rta_cmd.ptbl->name, "DELETE");
+      return;
     }
+    dor = where_match(pr, rx);
+    if (dor < 0)
+      return;
 
     /* In the next step we may delete the row (which frees the memory
        for it).  We'd better get the address of the _next_ row before
        we delete this one. */
-    rx++;
-    if (rta_cmd.ptbl->iterator)
-      newpr = (rta_cmd.ptbl->iterator) (pr, rta_cmd.ptbl->it_info, rx);
+    if (nfound >= 0) {
+      fx++;
+      newpr = (fx < nfound) ? found[fx].pr : (void *) NULL;
+      if (newpr)
+        rx = found[fx].rx;
+    }
+    else if (rta_cmd.ptbl->iterator)
+      newpr = (rta_cmd.ptbl->iterator) (pr, rta_cmd.ptbl->it_info, ++rx);
     else {
-      if (rx >= rta_cmd.ptbl->nrows)
+      if (++rx >= rta_cmd.ptbl->nrows)
         newpr = (void *) NULL;
       else
         newpr = (char *)rta_cmd.ptbl->address + (rx * sr);
@@ -1670,6 +3124,8 @@ do_delete(char *buf, int *nbuf)
       rta_cmd.ptbl->deletecb(rta_cmd.ptbl->name, rta_cmd.sqlcmd, pr);
       rta_cmd.limit--;       /* decrement row limit count */
       nrd++;
+      TblGen[rta_cmd.itbl]++;
+      rta_index_stale(rta_cmd.itbl);
     }
     pr = newpr;
   }
@@ -1681,17 +3137,19 @@ do_delete(char *buf, int *nbuf)
   }
   if (svt && rta_cmd.ptbl->savefile && strlen(rta_cmd.ptbl->savefile))
     rta_save(rta_cmd.ptbl, rta_cmd.ptbl->savefile);
+  if (nrd > 0)
+    (void) rta_notify(rta_cmd.ptbl->name, "DELETE");
 
   /* Send the delete complete message */
   *buf++ = 'C';
   tmark = buf;                  /* Save length location */
   buf += 4;
   nfree = *nbuf - (int)(buf - startbuf);
-  ad_str(&buf, nfree, "DELETE", 6);
+  rta_ad_str(&buf, nfree, "DELETE", 6);
   n = sprintf(buf, " %d", nrd); /* # rows affected */
   buf += n;
   *buf++ = 0x00;
-  ad_int4(&tmark, (buf - tmark));
+  rta_ad_int4(&tmark, (buf - tmark));
 
   *nbuf -= (int) (buf - startbuf);
 
@@ -1701,7 +3159,7 @@ do_delete(char *buf, int *nbuf)
 }
 
 /***************************************************************
- * ad_str(): - Add a string to the output buffer.  Includes a
+ * rta_ad_str(): - Add a string to the output buffer.  Includes a
  *             NULL to terminate the string.
  *
  * Input:        A **char to the target buffer, the free space
@@ -1711,8 +3169,8 @@ do_delete(char *buf, int *nbuf)
  * Effects:      Increments the **char to point to the next
  *               available space in the buffer.
  ***************************************************************/
-static void
-ad_str(char **pbuf, int outcnt, char *instr, int incnt)
+void
+rta_ad_str(char **pbuf, int outcnt, char *instr, int incnt)
 {
   // sanity check
   if ((outcnt <= 0) || (incnt <= 0))
@@ -1728,15 +3186,75 @@ ad_str(char **pbuf, int outcnt, char *instr, int incnt)
 }
 
 /***************************************************************
- * ad_int2(): - Add a 2 byte integer to the output buffer
+ * rta_ad_ref(): - Add a string to the output by reference if the
+ * caller of rta_session_dbbatchv() gave us an iovec list.  The
+ * string is left as a hole in the buffer.  We keep one entry
+ * free for the output after the last string.
+ *
+ * Input:        A **char to the target buffer, the string, and
+ *               the number of bytes to send
+ * Output:       1 if the string was added, 0 if the caller
+ *               should copy it
+ * Effects:      Increments the **char past the hole
+ ***************************************************************/
+int
+rta_ad_ref(char **pbuf, char *instr, int incnt)
+{
+  struct iovec *piov;      /* the two new entries */
+
+  if (rta_iov.iov == (struct iovec *) 0 || incnt < RTA_MNIOVREF ||
+      rta_iov.niov + 3 > rta_iov.mxiov)
+    return (0);
+
+  piov = &rta_iov.iov[rta_iov.niov];
+  piov[0].iov_base = rta_iov.base;
+  piov[0].iov_len = *pbuf - rta_iov.base;
+  piov[1].iov_base = instr;
+  piov[1].iov_len = incnt;
+  rta_iov.niov += 2;
+  *pbuf += incnt;
+  rta_iov.base = *pbuf;
+  return (1);
+}
+
+/***************************************************************
+ * rta_iov_trim(): - Drop the strings of output that is being
+ * overwritten, as by an error message.
+ *
+ * Input:        The new end of the output
+ * Output:       void
+ * Effects:      The iovec list of rta_session_dbbatchv()
+ ***************************************************************/
+void
+rta_iov_trim(char *end)
+{
+  struct iovec *piov;      /* the last kept string */
+
+  if (rta_iov.iov == (struct iovec *) 0)
+    return;
+  while (rta_iov.niov >= 2 &&
+         (char *) rta_iov.iov[rta_iov.niov - 2].iov_base +
+         rta_iov.iov[rta_iov.niov - 2].iov_len >= end)
+    rta_iov.niov -= 2;
+  if (rta_iov.niov == 0)
+    rta_iov.base = rta_iov.start;
+  else {
+    piov = &rta_iov.iov[rta_iov.niov - 2];
+    rta_iov.base = (char *) piov[0].iov_base + piov[0].iov_len +
+      piov[1].iov_len;
+  }
+}
+
+/***************************************************************
+ * rta_ad_int2(): - Add a 2 byte integer to the output buffer
  *
  * Input:        A **char to the buffer and the integer
  * Output:       void
  * Effects:      Increments the **char to point to the next
  *               available space in the buffer.
  ***************************************************************/
-static void
-ad_int2(char **pbuf, int inint)
+void
+rta_ad_int2(char **pbuf, int inint)
 {
   **pbuf = (char) ((inint >> 8) & 0x00FF);
   (*pbuf)++;
@@ -1745,15 +3263,15 @@ ad_int2(char **pbuf, int inint)
 }
 
 /***************************************************************
- * ad_int4(): - Add a 4 byte integer to the output buffer
+ * rta_ad_int4(): - Add a 4 byte integer to the output buffer
  *
  * Input:        A **char to the buffer and the integer
  * Output:       void
  * Effects:      Increments the **char to point to the next
  *               available space in the buffer.
  ***************************************************************/
-static void
-ad_int4(char **pbuf, int inint)
+void
+rta_ad_int4(char **pbuf, int inint)
 {
   **pbuf = (char) ((inint >> 24) & 0x00FF);
   (*pbuf)++;
@@ -1765,6 +3283,151 @@ ad_int4(char **pbuf, int inint)
   (*pbuf)++;
 }
 
+/***************************************************************
+ * ad_binary(): - Add a column value to the output buffer in the
+ *             binary format of Postgres.  This is the 4 byte
+ *             length followed by the value in network byte order.
+ *             Strings are the same in text and binary format so
+ *             we leave them to the caller.
+ *
+ * Input:        A **char to the buffer, the column definition,
+ *               and a pointer to the data in the row
+ * Output:       1 if the value was added, 0 if it is a string
+ * Effects:      Increments the **char to point to the next
+ *               available space in the buffer.
+ ***************************************************************/
+static int
+ad_binary(char **pbuf, RTA_COLDEF *pcol, void *pd)
+{
+  union {
+    float    f;
+    int      i;
+  } u4;                /* the bits of a float */
+  union {
+    double   d;
+    llong    l;
+  } u8;                /* the bits of a double */
+  llong    l;          /* a long value */
+
+  switch (pcol->type) {
+    case RTA_SHORT:
+      rta_ad_int4(pbuf, 2);
+      rta_ad_int2(pbuf, *((short *) pd));
+      break;
+    case RTA_UCHAR:
+      rta_ad_int4(pbuf, 2);
+      rta_ad_int2(pbuf, *((unsigned char *) pd));
+      break;
+    case RTA_INT:
+    case RTA_PTR:
+      rta_ad_int4(pbuf, 4);
+      rta_ad_int4(pbuf, *((int *) pd));
+      break;
+    case RTA_PINT:
+      rta_ad_int4(pbuf, 4);
+      rta_ad_int4(pbuf, **((int **) pd));
+      break;
+    case RTA_LONG:
+    case RTA_PLONG:
+      l = (pcol->type == RTA_LONG) ? *((llong *) pd) : **((llong **) pd);
+      rta_ad_int4(pbuf, 8);
+      rta_ad_int4(pbuf, (int) (l >> 32));
+      rta_ad_int4(pbuf, (int) l);
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+      u4.f = (pcol->type == RTA_FLOAT) ? *((float *) pd) : **((float **) pd);
+      rta_ad_int4(pbuf, 4);
+      rta_ad_int4(pbuf, u4.i);
+      break;
+    case RTA_DOUBLE:
+      u8.d = *((double *) pd);
+      rta_ad_int4(pbuf, 8);
+      rta_ad_int4(pbuf, (int) (u8.l >> 32));
+      rta_ad_int4(pbuf, (int) u8.l);
+      break;
+    default:
+      return (0);
+  }
+  return (1);
+}
+
+/***************************************************************
+ * ad_copy_text(): - Add the value of a column to a text COPY
+ * row.  Backslash, tab, newline, and carriage return in strings
+ * are escaped with a backslash as Postgres does.
+ *
+ * Input:        Pointer to the buffer pointer, the column, and
+ *               a pointer to the data in the row
+ * Output:       None
+ * Effects:      Increments the **char to point to the next
+ *               available space in the buffer.
+ ***************************************************************/
+static void
+ad_copy_text(char **pbuf, RTA_COLDEF *pcol, void *pd)
+{
+  char    *ps;         /* the string value */
+  int      count;      /* chars left in the string */
+
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      ps = (pcol->type == RTA_STR) ? (char *) pd : *(char **) pd;
+      for (count = pcol->length - 1; count > 0 && *ps; count--, ps++) {
+        switch (*ps) {
+          case '\\':
+            *(*pbuf)++ = '\\';
+            *(*pbuf)++ = '\\';
+            break;
+          case '\t':
+            *(*pbuf)++ = '\\';
+            *(*pbuf)++ = 't';
+            break;
+          case '\n':
+            *(*pbuf)++ = '\\';
+            *(*pbuf)++ = 'n';
+            break;
+          case '\r':
+            *(*pbuf)++ = '\\';
+            *(*pbuf)++ = 'r';
+            break;
+          default:
+            *(*pbuf)++ = *ps;
+            break;
+        }
+      }
+      break;
+    case RTA_INT:
+    case RTA_PTR:
+      *pbuf += sprintf(*pbuf, "%d", *((int *) pd));
+      break;
+    case RTA_PINT:
+      *pbuf += sprintf(*pbuf, "%d", **((int **) pd));
+      break;
+    case RTA_SHORT:
+      *pbuf += sprintf(*pbuf, "%d", *((short *) pd));
+      break;
+    case RTA_UCHAR:
+      *pbuf += sprintf(*pbuf, "%d", *((unsigned char *) pd));
+      break;
+    case RTA_LONG:
+      *pbuf += sprintf(*pbuf, "%lld", *((llong *) pd));
+      break;
+    case RTA_PLONG:
+      *pbuf += sprintf(*pbuf, "%lld", **((llong **) pd));
+      break;
+    case RTA_FLOAT:
+      *pbuf += sprintf(*pbuf, "%.10f", *((float *) pd));
+      break;
+    case RTA_PFLOAT:
+      *pbuf += sprintf(*pbuf, "%.10f", **((float **) pd));
+      break;
+    case RTA_DOUBLE:
+      *pbuf += sprintf(*pbuf, "%.10f", *((double *) pd));
+      break;
+  }
+}
+
 /***************************************************************
  * rta_log(): - Sends debug log messages to syslog() and stderr.
  *
@@ -20,6 +20,11 @@
 #define RTA_UPDATE    1
 #define RTA_INSERT    2
 #define RTA_DELETE    3
+#define RTA_COPYOUT   4
+#define RTA_COPYIN    5
+#define RTA_LISTEN    6
+#define RTA_UNLISTEN  7
+#define RTA_SET       8
 
     /* types of relations allowed in WHERE */
 #define RTA_EQ        0
@@ -42,25 +47,115 @@
 #define MX_LONG_STRING   (24)
 #define MX_FLOT_STRING   (24)
 
-    /* Max # strings in our private stack for yacc */
-#define MXPARSESTR   ((RTA_NCMDCOLS *2) + 4)
+    /* Values of rta_cmd.more after a SELECT */
+#define RTA_MORE_FULL    (1)   /* stopped, the output buffer is full */
+#define RTA_MORE_SUSPEND (2)   /* stopped at the Execute row count */
+#define RTA_MORE_COPYIN  (3)   /* waiting for COPY FROM STDIN data */
+#define RTA_MORE_YIELD   (4)   /* stopped, the budget of rta_budget() */
+
+    /* Rows scanned between clock reads for rta_budget() and for
+       statement_timeout */
+#define RTA_NCHKCLOCK    (32)
+
+    /* Rows in a block of a SELECT on a table without an iterator.
+       The WHERE scans give one bit per row in an unsigned long long. */
+#define RTA_SCANBLK      (64)
+
+    /* The settings of SET, as bits of RtaSession.sets */
+#define RTA_SET_TIMEOUT  (1)   /* statement_timeout */
+#define RTA_SET_MAXSCAN  (2)   /* max_rows_scanned */
+
+    /* Shortest string sent by reference in rta_session_dbbatchv() */
+#define RTA_MNIOVREF     (64)
+
+    /* Longest binary COPY header extension we will skip over */
+#define RTA_MXCOPYEXT    (1024)
+
+    /* Postgres type OIDs used to describe parameters and columns */
+#define RTA_OID_INT8     (20)
+#define RTA_OID_INT2     (21)
+#define RTA_OID_INT4     (23)
+#define RTA_OID_TEXT     (25)
+#define RTA_OID_FLOAT4  (700)
+#define RTA_OID_FLOAT8  (701)
+
+/** ************************************************************
+ * A Sql_Guard holds the limits of the statement a session is
+ * running, from SET or the rta_limit table.  The row loops of
+ * do_sql.c count rows in it and stop the statement at a limit.
+ **************************************************************/
+struct Sql_Guard
+{
+  int          timeout;    /* statement_timeout in ms, 0 for none */
+  int          maxscan;    /* max_rows_scanned, 0 for no limit */
+  llong        deadline;   /* monotonic usecs to stop at, 0=none */
+  llong        nscan;      /* rows scanned by the statement */
+};
+
+/** ************************************************************
+ * A Sql_Val is one column or one WHERE phrase of a command:
+ * the name, the column it resolves to, the relation if in a
+ * WHERE, and the value as text and converted to the column
+ * data type.  'parm' is n if the value is the parameter $n in
+ * a prepared statement, and zero if the value is a literal.
+ * 'test' is set by the verify of a WHERE phrase to a function
+ * for its column type and relation.  It is given a pointer to
+ * the column data in a row and returns 1 if the row passes.
+ * 'scan' is set if the table has no iterator and the column is
+ * a number with no read callback.  It tests a block of rows at
+ * once.  See scan.c.
+ **************************************************************/
+struct Sql_Val;
+typedef unsigned long long (*ScanFn) (char *, int, int, struct Sql_Val *);
+
+struct Sql_Val
+{
+  char        *name;       /* column name */
+  RTA_COLDEF  *pcol;       /* pointer to column in COLDEFS */
+  int          rel;        /* relation (EQ, GT, ...) if in WHERE */
+  char        *val;        /* text of the value, or NULL */
+  int          parm;       /* n if the value is $n, else 0 */
+  int          fmt;        /* result format, 0=text, 1=binary */
+  int          ival;       /* integer value */
+  llong        lval;       /* long value */
+  float        fval;       /* float value */
+  double       dval;       /* double value */
+  int        (*test)(void *, struct Sql_Val *); /* WHERE test */
+  ScanFn       scan;       /* WHERE test of a block, or NULL */
+};
+
+/** ************************************************************
+ * A row found with the index of a column, or the next row of
+ * the walk of an ORDER BY.  See index.c.
+ **************************************************************/
+struct Sql_Row
+{
+  void        *pr;         /* the row */
+  int          rx;         /* the row index */
+};
 
 /** ************************************************************
  * This structure contains/encodes the parsed SQL command from
  * one of the UI or client interfaces.
- * This structure is filled in by the yacc parser.  If the parse
- * is successful, the completed structure is passed to do_sql()
- * for execution.
+ * This structure is filled in by the parser.  If the parse
+ * is successful, the completed structure is checked by
+ * rta_verify_sql() and run by rta_exec_sql().
  *
  * The 'command' is just the type of SQL command.
- * The 'cols' field is a list of names from the "SELECT cols"
- * or from the "UPDATE col=X [,...]".
- * The 'vals' field is a list of the strings "X" in an UPDATE.
+ * The 'cols' field is a list of the columns from the "SELECT
+ * cols" or from the "UPDATE col=X [,...]", with the "X" of an
+ * UPDATE or INSERT as their values.
  * The 'tbl' field has the name of the table in use.
- * The 'whrcols' and 'whrvals' fields are similar to the cols
- * and vals fields.  
- * Note that cols, vals, whrcols, and whrvals in the structure
- * below point to alloc()'ed memory and must be freed when done.
+ * The 'whr' field is the list of WHERE phrases.
+ * The 'order' field is the column of an ORDER BY, or NULL.
+ *   The lists are sized to the command.  They grow as needed
+ * with rta_cmd_grow() and are reused by the next command, so a
+ * reset just sets the counts to zero.  The lists only grow, so
+ * a plan made from the structure always fits back into it.
+ * The names and values point into the parser's string area,
+ * which is reused by the next parse, unless 'plan' is set.  In
+ * that case the strings belong to the plan that was loaded into
+ * the structure.
  **************************************************************/
 struct Sql_Cmd
 {
@@ -70,22 +165,16 @@ struct Sql_Cmd
   RTA_TBLDEF  *ptbl;       /* pointer to table in TBLDEFS */
   int          itbl;       /* Index of table in Tbl */
   int          ncols;      /* count of columns to display/update */
-  char        *cols[RTA_NCMDCOLS]; /* col to display/update */
-  RTA_COLDEF  *pcol[RTA_NCMDCOLS]; /* pointers to cols in COLDEFS */
-  char        *updvals[RTA_NCMDCOLS]; /* values for column updates */
-  int          updints[RTA_NCMDCOLS]; /* integer values for updates */
-  llong        updlngs[RTA_NCMDCOLS]; /* long values for updates */
-  float        updflot[RTA_NCMDCOLS]; /* float values for updates */
-  double       upddbl[RTA_NCMDCOLS];  /* double values for updates */
+  struct Sql_Val *cols;    /* the columns and update values */
+  int          mxcols;     /* size of the cols list */
   int          nwhrcols;   /* count of columns in where clause */
-  char        *whrcols[RTA_NCMDCOLS]; /* cols in where */
-  int          whrrel[RTA_NCMDCOLS];  /* relation (EQ, GT...) in where */
-  RTA_COLDEF  *pwhr[RTA_NCMDCOLS];    /* pointers to Wcols in COLDEFS */
-  char        *whrvals[RTA_NCMDCOLS]; /* values in the where clause */
-  int          whrints[RTA_NCMDCOLS]; /* integer values of whrvals[] */
-  llong        whrlngs[RTA_NCMDCOLS]; /* long values of whrvals[] */
-  float        whrflot[RTA_NCMDCOLS]; /* float values of whrvals[] */
-  double       whrdbl[RTA_NCMDCOLS];  /* double values of whrvals[] */
+  struct Sql_Val *whr;     /* the WHERE clause */
+  int          mxwhr;      /* size of the whr list */
+  int          nparams;    /* highest $n seen in the command */
+  int          copyfmt;    /* COPY format, 0=text, 1=binary */
+  char        *order;      /* the ORDER BY column, or NULL */
+  RTA_COLDEF  *porder;     /* pointer to it in COLDEFS */
+  int          desc;       /* ==1 if ORDER BY ... DESC */
   int          limit;      /* max num rows to output, 0=no_limit */
   int          offset;     /* scan past this # rows before output */
   char        *out;        /* put command response here */
@@ -94,6 +183,131 @@ struct Sql_Cmd
   int          nerrout;    /* ==nout at start. But for err msgs */
   int          err;        /* set =1 if error in SQL parse */
   int          nlineout;   /* #bytes in SELECT row response */
+  struct Sql_Plan *plan;   /* plan that owns the strings, or NULL */
+  void        *pr;         /* row to resume a SELECT at, or NULL */
+  int          rx;         /* row index of pr */
+  int          npr;        /* rows sent so far, for LIMIT */
+  int          maxrows;    /* rows left in this Execute, 0=all */
+  int          gen;        /* table generation when pr was saved */
+  struct Sql_Val okey;     /* ORDER BY value of pr, see index.c */
+  int          canmore;    /* ==1 if a SELECT may stop when full */
+  volatile int *cancel;    /* session's cancel flag, or NULL */
+  struct Sql_Guard *guard; /* session's limits, or NULL */
+  int          more;       /* RTA_MORE_* if the SELECT stopped */
+};
+
+/** ************************************************************
+ * A Sql_Plan is a verified command saved for later execution.
+ * It has everything the do_* routines need: the table and column
+ * pointers, and the values already converted to the column data
+ * type.  Prepared statements and bound portals are both plans.
+ * A plan is a single block of memory; free it with free().
+ **************************************************************/
+struct Sql_Plan
+{
+  char        *sqlcmd;     /* text of SQL command */
+  int          command;    /* RTA_SELECT, UPDATE, ... */
+  char        *tbl;        /* the table in question */
+  RTA_TBLDEF  *ptbl;       /* pointer to table in TBLDEFS */
+  int          itbl;       /* Index of table in Tbl */
+  int          limit;      /* max num rows to output */
+  int          offset;     /* scan past this # rows before output */
+  int          nlineout;   /* #bytes in SELECT row response */
+  int          nparams;    /* number of $n parameters */
+  int          copyfmt;    /* COPY format, 0=text, 1=binary */
+  char        *order;      /* the ORDER BY column, or NULL */
+  RTA_COLDEF  *porder;     /* pointer to it in COLDEFS */
+  int          desc;       /* ==1 if ORDER BY ... DESC */
+  int          ncols;      /* count of columns to display/update */
+  struct Sql_Val *cols;    /* the columns and update values */
+  int          nwhrcols;   /* count of columns in where clause */
+  struct Sql_Val *whr;     /* the WHERE clause */
+  void        *pr;         /* row to resume a SELECT at, or NULL */
+  int          rx;         /* row index of pr */
+  int          npr;        /* rows sent so far, for LIMIT */
+  int          maxrows;    /* rows left in this Execute, 0=all */
+  int          gen;        /* table generation when pr was saved */
+  struct Sql_Val okey;     /* ORDER BY value of pr */
+};
+
+/** ************************************************************
+ * A session holds the per-connection state of a Postgres client:
+ * the prepared statements and portals of the extended query
+ * protocol, and a SELECT that stopped when the output buffer
+ * filled.  RTA_SESSION in librta.h is an opaque handle to it.
+ **************************************************************/
+struct Sql_Stmt
+{
+  struct Sql_Stmt *next;   /* next statement or portal in list */
+  char        *name;       /* name given by the client */
+  struct Sql_Plan *plan;   /* the plan, or NULL if empty query */
+  int          done;       /* ==1 if a portal sent all its rows */
+};
+
+/** ************************************************************
+ * A session that has run LISTEN keeps the channels it listens
+ * on and the notifications not yet sent to it.  Each is a single
+ * block of memory with its strings after the structure.
+ **************************************************************/
+struct Sql_Chan
+{
+  struct Sql_Chan *next;   /* next channel of the session */
+  char        *name;       /* the channel, usually a table name */
+};
+
+struct Sql_Note
+{
+  struct Sql_Note *next;   /* next notification to send */
+  char        *chan;       /* the channel */
+  char        *payload;    /* the payload, "" if none */
+  int          pid;        /* process ID of the sender, or 0 */
+};
+
+struct RtaSession
+{
+  struct Sql_Stmt *stmts;  /* prepared statements */
+  int          nstmts;     /* number of prepared statements */
+  struct Sql_Stmt *portals; /* bound portals */
+  int          xerr;       /* ==1 to skip messages until Sync */
+  struct Sql_Stmt *query;  /* stopped SELECT of a 'Q' message */
+  char        *rest;       /* SQL after the stopped SELECT */
+  int          nrest;      /* number of bytes in rest */
+  struct Sql_Stmt *more;   /* portal or query with rows pending */
+  int          yield;      /* ==1 if 'more' stopped on the budget */
+  struct Sql_Stmt *copy;   /* portal or query in COPY FROM STDIN */
+  int          copyhdr;    /* COPY data state, see rta_copy_in() */
+  char        *cbuf;       /* partial row of COPY data */
+  int          ncbuf;      /* number of bytes in cbuf */
+  int          szcbuf;     /* size of cbuf */
+  struct Sql_Chan *chans;  /* channels of LISTEN */
+  struct Sql_Note *notes;  /* notifications to send, oldest first */
+  int          nnotes;     /* number of notes */
+  struct RtaSession *lnext; /* next session that has chans */
+  int          pid;        /* BackendKeyData process ID, 0 if none */
+  int          key;        /* BackendKeyData secret key */
+  volatile int cancel;     /* ==1 after a CancelRequest */
+  struct RtaSession *knext; /* next session that has a key */
+  struct RtaSession *kprev; /* previous session that has a key */
+  int          sets;       /* RTA_SET_* bits of the settings made */
+  int          timeout;    /* statement_timeout if set, in ms */
+  int          maxscan;    /* max_rows_scanned if set */
+  struct Sql_Guard guard;  /* limits of the running statement */
+};
+
+/** ************************************************************
+ * The iovec list of rta_session_dbbatchv().  Entries alternate
+ * between a part of the output buffer and a string in a row.
+ * The string fills a hole of the same size in the buffer that
+ * starts where the part before it ends.  'iov' is NULL when the
+ * caller wants all output in the buffer.
+ **************************************************************/
+struct Sql_Iov
+{
+  struct iovec *iov;       /* the caller's list, or NULL */
+  int          niov;       /* entries used */
+  int          mxiov;      /* size of the list */
+  char        *start;      /* start of the output buffer */
+  char        *base;       /* start of output not yet in the list */
 };
 
 /* Define the debug config structure */
@@ -109,6 +323,23 @@ struct RtaDbg
   char     ident[RTA_MXDBGIDENT]; /* ident string for syslog() */
 };
 
+/* Define the structure of the default limits of a statement */
+struct RtaLimit
+{
+  int      timeout;    /* statement_timeout in ms, 0 for none */
+  int      maxscan;    /* max_rows_scanned, 0 for no limit */
+};
+
+/* Define the structure of the plan cache settings and counts */
+struct RtaPcache
+{
+  int      size;       /* max # plans, 0 for no cache */
+  int      nplans;     /* # plans in the cache */
+  llong    nhit;       /* count of commands found */
+  llong    nmiss;      /* count of commands not found */
+  float    hitrate;    /* percent of lookups that were hits */
+};
+
 /* Define the stats structure */
 struct RtaStat
 {
@@ -123,8 +354,49 @@ struct RtaStat
 };
 
 /* Forward references */
-void     rta_do_sql(char *, int *);
+void     rta_dosql_init(void);
+int      rta_cmd_grow(int, int);
+void     rta_verify_sql(char *, int *);
+void     rta_run_sql(char *, int *);
+void     rta_exec_sql(char *, int *);
+int      rta_send_row_description(char *, int *);
 void     rta_send_error(char *, int, char *, char *);
 void     rta_log(char *, int, char *, ...);
+void     rta_ad_str(char **, int, char *, int);
+int      rta_ad_ref(char **, char *, int);
+void     rta_iov_trim(char *);
+void     rta_ad_int2(char **, int);
+void     rta_ad_int4(char **, int);
+int      rta_type_oid(int);
+struct Sql_Plan *rta_plan_save(void);
+void     rta_plan_load(struct Sql_Plan *);
+struct Sql_Plan *rta_plan_bind(struct Sql_Plan *, char **);
+struct Sql_Plan *rta_pcache_get(char *, int, unsigned int);
+void     rta_pcache_put(char *, int, unsigned int);
+void     rta_pcache_flush(void);
+ScanFn   rta_scan_fn(int);
+unsigned long long rta_scan_block(void *, int);
+int      rta_index_find(struct Sql_Row **, int);
+int      rta_index_first(struct Sql_Row *, int);
+int      rta_index_next(struct Sql_Row *);
+int      rta_index_mark(void);
+void     rta_index_row(int, void *);
+void     rta_index_stale(int);
+int      rta_SQL_prepare(char *, int, char *, int *);
+int      rta_SQL_exec(char *, int, char *, int *, int *);
+int      rta_copy_in(char *, int, int *);
+void     rta_copy_done(char *, int *);
+int      rta_ext_message(RTA_SESSION *, char, char *, int, char *, int *);
+int      rta_ext_query(RTA_SESSION *, char *, int, char *, int *);
+int      rta_ext_resume(RTA_SESSION *, char *, int *);
+int      rta_ext_rowsize(RTA_SESSION *);
+int      rta_ext_busy(RTA_SESSION *);
+int      rta_ext_listen(char *, int);
+int      rta_ext_notify(RTA_SESSION *, char *, int *);
+unsigned rta_ext_nqueued(void);
+void     rta_ext_keys(RTA_SESSION *, int *, int *);
+void     rta_ext_cancel(int, int);
+void     rta_ext_set(int, int);
+void     rta_guard_arm(void);
 
 #endif
@@ -0,0 +1,1564 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * index.c:  The indexes of RTA_INDEXED, RTA_ORDERED, and
+ * RTA_BITMAP columns.
+ *
+ *   A column with the RTA_INDEXED flag has a hash table from
+ * the value of the column to the rows that have it.  A SELECT,
+ * UPDATE, or DELETE with a WHERE phrase of the form 'col = val'
+ * on such a column visits only the rows with that value instead
+ * of every row in the table.
+ *   A column with the RTA_ORDERED flag has a skip list of its
+ * rows in the order of their values, with ties in row order.
+ * WHERE phrases of the form 'col > val', 'col <= val', and so
+ * on give the first and last rows of a range, and a SELECT
+ * with ORDER BY col walks the list forward or back instead of
+ * sorting the rows.  Each entry has its next and previous
+ * entry at each of its levels, so a row can be taken out of
+ * the list without a search.  The list is built with the
+ * levels of a perfect skip list; a row that moves keeps its
+ * level.
+ *   A uchar or short column with the RTA_BITMAP flag has a bitmap
+ * for each of its values, with bit n set if row n has the value.
+ * The rows that can pass every WHERE phrase on such columns are
+ * found a word of 64 rows at a time, by OR-ing the bitmaps of
+ * the values that pass each phrase and AND-ing the phrases,
+ * before any row is looked at.  A column with more than
+ * IX_MXBMAP values is not looked up with its bitmaps.
+ *   An index is built the first time it is used.  Each entry has
+ * the row pointer, the row index, and the hash of the value and
+ * is on two chains: one by the hash of the value and one by the
+ * row pointer.  An UPDATE moves the rows it changes to their new
+ * chains, to their new place in the skip list, or to the bitmap
+ * of their new value.  An INSERT or
+ * DELETE changes the row indexes of the rows after it, so it
+ * marks the index stale and the next use builds it again.  The
+ * same is done for a table without an iterator whose address or
+ * row count has changed.  Programs that change the table
+ * themselves call rta_index_touch().
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <syslog.h>
+#include "do_sql.h"
+
+extern RTA_TBLDEF *rta_Tbl[];
+extern int rta_Ntbl;
+extern struct Sql_Cmd rta_cmd;
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+
+    /* Most levels in a skip list.  Enough for 2^24 rows. */
+#define IX_MXLVL       (24)
+
+    /* The links of a skip list entry, or of the head of the list
+       for an entry of -1.  The head's next is the first entry of
+       a level and its previous is the last. */
+#define IX_LINKS(pix, ex)    (((ex) < 0) ? 0 : (pix)->ent[ex].link)
+#define IX_NEXT(pix, ex, l)  ((pix)->link[IX_LINKS(pix, ex) + 2 * (l)])
+#define IX_PREV(pix, ex, l)  ((pix)->link[IX_LINKS(pix, ex) + 2 * (l) + 1])
+
+    /* The kinds of index */
+#define IX_HASH        (0)
+#define IX_ORDER       (1)
+#define IX_BITMAP      (2)
+
+    /* Most values of a column with bitmaps */
+#define IX_MXBMAP      (256)
+
+    /* # values a uchar or short column can have */
+#define IX_NVAL(pcol)  (((pcol)->type == RTA_UCHAR) ? 256 : 65536)
+
+/* One row in an index */
+struct IxEnt
+{
+  void        *pr;         /* the row */
+  int          rx;         /* the row index */
+  unsigned int hash;       /* hash of the value, or its bitmap */
+  int          knext;      /* next entry on the value chain, or -1 */
+  int          kprev;      /* previous entry on the value chain, or -1 */
+  int          pnext;      /* next entry on the row chain, or -1 */
+  int          lvl;        /* # skip list levels of the entry */
+  int          link;       /* its skip list links in RtaIndex.link */
+};
+
+/* The value of a row while an ordered index is sorted */
+struct IxKey
+{
+  union
+  {
+    llong      n;          /* an integer value */
+    double     d;          /* a float or double value */
+    char      *s;          /* a string value */
+  } v;
+  int          ex;         /* the entry of the row */
+};
+
+/* The index of one column */
+struct RtaIndex
+{
+  struct RtaIndex *next;   /* next index on the same table */
+  RTA_COLDEF  *pcol;       /* the indexed column */
+  int          kind;       /* IX_HASH, IX_ORDER, or IX_BITMAP */
+  int          stale;      /* ==1 if it must be built again */
+  void        *address;    /* table address when built */
+  int          nrows;      /* table row count when built */
+  struct IxEnt *ent;       /* the rows, by row index */
+  int          nent;       /* # rows in ent */
+  int          ment;       /* size of ent */
+  int         *khead;      /* value chains */
+  int         *phead;      /* row chains */
+  int          nbkt;       /* # chains of each kind, a power of 2 */
+  int         *link;       /* skip list links, next and previous */
+  int          mlink;      /* size of link */
+  int         *bslot;      /* bitmap of each value, or -1 */
+  int          bval[IX_MXBMAP]; /* value of each bitmap */
+  int          nbmap;      /* # bitmaps, -1 if too many values */
+  unsigned long long *bits; /* the bitmaps, nwrd words each */
+  int          nwrd;       /* # words in a bitmap */
+  int          mbits;      /* size of bits in words */
+};
+
+/* Forward references */
+static struct RtaIndex *ix_get(int, RTA_COLDEF *, int);
+static int      ix_build(RTA_TBLDEF *, struct RtaIndex *);
+static int      ix_sort(struct RtaIndex *);
+static int      ix_bitmaps(struct RtaIndex *);
+static int      ix_bslot(struct RtaIndex *, int);
+static int      ix_entry(struct RtaIndex *, void *);
+static void     ix_rekey(struct RtaIndex *, void *);
+static void     ix_move(struct RtaIndex *, int);
+static void     ix_rebit(struct RtaIndex *, int);
+static int      ix_bitmap(struct Sql_Row **, int);
+static int      ix_bpass(struct RtaIndex *, struct Sql_Val *, int *);
+static int      ix_range(struct Sql_Row **);
+static int      ix_start(struct RtaIndex *, int);
+static int      ix_step(struct RtaIndex *, int, int);
+static int      ix_seek(struct RtaIndex *, struct Sql_Val *, int);
+static int      ix_inside(struct RtaIndex *, int, int);
+static int      ix_resume(struct RtaIndex *, int, int);
+static int      ix_side(struct Sql_Val *, void *);
+static int      ix_cmp_ent(struct RtaIndex *, int, int);
+static int      ix_cmp_okey(struct RtaIndex *, int);
+static int      ix_cmp_knum(const void *, const void *);
+static int      ix_cmp_kdbl(const void *, const void *);
+static int      ix_cmp_kstr(const void *, const void *);
+static int      ix_cmp_dbl(double, double);
+static llong    ix_num(RTA_COLDEF *, void *);
+static double   ix_dbl(RTA_COLDEF *, void *);
+static char    *ix_str(RTA_COLDEF *, void *);
+static int      ix_found(int, struct IxEnt *);
+static unsigned int ix_hash_row(RTA_COLDEF *, void *);
+static unsigned int ix_hash_val(struct Sql_Val *);
+static unsigned int ix_hash_str(char *, int);
+static unsigned int ix_hash_num(llong);
+static unsigned int ix_hash_ptr(void *);
+static int      ix_cmp_rx(const void *, const void *);
+
+/* The indexes of each table */
+static struct RtaIndex *TblIx[RTA_MX_TBL];
+
+/* The rows found by the last rta_index_find() */
+static struct Sql_Row *Found;
+static int      MxFound;
+
+/* The rows that pass the bitmap phrases of the last
+   rta_index_find() */
+static unsigned long long *Bits;
+static int      MxBits;
+
+/* The walk of an ORDER BY */
+static struct RtaIndex *Walk;
+static int      WalkEx;
+
+/* The string value saved by rta_index_mark() */
+static char    *Mark;
+static int      MxMark;
+
+/* Length of the string column being sorted */
+static int      SortLen;
+
+
+/***************************************************************
+ * rta_index_find(): - Find the rows of rta_cmd's table that can
+ * pass its WHERE clause using the index of an 'col = val'
+ * phrase, or else the bitmaps of the columns that have them,
+ * or else the ordered index of a column with range phrases.
+ * A range may have many rows, so a SELECT resumed at
+ * rta_cmd.pr scans from there instead of finding them again on
+ * every call.  The rows are in table order.  Each one must still be
+ * tested against the whole WHERE clause.  A column with a read
+ * callback is not looked up since the callback may change it.
+ *
+ * Input:        Where to put a pointer to the rows, and 1 if rows
+ *               were added or deleted since the SELECT resumed at
+ *               rta_cmd.pr stopped
+ * Output:       The number of rows, or -1 if no index can be used
+ * Effects:      The index may be built
+ ***************************************************************/
+int
+rta_index_find(struct Sql_Row **prows, int moved)
+{
+  struct RtaIndex *pix;    /* the index to use */
+  struct Sql_Val *pw;      /* the WHERE phrase it is for */
+  struct IxEnt *pe;        /* an entry on the value chain */
+  unsigned int hash;       /* hash of the value */
+  int      nfound = 0;     /* # rows found */
+  int      wx;             /* Where clause indeX */
+  int      ex;             /* Entry indeX */
+
+  pix = (struct RtaIndex *) 0;
+  for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (pw->rel == RTA_EQ && (pw->pcol->flags & RTA_INDEXED) &&
+        !pw->pcol->readcb) {
+      pix = ix_get(rta_cmd.itbl, pw->pcol, IX_HASH);
+      if (pix)
+        break;
+    }
+  }
+  if (pix == (struct RtaIndex *) 0) {
+    nfound = ix_bitmap(prows, moved);
+    return ((nfound >= 0 || rta_cmd.pr) ? nfound : ix_range(prows));
+  }
+
+  hash = ix_hash_val(pw);
+  for (ex = pix->khead[hash & (pix->nbkt - 1)]; ex >= 0; ex = pe->knext) {
+    pe = &(pix->ent[ex]);
+    if (pe->hash != hash ||
+        !(pw->test) ((char *) pe->pr + pw->pcol->offset, pw))
+      continue;
+    if (ix_found(nfound, pe))
+      return (-1);
+    nfound++;
+  }
+  if (nfound > 1)
+    qsort(Found, nfound, sizeof(struct Sql_Row), ix_cmp_rx);
+  *prows = Found;
+  return (nfound);
+}
+
+/***************************************************************
+ * rta_index_first(): - Start the walk of a SELECT with ORDER BY
+ * over the ordered index of its column.  The walk starts at the
+ * first row in the range of the WHERE phrases on the column, or
+ * where a stopped SELECT left off.  That place is found again by
+ * the value and row index saved by rta_index_mark().  If rows
+ * were added or deleted since, the row indexes have changed, and
+ * among rows of the saved value the place is the row at rta_cmd.pr.
+ * If no row has that value the walk goes on from the next value.
+ * If rows have the value but none is at rta_cmd.pr, the place
+ * is lost.
+ *
+ * Input:        Where to put the first row, and 1 if rows were
+ *               added or deleted since the SELECT stopped
+ * Output:       1 if there is a row, 0 if none, -1 if the index
+ *               could not be built, -2 if the place is lost
+ * Effects:      The index may be built
+ ***************************************************************/
+int
+rta_index_first(struct Sql_Row *prow, int moved)
+{
+  Walk = ix_get(rta_cmd.itbl, rta_cmd.porder, IX_ORDER);
+  if (Walk == (struct RtaIndex *) 0)
+    return (-1);
+  if (rta_cmd.pr)
+    WalkEx = ix_resume(Walk, rta_cmd.desc, moved);
+  else
+    WalkEx = ix_start(Walk, rta_cmd.desc);
+  if (WalkEx < 0)
+    return ((WalkEx == -2) ? -2 : 0);
+  prow->pr = Walk->ent[WalkEx].pr;
+  prow->rx = Walk->ent[WalkEx].rx;
+  return (1);
+}
+
+/***************************************************************
+ * rta_index_next(): - Give the next row of the walk started by
+ * rta_index_first().
+ *
+ * Input:        Where to put the row
+ * Output:       1 if there is a row, 0 at the end of the range
+ * Effects:      None
+ ***************************************************************/
+int
+rta_index_next(struct Sql_Row *prow)
+{
+  if (WalkEx >= 0)
+    WalkEx = ix_step(Walk, WalkEx, rta_cmd.desc);
+  if (WalkEx < 0)
+    return (0);
+  prow->pr = Walk->ent[WalkEx].pr;
+  prow->rx = Walk->ent[WalkEx].rx;
+  return (1);
+}
+
+/***************************************************************
+ * rta_index_mark(): - Save in rta_cmd.okey the value of the
+ * ORDER BY column in the row the walk stopped at.  The row may
+ * be changed or deleted before the SELECT resumes, so the value
+ * is copied.  A string goes in a buffer here until the stopped
+ * SELECT is saved in a plan.
+ *
+ * Input:        None
+ * Output:       0 on success, -1 if memory is short
+ * Effects:      rta_cmd.okey
+ ***************************************************************/
+int
+rta_index_mark()
+{
+  RTA_COLDEF *pcol;        /* the ORDER BY column */
+  char    *newm;           /* the buffer when it grows */
+  void    *pr;             /* the row the walk stopped at */
+
+  pcol = Walk->pcol;
+  pr = Walk->ent[WalkEx].pr;
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      if (pcol->length + 1 > MxMark) {
+        newm = realloc(Mark, pcol->length + 1);
+        if (newm == (char *) 0) {
+          rta_stat.nsyserr++;
+          if (rta_dbg.syserr)
+            rta_log(LOC, Er_No_Mem);
+          return (-1);
+        }
+        Mark = newm;
+        MxMark = pcol->length + 1;
+      }
+      strncpy(Mark, ix_str(pcol, pr), pcol->length);
+      Mark[pcol->length] = (char) 0;
+      rta_cmd.okey.val = Mark;
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      rta_cmd.okey.dval = ix_dbl(pcol, pr);
+      break;
+    default:
+      rta_cmd.okey.lval = ix_num(pcol, pr);
+      break;
+  }
+  return (0);
+}
+
+/***************************************************************
+ * rta_index_row(): - Move a row to the chains of its values in
+ * the indexes of a table.  Called after an UPDATE of the row.
+ *
+ * Input:        The table index and the row
+ * Output:       None
+ * Effects:      The indexes of the table
+ ***************************************************************/
+void
+rta_index_row(int itbl, void *pr)
+{
+  struct RtaIndex *pix;    /* an index on the table */
+
+  for (pix = TblIx[itbl]; pix; pix = pix->next) {
+    if (!pix->stale)
+      ix_rekey(pix, pr);
+  }
+}
+
+/***************************************************************
+ * rta_index_stale(): - Mark the indexes of a table to be built
+ * again.  Called after rows are inserted or deleted.
+ *
+ * Input:        The table index
+ * Output:       None
+ * Effects:      The indexes of the table
+ ***************************************************************/
+void
+rta_index_stale(int itbl)
+{
+  struct RtaIndex *pix;    /* an index on the table */
+
+  for (pix = TblIx[itbl]; pix; pix = pix->next)
+    pix->stale = 1;
+}
+
+/***************************************************************
+ * rta_index_touch(): - Tell the indexes of a table that the
+ * program has changed a row, or the rows, of the table.
+ *
+ * Input:        The table and the row, or NULL if rows were
+ *               added or removed
+ * Output:       RTA_SUCCESS, or RTA_ERROR if the table is not
+ *               in the DB
+ * Effects:      The indexes of the table
+ ***************************************************************/
+int
+rta_index_touch(RTA_TBLDEF *ptbl, void *pr)
+{
+  int      itbl;           /* the table index */
+
+  for (itbl = 0; itbl < rta_Ntbl; itbl++) {
+    if (rta_Tbl[itbl] == ptbl)
+      break;
+  }
+  if (itbl == rta_Ntbl)
+    return (RTA_ERROR);
+
+  if (pr)
+    rta_index_row(itbl, pr);
+  else
+    rta_index_stale(itbl);
+  return (RTA_SUCCESS);
+}
+
+/***************************************************************
+ * ix_get(): - Give the hash, ordered, or bitmap index of a
+ * column, ready to use.  It is created or built again as needed.
+ *
+ * Input:        The table index, the column, and the kind of
+ *               index: IX_HASH, IX_ORDER, or IX_BITMAP
+ * Output:       The index, or NULL if memory is short
+ * Effects:      The indexes of the table
+ ***************************************************************/
+static struct RtaIndex *
+ix_get(int itbl, RTA_COLDEF *pcol, int kind)
+{
+  RTA_TBLDEF *ptbl;        /* the table */
+  struct RtaIndex *pix;    /* the index of the column */
+
+  ptbl = rta_Tbl[itbl];
+  for (pix = TblIx[itbl]; pix; pix = pix->next) {
+    if (pix->pcol == pcol && pix->kind == kind)
+      break;
+  }
+  if (pix == (struct RtaIndex *) 0) {
+    pix = calloc(1, sizeof(struct RtaIndex));
+    if (pix == (struct RtaIndex *) 0) {
+      rta_stat.nsyserr++;
+      if (rta_dbg.syserr)
+        rta_log(LOC, Er_No_Mem);
+      return ((struct RtaIndex *) 0);
+    }
+    pix->pcol = pcol;
+    pix->kind = kind;
+    pix->stale = 1;
+    pix->next = TblIx[itbl];
+    TblIx[itbl] = pix;
+  }
+
+  if (!ptbl->iterator &&
+      (pix->address != ptbl->address || pix->nrows != ptbl->nrows))
+    pix->stale = 1;
+  if (pix->stale && ix_build(ptbl, pix) != RTA_SUCCESS)
+    return ((struct RtaIndex *) 0);
+  return (pix);
+}
+
+/***************************************************************
+ * ix_build(): - Put every row of the table in the index.
+ *
+ * Input:        The table and its index
+ * Output:       RTA_SUCCESS, or RTA_ERROR if memory is short
+ * Effects:      The index is no longer stale
+ ***************************************************************/
+static int
+ix_build(RTA_TBLDEF *ptbl, struct RtaIndex *pix)
+{
+  struct IxEnt *newent;    /* the entries when they grow */
+  struct IxEnt *pe;        /* the entry of a row */
+  int     *newhead;        /* the chains when they grow */
+  int      newbkt;         /* # chains needed */
+  void    *pr;             /* a row */
+  int      rx;             /* its row index */
+  int      b;              /* a chain */
+
+  pix->nent = 0;
+  rx = 0;
+  pr = (ptbl->iterator) ?
+    (ptbl->iterator) ((void *) NULL, ptbl->it_info, 0) : ptbl->address;
+  while (pr && (ptbl->iterator || rx < ptbl->nrows)) {
+    if (pix->nent == pix->ment) {
+      newent = realloc(pix->ent, (pix->ment + 64) * 2 * sizeof(struct IxEnt));
+      if (newent == (struct IxEnt *) 0)
+        goto nomem;
+      pix->ent = newent;
+      pix->ment = (pix->ment + 64) * 2;
+    }
+    pe = &(pix->ent[pix->nent++]);
+    pe->pr = pr;
+    pe->rx = rx;
+    pe->hash = (pix->kind == IX_HASH) ? ix_hash_row(pix->pcol, pr) : 0;
+    rx++;
+    pr = (ptbl->iterator) ? (ptbl->iterator) (pr, ptbl->it_info, rx) :
+      (char *) ptbl->address + (rx * ptbl->rowlen);
+  }
+
+  /* Keep the chains short.  There are at least twice as many as
+     rows and they only grow. */
+  for (newbkt = (pix->nbkt) ? pix->nbkt : 64; newbkt < 2 * pix->nent;)
+    newbkt *= 2;
+  if (newbkt != pix->nbkt) {
+    newhead = realloc(pix->khead, newbkt * sizeof(int));
+    if (newhead == (int *) 0)
+      goto nomem;
+    pix->khead = newhead;
+    newhead = realloc(pix->phead, newbkt * sizeof(int));
+    if (newhead == (int *) 0)
+      goto nomem;
+    pix->phead = newhead;
+    pix->nbkt = newbkt;
+  }
+
+  /* Ordered and bitmap indexes use only the row chains */
+  memset(pix->khead, -1, pix->nbkt * sizeof(int));
+  memset(pix->phead, -1, pix->nbkt * sizeof(int));
+  for (rx = pix->nent - 1; rx >= 0; rx--) {
+    pe = &(pix->ent[rx]);
+    if (pix->kind == IX_HASH) {
+      b = pe->hash & (pix->nbkt - 1);
+      pe->kprev = -1;
+      pe->knext = pix->khead[b];
+      if (pe->knext >= 0)
+        pix->ent[pe->knext].kprev = rx;
+      pix->khead[b] = rx;
+    }
+    b = ix_hash_ptr(pe->pr) & (pix->nbkt - 1);
+    pe->pnext = pix->phead[b];
+    pix->phead[b] = rx;
+  }
+  if (pix->kind == IX_ORDER && ix_sort(pix) != RTA_SUCCESS)
+    goto nomem;
+  if (pix->kind == IX_BITMAP && ix_bitmaps(pix) != RTA_SUCCESS)
+    goto nomem;
+
+  pix->address = ptbl->address;
+  pix->nrows = ptbl->nrows;
+  pix->stale = 0;
+  return (RTA_SUCCESS);
+
+nomem:
+  rta_stat.nsyserr++;
+  if (rta_dbg.syserr)
+    rta_log(LOC, Er_No_Mem);
+  pix->stale = 1;
+  return (RTA_ERROR);
+}
+
+/***************************************************************
+ * ix_sort(): - Link the entries of an ordered index into a skip
+ * list in the order of their values.  The values are copied out
+ * of the rows first so that the sort does not go back to them.
+ * The k'th entry, counting from one, is on one level more than
+ * the number of times two divides k, which makes a perfect skip
+ * list.
+ *
+ * Input:        The index
+ * Output:       RTA_SUCCESS, or RTA_ERROR if memory is short
+ * Effects:      The links of the index
+ ***************************************************************/
+static int
+ix_sort(struct RtaIndex *pix)
+{
+  struct IxKey *keys;      /* the values, then in order */
+  RTA_COLDEF *pcol;        /* the indexed column */
+  int      (*cmp)(const void *, const void *); /* compare of keys */
+  int     *newlink;        /* the links when they grow */
+  int      last[IX_MXLVL]; /* last entry linked on each level */
+  int      nlink;          /* # links needed */
+  struct IxEnt *pe;        /* the entry of a row */
+  int      k;              /* position in keys */
+  int      l;              /* a level */
+
+  keys = malloc((pix->nent + 1) * sizeof(struct IxKey));
+  if (keys == (struct IxKey *) 0)
+    return (RTA_ERROR);
+  pcol = pix->pcol;
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      for (k = 0; k < pix->nent; k++)
+        keys[k].v.s = ix_str(pcol, pix->ent[k].pr);
+      cmp = ix_cmp_kstr;
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      for (k = 0; k < pix->nent; k++)
+        keys[k].v.d = ix_dbl(pcol, pix->ent[k].pr);
+      cmp = ix_cmp_kdbl;
+      break;
+    default:
+      for (k = 0; k < pix->nent; k++)
+        keys[k].v.n = ix_num(pcol, pix->ent[k].pr);
+      cmp = ix_cmp_knum;
+      break;
+  }
+  for (k = 0; k < pix->nent; k++)
+    keys[k].ex = k;
+  SortLen = pcol->length;
+  qsort(keys, pix->nent, sizeof(struct IxKey), cmp);
+
+  /* The head has every level.  Each level takes a next and a
+     previous link. */
+  nlink = 2 * IX_MXLVL;
+  for (k = 0; k < pix->nent; k++) {
+    pe = &(pix->ent[keys[k].ex]);
+    pe->lvl = 1 + __builtin_ctz(k + 1);
+    if (pe->lvl > IX_MXLVL)
+      pe->lvl = IX_MXLVL;
+    pe->link = nlink;
+    nlink += 2 * pe->lvl;
+  }
+  if (nlink > pix->mlink) {
+    newlink = realloc(pix->link, nlink * sizeof(int));
+    if (newlink == (int *) 0) {
+      free(keys);
+      return (RTA_ERROR);
+    }
+    pix->link = newlink;
+    pix->mlink = nlink;
+  }
+
+  for (l = 0; l < IX_MXLVL; l++)
+    last[l] = -1;
+  for (k = 0; k < pix->nent; k++) {
+    for (l = 0; l < pix->ent[keys[k].ex].lvl; l++) {
+      IX_NEXT(pix, last[l], l) = keys[k].ex;
+      IX_PREV(pix, keys[k].ex, l) = last[l];
+      last[l] = keys[k].ex;
+    }
+  }
+  for (l = 0; l < IX_MXLVL; l++) {
+    IX_NEXT(pix, last[l], l) = -1;
+    IX_PREV(pix, -1, l) = last[l];
+  }
+  free(keys);
+  return (RTA_SUCCESS);
+}
+
+/***************************************************************
+ * ix_bitmaps(): - Set the bit of each row in the bitmap of its
+ * value.  Too many values leave the index with no bitmaps and
+ * it is not used.
+ *
+ * Input:        The index
+ * Output:       RTA_SUCCESS, or RTA_ERROR if memory is short
+ * Effects:      The bitmaps of the index
+ ***************************************************************/
+static int
+ix_bitmaps(struct RtaIndex *pix)
+{
+  struct IxEnt *pe;        /* the entry of a row */
+  int      b;              /* the bitmap of its value */
+  int      ex;             /* Entry indeX */
+
+  if (pix->bslot == (int *) 0) {
+    pix->bslot = malloc(IX_NVAL(pix->pcol) * sizeof(int));
+    if (pix->bslot == (int *) 0)
+      return (RTA_ERROR);
+  }
+  memset(pix->bslot, -1, IX_NVAL(pix->pcol) * sizeof(int));
+  pix->nbmap = 0;
+  pix->nwrd = (pix->nent + 63) / 64;
+  for (ex = 0; ex < pix->nent; ex++) {
+    pe = &(pix->ent[ex]);
+    b = ix_bslot(pix, (int) ix_num(pix->pcol, pe->pr));
+    if (b < 0)
+      return ((pix->nbmap < 0) ? RTA_SUCCESS : RTA_ERROR);
+    pe->hash = b;
+    pix->bits[b * pix->nwrd + ex / 64] |= 1ULL << (ex % 64);
+  }
+  return (RTA_SUCCESS);
+}
+
+/***************************************************************
+ * ix_bslot(): - Give the bitmap of a value, adding an empty one
+ * if the value is new.  A value past the IX_MXBMAP'th sets the
+ * number of bitmaps to -1.
+ *
+ * Input:        The index and the value
+ * Output:       The bitmap, or -1 if there are too many values
+ *               or memory is short
+ * Effects:      The bitmaps of the index may grow
+ ***************************************************************/
+static int
+ix_bslot(struct RtaIndex *pix, int v)
+{
+  unsigned long long *newbits; /* the bitmaps when they grow */
+  int      vx;             /* the value as an index into bslot */
+  int      b;              /* the bitmap */
+
+  vx = v & (IX_NVAL(pix->pcol) - 1);
+  if (pix->bslot[vx] >= 0)
+    return (pix->bslot[vx]);
+  if (pix->nbmap >= IX_MXBMAP) {
+    pix->nbmap = -1;
+    return (-1);
+  }
+  if ((pix->nbmap + 1) * pix->nwrd > pix->mbits) {
+    newbits = realloc(pix->bits,
+      (pix->nbmap + 1) * 2 * pix->nwrd * sizeof(unsigned long long));
+    if (newbits == (unsigned long long *) 0)
+      return (-1);
+    pix->bits = newbits;
+    pix->mbits = (pix->nbmap + 1) * 2 * pix->nwrd;
+  }
+  b = pix->nbmap++;
+  memset(&(pix->bits[b * pix->nwrd]), 0,
+    pix->nwrd * sizeof(unsigned long long));
+  pix->bval[b] = v;
+  pix->bslot[vx] = b;
+  return (b);
+}
+
+/***************************************************************
+ * ix_entry(): - Find the entry of a row with the row chains.
+ *
+ * Input:        The index and the row
+ * Output:       The entry index, or -1 if the row is not in it
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_entry(struct RtaIndex *pix, void *pr)
+{
+  int      ex;             /* Entry indeX */
+
+  for (ex = pix->phead[ix_hash_ptr(pr) & (pix->nbkt - 1)]; ex >= 0;
+      ex = pix->ent[ex].pnext) {
+    if (pix->ent[ex].pr == pr)
+      break;
+  }
+  return (ex);
+}
+
+/***************************************************************
+ * ix_rekey(): - Move a row to the value chain of the value now
+ * in the row, to its place in the skip list, or to the bitmap of
+ * its value.  A row not in the index makes it stale.
+ *
+ * Input:        The index and the row
+ * Output:       None
+ * Effects:      The index
+ ***************************************************************/
+static void
+ix_rekey(struct RtaIndex *pix, void *pr)
+{
+  struct IxEnt *pe;        /* the entry of the row */
+  unsigned int hash;       /* hash of the value in the row */
+  int      ex;             /* Entry indeX */
+  int      b;              /* the new value chain */
+
+  ex = ix_entry(pix, pr);
+  if (ex < 0) {
+    pix->stale = 1;
+    return;
+  }
+  if (pix->kind == IX_ORDER) {
+    ix_move(pix, ex);
+    return;
+  }
+  if (pix->kind == IX_BITMAP) {
+    ix_rebit(pix, ex);
+    return;
+  }
+  pe = &(pix->ent[ex]);
+  hash = ix_hash_row(pix->pcol, pr);
+  if (hash == pe->hash)
+    return;
+
+  /* Unlink from the old chain and add to the head of the new */
+  if (pe->knext >= 0)
+    pix->ent[pe->knext].kprev = pe->kprev;
+  if (pe->kprev >= 0)
+    pix->ent[pe->kprev].knext = pe->knext;
+  else
+    pix->khead[pe->hash & (pix->nbkt - 1)] = pe->knext;
+  pe->hash = hash;
+  b = hash & (pix->nbkt - 1);
+  pe->kprev = -1;
+  pe->knext = pix->khead[b];
+  if (pe->knext >= 0)
+    pix->ent[pe->knext].kprev = ex;
+  pix->khead[b] = ex;
+}
+
+/***************************************************************
+ * ix_move(): - Move an entry of a skip list to the place of the
+ * value now in its row.  Nothing is done if it is still between
+ * its neighbors.
+ *
+ * Input:        The index and the entry
+ * Output:       None
+ * Effects:      The links of the index
+ ***************************************************************/
+static void
+ix_move(struct RtaIndex *pix, int ex)
+{
+  int      lvl;            /* levels of the entry */
+  int      p;              /* entry before it on a level */
+  int      n;              /* entry after it on a level */
+  int      l;              /* a level */
+
+  p = IX_PREV(pix, ex, 0);
+  n = IX_NEXT(pix, ex, 0);
+  if ((p < 0 || ix_cmp_ent(pix, p, ex) < 0) &&
+      (n < 0 || ix_cmp_ent(pix, ex, n) < 0))
+    return;
+
+  lvl = pix->ent[ex].lvl;
+  for (l = 0; l < lvl; l++) {
+    p = IX_PREV(pix, ex, l);
+    n = IX_NEXT(pix, ex, l);
+    IX_NEXT(pix, p, l) = n;
+    IX_PREV(pix, n, l) = p;
+  }
+
+  /* Find the entry it goes after on each level from the top */
+  p = -1;
+  for (l = IX_MXLVL - 1; l >= 0; l--) {
+    while ((n = IX_NEXT(pix, p, l)) >= 0 && ix_cmp_ent(pix, n, ex) < 0)
+      p = n;
+    if (l < lvl) {
+      IX_NEXT(pix, ex, l) = n;
+      IX_PREV(pix, ex, l) = p;
+      IX_NEXT(pix, p, l) = ex;
+      IX_PREV(pix, n, l) = ex;
+    }
+  }
+}
+
+/***************************************************************
+ * ix_rebit(): - Move the bit of an entry to the bitmap of the
+ * value now in its row.  An index with too many values, or a
+ * new value it has no room for, is made stale.
+ *
+ * Input:        The index and the entry
+ * Output:       None
+ * Effects:      The bitmaps of the index
+ ***************************************************************/
+static void
+ix_rebit(struct RtaIndex *pix, int ex)
+{
+  struct IxEnt *pe;        /* the entry */
+  unsigned long long bit;  /* its bit in a word */
+  int      wx;             /* its word in a bitmap */
+  int      b;              /* the bitmap of its value */
+
+  if (pix->nbmap < 0) {
+    pix->stale = 1;
+    return;
+  }
+  pe = &(pix->ent[ex]);
+  b = ix_bslot(pix, (int) ix_num(pix->pcol, pe->pr));
+  if (b < 0) {
+    pix->stale = 1;
+    return;
+  }
+  if (b == (int) pe->hash)
+    return;
+  wx = pe->rx / 64;
+  bit = 1ULL << (pe->rx % 64);
+  pix->bits[pe->hash * pix->nwrd + wx] &= ~bit;
+  pix->bits[b * pix->nwrd + wx] |= bit;
+  pe->hash = b;
+}
+
+/***************************************************************
+ * ix_bitmap(): - Find the rows that pass every WHERE phrase on
+ * a column with bitmaps.  The bitmaps of the values that pass
+ * a phrase are OR-ed together and the phrases are AND-ed, a
+ * word at a time, and only then are the rows of the bits that
+ * are left looked up.  A SELECT resumed at rta_cmd.rx starts at
+ * its word, unless rows have moved since it stopped.  The rows
+ * are in table order.  A SELECT of a table
+ * without an iterator tests many rows faster with the block
+ * scan, so more than an eighth of the rows are left to it.
+ *
+ * Input:        Where to put a pointer to the rows, and 1 if rows
+ *               have moved since the SELECT stopped
+ * Output:       The number of rows, or -1 if no bitmap is used
+ * Effects:      The indexes may be built
+ ***************************************************************/
+static int
+ix_bitmap(struct Sql_Row **prows, int moved)
+{
+  struct RtaIndex *pix;    /* the index of a phrase */
+  struct RtaIndex *prow;   /* the index that gives the rows */
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  unsigned long long *newb; /* the result when it grows */
+  unsigned long long *pb;  /* the bitmaps of the index */
+  unsigned long long w;    /* a word of OR-ed bitmaps */
+  int      pass[IX_MXBMAP]; /* the bitmaps that pass a phrase */
+  int      npass;          /* # bitmaps in pass */
+  int      nwrd = 0;       /* # words in the result */
+  int      w0;             /* first word of the result */
+  int      nfound = 0;     /* # rows found */
+  int      wx;             /* Where clause indeX */
+  int      i;              /* a word, or a bitmap in pass */
+  int      b;              /* a bit */
+
+  prow = (struct RtaIndex *) 0;
+  w0 = (rta_cmd.pr && !moved) ? rta_cmd.rx / 64 : 0;
+  for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (!(pw->pcol->flags & RTA_BITMAP) || pw->pcol->readcb)
+      continue;
+    pix = ix_get(rta_cmd.itbl, pw->pcol, IX_BITMAP);
+    if (pix == (struct RtaIndex *) 0 || pix->nbmap < 0 ||
+        (prow && pix->nent != prow->nent))
+      continue;
+    npass = ix_bpass(pix, pw, pass);
+
+    /* The first phrase sets the result and the others clear
+       the bits of the rows that fail them */
+    if (prow == (struct RtaIndex *) 0) {
+      prow = pix;
+      nwrd = pix->nwrd;
+      if (nwrd > MxBits) {
+        newb = realloc(Bits, nwrd * sizeof(unsigned long long));
+        if (newb == (unsigned long long *) 0) {
+          rta_stat.nsyserr++;
+          if (rta_dbg.syserr)
+            rta_log(LOC, Er_No_Mem);
+          return (-1);
+        }
+        Bits = newb;
+        MxBits = nwrd;
+      }
+      for (i = w0; i < nwrd; i++)
+        Bits[i] = ~0ULL;
+    }
+    pb = pix->bits;
+    for (i = w0; i < nwrd; i++) {
+      if (Bits[i] == 0)
+        continue;
+      w = 0;
+      for (b = 0; b < npass; b++)
+        w |= pb[pass[b] * nwrd + i];
+      Bits[i] &= w;
+    }
+  }
+  if (prow == (struct RtaIndex *) 0)
+    return (-1);
+  if (rta_cmd.command == RTA_SELECT && !rta_cmd.ptbl->iterator) {
+    for (i = w0; i < nwrd; i++)
+      nfound += __builtin_popcountll(Bits[i]);
+    if (nfound >= RTA_SCANBLK && nfound > (prow->nent - w0 * 64) / 8)
+      return (-1);
+    nfound = 0;
+  }
+
+  for (i = w0; i < nwrd; i++) {
+    for (w = Bits[i]; w; w &= w - 1) {
+      b = i * 64 + __builtin_ctzll(w);
+      if (ix_found(nfound, &(prow->ent[b])))
+        return (-1);
+      nfound++;
+    }
+  }
+  *prows = Found;
+  return (nfound);
+}
+
+/***************************************************************
+ * ix_bpass(): - List the bitmaps of the values that pass a WHERE
+ * phrase.  Each value is put in a column of the right type and
+ * given to the test of the phrase.
+ *
+ * Input:        The index, the phrase, and where to put the list
+ * Output:       The number of bitmaps in the list
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_bpass(struct RtaIndex *pix, struct Sql_Val *pw, int *pass)
+{
+  unsigned char uc;        /* the value as a uchar column */
+  short    sh;             /* the value as a short column */
+  void    *pd;             /* the value as a column */
+  int      npass = 0;      /* # bitmaps that pass */
+  int      b;              /* a bitmap */
+
+  pd = (pix->pcol->type == RTA_UCHAR) ? (void *) &uc : (void *) &sh;
+  for (b = 0; b < pix->nbmap; b++) {
+    uc = (unsigned char) pix->bval[b];
+    sh = (short) pix->bval[b];
+    if ((pw->test) (pd, pw))
+      pass[npass++] = b;
+  }
+  return (npass);
+}
+
+/***************************************************************
+ * ix_range(): - Find the rows in the range of the WHERE phrases
+ * on a column with an ordered index.  A range with many of the
+ * rows is left to the scan of the table, which is faster than
+ * putting them in table order.
+ *
+ * Input:        Where to put a pointer to the rows
+ * Output:       The number of rows, or -1 if no index is used
+ * Effects:      The index may be built
+ ***************************************************************/
+static int
+ix_range(struct Sql_Row **prows)
+{
+  struct RtaIndex *pix;    /* the index to use */
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  int      nfound = 0;     /* # rows found */
+  int      wx;             /* Where clause indeX */
+  int      ex;             /* Entry indeX */
+
+  pix = (struct RtaIndex *) 0;
+  for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (pw->rel != RTA_NE && (pw->pcol->flags & RTA_ORDERED) &&
+        !pw->pcol->readcb) {
+      pix = ix_get(rta_cmd.itbl, pw->pcol, IX_ORDER);
+      if (pix)
+        break;
+    }
+  }
+  if (pix == (struct RtaIndex *) 0)
+    return (-1);
+
+  for (ex = ix_start(pix, 0); ex >= 0; ex = ix_step(pix, ex, 0)) {
+    if (nfound >= RTA_SCANBLK && nfound > pix->nent / 4)
+      return (-1);
+    if (ix_found(nfound, &(pix->ent[ex])))
+      return (-1);
+    nfound++;
+  }
+  if (nfound > 1)
+    qsort(Found, nfound, sizeof(struct Sql_Row), ix_cmp_rx);
+  *prows = Found;
+  return (nfound);
+}
+
+/***************************************************************
+ * ix_start(): - Give the first entry of a skip list in the range
+ * of the WHERE phrases on its column.  Going forward it is the
+ * first entry not below any phrase, and going back it is the
+ * last entry not above any phrase.
+ *
+ * Input:        The index and 1 to go back, 0 to go forward
+ * Output:       The entry, or -1 if the range is empty
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_start(struct RtaIndex *pix, int desc)
+{
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  int      side;           /* where the entry is from the phrase */
+  int      ex;             /* Entry indeX */
+  int      wx;             /* Where clause indeX */
+
+  ex = (desc) ? IX_PREV(pix, -1, 0) : IX_NEXT(pix, -1, 0);
+  for (wx = 0; wx < rta_cmd.nwhrcols && ex >= 0; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (pw->pcol != pix->pcol)
+      continue;
+    side = ix_side(pw, pix->ent[ex].pr);
+    if ((desc) ? side > 0 : side < 0)
+      ex = ix_seek(pix, pw, desc);
+  }
+  return ((ex >= 0 && ix_inside(pix, ex, desc)) ? ex : -1);
+}
+
+/***************************************************************
+ * ix_step(): - Give the next entry of a skip list if it is in
+ * the range of the WHERE phrases on its column.
+ *
+ * Input:        The index, the entry, and 1 to go back
+ * Output:       The next entry, or -1 at the end of the range
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_step(struct RtaIndex *pix, int ex, int desc)
+{
+  ex = (desc) ? IX_PREV(pix, ex, 0) : IX_NEXT(pix, ex, 0);
+  return ((ex >= 0 && ix_inside(pix, ex, desc)) ? ex : -1);
+}
+
+/***************************************************************
+ * ix_seek(): - Search a skip list from the top level down for
+ * the first entry not below a WHERE phrase, or going back for
+ * the last entry not above it.
+ *
+ * Input:        The index, the phrase, and 1 to go back
+ * Output:       The entry, or -1 if there is none
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_seek(struct RtaIndex *pix, struct Sql_Val *pw, int desc)
+{
+  int      p = -1;         /* last entry passed over */
+  int      n;              /* the entry after it */
+  int      l;              /* a level */
+
+  for (l = IX_MXLVL - 1; l >= 0; l--) {
+    while ((n = IX_NEXT(pix, p, l)) >= 0 && ((desc) ?
+        ix_side(pw, pix->ent[n].pr) <= 0 : ix_side(pw, pix->ent[n].pr) < 0))
+      p = n;
+  }
+  return ((desc) ? p : IX_NEXT(pix, p, 0));
+}
+
+/***************************************************************
+ * ix_inside(): - Test that an entry is not past the far end of
+ * the range of the WHERE phrases on the column.  Going forward
+ * the far end is above; going back it is below.
+ *
+ * Input:        The index, the entry, and 1 to go back
+ * Output:       1 if the entry is not past the end, else 0
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_inside(struct RtaIndex *pix, int ex, int desc)
+{
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  int      side;           /* where the entry is from the phrase */
+  int      wx;             /* Where clause indeX */
+
+  for (wx = 0; wx < rta_cmd.nwhrcols; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (pw->pcol != pix->pcol)
+      continue;
+    side = ix_side(pw, pix->ent[ex].pr);
+    if ((desc) ? side < 0 : side > 0)
+      return (0);
+  }
+  return (1);
+}
+
+/***************************************************************
+ * ix_resume(): - Search a skip list from the top level down for
+ * the place a stopped walk left off.  Going forward it is the
+ * first entry not below the value and row index saved by
+ * rta_index_mark(), and going back it is the last entry not
+ * above them.  If the row indexes have moved, only the value is
+ * used and the place among the entries of that value is the
+ * one with the saved row.
+ *
+ * Input:        The index, 1 to go back, and 1 if the row
+ *               indexes have moved
+ * Output:       The entry, -1 at the end of the range, or -2 if
+ *               the place is lost
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_resume(struct RtaIndex *pix, int desc, int moved)
+{
+  int      p = -1;         /* last entry passed over */
+  int      n;              /* the entry after it */
+  int      l;              /* a level */
+  int      cmp;            /* the entry against the saved place */
+
+  for (l = IX_MXLVL - 1; l >= 0; l--) {
+    while ((n = IX_NEXT(pix, p, l)) >= 0) {
+      cmp = ix_cmp_okey(pix, n);
+      if (cmp == 0 && !moved)
+        cmp = pix->ent[n].rx - rta_cmd.rx;
+      if ((desc) ? cmp > 0 : cmp >= 0)
+        break;
+      p = n;
+    }
+  }
+  n = (desc) ? p : IX_NEXT(pix, p, 0);
+
+  /* Look for the row among the entries of the saved value */
+  if (moved && n >= 0 && ix_cmp_okey(pix, n) == 0) {
+    while (n >= 0 && pix->ent[n].pr != rta_cmd.pr) {
+      n = (desc) ? IX_PREV(pix, n, 0) : IX_NEXT(pix, n, 0);
+      if (n >= 0 && ix_cmp_okey(pix, n) != 0)
+        n = -1;
+    }
+    if (n < 0)
+      return (-2);
+  }
+  return ((n >= 0 && ix_inside(pix, n, desc)) ? n : -1);
+}
+
+/***************************************************************
+ * ix_side(): - Tell where the value of a row is from the range
+ * of values that pass a WHERE phrase.  A '!=' phrase has no
+ * range.  A NaN passes no other phrase and is after every number,
+ * so it is above every range.
+ *
+ * Input:        The phrase and the row
+ * Output:       -1 if below the range, 1 if above, 0 if in it
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_side(struct Sql_Val *pw, void *pr)
+{
+  RTA_COLDEF *pcol;        /* the column of the phrase */
+  double   d;              /* a float or double value */
+  int      cmp;            /* the row's value against the phrase's */
+
+  if (pw->rel == RTA_NE)
+    return (0);
+  pcol = pw->pcol;
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      cmp = strncmp(ix_str(pcol, pr), pw->val, pcol->length);
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      d = ix_dbl(pcol, pr);
+      if (d != d)
+        return (1);
+      cmp = ix_cmp_dbl(d, (pcol->type == RTA_DOUBLE) ? pw->dval : pw->fval);
+      break;
+    case RTA_LONG:
+    case RTA_PLONG:
+      cmp = (ix_num(pcol, pr) > pw->lval) - (ix_num(pcol, pr) < pw->lval);
+      break;
+    default:
+      cmp = (ix_num(pcol, pr) > pw->ival) - (ix_num(pcol, pr) < pw->ival);
+      break;
+  }
+
+  switch (pw->rel) {
+    case RTA_EQ:
+      return ((cmp < 0) ? -1 : (cmp > 0));
+    case RTA_GT:
+      return ((cmp <= 0) ? -1 : 0);
+    case RTA_GE:
+      return ((cmp < 0) ? -1 : 0);
+    case RTA_LT:
+      return (cmp >= 0);
+    case RTA_LE:
+      return (cmp > 0);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * ix_cmp_ent(): - Compare the rows of two entries by the value
+ * of the indexed column, and by row index if the values are
+ * the same.  A NaN is above every number.
+ *
+ * Input:        The index and the two entries
+ * Output:       <0, 0, or >0 as the first is before, the same
+ *               as, or after the second
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_cmp_ent(struct RtaIndex *pix, int a, int b)
+{
+  RTA_COLDEF *pcol;        /* the indexed column */
+  void    *pra;            /* the row of a */
+  void    *prb;            /* the row of b */
+  llong    na, nb;         /* integer values */
+  int      cmp;            /* the values compared */
+
+  pcol = pix->pcol;
+  pra = pix->ent[a].pr;
+  prb = pix->ent[b].pr;
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      cmp = strncmp(ix_str(pcol, pra), ix_str(pcol, prb), pcol->length);
+      break;
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      cmp = ix_cmp_dbl(ix_dbl(pcol, pra), ix_dbl(pcol, prb));
+      break;
+    default:
+      na = ix_num(pcol, pra);
+      nb = ix_num(pcol, prb);
+      cmp = (na > nb) - (na < nb);
+      break;
+  }
+  return ((cmp) ? cmp : pix->ent[a].rx - pix->ent[b].rx);
+}
+
+/***************************************************************
+ * ix_cmp_okey(): - Compare the row of an entry with the value
+ * saved by rta_index_mark().
+ *
+ * Input:        The index and the entry
+ * Output:       <0, 0, or >0 as the row's value is below, the
+ *               same as, or above the saved value
+ * Effects:      None
+ ***************************************************************/
+static int
+ix_cmp_okey(struct RtaIndex *pix, int ex)
+{
+  RTA_COLDEF *pcol;        /* the indexed column */
+  void    *pr;             /* the row of the entry */
+  llong    n;              /* an integer value */
+
+  pcol = pix->pcol;
+  pr = pix->ent[ex].pr;
+  switch (pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      return (strncmp(ix_str(pcol, pr), rta_cmd.okey.val, pcol->length));
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      return (ix_cmp_dbl(ix_dbl(pcol, pr), rta_cmd.okey.dval));
+  }
+  n = ix_num(pcol, pr);
+  return ((n > rta_cmd.okey.lval) - (n < rta_cmd.okey.lval));
+}
+
+/***************************************************************
+ * ix_cmp_knum(): - qsort() compare of two integer keys, and of
+ * their entries if the values are the same.  The entries are
+ * in row order when sorted.
+ ***************************************************************/
+static int
+ix_cmp_knum(const void *a, const void *b)
+{
+  struct IxKey *ka = (struct IxKey *) a;
+  struct IxKey *kb = (struct IxKey *) b;
+
+  if (ka->v.n != kb->v.n)
+    return ((ka->v.n > kb->v.n) ? 1 : -1);
+  return (ka->ex - kb->ex);
+}
+
+/***************************************************************
+ * ix_cmp_kdbl(): - qsort() compare of two float or double keys.
+ ***************************************************************/
+static int
+ix_cmp_kdbl(const void *a, const void *b)
+{
+  struct IxKey *ka = (struct IxKey *) a;
+  struct IxKey *kb = (struct IxKey *) b;
+  int      cmp;            /* the values compared */
+
+  cmp = ix_cmp_dbl(ka->v.d, kb->v.d);
+  return ((cmp) ? cmp : ka->ex - kb->ex);
+}
+
+/***************************************************************
+ * ix_cmp_kstr(): - qsort() compare of two string keys.
+ ***************************************************************/
+static int
+ix_cmp_kstr(const void *a, const void *b)
+{
+  struct IxKey *ka = (struct IxKey *) a;
+  struct IxKey *kb = (struct IxKey *) b;
+  int      cmp;            /* the values compared */
+
+  cmp = strncmp(ka->v.s, kb->v.s, SortLen);
+  return ((cmp) ? cmp : ka->ex - kb->ex);
+}
+
+/***************************************************************
+ * ix_cmp_dbl(): - Compare two numbers with NaN above the rest.
+ ***************************************************************/
+static int
+ix_cmp_dbl(double a, double b)
+{
+  if (a < b)
+    return (-1);
+  if (a > b)
+    return (1);
+  if (a == b)
+    return (0);
+  return ((a != a) - (b != b));
+}
+
+/***************************************************************
+ * ix_num(): - The value of an integer column in a row.  The
+ * integer types compare as they do in a WHERE.
+ ***************************************************************/
+static llong
+ix_num(RTA_COLDEF *pcol, void *pr)
+{
+  void    *pd;             /* the column in the row */
+
+  pd = (char *) pr + pcol->offset;
+  switch (pcol->type) {
+    case RTA_INT:
+    case RTA_PTR:
+      return (*(int *) pd);
+    case RTA_PINT:
+      return (**(int **) pd);
+    case RTA_SHORT:
+      return (*(short *) pd);
+    case RTA_UCHAR:
+      return (*(unsigned char *) pd);
+    case RTA_LONG:
+      return (*(llong *) pd);
+    case RTA_PLONG:
+      return (**(llong **) pd);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * ix_dbl(): - The value of a float or double column in a row.
+ ***************************************************************/
+static double
+ix_dbl(RTA_COLDEF *pcol, void *pr)
+{
+  void    *pd;             /* the column in the row */
+
+  pd = (char *) pr + pcol->offset;
+  switch (pcol->type) {
+    case RTA_FLOAT:
+      return (*(float *) pd);
+    case RTA_PFLOAT:
+      return (**(float **) pd);
+  }
+  return (*(double *) pd);
+}
+
+/***************************************************************
+ * ix_str(): - The value of a string column in a row.
+ ***************************************************************/
+static char *
+ix_str(RTA_COLDEF *pcol, void *pr)
+{
+  void    *pd;             /* the column in the row */
+
+  pd = (char *) pr + pcol->offset;
+  return ((pcol->type == RTA_PSTR) ? *(char **) pd : (char *) pd);
+}
+
+/***************************************************************
+ * ix_found(): - Add the row of an entry to the rows found.
+ *
+ * Input:        The number of rows found so far and the entry
+ * Output:       0 on success, -1 if memory is short
+ * Effects:      The list of rows found may grow
+ ***************************************************************/
+static int
+ix_found(int nfound, struct IxEnt *pe)
+{
+  struct Sql_Row *newf;    /* the list of rows when it grows */
+
+  if (nfound == MxFound) {
+    newf = realloc(Found, (MxFound + 16) * 2 * sizeof(struct Sql_Row));
+    if (newf == (struct Sql_Row *) 0) {
+      rta_stat.nsyserr++;
+      if (rta_dbg.syserr)
+        rta_log(LOC, Er_No_Mem);
+      return (-1);
+    }
+    Found = newf;
+    MxFound = (MxFound + 16) * 2;
+  }
+  Found[nfound].pr = pe->pr;
+  Found[nfound].rx = pe->rx;
+  return (0);
+}
+
+/***************************************************************
+ * ix_hash_row(): - Hash the value of a column in a row.  The
+ * integer types hash as the integer they compare as in a WHERE.
+ *
+ * Input:        The column and the row
+ * Output:       The hash
+ * Effects:      None
+ ***************************************************************/
+static unsigned int
+ix_hash_row(RTA_COLDEF *pcol, void *pr)
+{
+  void    *pd;             /* the column in the row */
+
+  pd = (char *) pr + pcol->offset;
+  switch (pcol->type) {
+    case RTA_STR:
+      return (ix_hash_str((char *) pd, pcol->length));
+    case RTA_PSTR:
+      return (ix_hash_str(*(char **) pd, pcol->length));
+    case RTA_INT:
+    case RTA_PTR:
+      return (ix_hash_num(*(int *) pd));
+    case RTA_PINT:
+      return (ix_hash_num(**(int **) pd));
+    case RTA_SHORT:
+      return (ix_hash_num(*(short *) pd));
+    case RTA_UCHAR:
+      return (ix_hash_num(*(unsigned char *) pd));
+    case RTA_LONG:
+      return (ix_hash_num(*(llong *) pd));
+    case RTA_PLONG:
+      return (ix_hash_num(**(llong **) pd));
+  }
+  return (0);
+}
+
+/***************************************************************
+ * ix_hash_val(): - Hash the value of a WHERE phrase the same
+ * way as ix_hash_row() hashes a column with that value.
+ *
+ * Input:        The WHERE phrase
+ * Output:       The hash
+ * Effects:      None
+ ***************************************************************/
+static unsigned int
+ix_hash_val(struct Sql_Val *pw)
+{
+  switch (pw->pcol->type) {
+    case RTA_STR:
+    case RTA_PSTR:
+      return (ix_hash_str(pw->val, pw->pcol->length));
+    case RTA_LONG:
+    case RTA_PLONG:
+      return (ix_hash_num(pw->lval));
+  }
+  return (ix_hash_num(pw->ival));
+}
+
+/***************************************************************
+ * ix_hash_str(): - FNV-1a hash of a string of at most n bytes.
+ ***************************************************************/
+static unsigned int
+ix_hash_str(char *s, int n)
+{
+  unsigned int hash = 2166136261u;
+
+  while (n-- > 0 && *s) {
+    hash ^= (unsigned char) *s++;
+    hash *= 16777619u;
+  }
+  return (hash);
+}
+
+/***************************************************************
+ * ix_hash_num(): - Mix the bits of a number into a hash.
+ ***************************************************************/
+static unsigned int
+ix_hash_num(llong v)
+{
+  unsigned long long h = (unsigned long long) v;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return ((unsigned int) h);
+}
+
+/***************************************************************
+ * ix_hash_ptr(): - Hash a row pointer.
+ ***************************************************************/
+static unsigned int
+ix_hash_ptr(void *pr)
+{
+  return (ix_hash_num((llong) (uintptr_t) pr));
+}
+
+/***************************************************************
+ * ix_cmp_rx(): - qsort() compare of two rows by row index.
+ ***************************************************************/
+static int
+ix_cmp_rx(const void *a, const void *b)
+{
+  return (((struct Sql_Row *) a)->rx - ((struct Sql_Row *) b)->rx);
+}
@@ -117,6 +117,7 @@
  **************************************************************/
 
 #include <limits.h>             /* for PATH_MAX */
+#include <sys/uio.h>            /* for struct iovec */
 
         /** Maximum number of tables allowed in the system.
          * Your data base may not contain more than this number
@@ -148,6 +149,55 @@
     /* Maximum number of columns allowed in a table */
 #define RTA_NCMDCOLS     (1000)
 
+        /** Maximum number of named prepared statements that one
+         * client session may hold at a time.  See the extended
+         * query protocol in rta_session_dbcommand() below. */
+#define RTA_MX_STMT       (100)
+
+        /** Default number of verified SQL commands kept by the
+         * plan cache of rta_SQL_string() and of simple queries.
+         * See the rta_plancache table below. */
+#define RTA_PCACHE        (512)
+
+        /** Maximum number of notifications waiting to be sent to
+         * one client session, and the longest payload that
+         * rta_notify() accepts.  See LISTEN below. */
+#define RTA_MX_NOTIFY     (100)
+#define RTA_MX_PAYLOAD   (1000)
+
+        /** The largest packets accepted from a client: a
+         * start-up packet, and any other message.  These are the
+         * limits of Postgres.  A packet with a longer length
+         * closes the connection. */
+#define RTA_MX_STARTUP  (10000)
+#define RTA_MX_MSG      (0x3fffffff)
+
+        /** Size of the input and output buffers of each client of
+         * the built-in server, rta_serve().  The input buffer
+         * grows for a message of up to RTA_SRV_MXMSG bytes and the
+         * output buffer for a row bigger than RTA_SRV_MXOUT.  Both
+         * shrink back once the big message or row is done. */
+#define RTA_SRV_MXIN    (16384)
+#define RTA_SRV_MXOUT   (65536)
+#define RTA_SRV_MXMSG   (67108864)
+
+        /** Size of the chunks of an RTA_OUTBUF, the number of free
+         * chunks kept for reuse, and how many bytes of output
+         * rta_session_dbout() queues before it waits for the
+         * caller to send them. */
+#define RTA_OUTCHUNK    (16384)
+#define RTA_OUTPOOL        (64)
+#define RTA_OUTMAX     (262144)
+
+        /** I/O backends of the built-in server */
+#define RTA_SRV_EPOLL   (0)
+#define RTA_SRV_URING   (1)
+
+        /** Scheduling classes of the clients of the built-in
+         * server.  See rta_serve_class(). */
+#define RTA_SRV_NORMAL  (0)
+#define RTA_SRV_HIGH    (1)
+
 /***************************************************************
  * - Data Structures:
  *     Each column and table in the data base must be described
@@ -299,6 +349,44 @@ typedef long long llong;
          * the corner cases.)   */
 #define RTA_READONLY     (1<<1)
 
+        /** If the indexed flag is set, librta keeps a hash index
+         * of the values in the column.  A SELECT, UPDATE, or
+         * DELETE with a WHERE phrase of 'column = value' then
+         * looks at only the rows with that value.  The index is
+         * kept up to date by UPDATE, INSERT, and DELETE.  If
+         * your program changes the column, or adds or removes
+         * rows, it must call rta_index_touch().  Float and
+         * double columns can not be indexed.  The index is not
+         * used for a column with a read callback.  */
+#define RTA_INDEXED      (1<<2)
+
+        /** If the ordered flag is set, librta keeps the rows in
+         * the order of the values in the column.  A WHERE
+         * phrase of 'column > value', '<', '>=', '<=', or '='
+         * then looks at only the rows in that range, and a
+         * SELECT may use 'ORDER BY column' to get its rows in
+         * that order without a sort.  Columns of any type may
+         * be ordered.  The index is kept up to date as for
+         * RTA_INDEXED, and rta_index_touch() is used the same
+         * way.  A column may have both flags.  The index is not
+         * used for a column with a read callback, and ORDER BY
+         * is allowed only on an ordered column.  */
+#define RTA_ORDERED      (1<<3)
+
+        /** If the bitmap flag is set on a uchar or short column,
+         * librta keeps a bitmap of the rows for each value in
+         * the column.  This suits columns with few values, such
+         * as states and severities.  The WHERE phrases on all
+         * such columns are tested against the bitmaps, 64 rows
+         * at a time, before any row is looked at, so a SELECT,
+         * UPDATE, or DELETE with 'state = 3 AND port = 7' goes
+         * straight to the matching rows.  A column with more
+         * than 256 values is not looked up this way.  The
+         * bitmaps are kept up to date as for RTA_INDEXED, and
+         * rta_index_touch() is used the same way.  They are not
+         * used for a column with a read callback.  */
+#define RTA_BITMAP       (1<<4)
+
         /** The table definition (RTA_TBLDEF) structure describes
          * a table and is passed into the DB system by the
          * rta_add_table() subroutine.  */
@@ -388,14 +476,49 @@ typedef struct
 }
 RTA_TBLDEF;
 
+        /** A session holds the state of one client connection,
+         * such as the prepared statements of the extended query
+         * protocol.  The structure is private to librta; use
+         * rta_session_new() to get one.  */
+typedef struct RtaSession RTA_SESSION;
+
+        /** An output buffer that grows in chunks as responses are
+         * added and shrinks as they are sent.  The structure is
+         * private to librta; use rta_outbuf_new() to get one. */
+typedef struct RtaOutbuf RTA_OUTBUF;
+
 /***************************************************************
  * - Subroutines
  * Here is a summary of the few routines in the librta API:
  *    rta_dbcommand()  - I/F to Postgres clients
+ *    rta_session_new() - allocate the state for one client
+ *    rta_session_free() - free the state of a client
+ *    rta_session_dbcommand() - I/F to one Postgres client
+ *    rta_session_dbbatch() - run all commands from a client
+ *    rta_session_dbbatchv() - as above, with strings by reference
+ *    rta_session_dbout() - run all commands into an RTA_OUTBUF
+ *    rta_dbmsglen()   - length of the next packet from a client
+ *    rta_outbuf_new() - allocate a growable output buffer
+ *    rta_outbuf_free() - free an output buffer
+ *    rta_outbuf_len() - bytes waiting in an output buffer
+ *    rta_outbuf_iov() - describe an output buffer for writev()
+ *    rta_outbuf_drain() - remove sent bytes from an output buffer
+ *    rta_notify()     - notify the clients that LISTEN on a channel
+ *    rta_session_pending() - notifications waiting for a client
+ *    rta_budget()     - limit the work of a SELECT per call
+ *    rta_serve()      - built-in server for Postgres clients
+ *    rta_serve_open() - listen on a port for the built-in server
+ *    rta_serve_open_unix() - listen on a Unix socket for the server
+ *    rta_serve_backend() - use epoll or io_uring in the server
+ *    rta_serve_class() - set the priority of the clients of a port
+ *    rta_serve_timeout() - how long to wait for the server
+ *    rta_serve_poll() - handle the clients of the server
+ *    rta_serve_close() - close the server and its clients
  *    rta_add_table()  - add a table and its columns to the DB
  *    rta_SQL_string() - execute an SQL statement in the DB
  *    rta_save()       - save a table to a file
  *    rta_load()       - load a table from a file
+ *    rta_index_touch() - tell the indexes the program changed rows
  *
  **************************************************************/
 
@@ -414,9 +537,18 @@ RTA_TBLDEF;
  * routine is called the input variable, nout, has the number of
  * free bytes available in the output buffer, out.  When the
  * routine returns nout has been decremented by the size of the
- * response placed in the output buffer.  An error message is
- * generated if the number of available bytes in the output 
- * buffer is too small to hold the response from the SQL command.
+ * response placed in the output buffer.
+ *     A SELECT whose response does not fit in the output buffer
+ * stops when the buffer is full and RTA_MORE is returned.  Send
+ * the output to the client and call again, with or without new
+ * input.  The next call continues the SELECT from the row where
+ * it stopped before it looks at any new input.  This lets a
+ * large table stream through a small buffer in one query.  An
+ * error message is generated only if the output buffer can not
+ * hold even one row.
+ *     A SELECT also stops, and RTA_YIELD is returned, once it
+ * has used the budget set with rta_budget().  Send any output,
+ * do your own work, and call again to continue the SELECT.
  * 
  * Input:  cmd - the buffer with the Postgres packet
  *         nin - on entry, the number of bytes in 'cmd',
@@ -426,11 +558,436 @@ RTA_TBLDEF;
  *               on exit, the number of remaining free bytes
  * Return: RTA_SUCCESS   - executed one command
  *         RTA_NOCMD     - input did not have a full cmd
- *         RTA_CLOSE     - client requests an orderly close
+ *         RTA_CLOSE     - client requests an orderly close, or
+ *                         sent a packet with a bad length
  *         RTA_NOBUF     - insufficient output buffer space
+ *         RTA_MORE      - output buffer full, call again to
+ *                         get the rest of the response
+ *         RTA_YIELD     - SELECT used its budget, call again
+ *                         to continue it
+ *
+ *     All callers of rta_dbcommand() share one session.  This is
+ * fine for the simple query protocol but prepared statements
+ * of one client are visible to all others.  Programs that serve
+ * more than one client should give each client its own session
+ * and use rta_session_dbcommand().
  **************************************************************/
 int      rta_dbcommand(char *, int *, char *, int *);
 
+/** ************************************************************
+ * rta_session_new():  - Allocate the state for one client
+ * connection.  Call this when a client connects and pass the
+ * returned session to rta_session_dbcommand() for all of the
+ * traffic from that client.
+ *
+ * Return: pointer to the new session, or NULL if out of memory
+ **************************************************************/
+RTA_SESSION *rta_session_new(void);
+
+/** ************************************************************
+ * rta_session_free():  - Free a session and its prepared
+ * statements.  Call this when the client connection closes.
+ *
+ * Input:  sess   - the session from rta_session_new()
+ **************************************************************/
+void     rta_session_free(RTA_SESSION *);
+
+/** ************************************************************
+ * rta_session_dbcommand():  - Depacketize and execute Postgres
+ * commands from one client.
+ *
+ *     This is rta_dbcommand() with a per-client session.  In
+ * addition to the simple query ('Q') message it handles the
+ * extended query protocol used by most modern drivers: Parse,
+ * Bind, Describe, Execute, Close, Sync, and Flush.  Parse
+ * verifies the SQL once and saves the table and column pointers
+ * in a named (or unnamed) prepared statement.  Executing the
+ * statement later skips the SQL parse and all of the checks.
+ * Parameters appear in the SQL as $1, $2, ... anywhere a literal
+ * value may appear in a SET, VALUES, or WHERE clause.  Bind
+ * gives the parameters in either text or binary format.  Bind
+ * may also ask for the columns of a SELECT in binary format.
+ * Numbers are then sent in network byte order straight from the
+ * row as int2, int4, int8, float4, or float8, and the row
+ * description gives the real Postgres type of the column.  This
+ * is smaller and much faster than text for numeric tables.
+ * An Execute with a row count returns that many rows and leaves
+ * the portal suspended; the next Execute continues from there.
+ * The CopyData, CopyDone, and CopyFail messages of COPY FROM
+ * STDIN are handled here too.
+ * Notifications queued by rta_notify() are sent before any new
+ * input is read, even if there is no input.
+ *     Each session gets its own process ID and random secret key
+ * in the BackendKeyData of its start-up reply.  A CancelRequest
+ * with that key, such as psql sends on Ctrl-C, makes a SELECT,
+ * UPDATE, DELETE, or COPY FROM STDIN of the session fail with
+ * SQLSTATE 57014 at its next row.  Since the program runs one
+ * command at a time, the request is seen while a SELECT waits
+ * for room in the output buffer or has yielded (see
+ * rta_budget()), or while a COPY waits for data.  The
+ * connection that sent the CancelRequest gets RTA_CLOSE.
+ *     Each message of the extended protocol counts as one
+ * command.  A session holds at most RTA_MX_STMT named prepared
+ * statements.  A NULL session means the session shared by all
+ * callers of rta_dbcommand().
+ *
+ * Input:  sess - the client's session
+ *         cmd  - the buffer with the Postgres packet
+ *         nin  - on entry, the number of bytes in 'cmd',
+ *               on exit, the number of bytes remaining in cmd
+ *         out  - the buffer to hold responses back to client
+ *         nout - on entry, the number of free bytes in 'out'
+ *               on exit, the number of remaining free bytes
+ * Return: as rta_dbcommand() above
+ **************************************************************/
+int      rta_session_dbcommand(RTA_SESSION *, char *, int *, char *,
+                               int *);
+
+/** ************************************************************
+ * rta_session_dbbatch():  - Execute every complete command in
+ * the input buffer of one client in a single call.
+ *
+ *     Clients often pipeline many commands in one write.  With
+ * rta_session_dbcommand() the caller must move the rest of the
+ * input to the front of the buffer after each command.  This
+ * routine runs all of the complete commands and appends their
+ * responses to the output buffer.  The number of bytes used is
+ * the change in 'nin'.  Any unused bytes start at 'cmd' plus the
+ * number used and should be moved to the front of the buffer
+ * once.
+ *
+ * Input:  sess - the client's session, NULL for the default
+ *         cmd  - the buffer with the Postgres packets
+ *         nin  - on entry, the number of bytes in 'cmd',
+ *               on exit, the number of bytes not used
+ *         out  - the buffer to hold responses back to client
+ *         nout - on entry, the number of free bytes in 'out'
+ *               on exit, the number of remaining free bytes
+ *         ncmd - on exit, the number of commands executed
+ * Return: RTA_SUCCESS   - all of the input was used
+ *         RTA_NOCMD     - the input ends in a partial command
+ *         RTA_CLOSE     - client requests an orderly close
+ *         RTA_NOBUF     - insufficient output buffer space
+ *         RTA_MORE      - output buffer full, call again to
+ *                         get the rest of the response
+ *         RTA_YIELD     - SELECT used its budget, call again
+ *                         to continue it
+ **************************************************************/
+int      rta_session_dbbatch(RTA_SESSION *, char *, int *, char *,
+                             int *, int *);
+
+/** ************************************************************
+ * rta_session_dbbatchv():  - Execute every complete command in
+ * the input buffer of one client and describe the responses
+ * with an iovec list for writev() or sendmsg().
+ *
+ *     This is rta_session_dbbatch() except that SELECT and COPY
+ * TO STDOUT do not copy long RTA_STR and RTA_PSTR values into
+ * 'out'.  The value is left as a hole of the same size in 'out'
+ * and an iovec entry points at the string in the row.  The
+ * responses are the entries of 'iov' in order, or equally 'out'
+ * after each hole is filled from the entry that follows it.
+ * Holes count against 'nout' so the two always have the same
+ * size.  Strings shorter than 64 bytes are copied since an
+ * iovec entry costs more than the copy.
+ *     The referenced strings must not change or be freed until
+ * the responses are sent.  Send before your program returns
+ * to code that may change the tables, or fill the holes of any
+ * part you could not send.
+ *
+ * Input:  sess, cmd, nin, out, nout, ncmd - as for
+ *               rta_session_dbbatch() above
+ *         iov  - the list to fill in
+ *         niov - on entry, the size of 'iov', at least 1,
+ *               on exit, the number of entries used
+ * Return: RTA_ERROR if 'niov' is less than 1, else as for
+ *         rta_session_dbbatch() above
+ **************************************************************/
+int      rta_session_dbbatchv(RTA_SESSION *, char *, int *, char *,
+                              int *, int *, struct iovec *, int *);
+
+/** ************************************************************
+ * rta_session_dbout():  - Execute every complete command in the
+ * input buffer of one client and add the responses to a
+ * growable output buffer.
+ *
+ *     With a flat buffer the caller must size it for the largest
+ * response, or handle RTA_NOBUF and RTA_MORE.  An RTA_OUTBUF
+ * instead grows in chunks of RTA_OUTCHUNK bytes, taken from a
+ * pool shared by all buffers, and a SELECT that fills a chunk
+ * goes on in the next.  Once RTA_OUTMAX bytes are waiting we
+ * stop and return RTA_MORE; send some of the output and call
+ * again, with the unused input, to get the rest.  Send the
+ * output with rta_outbuf_iov() and writev(), then remove what
+ * was sent with rta_outbuf_drain().  An empty RTA_OUTBUF holds
+ * no chunks.
+ *
+ * Input:  sess - the client's session, NULL for the default
+ *         cmd  - the buffer with the Postgres packets
+ *         nin  - on entry, the number of bytes in 'cmd',
+ *               on exit, the number of bytes not used
+ *         out  - the output buffer
+ *         ncmd - on exit, the number of commands executed
+ * Return: RTA_SUCCESS   - all of the input was used
+ *         RTA_NOCMD     - the input ends in a partial command
+ *         RTA_CLOSE     - client requests an orderly close
+ *         RTA_NOBUF     - out of memory
+ *         RTA_MORE      - RTA_OUTMAX bytes are waiting, send
+ *                         some and call again
+ *         RTA_YIELD     - SELECT used its budget, call again
+ *                         to continue it
+ **************************************************************/
+int      rta_session_dbout(RTA_SESSION *, char *, int *, RTA_OUTBUF *,
+                           int *);
+
+/** ************************************************************
+ * rta_dbmsglen():  - Give the length of the packet at the start
+ * of a client's input.  rta_dbcommand() returns RTA_NOCMD until
+ * the whole packet is in the input buffer, so a program with a
+ * small input buffer uses this to see how big the buffer must
+ * be.  Lengths are the full 32 bits of the Postgres protocol,
+ * up to RTA_MX_MSG bytes, so messages over 16 MB, such as a
+ * long statement or a big CopyData, work.
+ *
+ * Input:  buf - the input from the client
+ *         nin - the number of bytes in buf
+ * Return: the number of bytes in the packet, 0 if nin is too
+ *         small to tell, or -1 if the length is not valid.  In
+ *         that case rta_dbcommand() returns RTA_CLOSE.
+ **************************************************************/
+int      rta_dbmsglen(char *, int);
+
+/** ************************************************************
+ * rta_outbuf_new():  - Allocate an empty output buffer for
+ * rta_session_dbout().  Use one per client.
+ *
+ * Input:  None
+ * Return: The buffer, or NULL if out of memory
+ **************************************************************/
+RTA_OUTBUF *rta_outbuf_new(void);
+
+/** ************************************************************
+ * rta_outbuf_free():  - Free an output buffer and any output
+ * still in it.
+ *
+ * Input:  out - the buffer, may be NULL
+ * Return: None
+ **************************************************************/
+void     rta_outbuf_free(RTA_OUTBUF *);
+
+/** ************************************************************
+ * rta_outbuf_len():  - Give the number of bytes in an output
+ * buffer that are waiting to be sent.
+ *
+ * Input:  out - the buffer
+ * Return: The number of bytes
+ **************************************************************/
+int      rta_outbuf_len(RTA_OUTBUF *);
+
+/** ************************************************************
+ * rta_outbuf_iov():  - Fill in an iovec list, oldest first, with
+ * the output waiting in a buffer.  The list may describe only
+ * the start of the output if 'niov' is small.  The entries are
+ * good until the next call on the buffer.
+ *
+ * Input:  out  - the buffer
+ *         iov  - the list to fill in
+ *         niov - the size of the list
+ * Return: The number of entries filled in
+ **************************************************************/
+int      rta_outbuf_iov(RTA_OUTBUF *, struct iovec *, int);
+
+/** ************************************************************
+ * rta_outbuf_drain():  - Remove bytes that were sent from the
+ * front of an output buffer.  Chunks that are empty go back
+ * to the pool.
+ *
+ * Input:  out   - the buffer
+ *         nsent - the number of bytes sent
+ * Return: None
+ **************************************************************/
+void     rta_outbuf_drain(RTA_OUTBUF *, int);
+
+/** ************************************************************
+ * rta_notify():  - Send a notification to every client that
+ * has run LISTEN on a channel.  librta calls this with the
+ * table name as the channel and "UPDATE", "INSERT", "DELETE",
+ * or "COPY" as the payload after a command changes rows of a
+ * table.  Call it yourself when your program changes a table
+ * directly, or to raise events on channels of your own.
+ *     The notification is queued in each session and is sent
+ * as a Postgres NotificationResponse the next time the session
+ * is run.  A notification just like one already waiting is
+ * not queued again, and one beyond RTA_MX_NOTIFY is dropped.
+ * The built-in server sends notifications on its next call of
+ * rta_serve_poll().  If you run your own I/O loop, call
+ * rta_session_dbbatch() or rta_session_dbout() with no input
+ * for each client with rta_session_pending().
+ *
+ * Input:  chan    - the channel, usually a table name
+ *         payload - a string for the clients, may be NULL
+ * Return: the number of sessions that listen on the channel,
+ *         or RTA_ERROR if the channel has RTA_MXTBLNAME or the
+ *         payload has RTA_MX_PAYLOAD or more characters
+ **************************************************************/
+int      rta_notify(char *, char *);
+
+/** ************************************************************
+ * rta_session_pending():  - Give the number of notifications
+ * waiting to be sent to a client.  See rta_notify().
+ *
+ * Input:  sess   - the client's session, NULL for the default
+ * Return: the number of notifications
+ **************************************************************/
+int      rta_session_pending(RTA_SESSION *);
+
+/** ************************************************************
+ * rta_budget():  - Limit the work a SELECT or COPY TO STDOUT
+ * does in one call of rta_dbcommand() and the routines like it.
+ * Once a call has scanned 'nrows' rows, or has run for 'usecs'
+ * microseconds, the SELECT saves its place and the call returns
+ * RTA_YIELD.  The next call for the session continues from that
+ * row before it looks at new input.  Read callbacks are part of
+ * the time, so this bounds how long librta holds up your event
+ * loop when a client scans a big table.  Each call scans at
+ * least one row.  The clock is read only every few dozen rows
+ * so the time limit is approximate.
+ *     UPDATE, DELETE, and INSERT always run to completion so
+ * that no client sees a table half changed.  The budget does
+ * not apply to rta_SQL_string() since it can not be resumed.
+ * The built-in server runs each yielded client again on its
+ * next call of rta_serve_poll().  The default is no limit.
+ *
+ * Input:  nrows  - rows scanned per call, 0 for no limit
+ *         usecs  - microseconds per call, 0 for no limit
+ * Return: None
+ **************************************************************/
+void     rta_budget(int, int);
+
+/** ************************************************************
+ * rta_serve():  - Listen on a TCP port and serve Postgres
+ * clients forever.  This is an optional replacement for the
+ * select() loop of the sample application.  Each client gets
+ * its own session and buffers of RTA_SRV_MXIN and RTA_SRV_MXOUT
+ * bytes.  The server uses an edge-triggered epoll set, or
+ * io_uring if chosen with rta_serve_backend(), and so is
+ * available only on Linux.
+ *
+ * Input:  port    - the TCP port to listen on
+ *         backlog - the listen() backlog, 0 for SOMAXCONN
+ * Return: RTA_ERROR, and only if the server could not start
+ *         or epoll failed
+ **************************************************************/
+int      rta_serve(int, int);
+
+/** ************************************************************
+ * rta_serve_open():  - Listen on a TCP port for the built-in
+ * server without giving it control of the program.  Add the
+ * returned fd to your own select() or poll() loop as readable,
+ * wait at most rta_serve_timeout() milliseconds, and then call
+ * rta_serve_poll(0).  Call again to listen on more ports; all
+ * ports share one fd.
+ *     New clients beyond 'mxconn' are closed at once instead of
+ * evicting an older client.
+ *
+ * Input:  port    - the TCP port to listen on
+ *         backlog - the listen() backlog, 0 for SOMAXCONN
+ *         mxconn  - max number of clients, 0 for no limit
+ *         idle    - close clients idle this many seconds, 0 to
+ *                   never close them
+ * Return: the fd to wait on, or -1 on error
+ **************************************************************/
+int      rta_serve_open(int, int, int, int);
+
+/** ************************************************************
+ * rta_serve_open_unix():  - Listen on a Unix socket for the
+ * built-in server.  Local clients such as a web UI or CLI skip
+ * the TCP stack this way.  The socket is named as libpq expects,
+ * DIR/.s.PGSQL.PORT, so that "psql -h /run/app -p 8888" finds
+ * it.  A dir that starts with '@' gives a Linux abstract socket
+ * which has no file and needs no cleanup; psql -h @app finds
+ * it.  A stale socket file left by an earlier run is removed,
+ * and rta_serve_close() removes the file.  Unix and TCP ports
+ * share the one fd returned.
+ *
+ * Input:  dir     - the socket directory, or "@name"
+ *         port    - the port number in the socket name
+ *         backlog, mxconn, idle - as rta_serve_open()
+ * Return: the fd to wait on, or -1 on error
+ **************************************************************/
+int      rta_serve_open_unix(char *, int, int, int, int);
+
+/** ************************************************************
+ * rta_serve_backend():  - Choose how the built-in server does
+ * its I/O.  RTA_SRV_EPOLL, the default, uses an epoll set and a
+ * read() and send() per client per batch of commands.  With
+ * RTA_SRV_URING the server uses io_uring: a multishot accept on
+ * each listener, receives into a ring of kernel-selected
+ * buffers, and sends with the next receive linked behind them.
+ * All of the I/O requests of one rta_serve_poll() go to the
+ * kernel in a single system call.  io_uring needs Linux 5.19
+ * or later; if it is not available the server uses epoll.
+ * The fd from rta_serve_open() is then the io_uring fd, which
+ * is readable when there is work to do.  Call this before the
+ * first rta_serve_open().
+ *
+ * Input:  backend - RTA_SRV_EPOLL or RTA_SRV_URING
+ * Return: the backend the server will use
+ **************************************************************/
+int      rta_serve_backend(int);
+
+/** ************************************************************
+ * rta_serve_class():  - Set the scheduling class and the output
+ * high-water mark of the clients that connect to a port of the
+ * built-in server from now on.  Clients take turns: in each
+ * call of rta_serve_poll() a client may produce RTA_SRV_MXOUT
+ * bytes of output before the other clients run, so a bulk
+ * export cannot hold up a small query.  Clients of the
+ * RTA_SRV_HIGH class run first in each poll and get four times
+ * the output per turn.  Give an operator's console its own port
+ * or Unix socket in the high class to keep it responsive while
+ * other clients load the server.
+ *     The commands of a client wait while 'hiwat' bytes of its
+ * output are not yet sent, which keeps a slow reader from
+ * using CPU to build output it cannot take.  The default is
+ * RTA_SRV_MXOUT.  All listeners on the port are changed, so
+ * call this after rta_serve_open() or rta_serve_open_unix().
+ *
+ * Input:  port    - the port given to rta_serve_open() or
+ *                   rta_serve_open_unix()
+ *         prio    - RTA_SRV_NORMAL or RTA_SRV_HIGH
+ *         hiwat   - unsent bytes at which commands wait, from
+ *                   1 to RTA_SRV_MXOUT, or 0 for the default
+ * Return: the number of listeners changed, or -1 if prio or
+ *         hiwat is not valid
+ **************************************************************/
+int      rta_serve_class(int, int, int);
+
+/** ************************************************************
+ * rta_serve_timeout():  - The number of milliseconds you may
+ * wait before calling rta_serve_poll() to close idle clients.
+ *
+ * Return: milliseconds to wait, or -1 to wait forever
+ **************************************************************/
+int      rta_serve_timeout(void);
+
+/** ************************************************************
+ * rta_serve_poll():  - Accept new clients, read and execute
+ * their commands, and send the responses.  Only the clients
+ * with activity are visited.
+ *
+ * Input:  timeout - max milliseconds to wait for activity, 0
+ *                   to not wait, -1 to wait forever
+ * Return: the number of sockets handled, or -1 on error
+ **************************************************************/
+int      rta_serve_poll(int);
+
+/** ************************************************************
+ * rta_serve_close():  - Close all listen ports and clients of
+ * the built-in server.
+ **************************************************************/
+void     rta_serve_close(void);
+
 /** ************************************************************
  * rta_add_table():  - Register a table for inclusion in the
  * DB interface.  Adding a table allows external Postgres
@@ -539,6 +1096,24 @@ int      rta_save(RTA_TBLDEF *, char *);
  **************************************************************/
 int      rta_load(RTA_TBLDEF *, char *);
 
+/** ************************************************************
+ * rta_index_touch():  - Tell librta that the program has changed
+ * a table with RTA_INDEXED, RTA_ORDERED, or RTA_BITMAP columns.
+ * Give the row after changing an indexed column in it.  Give a
+ * NULL row after adding or removing rows, or after changing many
+ * of them; the indexes are then built again when next used.
+ * Changes made with SQL do not need this call.  For a table
+ * without an iterator a new address or row count is seen
+ * without this call.
+ * 
+ * Input:  ptbl   - pointer to the table that changed
+ *         prow   - pointer to the row that changed, or NULL
+ *
+ * Return: RTA_SUCCESS   - indexes updated
+ *         RTA_ERROR     - the table is not in the DB
+ **************************************************************/
+int      rta_index_touch(RTA_TBLDEF *, void *);
+
     /* successfully executed request or command */
 #define RTA_SUCCESS   (0)
 
@@ -554,6 +1129,12 @@ int      rta_load(RTA_TBLDEF *, char *);
     /* Insufficient output buffer space */
 #define RTA_NOBUF     (4)
 
+    /* Output buffer is full and more of the response is pending */
+#define RTA_MORE      (5)
+
+    /* A SELECT used its budget and will continue on the next call */
+#define RTA_YIELD     (6)
+
 
 /** ************************************************************
  * - librta UPDATE and SELECT syntax
@@ -564,7 +1145,8 @@ int      rta_load(RTA_TBLDEF *, char *);
  * or transactions.
  *
  * SELECT:
- *    SELECT column_list FROM table [where_clause] [limit_clause]
+ *    SELECT column_list FROM table [where_clause] [order_clause]
+ *           [limit_clause]
  *
  *    SELECT supports multiple columns, '*', LIMIT, and OFFSET.
  * At most RTA_MXCMDCOLS columns can be specified in the select list
@@ -574,15 +1156,20 @@ int      rta_load(RTA_TBLDEF *, char *);
  * 'column_list' is a '*' or 'column_name [, column_name ...]'.
  * 'where_clause' is 'col_name = value [AND col_name = value ..]'
  * in which all col=val pairs must match for a row to match.
+ * 'order_clause' is 'ORDER BY col_name [ASC | DESC]' and is
+ * allowed only on a column with the RTA_ORDERED flag.  The rows
+ * come from the ordered index of the column.  Without it, rows
+ * are in table order.
  *     LIMIT and OFFSET are very useful to prevent a buffer
  * overflow on the output buffer of rta_dbcommand().  They are also
  * very useful for web based user interfaces in which viewing
  * the data a page-at-a-time is desirable.
  *     Column and table names are case sensitive and may not be
- * one of the reserved words.  The reserved words are: AND, FROM, 
- * LIMIT, OFFSET, SELECT, SET, UPDATE, and WHERE.  Reserved 
- * words are *not* case sensitive.  You may use lower case
- * reserved words in your SQL statements if you wish.
+ * one of the reserved words.  The reserved words are: AND, COPY,
+ * FROM, LIMIT, LISTEN, OFFSET, SELECT, SET, UNLISTEN, UPDATE,
+ * and WHERE.  Reserved words are *not* case sensitive.  You
+ * may use lower case reserved words in your SQL statements if
+ * you wish.
  *    Comparison operator in the WHERE clause include =, >=,
  * <=, >, and <.
  *    You can use a reserved word, like OFFSET, as a column name
@@ -600,6 +1187,10 @@ int      rta_load(RTA_TBLDEF *, char *);
  *
  * SELECT destIP FROM conns WHERE fd != 0 AND lport = 80
  *
+ * SELECT destIP, nbytes FROM conns \
+ *       WHERE nbytes >= 1000000 \
+ *       ORDER BY nbytes DESC LIMIT 10
+ *
  * SELECT destIP, destPort FROM conns \
  *       WHERE fd != 0 \
  *       LIMIT 100 OFFSET 0
@@ -632,6 +1223,12 @@ int      rta_load(RTA_TBLDEF *, char *);
  *
  * UPDATE conn SET usecount = 0 WHERE fd != 0 AND lport = 21
  *
+ *    A statement prepared with the extended query protocol may
+ * use the parameters $1, $2, ... in place of any literal value.
+ * The values are given when the statement is executed.
+ *
+ * SELECT destIP FROM conns WHERE fd != $1 AND lport = $2
+ *
  **************************************************************/
 
 /** ************************************************************
@@ -684,13 +1281,113 @@ int      rta_load(RTA_TBLDEF *, char *);
  * Delete the fourth and fifth rows.  (Table are zero indexed.)
  * DELETE FROM demotbl LIMIT 2 OFFSET 3
  *
+ *
+ * COPY:
+ *    COPY table [(column_list)] TO STDOUT [copy_format]
+ *
+ *    COPY sends all of the rows of a table, or just the columns
+ * listed, as a Postgres COPY stream.  This is the fastest way
+ * to dump a whole table.  There is no row description and each
+ * row is sent as a single CopyData message.  Like a SELECT, the
+ * output continues over as many calls to rta_dbcommand() as
+ * needed, so the table may be much bigger than the output
+ * buffer.  'copy_format' is BINARY, WITH BINARY, or WITH (FORMAT
+ * text|binary).  The default is text: one line per row with
+ * the values separated by tabs.  Binary COPY sends numbers in
+ * network byte order as in the Postgres binary COPY file format.
+ * TO, STDOUT, WITH, FORMAT, and BINARY are not reserved words.
+ *
+ *    Examples:
+ * COPY conns TO STDOUT
+ *
+ * COPY conns (destIP, destPort) TO STDOUT WITH BINARY
+ *
+ *    COPY table [(column_list)] FROM STDIN [copy_format]
+ *
+ *    COPY FROM STDIN bulk loads rows into a table that has an
+ * insert callback.  The client follows the command with the
+ * rows in CopyData messages and ends with CopyDone, or CopyFail
+ * to give up.  Rows may be split across CopyData messages.  Each
+ * value is converted once straight into a new row and the row
+ * is handed to the insert and write callbacks just as for an
+ * INSERT, but without parsing an INSERT for every row.  Columns
+ * not listed are left zero, as are text values of \N.  Text
+ * rows end at a newline, have their values separated by tabs,
+ * and may use the backslash escapes sent by COPY TO.  A line
+ * with just "\." ends the data.  Binary data is in the
+ * Postgres binary COPY file format with network byte order
+ * numbers the size of each column.  There are no transactions
+ * in librta so rows before a bad row stay in the table.  The
+ * table is saved to disk once at the end of the COPY.  COPY
+ * FROM is not available from rta_SQL_string() since it needs
+ * the client's CopyData messages.
+ *
+ *    Examples:
+ * COPY demotbl (dlstr, dlplong) FROM STDIN
+ *
+ * COPY demotbl FROM STDIN WITH (FORMAT binary)
+ *
+ *
+ * LISTEN:
+ *    LISTEN channel
+ *    UNLISTEN channel
+ *    UNLISTEN *
+ *
+ *    LISTEN asks for a Postgres NotificationResponse on the
+ * channel each time a table of that name changes, so that a
+ * client can wait for changes instead of polling with SELECT.
+ * Each UPDATE, INSERT, DELETE, or COPY that changes rows sends
+ * one notification with the command name as its payload.  The
+ * program may also send notifications on any channel with
+ * rta_notify().  Any name may be a channel.  Notifications are
+ * sent between commands, never in the middle of a response.
+ * UNLISTEN stops one channel, or all of them with '*'.  LISTEN
+ * is not available from rta_SQL_string() since it needs a
+ * client connection to send the notifications to.
+ *
+ *    Examples:
+ * LISTEN conns
+ *
+ * UNLISTEN *
+ *
+ *
+ * SET:
+ *    SET parameter = value
+ *    SET parameter TO value
+ *
+ *    SET changes a limit of the client's own session.  The
+ * limits apply to each SELECT, UPDATE, and DELETE after that
+ * and stop one that runs too long or looks at too many rows.
+ * The parameters are:
+ *     statement_timeout - the time a statement may run, in
+ *              milliseconds or with a unit of ms, s, min, or h
+ *              as in '5s'.  A statement that runs longer
+ *              fails with SQLSTATE 57014.  The time a SELECT
+ *              waits for the client to read its rows counts.
+ *     max_rows_scanned - the number of rows a statement may
+ *              look at.  A statement that looks at more fails
+ *              with SQLSTATE 54000.  Rows skipped by OFFSET
+ *              and rows that fail the WHERE clause count.
+ * Zero is no limit.  DEFAULT goes back to the value in the
+ * rta_limit table.  An UPDATE or DELETE stopped by a limit
+ * keeps the changes made to the rows before it.  SET is not
+ * available from rta_SQL_string() whose statements have no
+ * limits.
+ *
+ *    Examples:
+ * SET statement_timeout = '2s'
+ *
+ * SET max_rows_scanned TO DEFAULT
+ *
  **************************************************************/
 
 /** ************************************************************
  * - Internal DB tables
- *     librta has four tables visible to the application:
+ *     librta has six tables visible to the application:
  *  rta_tables:      - a table of all tables in the DB
  *  rta_columns:     - a table of all columns in the DB
+ *  rta_limit:       - default limits of client statements
+ *  rta_plancache:   - size and hit rate of the plan cache
  *  rta_logconfig:   - controls what gets logged from librta
  *  rta_stats:       - simple usage and error statistics
  *
@@ -786,6 +1483,32 @@ int      rta_load(RTA_TBLDEF *, char *);
  *              is updated.  This can be at most RTA_MXDBGIDENT
  *              characters in length.
  *
+ *     The rta_limit table has one row with the limits that a
+ * new client session starts with.  A client may change them for
+ * its own session with SET.  A change to the table applies to
+ * the next statement of each session that has not SET its own
+ * value.  The columns of rta_limit are:
+ *     statement_timeout - integer, the milliseconds a SELECT,
+ *              UPDATE, or DELETE may run.  Default is 0,
+ *              no limit.
+ *     max_rows_scanned - integer, the rows a SELECT, UPDATE,
+ *              or DELETE may look at.  Default is 0, no limit.
+ *
+ *     The rta_plancache table has one row that describes the
+ * plan cache.  A SELECT, UPDATE, INSERT, or DELETE from a simple
+ * query or rta_SQL_string() is looked up by its tokens, so case
+ * and spacing do not matter.  A command that is found is run
+ * without being parsed and checked again.  The cache is emptied
+ * when a table is added.  The columns of rta_plancache are:
+ *     size     - integer, the most commands kept.  The least
+ *              recently used is dropped to make room.  Default
+ *              is RTA_PCACHE.  Zero turns the cache off.
+ *     nplans   - integer, read-only, the commands now kept.
+ *     nhit     - long, read-only, the commands found.
+ *     nmiss    - long, read-only, the commands not found.
+ *     hitrate  - float, read-only, nhit as a percent of nhit
+ *              plus nmiss.
+ *
  *     The rta_stat table contains usage and error statistics
  * which might be of interest to developers.  All fields are
  * of type long, are read-only, and are set to zero by the 
@@ -820,11 +1543,12 @@ int      rta_load(RTA_TBLDEF *, char *);
  *      mis-match in the types of data in a where clause or in 
  *      an update list.
  * 4)  "ERROR:  Output buffer full"
- *      This reply indicates that the size of the response to
- *      a request exceeds the size of the output buffer.  See
- *      rta_dbcommand() and the 'out' and 'nout' parameters.  This
- *      error can be avoided with a large enough output buffer
- *      or, preferably, with the use of LIMIT and OFFSET.
+ *      This reply indicates that a single row of the response
+ *      does not fit in the output buffer, or that the response
+ *      to rta_SQL_string() exceeds the size of the output
+ *      buffer.  rta_dbcommand() sends larger responses in parts
+ *      with RTA_MORE.  See rta_dbcommand() and the 'out' and
+ *      'nout' parameters.
  * 5)  "ERROR:  String too long for '%s'"
  *      This reply indicates that an update to a column of type
  *      string or pointer to string would have exceeded the
@@ -847,6 +1571,66 @@ int      rta_load(RTA_TBLDEF *, char *);
  *      captured by other error messages leaving this message to
  *      imply that the application itself found something wrong
  *      with the values in the INSERT request.
+ * 11) "Parameter used outside a prepared statement"
+ *      A $n parameter appeared in a simple query.
+ * 12) "Prepared statement '%s' does not exist"
+ * 13) "Portal '%s' does not exist"
+ *      A Bind, Describe, or Execute message named a prepared
+ *      statement or portal that the client has not created.
+ * 14) "Prepared statement '%s' already exists"
+ * 15) "Portal '%s' already exists"
+ *      Only the unnamed statement and portal may be redefined
+ *      without first closing them.
+ * 16) "Too many prepared statements"
+ *      The session already holds RTA_MX_STMT statements.
+ * 17) "Wrong parameter count for statement '%s'"
+ *      A Bind message has more or fewer values than the
+ *      statement has parameters.
+ * 18) "NULL parameter values are not supported"
+ * 19) "Malformed protocol message"
+ *      A message of the extended query protocol is truncated
+ *      or has an invalid field.
+ * 20) "Invalid COPY data for column '%s'"
+ *      A COPY FROM STDIN value could not be converted to the
+ *      type of the column.
+ * 21) "Wrong number of COPY columns for '%s'"
+ *      A COPY FROM STDIN row has more or fewer values than
+ *      the columns being copied.
+ * 22) "COPY FROM STDIN needs a client connection"
+ *      COPY FROM STDIN was given to rta_SQL_string().
+ * 23) "COPY failed: %s"
+ *      The client sent CopyFail to abort a COPY FROM STDIN.
+ * 24) "LISTEN needs a client connection"
+ *      LISTEN or UNLISTEN was given to rta_SQL_string().
+ * 25) "Canceling statement due to user request"
+ *      The client sent a CancelRequest while the command ran.
+ *      This error has SQLSTATE 57014 instead of 42601, which
+ *      is what psql and drivers expect.
+ * 26) "Canceling statement due to statement timeout"
+ *      The statement ran longer than its statement_timeout.
+ *      The SQLSTATE is 57014 as for a cancel.
+ * 27) "Canceling statement after %s rows scanned"
+ *      The statement looked at more rows than its
+ *      max_rows_scanned.  The SQLSTATE is 54000.
+ * 28) "Unrecognized configuration parameter '%s'"
+ *      SET named a parameter other than statement_timeout
+ *      or max_rows_scanned.
+ * 29) "Invalid value for parameter '%s'"
+ *      The SET value is not a number, DEFAULT, or a time
+ *      with a known unit.
+ * 30) "SET needs a client connection"
+ *      SET was given to rta_SQL_string().
+ * 31) "ORDER BY needs a column with an ordered index, not '%s'"
+ *      ORDER BY named a column without the RTA_ORDERED flag,
+ *      or one with a read callback.
+ * 32) "Out of memory"
+ *      An index could not be built for an ORDER BY.  The
+ *      SQLSTATE is 53200.
+ * 33) "Rows of '%s' changed under a stopped SELECT"
+ *      A SELECT stopped on a full buffer or its budget, and
+ *      rows were then added or deleted so that it can not
+ *      find its place again.  The rows sent so far stand.
+ *      The SQLSTATE is 40001 so the client may retry.
  *
  *     The other type of error messages are internal debug
  * messages.  Debug messages are logged using the standard
@@ -869,6 +1653,7 @@ int      rta_load(RTA_TBLDEF *, char *);
 #define Er_No_Mem    "%s %d: Can not allocate memory"
 #define Er_No_Save   "%s %d: Table '%s' save failure.  Can not open %s"
 #define Er_No_Load   "%s %d: Table '%s' load failure.  Can not open %s"
+#define Er_Sys_Call  "%s %d: System call %s() failed: %s"
 
         /** "RTA" errors */
 #define Er_Max_Tbls  "%s %d: Too many tables in DB"
@@ -887,6 +1672,7 @@ int      rta_load(RTA_TBLDEF *, char *);
 
         /** "SQL" errors */
 #define Er_Bad_SQL   "%s %d: SQL parse error: %s"
+#define Er_Msg_Len   "%s %d: Invalid length in packet of type %d"
 #define Er_Readonly  "%s %d: Attempt to update readonly column: %s"
 
         /* SQL errors to the front ends */
@@ -900,6 +1686,32 @@ int      rta_load(RTA_TBLDEF *, char *);
 #define E_NODELETE   "DELETE not available on relation '%s'"
 #define E_NOINSERT   "INSERT not available on relation '%s'"
 #define E_BADINSERT  "Failed INSERT on relation '%s'"
+#define E_NOPARAM    "Parameter used outside a prepared statement",""
+#define E_NOSTMT     "Prepared statement '%s' does not exist"
+#define E_NOPORTAL   "Portal '%s' does not exist"
+#define E_DUPSTMT    "Prepared statement '%s' already exists"
+#define E_DUPPORTAL  "Portal '%s' already exists"
+#define E_MAXSTMT    "Too many prepared statements",""
+#define E_NPARAMS    "Wrong parameter count for statement '%s'"
+#define E_NULLPARM   "NULL parameter values are not supported",""
+#define E_BADMSG     "Malformed protocol message",""
+#define E_BADCOPY    "Invalid COPY data for column '%s'"
+#define E_COPYCOLS   "Wrong number of COPY columns for '%s'"
+#define E_NOCOPYIN   "COPY FROM STDIN needs a client connection",""
+#define E_COPYFAIL   "COPY failed: %s"
+#define E_NOLISTEN   "LISTEN needs a client connection",""
+#define E_CANCELMSG  "Canceling statement due to user request"
+#define E_CANCEL     E_CANCELMSG,""
+#define E_TIMEOUTMSG "Canceling statement due to statement timeout"
+#define E_TIMEOUT    E_TIMEOUTMSG,""
+#define E_MAXSCAN    "Canceling statement after %s rows scanned"
+#define E_NOSETTING  "Unrecognized configuration parameter '%s'"
+#define E_BADSETTING "Invalid value for parameter '%s'"
+#define E_NOSET      "SET needs a client connection",""
+#define E_NOORDER    "ORDER BY needs a column with an ordered index, not '%s'"
+#define E_NOMEMMSG   "Out of memory"
+#define E_NORESUME   "Rows of '%s' changed under a stopped SELECT"
+#define E_NOMEM      E_NOMEMMSG,""
 
         /** "Trace" messages */
 #define Er_Trace_SQL "%s %d: SQL command: %s  (%s)"
@@ -1015,7 +1827,6 @@ int      rta_load(RTA_TBLDEF *, char *);
  * - table save callback (to save file to flash?)
  * - execution times for table access, update
  * - count(*) function
- * - model output buffer mgmt on zlib to allow output streams
  * - add a column data type of "table" to allow nested tables
  * - add internationalization support
  * - make it thread safe
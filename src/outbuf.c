@@ -0,0 +1,328 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * outbuf.c:  Output buffers that grow as needed.
+ *
+ *   An RTA_OUTBUF is a list of chunks.  rta_session_dbout() runs
+ * the commands of a client into the free space at the end of
+ * the last chunk and adds a chunk when that space runs out.
+ * The caller sends the chunks with writev() and drains what
+ * was sent.  A drained chunk goes back to a small pool shared
+ * by all output buffers, so an idle client holds no output
+ * memory and a busy one does not call malloc() per response.
+ *   A SELECT that fills a chunk stops and is continued in the
+ * next chunk by the normal resume of rta_session_dbcommand().
+ * If the row that did not fit is bigger than a chunk, the next
+ * chunk is made big enough for it.  Such chunks are freed, not
+ * pooled.  Output stops at RTA_OUTMAX queued bytes until the
+ * caller drains it.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "do_sql.h"
+
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+
+/* Do not run commands into less free space than this.  The
+   largest fixed reply, to a start-up packet, is 164 bytes. */
+#define OB_MNFREE      (256)
+
+/* One chunk of output.  The data follows the structure. */
+struct RtaChunk
+{
+  struct RtaChunk *next;   /* next chunk in buffer or pool */
+  int          size;       /* bytes of data in the chunk */
+  int          head;       /* offset of the first unsent byte */
+  int          tail;       /* offset of the first free byte */
+};
+
+struct RtaOutbuf
+{
+  struct RtaChunk *first;  /* oldest chunk, sent first */
+  struct RtaChunk *last;   /* chunk that gets new output */
+  int          len;        /* bytes waiting to be sent */
+};
+
+/* Forward references */
+static struct RtaChunk *ob_add(RTA_OUTBUF *, int);
+static void     ob_trim(RTA_OUTBUF *);
+static void     ob_release(struct RtaChunk *);
+
+/* Free chunks of RTA_OUTCHUNK bytes */
+static struct RtaChunk *Pool;
+static int      NPool;
+
+
+/***************************************************************
+ * rta_outbuf_new(): - Allocate an empty output buffer.
+ *
+ * Input:        None
+ * Output:       The buffer, or NULL if out of memory
+ * Effects:      None
+ ***************************************************************/
+RTA_OUTBUF *
+rta_outbuf_new()
+{
+  RTA_OUTBUF *ob;          /* the new buffer */
+
+  ob = calloc(1, sizeof(RTA_OUTBUF));
+  if (ob == (RTA_OUTBUF *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+  }
+  return (ob);
+}
+
+/***************************************************************
+ * rta_outbuf_free(): - Free an output buffer and any output
+ * it still holds.
+ *
+ * Input:        The buffer, may be NULL
+ * Output:       None
+ * Effects:      The chunk pool
+ ***************************************************************/
+void
+rta_outbuf_free(RTA_OUTBUF *ob)
+{
+  struct RtaChunk *pc;     /* chunk to release */
+
+  if (ob == (RTA_OUTBUF *) 0)
+    return;
+  while (ob->first) {
+    pc = ob->first;
+    ob->first = pc->next;
+    ob_release(pc);
+  }
+  free(ob);
+}
+
+/***************************************************************
+ * rta_outbuf_len(): - Give the number of bytes waiting to be
+ * sent.
+ *
+ * Input:        The buffer
+ * Output:       The number of bytes
+ * Effects:      None
+ ***************************************************************/
+int
+rta_outbuf_len(RTA_OUTBUF *ob)
+{
+  return (ob->len);
+}
+
+/***************************************************************
+ * rta_outbuf_iov(): - Describe the waiting output as an iovec
+ * list, oldest first.
+ *
+ * Input:        The buffer, the list, and the size of the list
+ * Output:       The number of entries filled in
+ * Effects:      None
+ ***************************************************************/
+int
+rta_outbuf_iov(RTA_OUTBUF *ob, struct iovec *iov, int niov)
+{
+  struct RtaChunk *pc;     /* chunk in the buffer */
+  int      n = 0;          /* entries filled in */
+
+  for (pc = ob->first; pc && n < niov; pc = pc->next) {
+    if (pc->tail == pc->head)
+      continue;
+    iov[n].iov_base = (char *) (pc + 1) + pc->head;
+    iov[n].iov_len = pc->tail - pc->head;
+    n++;
+  }
+  return (n);
+}
+
+/***************************************************************
+ * rta_outbuf_drain(): - Remove sent bytes from the front of the
+ * buffer.  Emptied chunks are released.
+ *
+ * Input:        The buffer and the number of bytes sent
+ * Output:       None
+ * Effects:      The chunk pool
+ ***************************************************************/
+void
+rta_outbuf_drain(RTA_OUTBUF *ob, int nsent)
+{
+  struct RtaChunk *pc;     /* oldest chunk */
+  int      n;              /* bytes taken from the chunk */
+
+  while (ob->first && nsent > 0) {
+    pc = ob->first;
+    n = pc->tail - pc->head;
+    if (n > nsent)
+      n = nsent;
+    pc->head += n;
+    ob->len -= n;
+    nsent -= n;
+    if (pc->head == pc->tail) {
+      ob->first = pc->next;
+      if (ob->first == (struct RtaChunk *) 0)
+        ob->last = (struct RtaChunk *) 0;
+      ob_release(pc);
+    }
+  }
+}
+
+/***************************************************************
+ * rta_session_dbout():  - Execute all of the complete commands
+ * in the input buffer of a client, adding chunks to the output
+ * buffer as needed.
+ *
+ * Input:  sess - the client's session, NULL for the default
+ *         buf, nin - as rta_dbcommand()
+ *         ob - the output buffer
+ *         ncmd - on exit, the number of commands executed
+ * Return: RTA_MORE if RTA_OUTMAX bytes are waiting, RTA_NOBUF
+ *         if out of memory, else as rta_session_dbbatch().
+ *         A SELECT that yields returns at once with RTA_YIELD.
+ **************************************************************/
+int
+rta_session_dbout(RTA_SESSION *sess, char *buf, int *nin, RTA_OUTBUF *ob,
+  int *ncmd)
+{
+  struct RtaChunk *pc;     /* chunk getting the output */
+  int      nbuf;           /* size of the input on entry */
+  int      nfree;          /* free bytes in the chunk */
+  int      nused;          /* bytes of output added */
+  int      need = 0;       /* size of the next chunk, 0 if any */
+  int      n;              /* commands run by each batch */
+  int      ret = RTA_MORE; /* rta_session_dbbatch() return */
+
+  nbuf = *nin;
+  *ncmd = 0;
+  while (ob->len < RTA_OUTMAX) {
+    pc = ob->last;
+    if (need || pc == (struct RtaChunk *) 0 ||
+        pc->size - pc->tail < OB_MNFREE) {
+      ob_trim(ob);
+      pc = ob_add(ob, need);
+      if (pc == (struct RtaChunk *) 0)
+        return (RTA_NOBUF);
+    }
+
+    nfree = pc->size - pc->tail;
+    ret = rta_session_dbbatch(sess, &buf[nbuf - *nin], nin,
+      (char *) (pc + 1) + pc->tail, &nfree, &n);
+    nused = pc->size - pc->tail - nfree;
+    pc->tail += nused;
+    ob->len += nused;
+    *ncmd += n;
+
+    /* A SELECT that stopped goes on in a new chunk that is big
+       enough for its next row.  A full chunk means a new one. */
+    if (ret == RTA_MORE)
+      need = rta_ext_rowsize(sess);
+    else if (ret == RTA_NOBUF && pc->tail > 0)
+      need = 0;
+    else
+      break;
+    if (need == 0)
+      need = OB_MNFREE;
+    ret = RTA_MORE;
+  }
+
+  /* Chunks that got no output are not kept */
+  ob_trim(ob);
+  return (ret);
+}
+
+/***************************************************************
+ * ob_add(): - Add an empty chunk to the end of a buffer.
+ *
+ * Input:        The buffer and the free space needed, 0 if any
+ * Output:       The chunk, or NULL if out of memory
+ * Effects:      The chunk pool
+ ***************************************************************/
+static struct RtaChunk *
+ob_add(RTA_OUTBUF *ob, int need)
+{
+  struct RtaChunk *pc;     /* the new chunk */
+  int      size;           /* bytes of data in it */
+
+  size = (need > RTA_OUTCHUNK) ? need : RTA_OUTCHUNK;
+  if (size == RTA_OUTCHUNK && Pool) {
+    pc = Pool;
+    Pool = pc->next;
+    NPool--;
+  }
+  else {
+    pc = malloc(sizeof(struct RtaChunk) + size);
+    if (pc == (struct RtaChunk *) 0) {
+      rta_stat.nsyserr++;
+      if (rta_dbg.syserr)
+        rta_log(LOC, Er_No_Mem);
+      return (pc);
+    }
+    pc->size = size;
+  }
+  pc->next = (struct RtaChunk *) 0;
+  pc->head = 0;
+  pc->tail = 0;
+
+  if (ob->last)
+    ob->last->next = pc;
+  else
+    ob->first = pc;
+  ob->last = pc;
+  return (pc);
+}
+
+/***************************************************************
+ * ob_trim(): - Release the empty chunks of a buffer.
+ *
+ * Input:        The buffer
+ * Output:       None
+ * Effects:      The chunk pool
+ ***************************************************************/
+static void
+ob_trim(RTA_OUTBUF *ob)
+{
+  struct RtaChunk **ppc;   /* link to the chunk */
+  struct RtaChunk *pc;     /* the chunk */
+
+  ob->last = (struct RtaChunk *) 0;
+  ppc = &(ob->first);
+  while ((pc = *ppc) != (struct RtaChunk *) 0) {
+    if (pc->head == pc->tail) {
+      *ppc = pc->next;
+      ob_release(pc);
+    }
+    else {
+      ob->last = pc;
+      ppc = &(pc->next);
+    }
+  }
+}
+
+/***************************************************************
+ * ob_release(): - Return a chunk to the pool, or free it if the
+ * pool is full or the chunk is not of the standard size.
+ *
+ * Input:        The chunk
+ * Output:       None
+ * Effects:      The chunk pool
+ ***************************************************************/
+static void
+ob_release(struct RtaChunk *pc)
+{
+  if (pc->size != RTA_OUTCHUNK || NPool >= RTA_OUTPOOL) {
+    free(pc);
+    return;
+  }
+  pc->next = Pool;
+  Pool = pc;
+  NPool++;
+}
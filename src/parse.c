@@ -0,0 +1,1333 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * parse.c:  The tokenizer and parser for our subset of SQL.
+ *
+ *   The tokenizer works in place.  A token is its type and a
+ * slice of the SQL text; nothing is copied while we scan.  The
+ * parser is recursive descent with one token of look-ahead and
+ * keeps its state in a Sql_Lex on the stack, so a callback may
+ * run SQL while a command is being executed.
+ *   The names and values kept in rta_cmd must end in a null, so
+ * the parser copies just those tokens into a string area.  The
+ * area is sized for the rest of the SQL before each command and
+ * is reused by the next command, so a parse does not call
+ * malloc() once the area has grown to the size of the SQL.
+ *   The grammar is:
+ *
+ *   command: SELECT cols FROM name [where] [order] [limit] ;
+ *          | UPDATE name SET name = lit {, name = lit} [where] [limit] ;
+ *          | INSERT INTO name ( [cols] ) VALUES ( [lit] {, [lit]} ) ;
+ *          | DELETE FROM name [where] [limit] ;
+ *          | COPY name [( cols )] TO STDOUT [format] ;
+ *          | COPY name [( cols )] FROM STDIN [format] ;
+ *          | LISTEN name ;  |  UNLISTEN name ;
+ *          | SET name = lit ;  |  SET name TO lit ;
+ *          | ;
+ *   cols:   name {, name}
+ *   where:  WHERE test {AND test}
+ *   test:   ( test {AND test} )  |  name relation lit
+ *   order:  ORDER BY name [ASC | DESC]
+ *   limit:  LIMIT integer [OFFSET integer]
+ *   format: BINARY | WITH BINARY | WITH ( FORMAT BINARY|TEXT )
+ *
+ * The ';' is also a null byte or the end of the SQL.  ORDER, BY,
+ * ASC, and DESC are not reserved words.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "do_sql.h"
+
+extern struct Sql_Cmd rta_cmd;
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+
+    /* Token types.  The relations are in the order of RTA_EQ... */
+#define TK_GARBAGE     (0)     /* anything else, a syntax error */
+#define TK_TERMINATOR  (1)     /* ';', a null, or the end */
+#define TK_NAME        (2)     /* a name, '*', or a quoted name */
+#define TK_STRING      (3)     /* a quoted string */
+#define TK_INTEGER     (4)     /* an integer, quoted or not */
+#define TK_REALNUM     (5)     /* a real number, quoted or not */
+#define TK_PARAM       (6)     /* $n in a prepared statement */
+#define TK_EQ          (7)     /* = */
+#define TK_NE          (8)     /* != or <> */
+#define TK_GT          (9)     /* > */
+#define TK_LT          (10)    /* < */
+#define TK_GE          (11)    /* >= */
+#define TK_LE          (12)    /* <= */
+#define TK_COMMA       (13)
+#define TK_LPAREN      (14)
+#define TK_RPAREN      (15)
+#define TK_AND         (16)    /* reserved words from here on */
+#define TK_FROM        (17)
+#define TK_LIMIT       (18)
+#define TK_OFFSET      (19)
+#define TK_SELECT      (20)
+#define TK_SET         (21)
+#define TK_UPDATE      (22)
+#define TK_INSERT      (23)
+#define TK_INTO        (24)
+#define TK_VALUES      (25)
+#define TK_DELETE      (26)
+#define TK_COPY        (27)
+#define TK_LISTEN      (28)
+#define TK_UNLISTEN    (29)
+#define TK_WHERE       (30)
+
+#define SQL_ALPHA(c)   (((c) >= 'a' && (c) <= 'z') || \
+                        ((c) >= 'A' && (c) <= 'Z'))
+#define SQL_DIGIT(c)   ((c) >= '0' && (c) <= '9')
+
+    /* Size of the string area when first allocated, and the size
+       above which we give it back when the SQL is small again */
+#define SQL_NSTRS      (8192)
+#define SQL_MXSTRS     (65536)
+
+    /* Room in the string area for the nulls.  A command keeps at
+       most a table name, a column and value per column, a column
+       and value per WHERE phrase, the ORDER BY column, and the
+       LIMIT and OFFSET. */
+#define SQL_NNULLS     ((4 * RTA_NCMDCOLS) + 8)
+
+    /* Size of the lists of columns and WHERE phrases in rta_cmd
+       when first allocated */
+#define SQL_NVALS      (16)
+
+    /* Longest plan cache key.  Longer commands are not cached. */
+#define SQL_MXKEY      (2048)
+
+/* A token is a slice of the SQL text */
+struct Sql_Tok
+{
+  int          type;       /* TK_NAME, TK_EQ, ... */
+  char        *p;          /* the text, without any quotes */
+  int          len;        /* bytes of text */
+};
+
+/* The state of a parse */
+struct Sql_Lex
+{
+  char        *s;          /* the SQL commands */
+  int          n;          /* number of bytes in s */
+  int          pos;        /* bytes of s scanned so far */
+  int          look;       /* ==1 if tok is a look-ahead token */
+  struct Sql_Tok tok;      /* the last token scanned */
+  char        *str;        /* next free byte in the string area */
+};
+
+/* The reserved words.  Case does not matter. */
+static struct Sql_Word
+{
+  char        *word;       /* the word in upper case */
+  int          len;        /* its length */
+  int          type;       /* its token type */
+} Words[] = {
+  {"AND", 3, TK_AND},
+  {"FROM", 4, TK_FROM},
+  {"LIMIT", 5, TK_LIMIT},
+  {"OFFSET", 6, TK_OFFSET},
+  {"SELECT", 6, TK_SELECT},
+  {"SET", 3, TK_SET},
+  {"UPDATE", 6, TK_UPDATE},
+  {"INSERT", 6, TK_INSERT},
+  {"INTO", 4, TK_INTO},
+  {"VALUES", 6, TK_VALUES},
+  {"DELETE", 6, TK_DELETE},
+  {"COPY", 4, TK_COPY},
+  {"LISTEN", 6, TK_LISTEN},
+  {"UNLISTEN", 8, TK_UNLISTEN},
+  {"WHERE", 5, TK_WHERE},
+};
+#define NWORDS  (sizeof(Words) / sizeof(struct Sql_Word))
+
+/* The string area for the tokens kept in rta_cmd */
+static char   *Strs;
+static int     NStrs;
+
+/* Forward references */
+static void    sql_begin(struct Sql_Lex *, char *, int, char *, int *);
+static int     sql_key(struct Sql_Lex *, char *, unsigned int *);
+static int     sql_command(struct Sql_Lex *);
+static int     sql_select(struct Sql_Lex *);
+static int     sql_update(struct Sql_Lex *);
+static int     sql_insert(struct Sql_Lex *);
+static int     sql_delete(struct Sql_Lex *);
+static int     sql_copy(struct Sql_Lex *);
+static int     sql_set(struct Sql_Lex *);
+static int     sql_columns(struct Sql_Lex *);
+static int     sql_where(struct Sql_Lex *);
+static int     sql_order(struct Sql_Lex *);
+static int     sql_limit(struct Sql_Lex *);
+static int     sql_literal(struct Sql_Lex *, char **, int *);
+static char   *sql_name(struct Sql_Lex *);
+static int     sql_expect(struct Sql_Lex *, int);
+static int     sql_word(struct Sql_Lex *, char *);
+static int     isword(struct Sql_Tok *, char *);
+static char   *sql_save(struct Sql_Lex *, struct Sql_Tok *);
+static struct Sql_Val *sql_newval(int);
+static int     sql_grow(struct Sql_Val **, int *, int);
+static int     sql_room(int);
+static int     sql_error(void);
+static struct Sql_Tok *sql_peek(struct Sql_Lex *);
+static struct Sql_Tok *sql_next(struct Sql_Lex *);
+static void    sql_scan(struct Sql_Lex *);
+static int     sql_quoted(char *, int);
+static int     sql_strchar(int);
+
+
+/***************************************************************
+ * rta_SQL_string(): - Execute the SQL commands in a buffer.
+ *
+ * Input:  s     - the SQL commands
+ *         incnt - number of bytes in s
+ *         out   - the buffer for the response
+ *         nout  - number of free bytes in out
+ * Output: None
+ **************************************************************/
+void
+rta_SQL_string(char *s, int incnt, char *out, int *nout)
+{
+  (void) rta_SQL_exec(s, incnt, out, nout, (int *) 0);
+}
+
+/***************************************************************
+ * rta_SQL_exec(): - Execute the SQL commands in a buffer.  If
+ * pused is not NULL a SELECT may stop when the output buffer
+ * fills.  The stopped SELECT is left in rta_cmd, and pused is
+ * set to the number of bytes of SQL used so far, so that the
+ * caller can save both and continue later.
+ *
+ * Input:  s     - the SQL commands
+ *         incnt - number of bytes in s
+ *         out   - the buffer for the response
+ *         nout  - number of free bytes in out
+ *         pused - where to put the bytes used, or NULL
+ * Return: 0 when all commands are done, 1 if a SELECT stopped.
+ **************************************************************/
+int
+rta_SQL_exec(char *s, int incnt, char *out, int *nout, int *pused)
+{
+  struct Sql_Lex lx;       /* state of the parse */
+  struct Sql_Plan *pplan;  /* plan found in the plan cache */
+  char     key[SQL_MXKEY]; /* plan cache key of the command */
+  int      klen;           /* bytes in key, 0 if no key */
+  unsigned int hash;       /* hash of the key */
+  char    *buf;            /* where the response goes */
+  int      start;          /* position of the command in s */
+  int      i;              /* index into out */
+
+  /* Sanity checks */
+  if (!s || !out || !nout)
+    return (0);
+
+  sql_begin(&lx, s, incnt, out, nout);
+  rta_cmd.canmore = (pused != (int *) 0);
+
+  for (;;) {
+    buf = &out[rta_cmd.nerrout - *nout];
+
+    /* A command seen before has a verified plan */
+    start = lx.pos;
+    klen = sql_key(&lx, key, &hash);
+    pplan = (klen) ? rta_pcache_get(key, klen, hash) : (struct Sql_Plan *) 0;
+    if (pplan) {
+      rta_plan_load(pplan);
+      rta_cmd.sqlcmd = s;
+    }
+    else {
+      lx.pos = start;
+      if (sql_command(&lx) != 0)
+        break;
+      if (rta_cmd.err) {
+        rta_cmd.canmore = 0;
+        return (0);
+      }
+      rta_verify_sql(buf, nout);
+      if (klen && !rta_cmd.err)
+        rta_pcache_put(key, klen, hash);
+    }
+
+    /* At this point we have a verified command.  If no errors
+       were detected, we can continue processing */
+    if (!rta_cmd.err) {
+      /* everything is set.  do the command */
+      rta_run_sql(buf, nout);
+      if (rta_cmd.more) {
+        /* output buffer is full; caller saves the SELECT */
+        rta_cmd.canmore = 0;
+        *pused = lx.pos;
+        return (1);
+      }
+    }
+    rta_dosql_init();           /* re-init the rta_cmd structure */
+  }
+
+  /* We are done processing the command and have assembled the
+     response.  Tell the other end that we are ready for a new
+     command.  */
+  i = rta_cmd.nerrout - *nout;
+  out[i++] = 'Z';               /* Ready */
+  out[i++] = 0;                 /* byte 4 of length */
+  out[i++] = 0;                 /* byte 3 of length */
+  out[i++] = 0;                 /* byte 2 of length */
+  out[i++] = 5;                 /* byte 1 of length */
+  out[i++] = 'I';               /* status of result */
+  *nout -= 6;
+  rta_cmd.canmore = 0;
+  return (0);
+}
+
+/***************************************************************
+ * rta_SQL_prepare(): - Parse and verify one SQL command but do
+ * not execute it.  This is the Parse message of the extended
+ * query protocol.  On success the verified command is left in
+ * rta_cmd where rta_plan_save() can copy it.  Errors are sent
+ * to the output buffer.
+ *
+ * Input:  s     - the SQL command
+ *         incnt - number of bytes in s
+ *         out   - the buffer for an error response
+ *         nout  - number of free bytes in out
+ * Return: 0 if the command is ready to save, 1 if the command
+ *         is empty, and -1 on error.
+ **************************************************************/
+int
+rta_SQL_prepare(char *s, int incnt, char *out, int *nout)
+{
+  struct Sql_Lex lx;       /* state of the parse */
+  int      ret;            /* the return value */
+
+  sql_begin(&lx, s, incnt, out, nout);
+
+  ret = sql_command(&lx);
+  if (ret != 0) {
+    /* An empty command stops the parse without an error */
+    ret = (rta_cmd.err) ? -1 : 1;
+  }
+  else if (sql_next(&lx)->type != TK_TERMINATOR) {
+    /* A prepared statement has exactly one command */
+    ret = sql_error();
+  }
+  else {
+    rta_verify_sql(out, nout);
+    ret = (rta_cmd.err) ? -1 : 0;
+  }
+  return (ret);
+}
+
+/***************************************************************
+ * rta_dosql_init(): - Set up data structures prior to parse of
+ * an SQL command.  The lists of columns and WHERE phrases are
+ * kept for the next command, and an entry is cleared when it is
+ * added, so this does not depend on the size of the last one.
+ *
+ * Input:        None.
+ * Output:       None.
+ * Effects:      structure rta_cmd is initialized
+ ***************************************************************/
+void
+rta_dosql_init()
+{
+  /* The strings are in the string area or in a plan and are
+     not freed here */
+  rta_cmd.tbl      = (char *) 0;
+  rta_cmd.ptbl     = (RTA_TBLDEF *) 0;
+  rta_cmd.ncols    = 0;
+  rta_cmd.nwhrcols = 0;
+  rta_cmd.limit    = 1 << 30;   /* no real limit */
+  rta_cmd.offset   = 0;
+  rta_cmd.err      = 0;
+  rta_cmd.nparams  = 0;
+  rta_cmd.copyfmt  = 0;
+  rta_cmd.order    = (char *) 0;
+  rta_cmd.porder   = (RTA_COLDEF *) 0;
+  rta_cmd.desc     = 0;
+  rta_cmd.plan     = (struct Sql_Plan *) 0;
+  rta_cmd.pr       = (void *) 0;
+  rta_cmd.rx       = 0;
+  rta_cmd.npr      = 0;
+  rta_cmd.maxrows  = 0;
+  rta_cmd.gen      = 0;
+  rta_cmd.okey.val = (char *) 0;
+  rta_cmd.more     = 0;
+}
+
+/***************************************************************
+ * rta_cmd_grow(): - Make the lists of columns and WHERE phrases
+ * in rta_cmd hold at least the number given.  The entries in use
+ * are kept.  A list grows to twice its size or more, and never
+ * shrinks, so a saved plan can always be loaded back.
+ *
+ * Input:        The number of columns and of WHERE phrases
+ * Output:       0 on success, -1 if out of memory
+ * Effects:      The lists in rta_cmd
+ ***************************************************************/
+int
+rta_cmd_grow(int ncols, int nwhrcols)
+{
+  if (sql_grow(&rta_cmd.cols, &rta_cmd.mxcols, ncols) ||
+      sql_grow(&rta_cmd.whr, &rta_cmd.mxwhr, nwhrcols)) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return (-1);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * sql_begin(): - Set up rta_cmd and the state of a parse.
+ *
+ * Input:        The parse state, the SQL and its length, and
+ *               the output buffer and its number of free bytes
+ * Output:       None
+ * Effects:      structure rta_cmd is initialized
+ ***************************************************************/
+static void
+sql_begin(struct Sql_Lex *plx, char *s, int incnt, char *out, int *nout)
+{
+  rta_dosql_init();
+  rta_cmd.out = out;
+  rta_cmd.nout = nout;
+  rta_cmd.sqlcmd = s;
+
+  /* We need to store the start addr of the buffer in case we
+     need to send an error message after we've started sending
+     a reply.  */
+  rta_cmd.errout = out;
+  rta_cmd.nerrout = *nout;
+  rta_cmd.nlineout = 0;
+
+  plx->s = s;
+  plx->n = incnt;
+  plx->pos = 0;
+  plx->look = 0;
+  plx->str = (char *) 0;
+}
+
+/***************************************************************
+ * sql_key(): - Build the plan cache key of the next command.
+ * The key is the type of each token up to the terminator and
+ * the text of the names and values, so case and spaces do not
+ * matter.  Only a SELECT, UPDATE, INSERT, or DELETE without
+ * parameters and with a key of at most SQL_MXKEY bytes has a
+ * key.  Tokens have no nulls, so a null ends each text.
+ *
+ * Input:        The parse state, a buffer of SQL_MXKEY bytes,
+ *               and where to put the hash of the key
+ * Output:       The length of the key, or 0 if there is none
+ * Effects:      The position in the parse state
+ ***************************************************************/
+static int
+sql_key(struct Sql_Lex *plx, char *key, unsigned int *phash)
+{
+  struct Sql_Tok *pt;      /* a token of the command */
+  unsigned int hash;       /* FNV-1a hash of the key */
+  int      n = 0;          /* bytes in the key */
+  int      len;            /* bytes of text of the token */
+  int      i;              /* index into key */
+
+  pt = sql_next(plx);
+  if (pt->type != TK_SELECT && pt->type != TK_UPDATE &&
+      pt->type != TK_INSERT && pt->type != TK_DELETE)
+    return (0);
+
+  for (;;) {
+    if (pt->type == TK_GARBAGE || pt->type == TK_PARAM)
+      return (0);
+    len = (pt->type >= TK_NAME && pt->type <= TK_REALNUM) ? pt->len + 1 : 0;
+    if (n + 1 + len > SQL_MXKEY)
+      return (0);
+    key[n++] = (char) pt->type;
+    if (len) {
+      memcpy(&key[n], pt->p, pt->len);
+      n += pt->len;
+      key[n++] = (char) 0;
+    }
+    if (pt->type == TK_TERMINATOR)
+      break;
+    pt = sql_next(plx);
+  }
+
+  hash = 2166136261U;
+  for (i = 0; i < n; i++) {
+    hash ^= (unsigned char) key[i];
+    hash *= 16777619U;
+  }
+  *phash = hash;
+  return (n);
+}
+
+/***************************************************************
+ * sql_command(): - Parse the next command into rta_cmd.
+ *
+ * Input:        The parse state
+ * Output:       0 if the command was parsed, 1 if it is empty
+ *               or there are no more, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_command(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the first token */
+
+  /* The tokens kept from the last command are no longer needed */
+  if (sql_room(plx->n - plx->pos + SQL_NNULLS))
+    return (sql_error());
+  plx->str = Strs;
+
+  pt = sql_next(plx);
+  switch (pt->type) {
+    case TK_TERMINATOR:
+      return (1);
+    case TK_SELECT:
+      return (sql_select(plx));
+    case TK_UPDATE:
+      return (sql_update(plx));
+    case TK_INSERT:
+      return (sql_insert(plx));
+    case TK_DELETE:
+      return (sql_delete(plx));
+    case TK_COPY:
+      return (sql_copy(plx));
+    case TK_LISTEN:
+    case TK_UNLISTEN:
+      rta_cmd.command = (pt->type == TK_LISTEN) ? RTA_LISTEN : RTA_UNLISTEN;
+      rta_cmd.tbl = sql_name(plx);
+      if (!rta_cmd.tbl || sql_expect(plx, TK_TERMINATOR))
+        return (-1);
+      return (0);
+    case TK_SET:
+      return (sql_set(plx));
+    default:
+      return (sql_error());
+  }
+}
+
+/***************************************************************
+ * sql_select(): - Parse the rest of a SELECT.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_select(struct Sql_Lex *plx)
+{
+  if (sql_columns(plx) || sql_expect(plx, TK_FROM))
+    return (-1);
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl || sql_where(plx) || sql_order(plx) || sql_limit(plx) ||
+      sql_expect(plx, TK_TERMINATOR))
+    return (-1);
+  rta_cmd.command = RTA_SELECT;
+  return (0);
+}
+
+/***************************************************************
+ * sql_update(): - Parse the rest of an UPDATE.  The columns
+ * and values of the SET go into cols.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_update(struct Sql_Lex *plx)
+{
+  struct Sql_Val *pval;    /* the column */
+  char    *col;            /* the column to set */
+  char    *val;            /* its value */
+  int      parm;           /* param # of the value, or 0 */
+
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl || sql_expect(plx, TK_SET))
+    return (-1);
+  do {
+    col = sql_name(plx);
+    if (!col || sql_expect(plx, TK_EQ) || sql_literal(plx, &val, &parm))
+      return (-1);
+    pval = sql_newval(0);
+    if (!pval)
+      return (-1);
+    pval->name = col;
+    pval->val = val;
+    pval->parm = parm;
+  } while (sql_peek(plx)->type == TK_COMMA && sql_next(plx));
+
+  if (sql_where(plx) || sql_limit(plx) || sql_expect(plx, TK_TERMINATOR))
+    return (-1);
+  rta_cmd.command = RTA_UPDATE;
+  return (0);
+}
+
+/***************************************************************
+ * sql_insert(): - Parse the rest of an INSERT.  The list of
+ * columns may be empty, as may each value in the list of values.
+ * The number of values must be the number of columns.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_insert(struct Sql_Lex *plx)
+{
+  int      nvals = 0;      /* number of values */
+  int      type;           /* type of the next token */
+
+  if (sql_expect(plx, TK_INTO))
+    return (-1);
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl || sql_expect(plx, TK_LPAREN))
+    return (-1);
+  if (sql_peek(plx)->type == TK_NAME && sql_columns(plx))
+    return (-1);
+  if (sql_expect(plx, TK_RPAREN) || sql_expect(plx, TK_VALUES) ||
+      sql_expect(plx, TK_LPAREN))
+    return (-1);
+
+  for (;;) {
+    type = sql_peek(plx)->type;
+    if (type >= TK_NAME && type <= TK_PARAM) {
+      if (nvals >= rta_cmd.ncols)
+        return (sql_error());   /* more values than columns */
+      if (sql_literal(plx, &(rta_cmd.cols[nvals].val),
+          &(rta_cmd.cols[nvals].parm)))
+        return (-1);
+      nvals++;
+    }
+    if (sql_peek(plx)->type != TK_COMMA)
+      break;
+    (void) sql_next(plx);
+  }
+
+  if (sql_expect(plx, TK_RPAREN) || sql_expect(plx, TK_TERMINATOR))
+    return (-1);
+  if (nvals != rta_cmd.ncols)
+    return (sql_error());       /* need a value for each column */
+  rta_cmd.command = RTA_INSERT;
+  return (0);
+}
+
+/***************************************************************
+ * sql_delete(): - Parse the rest of a DELETE.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_delete(struct Sql_Lex *plx)
+{
+  if (sql_expect(plx, TK_FROM))
+    return (-1);
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl || sql_where(plx) || sql_limit(plx) ||
+      sql_expect(plx, TK_TERMINATOR))
+    return (-1);
+  rta_cmd.command = RTA_DELETE;
+  return (0);
+}
+
+/***************************************************************
+ * sql_copy(): - Parse the rest of a COPY.  The words of COPY
+ * other than COPY and FROM are not reserved.  They are names
+ * that must match the word given.  No list of columns is the
+ * same as '*'.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_copy(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the next token */
+
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl)
+    return (-1);
+  if (sql_peek(plx)->type == TK_LPAREN) {
+    (void) sql_next(plx);
+    if (sql_columns(plx) || sql_expect(plx, TK_RPAREN))
+      return (-1);
+  }
+  else {
+    if (!sql_newval(0))
+      return (-1);
+    rta_cmd.cols[0].name = "*";
+  }
+
+  /* TO STDOUT or FROM STDIN */
+  pt = sql_next(plx);
+  if (pt->type == TK_FROM) {
+    if (sql_word(plx, "STDIN"))
+      return (-1);
+    rta_cmd.command = RTA_COPYIN;
+  }
+  else if (isword(pt, "TO")) {
+    if (sql_word(plx, "STDOUT"))
+      return (-1);
+    rta_cmd.command = RTA_COPYOUT;
+  }
+  else
+    return (sql_error());
+
+  /* The format, text if not given */
+  pt = sql_peek(plx);
+  if (isword(pt, "BINARY")) {
+    (void) sql_next(plx);
+    rta_cmd.copyfmt = 1;
+  }
+  else if (isword(pt, "WITH")) {
+    (void) sql_next(plx);
+    pt = sql_next(plx);
+    if (isword(pt, "BINARY"))
+      rta_cmd.copyfmt = 1;
+    else if (pt->type != TK_LPAREN)
+      return (sql_error());
+    else {
+      if (sql_word(plx, "FORMAT"))
+        return (-1);
+      pt = sql_next(plx);
+      if (isword(pt, "BINARY"))
+        rta_cmd.copyfmt = 1;
+      else if (!isword(pt, "TEXT"))
+        return (sql_error());
+      if (sql_expect(plx, TK_RPAREN))
+        return (-1);
+    }
+  }
+  return (sql_expect(plx, TK_TERMINATOR));
+}
+
+/***************************************************************
+ * sql_set(): - Parse the rest of a SET.  The name of the
+ * setting is in rta_cmd.tbl.  It is also the column name so
+ * that a prepared SET keeps its value.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_set(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the = or TO */
+  char    *val;            /* the value */
+  int      parm;           /* param # of the value, or 0 */
+
+  rta_cmd.tbl = sql_name(plx);
+  if (!rta_cmd.tbl)
+    return (-1);
+  pt = sql_next(plx);
+  if (pt->type != TK_EQ && !isword(pt, "TO"))
+    return (sql_error());
+  if (sql_literal(plx, &val, &parm) || sql_expect(plx, TK_TERMINATOR))
+    return (-1);
+  if (!sql_newval(0))
+    return (-1);
+  rta_cmd.cols[0].name = rta_cmd.tbl;
+  rta_cmd.cols[0].val = val;
+  rta_cmd.cols[0].parm = parm;
+  rta_cmd.command = RTA_SET;
+  return (0);
+}
+
+/***************************************************************
+ * sql_columns(): - Parse a list of column names into cols.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_columns(struct Sql_Lex *plx)
+{
+  struct Sql_Val *pval;    /* the column */
+  char    *col;            /* the column name */
+
+  do {
+    col = sql_name(plx);
+    if (!col)
+      return (-1);
+    pval = sql_newval(0);
+    if (!pval)
+      return (-1);
+    pval->name = col;
+  } while (sql_peek(plx)->type == TK_COMMA && sql_next(plx));
+  return (0);
+}
+
+/***************************************************************
+ * sql_where(): - Parse an optional WHERE clause into whr.  Since
+ * AND is the only operator the parentheses do not change the
+ * meaning and we just count them.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_where(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the relation */
+  char    *col;            /* the column to test */
+  int      rel;            /* the relation, RTA_EQ, ... */
+  char    *val;            /* the value to test against */
+  int      parm;           /* param # of the value, or 0 */
+  int      depth = 0;      /* number of open parentheses */
+  struct Sql_Val *pval;    /* the WHERE phrase */
+
+  if (sql_peek(plx)->type != TK_WHERE)
+    return (0);
+  (void) sql_next(plx);
+
+  for (;;) {
+    while (sql_peek(plx)->type == TK_LPAREN) {
+      (void) sql_next(plx);
+      depth++;
+    }
+    col = sql_name(plx);
+    if (!col)
+      return (-1);
+    pt = sql_next(plx);
+    if (pt->type < TK_EQ || pt->type > TK_LE)
+      return (sql_error());
+    rel = RTA_EQ + (pt->type - TK_EQ);
+    if (sql_literal(plx, &val, &parm))
+      return (-1);
+    pval = sql_newval(1);
+    if (!pval)
+      return (-1);
+    pval->name = col;
+    pval->rel = rel;
+    pval->val = val;
+    pval->parm = parm;
+
+    while (depth > 0 && sql_peek(plx)->type == TK_RPAREN) {
+      (void) sql_next(plx);
+      depth--;
+    }
+    if (sql_peek(plx)->type != TK_AND)
+      break;
+    (void) sql_next(plx);
+  }
+  return ((depth) ? sql_error() : 0);
+}
+
+/***************************************************************
+ * sql_order(): - Parse an optional ORDER BY.  The words are
+ * names that must match, as in COPY.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_order(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the ASC or DESC */
+
+  if (!isword(sql_peek(plx), "ORDER"))
+    return (0);
+  (void) sql_next(plx);
+  if (sql_word(plx, "BY"))
+    return (-1);
+  rta_cmd.order = sql_name(plx);
+  if (!rta_cmd.order)
+    return (-1);
+
+  pt = sql_peek(plx);
+  if (isword(pt, "DESC")) {
+    (void) sql_next(plx);
+    rta_cmd.desc = 1;
+  }
+  else if (isword(pt, "ASC"))
+    (void) sql_next(plx);
+  return (0);
+}
+
+/***************************************************************
+ * sql_limit(): - Parse an optional LIMIT and OFFSET.
+ *
+ * Input:        The parse state
+ * Output:       0 on success, -1 on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static int
+sql_limit(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the integer */
+
+  if (sql_peek(plx)->type != TK_LIMIT)
+    return (0);
+  (void) sql_next(plx);
+  pt = sql_next(plx);
+  if (pt->type != TK_INTEGER)
+    return (sql_error());
+  rta_cmd.limit = atoi(sql_save(plx, pt));
+
+  if (sql_peek(plx)->type != TK_OFFSET)
+    return (0);
+  (void) sql_next(plx);
+  pt = sql_next(plx);
+  if (pt->type != TK_INTEGER)
+    return (sql_error());
+  rta_cmd.offset = atoi(sql_save(plx, pt));
+  return (0);
+}
+
+/***************************************************************
+ * sql_literal(): - Parse a value.  A value is a name, a string,
+ * a number, or a parameter $1 to $RTA_NCMDCOLS.
+ *
+ * Input:        The parse state, where to put the value, and
+ *               where to put its parameter number or 0
+ * Output:       0 on success, -1 on error
+ * Effects:      rta_cmd.nparams, and the error message
+ ***************************************************************/
+static int
+sql_literal(struct Sql_Lex *plx, char **pval, int *pparm)
+{
+  struct Sql_Tok *pt;      /* the value */
+
+  pt = sql_next(plx);
+  if (pt->type < TK_NAME || pt->type > TK_PARAM)
+    return (sql_error());
+  *pval = sql_save(plx, pt);
+  *pparm = 0;
+  if (pt->type == TK_PARAM) {
+    *pparm = atoi(&(*pval)[1]);
+    if (*pparm < 1 || *pparm > RTA_NCMDCOLS) {
+      /* parameters are numbered from $1 */
+      *pparm = 0;
+      return (sql_error());
+    }
+    if (*pparm > rta_cmd.nparams)
+      rta_cmd.nparams = *pparm;
+  }
+  return (0);
+}
+
+/***************************************************************
+ * sql_name(): - Parse a name and keep it.
+ *
+ * Input:        The parse state
+ * Output:       The name, or NULL on error
+ * Effects:      The error message
+ ***************************************************************/
+static char *
+sql_name(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the name */
+
+  pt = sql_next(plx);
+  if (pt->type != TK_NAME) {
+    (void) sql_error();
+    return ((char *) 0);
+  }
+  return (sql_save(plx, pt));
+}
+
+/***************************************************************
+ * sql_expect(): - Parse a token of the type given.
+ *
+ * Input:        The parse state and the token type
+ * Output:       0 on success, -1 on error
+ * Effects:      The error message
+ ***************************************************************/
+static int
+sql_expect(struct Sql_Lex *plx, int type)
+{
+  return ((sql_next(plx)->type == type) ? 0 : sql_error());
+}
+
+/***************************************************************
+ * sql_word(): - Parse a name that must be the word given.
+ *
+ * Input:        The parse state and the word in upper case
+ * Output:       0 on success, -1 on error
+ * Effects:      The error message
+ ***************************************************************/
+static int
+sql_word(struct Sql_Lex *plx, char *word)
+{
+  return ((isword(sql_next(plx), word)) ? 0 : sql_error());
+}
+
+/***************************************************************
+ * isword(): - Test if a token is a NAME that is the word given.
+ * Case does not matter, as for the reserved words.
+ *
+ * Input:        The token and the word in upper case
+ * Output:       1 if the NAME is the word, else 0
+ * Effects:      None
+ ***************************************************************/
+static int
+isword(struct Sql_Tok *pt, char *word)
+{
+  return (pt->type == TK_NAME && pt->len == (int) strlen(word) &&
+    !strncasecmp(pt->p, word, pt->len));
+}
+
+/***************************************************************
+ * sql_save(): - Copy a token to the string area with a null at
+ * the end.  sql_room() made the area big enough for all of the
+ * tokens a command keeps.
+ *
+ * Input:        The parse state and the token
+ * Output:       The copy
+ * Effects:      The string area
+ ***************************************************************/
+static char *
+sql_save(struct Sql_Lex *plx, struct Sql_Tok *pt)
+{
+  char    *str;            /* the copy */
+
+  str = plx->str;
+  memcpy(str, pt->p, pt->len);
+  str[pt->len] = (char) 0;
+  plx->str += pt->len + 1;
+  return (str);
+}
+
+/***************************************************************
+ * sql_newval(): - Add a cleared entry to the columns or to the
+ * WHERE phrases of rta_cmd.
+ *
+ * Input:        ==1 for a WHERE phrase, else a column
+ * Output:       The entry, or NULL on error
+ * Effects:      structure rta_cmd, and the error message
+ ***************************************************************/
+static struct Sql_Val *
+sql_newval(int inwhr)
+{
+  struct Sql_Val *pval;    /* the new entry */
+
+  if ((inwhr ? rta_cmd.nwhrcols : rta_cmd.ncols) >= RTA_NCMDCOLS ||
+      rta_cmd_grow(rta_cmd.ncols + !inwhr, rta_cmd.nwhrcols + inwhr)) {
+    (void) sql_error();         /* too many columns in list */
+    return ((struct Sql_Val *) 0);
+  }
+  if (inwhr)
+    pval = &(rta_cmd.whr[rta_cmd.nwhrcols++]);
+  else
+    pval = &(rta_cmd.cols[rta_cmd.ncols++]);
+  memset(pval, 0, sizeof(struct Sql_Val));
+  return (pval);
+}
+
+/***************************************************************
+ * sql_grow(): - Make a list of Sql_Val at least the size given.
+ *
+ * Input:        The list, its size, and the size needed
+ * Output:       0 on success, -1 if out of memory
+ * Effects:      The list and its size
+ ***************************************************************/
+static int
+sql_grow(struct Sql_Val **plist, int *psize, int need)
+{
+  struct Sql_Val *list;    /* the bigger list */
+  int      size;           /* its size */
+
+  if (need <= *psize)
+    return (0);
+  size = (*psize < SQL_NVALS) ? SQL_NVALS : 2 * *psize;
+  if (size < need)
+    size = need;
+  list = realloc(*plist, size * sizeof(struct Sql_Val));
+  if (list == (struct Sql_Val *) 0)
+    return (-1);
+  *plist = list;
+  *psize = size;
+  return (0);
+}
+
+/***************************************************************
+ * sql_room(): - Make the string area at least the size given.
+ * A big area is freed when a small one will do.
+ *
+ * Input:        The number of bytes needed
+ * Output:       0 on success, -1 if out of memory
+ * Effects:      The string area
+ ***************************************************************/
+static int
+sql_room(int need)
+{
+  if (need <= NStrs && (NStrs <= SQL_MXSTRS || need > SQL_NSTRS))
+    return (0);
+
+  if (need < SQL_NSTRS)
+    need = SQL_NSTRS;
+  free(Strs);
+  Strs = malloc(need);
+  if (Strs == (char *) 0) {
+    NStrs = 0;
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return (-1);
+  }
+  NStrs = need;
+  return (0);
+}
+
+/***************************************************************
+ * sql_error(): - Report an SQL syntax error.
+ *
+ * Input:        None
+ * Output:       -1
+ * Effects:      The error message and the err flag
+ ***************************************************************/
+static int
+sql_error()
+{
+  rta_send_error(LOC, E_BADPARSE);
+  return (-1);
+}
+
+/***************************************************************
+ * sql_peek(): - Get the next token without using it.
+ *
+ * Input:        The parse state
+ * Output:       The token
+ * Effects:      The parse state
+ ***************************************************************/
+static struct Sql_Tok *
+sql_peek(struct Sql_Lex *plx)
+{
+  if (!plx->look) {
+    sql_scan(plx);
+    plx->look = 1;
+  }
+  return (&(plx->tok));
+}
+
+/***************************************************************
+ * sql_next(): - Get and use the next token.  A command ends as
+ * soon as its terminator is used, so pos is then the number of
+ * bytes of SQL in the commands parsed so far.
+ *
+ * Input:        The parse state
+ * Output:       The token
+ * Effects:      The parse state
+ ***************************************************************/
+static struct Sql_Tok *
+sql_next(struct Sql_Lex *plx)
+{
+  (void) sql_peek(plx);
+  plx->look = 0;
+  return (&(plx->tok));
+}
+
+/***************************************************************
+ * sql_scan(): - Scan the next token.  A word or number is as
+ * long as it can be, so "selected" is a name and "1.5" is one
+ * real number.  A quoted token ends at the next quote of the
+ * same kind; there are no escapes.  It is a name, a number, or
+ * a string by its text.  Spaces, tabs, and newlines between
+ * tokens are skipped.  After the end of the SQL we return a
+ * terminator each time.
+ *
+ * Input:        The parse state
+ * Output:       None
+ * Effects:      The token and position in the parse state
+ ***************************************************************/
+static void
+sql_scan(struct Sql_Lex *plx)
+{
+  struct Sql_Tok *pt;      /* the token */
+  char    *s;              /* the SQL text */
+  int      n;              /* bytes of SQL text */
+  int      p;              /* start of the token */
+  int      q;              /* end of the token */
+  int      i;              /* loop index */
+
+  pt = &(plx->tok);
+  s = plx->s;
+  n = plx->n;
+  p = plx->pos;
+  while (p < n && (s[p] == ' ' || s[p] == '\t' || s[p] == '\n'))
+    p++;
+  pt->p = &s[p];
+  pt->len = 0;
+  if (p >= n) {
+    pt->type = TK_TERMINATOR;
+    plx->pos = n;
+    return;
+  }
+
+  q = p + 1;
+  switch (s[p]) {
+    case ';':
+    case 0:
+      pt->type = TK_TERMINATOR;
+      break;
+    case '*':
+      pt->type = TK_NAME;
+      pt->len = 1;
+      break;
+    case '\'':
+    case '"':
+      while (q < n && s[q] != s[p])
+        q++;
+      if (q == n) {
+        q = p + 1;
+        pt->type = TK_GARBAGE;
+        break;
+      }
+      pt->type = sql_quoted(&s[p + 1], q - p - 1);
+      if (pt->type == TK_GARBAGE) {
+        q = p + 1;
+        break;
+      }
+      pt->p = &s[p + 1];
+      pt->len = q - p - 1;
+      q++;
+      break;
+    case '$':
+      while (q < n && SQL_DIGIT(s[q]))
+        q++;
+      pt->type = (q > p + 1) ? TK_PARAM : TK_GARBAGE;
+      pt->len = q - p;
+      break;
+    case '=':
+      pt->type = TK_EQ;
+      break;
+    case '!':
+      if (q < n && s[q] == '=') {
+        pt->type = TK_NE;
+        q++;
+      }
+      else
+        pt->type = TK_GARBAGE;
+      break;
+    case '<':
+      pt->type = TK_LT;
+      if (q < n && (s[q] == '>' || s[q] == '=')) {
+        pt->type = (s[q] == '>') ? TK_NE : TK_LE;
+        q++;
+      }
+      break;
+    case '>':
+      pt->type = TK_GT;
+      if (q < n && s[q] == '=') {
+        pt->type = TK_GE;
+        q++;
+      }
+      break;
+    case ',':
+      pt->type = TK_COMMA;
+      break;
+    case '(':
+      pt->type = TK_LPAREN;
+      break;
+    case ')':
+      pt->type = TK_RPAREN;
+      break;
+    default:
+      if (SQL_ALPHA(s[p])) {
+        while (q < n && (SQL_ALPHA(s[q]) || SQL_DIGIT(s[q]) || s[q] == '_'))
+          q++;
+        pt->type = TK_NAME;
+        pt->len = q - p;
+        for (i = 0; i < NWORDS; i++) {
+          if (Words[i].len == pt->len &&
+              !strncasecmp(pt->p, Words[i].word, pt->len)) {
+            pt->type = Words[i].type;
+            break;
+          }
+        }
+      }
+      else if (SQL_DIGIT(s[p]) || (s[p] == '-' && q < n && SQL_DIGIT(s[q]))) {
+        while (q < n && SQL_DIGIT(s[q]))
+          q++;
+        pt->type = TK_INTEGER;
+        if (q < n && s[q] == '.') {
+          for (q++; q < n && SQL_DIGIT(s[q]); q++)
+            ;
+          pt->type = TK_REALNUM;
+        }
+        pt->len = q - p;
+      }
+      else
+        pt->type = TK_GARBAGE;
+      break;
+  }
+  plx->pos = q;
+}
+
+/***************************************************************
+ * sql_quoted(): - Get the type of the text of a quoted token.
+ * A name may have spaces and tabs after the first letter.  A
+ * string may have the printable characters but not a newline.
+ *
+ * Input:        The text between the quotes and its length
+ * Output:       TK_NAME, TK_INTEGER, TK_REALNUM, TK_STRING, or
+ *               TK_GARBAGE if none of these
+ * Effects:      None
+ ***************************************************************/
+static int
+sql_quoted(char *p, int len)
+{
+  int      i;              /* index into p */
+  int      j;              /* index of first digit */
+
+  if (len > 0 && SQL_ALPHA(p[0])) {
+    for (i = 1; i < len; i++) {
+      if (!SQL_ALPHA(p[i]) && !SQL_DIGIT(p[i]) && p[i] != '_' &&
+          p[i] != ' ' && p[i] != '\t')
+        break;
+    }
+    if (i == len)
+      return (TK_NAME);
+  }
+
+  j = (len > 0 && p[0] == '-') ? 1 : 0;
+  for (i = j; i < len && SQL_DIGIT(p[i]); i++)
+    ;
+  if (i > j) {
+    if (i == len)
+      return (TK_INTEGER);
+    if (p[i] == '.') {
+      for (i++; i < len && SQL_DIGIT(p[i]); i++)
+        ;
+      if (i == len)
+        return (TK_REALNUM);
+    }
+  }
+
+  for (i = 0; i < len; i++) {
+    if (!sql_strchar(p[i]))
+      return (TK_GARBAGE);
+  }
+  return (TK_STRING);
+}
+
+/***************************************************************
+ * sql_strchar(): - Test if a character may be in a string.
+ * The other kind of quote may be in a string.
+ *
+ * Input:        The character
+ * Output:       1 if the character may be in a string, else 0
+ * Effects:      None
+ ***************************************************************/
+static int
+sql_strchar(int c)
+{
+  if (SQL_ALPHA(c) || (c >= '+' && c <= '='))  /* includes digits */
+    return (1);
+  return (c != 0 && strchr(" \t!@#$%^&*()_{}|>?~`[]'\"\\", c) != (char *) 0);
+}
@@ -0,0 +1,241 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * plancache.c:  The plans of recent SQL commands.
+ *
+ *   Clients tend to send the same few SQL commands over and
+ * over.  rta_SQL_exec() looks up each SELECT, UPDATE, INSERT,
+ * and DELETE by its tokens, the key, before it parses it.  On a
+ * hit the saved plan is loaded and run, so the parse and the
+ * checks of the table, columns, and values are skipped.  On a
+ * miss the command is parsed and verified as usual and its plan
+ * is added here.
+ *   The plans are kept in least recently used order and the
+ * oldest is dropped when there are rta_pcache.size of them.  A
+ * plan points at the table and columns it uses, so all of the
+ * plans are dropped when a table is added.  A plan is also
+ * dropped if its table has since been given other columns.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "do_sql.h"
+
+extern RTA_TBLDEF *rta_Tbl[];
+extern int rta_Ntbl;
+extern struct Sql_Cmd rta_cmd;
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+extern struct RtaPcache rta_pcache;
+
+/* Number of hash chains.  Must be a power of two. */
+#define PC_NHASH       (1024)
+
+/* One saved plan.  The key follows the structure. */
+struct PcEntry
+{
+  struct PcEntry *hnext;   /* next entry in the hash chain */
+  struct PcEntry *newer;   /* next more recently used entry */
+  struct PcEntry *older;   /* next less recently used entry */
+  unsigned int hash;       /* hash of the key */
+  int          klen;       /* bytes in the key */
+  struct Sql_Plan *plan;   /* the verified command */
+  RTA_COLDEF  *cols;       /* columns of the table when saved */
+  int          ncol;       /* # columns of the table when saved */
+};
+
+/* Forward references */
+static void     pc_drop(struct PcEntry *);
+static void     pc_clear(void);
+
+/* The hash chains and the ends of the LRU list */
+static struct PcEntry *Hash[PC_NHASH];
+static struct PcEntry *Newest;
+static struct PcEntry *Oldest;
+
+/* ==1 if a table was added since the plans were saved */
+static int      Stale;
+
+
+/***************************************************************
+ * rta_pcache_get(): - Find the plan of a command.  A plan whose
+ * table has changed is dropped and is not found.
+ *
+ * Input:        The key, its length, and its hash
+ * Output:       The plan, or NULL if there is none
+ * Effects:      The LRU order and the hit and miss counts
+ ***************************************************************/
+struct Sql_Plan *
+rta_pcache_get(char *key, int klen, unsigned int hash)
+{
+  struct PcEntry *pe;      /* an entry in the hash chain */
+  struct Sql_Plan *pplan;  /* the plan of the entry */
+
+  if (Stale || rta_pcache.size <= 0) {
+    pc_clear();
+    if (rta_pcache.size <= 0)
+      return ((struct Sql_Plan *) 0);
+  }
+
+  for (pe = Hash[hash & (PC_NHASH - 1)]; pe; pe = pe->hnext) {
+    if (pe->hash == hash && pe->klen == klen &&
+        !memcmp((char *) (pe + 1), key, klen))
+      break;
+  }
+  if (pe) {
+    pplan = pe->plan;
+    if (pplan->itbl >= rta_Ntbl || rta_Tbl[pplan->itbl] != pplan->ptbl ||
+        pplan->ptbl->cols != pe->cols || pplan->ptbl->ncol != pe->ncol) {
+      pc_drop(pe);
+      pe = (struct PcEntry *) 0;
+    }
+  }
+  if (pe == (struct PcEntry *) 0) {
+    rta_pcache.nmiss++;
+    return ((struct Sql_Plan *) 0);
+  }
+  rta_pcache.nhit++;
+
+  /* Move the entry to the newest end of the list */
+  if (pe != Newest) {
+    pe->newer->older = pe->older;
+    if (pe->older)
+      pe->older->newer = pe->newer;
+    else
+      Oldest = pe->newer;
+    pe->older = Newest;
+    pe->newer = (struct PcEntry *) 0;
+    Newest->newer = pe;
+    Newest = pe;
+  }
+  return (pe->plan);
+}
+
+/***************************************************************
+ * rta_pcache_put(): - Save the verified command in rta_cmd as
+ * the plan of a key that rta_pcache_get() did not find.  The
+ * oldest plans are dropped to make room.  Nothing is saved if
+ * memory is short.
+ *
+ * Input:        The key, its length, and its hash
+ * Output:       None
+ * Effects:      The saved plans
+ ***************************************************************/
+void
+rta_pcache_put(char *key, int klen, unsigned int hash)
+{
+  struct PcEntry *pe;      /* the new entry */
+  struct Sql_Plan *pplan;  /* the saved command */
+  char    *sqlcmd;         /* the SQL of the command */
+
+  if (rta_pcache.size <= 0 || rta_cmd.nparams)
+    return;
+  while (rta_pcache.nplans >= rta_pcache.size)
+    pc_drop(Oldest);
+
+  pe = malloc(sizeof(struct PcEntry) + klen);
+  if (pe == (struct PcEntry *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return;
+  }
+
+  /* The SQL may hold more commands and need not end in a null,
+     so the plan does not keep it.  The key says what it was. */
+  sqlcmd = rta_cmd.sqlcmd;
+  rta_cmd.sqlcmd = "";
+  pplan = rta_plan_save();
+  rta_cmd.sqlcmd = sqlcmd;
+  if (pplan == (struct Sql_Plan *) 0) {
+    rta_cmd.err = 0;            /* the command can still run */
+    free(pe);
+    return;
+  }
+
+  memcpy((char *) (pe + 1), key, klen);
+  pe->hash = hash;
+  pe->klen = klen;
+  pe->plan = pplan;
+  pe->cols = pplan->ptbl->cols;
+  pe->ncol = pplan->ptbl->ncol;
+  pe->hnext = Hash[hash & (PC_NHASH - 1)];
+  Hash[hash & (PC_NHASH - 1)] = pe;
+  pe->older = Newest;
+  pe->newer = (struct PcEntry *) 0;
+  if (Newest)
+    Newest->newer = pe;
+  else
+    Oldest = pe;
+  Newest = pe;
+  rta_pcache.nplans++;
+}
+
+/***************************************************************
+ * rta_pcache_flush(): - Forget all of the saved plans.  A plan
+ * may be in use in rta_cmd, so the plans are freed by the next
+ * rta_pcache_get().
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      The saved plans
+ ***************************************************************/
+void
+rta_pcache_flush()
+{
+  Stale = 1;
+}
+
+/***************************************************************
+ * pc_drop(): - Remove an entry and free its plan.
+ *
+ * Input:        The entry
+ * Output:       None
+ * Effects:      The saved plans
+ ***************************************************************/
+static void
+pc_drop(struct PcEntry *pe)
+{
+  struct PcEntry **ppe;    /* link to an entry in the chain */
+
+  ppe = &(Hash[pe->hash & (PC_NHASH - 1)]);
+  while (*ppe != pe)
+    ppe = &((*ppe)->hnext);
+  *ppe = pe->hnext;
+
+  if (pe->newer)
+    pe->newer->older = pe->older;
+  else
+    Newest = pe->older;
+  if (pe->older)
+    pe->older->newer = pe->newer;
+  else
+    Oldest = pe->newer;
+
+  free(pe->plan);
+  free(pe);
+  rta_pcache.nplans--;
+}
+
+/***************************************************************
+ * pc_clear(): - Remove all of the entries.
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      The saved plans
+ ***************************************************************/
+static void
+pc_clear()
+{
+  while (Oldest)
+    pc_drop(Oldest);
+  Stale = 0;
+}
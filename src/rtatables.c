@@ -26,6 +26,7 @@
 
 /* Forward reference for read callbacks and iterators */
 int          rta_restart_syslog();
+static int   pcache_hitrate();
 static void *get_next_sysrow(void *, void *, int);
 
 
@@ -412,6 +413,30 @@ rta_restart_syslog(char *tblname, char *colname, char *sqlcmd,
   return(0);
 }
 
+/***************************************************************
+ * pcache_hitrate(): - Compute the hit rate of the plan cache
+ * before it is read.
+ *
+ * Input:        Name of the table 
+ *               Name of the column
+ *               Text of the SQL command itself
+ *               Pointer to row of data
+ *               Index of row used (zero indexed)
+ * Output:       Success (a zero)
+ * Effects:      The hitrate in rta_pcache
+ **************************************************************/
+static int
+pcache_hitrate(char *tblname, char *colname, char *sqlcmd,
+               void *prow, int rowid)
+{
+  extern struct RtaPcache rta_pcache;
+  llong    n;          /* number of lookups */
+
+  n = rta_pcache.nhit + rta_pcache.nmiss;
+  rta_pcache.hitrate = (n) ? (100.0 * rta_pcache.nhit) / n : 0.0;
+  return(0);
+}
+
 
 /***************************************************************
  *     The rta_dbg table controls which errors generate
@@ -453,6 +478,152 @@ struct RtaStat rta_stat = {
   (llong) 0,                    /* count of SELECT requests */
 };
 
+/***************************************************************
+ *     The rta_limit table has the limits of a statement from a
+ * client session.  A client may change them for its own session
+ * with SET.  Zero is no limit.  The limits do not apply to
+ * rta_SQL_string().
+ **************************************************************/
+/* Allocate and initialize the table */
+struct RtaLimit rta_limit = {
+  0,                            /* no statement_timeout */
+  0,                            /* no max_rows_scanned */
+};
+
+/* Define the table columns */
+RTA_COLDEF   rta_limitCols[] = {
+  {
+      "rta_limit",              /* table name */
+      "statement_timeout",      /* column name */
+      RTA_INT,                  /* type of data */
+      sizeof(int),              /* #bytes in col data */
+      offsetof(struct RtaLimit, timeout), /* offset 2 col strt */
+      0,               /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "Milliseconds a SELECT, UPDATE, or DELETE may run before "
+      "it fails with SQLSTATE 57014.  Time spent waiting for the "
+      "client to read the rows counts.  Zero is no limit."},
+  {
+      "rta_limit",              /* table name */
+      "max_rows_scanned",       /* column name */
+      RTA_INT,                  /* type of data */
+      sizeof(int),              /* #bytes in col data */
+      offsetof(struct RtaLimit, maxscan), /* offset 2 col strt */
+      0,               /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "Rows a SELECT, UPDATE, or DELETE may look at before it "
+      "fails with SQLSTATE 54000.  Zero is no limit."},
+};
+
+/* Define the table */
+RTA_TBLDEF   rta_limitTable = {
+  "rta_limit",                  /* table name */
+  (void *) &rta_limit,          /* address of table */
+  sizeof(struct RtaLimit),      /* length of each row */
+  1,                            /* # rows in table */
+  (void *) NULL,                /* iterator function */
+  (void *) NULL,                /* iterator callback data */
+  (void *) NULL,                /* INSERT callback function */
+  (void *) NULL,                /* DELETE callback function */
+  rta_limitCols,                /* Column definitions */
+  sizeof(rta_limitCols) / sizeof(RTA_COLDEF), /* # columns */
+  "",                           /* save file name */
+  "Default limits of the statements of client sessions.  A "
+    "client may change them for its own session with SET "
+    "statement_timeout or SET max_rows_scanned."
+};
+
+/***************************************************************
+ *     The rta_plancache table has the size and the counts of
+ * the cache of verified SQL commands in plancache.c.  Only the
+ * size may be changed.
+ **************************************************************/
+/* Allocate and initialize the table */
+struct RtaPcache rta_pcache = {
+  RTA_PCACHE,                   /* max # plans */
+  0,                            /* # plans in the cache */
+  (llong) 0,                    /* count of commands found */
+  (llong) 0,                    /* count of commands not found */
+  0.0,                          /* percent of lookups that hit */
+};
+
+/* Define the table columns */
+RTA_COLDEF   rta_pcacheCols[] = {
+  {
+      "rta_plancache",          /* table name */
+      "size",                   /* column name */
+      RTA_INT,                  /* type of data */
+      sizeof(int),              /* #bytes in col data */
+      offsetof(struct RtaPcache, size), /* offset 2 col strt */
+      0,               /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "The most SQL commands kept in the plan cache.  The least "
+      "recently used is dropped to make room.  Zero turns the "
+      "cache off."},
+  {
+      "rta_plancache",          /* table name */
+      "nplans",                 /* column name */
+      RTA_INT,                  /* type of data */
+      sizeof(int),              /* #bytes in col data */
+      offsetof(struct RtaPcache, nplans), /* offset 2 col strt */
+      RTA_READONLY,    /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "The number of SQL commands now in the plan cache."},
+  {
+      "rta_plancache",          /* table name */
+      "nhit",                   /* column name */
+      RTA_LONG,                 /* type of data */
+      sizeof(llong),            /* #bytes in col data */
+      offsetof(struct RtaPcache, nhit), /* offset 2 col strt */
+      RTA_READONLY,    /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "Count of SQL commands found in the plan cache."},
+  {
+      "rta_plancache",          /* table name */
+      "nmiss",                  /* column name */
+      RTA_LONG,                 /* type of data */
+      sizeof(llong),            /* #bytes in col data */
+      offsetof(struct RtaPcache, nmiss), /* offset 2 col strt */
+      RTA_READONLY,    /* Flags for read-only/disksave */
+      (int (*)()) 0,  /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "Count of SQL commands looked for in the plan cache and "
+      "not found."},
+  {
+      "rta_plancache",          /* table name */
+      "hitrate",                /* column name */
+      RTA_FLOAT,                /* type of data */
+      sizeof(float),            /* #bytes in col data */
+      offsetof(struct RtaPcache, hitrate), /* offset 2 col strt */
+      RTA_READONLY,    /* Flags for read-only/disksave */
+      pcache_hitrate, /* called before read */
+      (int (*)()) 0,  /* called after write */
+      "Percent of the lookups in the plan cache that found the "
+      "SQL command."},
+};
+
+/* Define the table */
+RTA_TBLDEF   rta_pcacheTable = {
+  "rta_plancache",              /* table name */
+  (void *) &rta_pcache,         /* address of table */
+  sizeof(struct RtaPcache),     /* length of each row */
+  1,                            /* # rows in table */
+  (void *) NULL,                /* iterator function */
+  (void *) NULL,                /* iterator callback data */
+  (void *) NULL,                /* INSERT callback function */
+  (void *) NULL,                /* DELETE callback function */
+  rta_pcacheCols,               /* Column definitions */
+  sizeof(rta_pcacheCols) / sizeof(RTA_COLDEF), /* # columns */
+  "",                           /* save file name */
+  "The cache of verified SQL commands.  A command found in the "
+    "cache is run without being parsed and checked again."
+};
+
 #ifdef DEBUG
 /* Define the table columns */
 RTA_COLDEF   rta_dbgCols[] = {
@@ -0,0 +1,368 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * scan.c:  The block tests of the WHERE clause.
+ *
+ *   The rows of a table without an iterator are in one array.
+ * A SELECT on such a table tests the rows RTA_SCANBLK at a
+ * time.  Each WHERE phrase on a number column with no read
+ * callback has a scan function that compares the column in a
+ * block of rows to the value of the phrase and gives back a bit
+ * for each row that passes.  The bits of all of the phrases are
+ * ANDed and do_select() visits only the rows with a bit set.
+ *   The scan functions load the column from each row into a
+ * vector register with AVX2 on x86 or NEON on ARM, and compare
+ * all of the lanes at once.  AVX2 is used only if the CPU has
+ * it.  Otherwise, and for the rows at the end of a block, the
+ * plain C versions are used.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "do_sql.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_AVX2
+#include <immintrin.h>
+#define TARGET_AVX2  __attribute__ ((target("avx2")))
+#elif defined(__aarch64__)
+#define SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+extern struct Sql_Cmd rta_cmd;
+
+
+/***************************************************************
+ * A scan function is given the column in the first row, the
+ * size of a row, the number of rows, and the WHERE phrase.
+ * The plain C scans.  SCAN_LOOP() tests n rows with the relation
+ * 'OP' and SCAN_C() makes the function of a column type with a
+ * loop for each relation.
+ **************************************************************/
+#define SCAN_LOOP(CT, V, OP)                                         \
+  for (i = 0; i < n; i++, pd += sr)                                  \
+    bits |= (unsigned long long) (*(CT *) pd OP pw->V) << i;         \
+  break;
+
+#define SCAN_C(T, CT, V)                                             \
+  static unsigned long long                                          \
+  T(char *pd, int sr, int n, struct Sql_Val *pw)                     \
+  {                                                                  \
+    unsigned long long bits = 0;                                     \
+    int      i;                                                      \
+                                                                     \
+    switch (pw->rel) {                                               \
+      case RTA_EQ: SCAN_LOOP(CT, V, ==)                              \
+      case RTA_NE: SCAN_LOOP(CT, V, !=)                              \
+      case RTA_GT: SCAN_LOOP(CT, V, >)                               \
+      case RTA_LT: SCAN_LOOP(CT, V, <)                               \
+      case RTA_GE: SCAN_LOOP(CT, V, >=)                              \
+      case RTA_LE: SCAN_LOOP(CT, V, <=)                              \
+    }                                                                \
+    return (bits);                                                   \
+  }
+
+SCAN_C(scan_int, int, ival)
+SCAN_C(scan_short, short, ival)
+SCAN_C(scan_uchar, unsigned char, ival)
+SCAN_C(scan_long, llong, lval)
+SCAN_C(scan_float, float, fval)
+SCAN_C(scan_double, double, dval)
+
+/* The plain C scans by column type.  RTA_SHORT and RTA_UCHAR
+   columns always use these.  A two or one byte column can not
+   be loaded as four bytes without reading past the table. */
+static ScanFn ScanC[RTA_MXCOLTYPE + 1] = {
+  0,                            /* RTA_STR */
+  0,                            /* RTA_PTR */
+  scan_int,                     /* RTA_INT */
+  scan_long,                    /* RTA_LONG */
+  0,                            /* RTA_PSTR */
+  0,                            /* RTA_PINT */
+  0,                            /* RTA_PLONG */
+  scan_float,                   /* RTA_FLOAT */
+  0,                            /* RTA_PFLOAT */
+  scan_short,                   /* RTA_SHORT */
+  scan_uchar,                   /* RTA_UCHAR */
+  scan_double,                  /* RTA_DOUBLE */
+};
+
+
+#ifdef SCAN_AVX2
+/***************************************************************
+ * The AVX2 scans.  A gather loads the column of eight rows, or
+ * four for the eight byte types, using the row offsets in idx.
+ * The compare gives all ones in the lanes that pass and the sign
+ * bits of the lanes are the bits of the rows.  NE, GE, and LE
+ * of integers are the inverse of EQ, LT, and GT.  The rows left
+ * over at the end use the plain C scan.
+ **************************************************************/
+static unsigned long long TARGET_AVX2
+avx2_int(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  unsigned long long bits = 0;
+  __m256i  idx;            /* offsets of the rows */
+  __m256i  k;              /* the value of the phrase */
+  __m256i  v;              /* the column of eight rows */
+  __m256i  m;              /* the result of the compare */
+  int      inv;            /* mask to invert the result */
+  int      i;
+
+  idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+    _mm256_set1_epi32(sr));
+  k = _mm256_set1_epi32(pw->ival);
+  inv = (pw->rel == RTA_NE || pw->rel == RTA_GE || pw->rel == RTA_LE) ?
+    0xff : 0;
+  for (i = 0; i + 8 <= n; i += 8, pd += 8 * sr) {
+    v = _mm256_i32gather_epi32((const int *) pd, idx, 1);
+    if (pw->rel == RTA_EQ || pw->rel == RTA_NE)
+      m = _mm256_cmpeq_epi32(v, k);
+    else if (pw->rel == RTA_GT || pw->rel == RTA_LE)
+      m = _mm256_cmpgt_epi32(v, k);
+    else
+      m = _mm256_cmpgt_epi32(k, v);
+    bits |= (unsigned long long)
+      (_mm256_movemask_ps(_mm256_castsi256_ps(m)) ^ inv) << i;
+  }
+  if (i < n)
+    bits |= scan_int(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+
+static unsigned long long TARGET_AVX2
+avx2_long(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  unsigned long long bits = 0;
+  __m128i  idx;            /* offsets of the rows */
+  __m256i  k;              /* the value of the phrase */
+  __m256i  v;              /* the column of four rows */
+  __m256i  m;              /* the result of the compare */
+  int      inv;            /* mask to invert the result */
+  int      i;
+
+  idx = _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(sr));
+  k = _mm256_set1_epi64x(pw->lval);
+  inv = (pw->rel == RTA_NE || pw->rel == RTA_GE || pw->rel == RTA_LE) ?
+    0xf : 0;
+  for (i = 0; i + 4 <= n; i += 4, pd += 4 * sr) {
+    v = _mm256_i32gather_epi64((const long long *) pd, idx, 1);
+    if (pw->rel == RTA_EQ || pw->rel == RTA_NE)
+      m = _mm256_cmpeq_epi64(v, k);
+    else if (pw->rel == RTA_GT || pw->rel == RTA_LE)
+      m = _mm256_cmpgt_epi64(v, k);
+    else
+      m = _mm256_cmpgt_epi64(k, v);
+    bits |= (unsigned long long)
+      (_mm256_movemask_pd(_mm256_castsi256_pd(m)) ^ inv) << i;
+  }
+  if (i < n)
+    bits |= scan_long(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+
+/* Floats compare as C does.  Only NE is true if a side is NaN. */
+static unsigned long long TARGET_AVX2
+avx2_float(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  unsigned long long bits = 0;
+  __m256i  idx;            /* offsets of the rows */
+  __m256   k;              /* the value of the phrase */
+  __m256   v;              /* the column of eight rows */
+  __m256   m;              /* the result of the compare */
+  int      i;
+
+  idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+    _mm256_set1_epi32(sr));
+  k = _mm256_set1_ps(pw->fval);
+  for (i = 0; i + 8 <= n; i += 8, pd += 8 * sr) {
+    v = _mm256_i32gather_ps((const float *) pd, idx, 1);
+    switch (pw->rel) {
+      case RTA_EQ: m = _mm256_cmp_ps(v, k, _CMP_EQ_OQ); break;
+      case RTA_NE: m = _mm256_cmp_ps(v, k, _CMP_NEQ_UQ); break;
+      case RTA_GT: m = _mm256_cmp_ps(v, k, _CMP_GT_OQ); break;
+      case RTA_LT: m = _mm256_cmp_ps(v, k, _CMP_LT_OQ); break;
+      case RTA_GE: m = _mm256_cmp_ps(v, k, _CMP_GE_OQ); break;
+      default:     m = _mm256_cmp_ps(v, k, _CMP_LE_OQ); break;
+    }
+    bits |= (unsigned long long) _mm256_movemask_ps(m) << i;
+  }
+  if (i < n)
+    bits |= scan_float(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+
+static unsigned long long TARGET_AVX2
+avx2_double(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  unsigned long long bits = 0;
+  __m128i  idx;            /* offsets of the rows */
+  __m256d  k;              /* the value of the phrase */
+  __m256d  v;              /* the column of four rows */
+  __m256d  m;              /* the result of the compare */
+  int      i;
+
+  idx = _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(sr));
+  k = _mm256_set1_pd(pw->dval);
+  for (i = 0; i + 4 <= n; i += 4, pd += 4 * sr) {
+    v = _mm256_i32gather_pd((const double *) pd, idx, 1);
+    switch (pw->rel) {
+      case RTA_EQ: m = _mm256_cmp_pd(v, k, _CMP_EQ_OQ); break;
+      case RTA_NE: m = _mm256_cmp_pd(v, k, _CMP_NEQ_UQ); break;
+      case RTA_GT: m = _mm256_cmp_pd(v, k, _CMP_GT_OQ); break;
+      case RTA_LT: m = _mm256_cmp_pd(v, k, _CMP_LT_OQ); break;
+      case RTA_GE: m = _mm256_cmp_pd(v, k, _CMP_GE_OQ); break;
+      default:     m = _mm256_cmp_pd(v, k, _CMP_LE_OQ); break;
+    }
+    bits |= (unsigned long long) _mm256_movemask_pd(m) << i;
+  }
+  if (i < n)
+    bits |= scan_double(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+#endif /* SCAN_AVX2 */
+
+
+#ifdef SCAN_NEON
+/***************************************************************
+ * The NEON scans.  NEON has no gather so the column of four
+ * rows is loaded a lane at a time.  A lane that passes is all
+ * ones; ANDed with the bit of its lane and added across the
+ * vector it gives the bits of the four rows.
+ **************************************************************/
+#define NEON_LOAD(LD, T, V)                                          \
+  V = LD((const T *) pd, V, 0);                                      \
+  V = LD((const T *) (pd + sr), V, 1);                               \
+  V = LD((const T *) (pd + 2 * sr), V, 2);                           \
+  V = LD((const T *) (pd + 3 * sr), V, 3);
+
+static unsigned long long
+neon_int(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+  unsigned long long bits = 0;
+  int32x4_t k;             /* the value of the phrase */
+  int32x4_t v;             /* the column of four rows */
+  uint32x4_t m;            /* the result of the compare */
+  int      i;
+
+  k = vdupq_n_s32(pw->ival);
+  v = k;
+  for (i = 0; i + 4 <= n; i += 4, pd += 4 * sr) {
+    NEON_LOAD(vld1q_lane_s32, int32_t, v)
+    switch (pw->rel) {
+      case RTA_EQ: m = vceqq_s32(v, k); break;
+      case RTA_NE: m = vmvnq_u32(vceqq_s32(v, k)); break;
+      case RTA_GT: m = vcgtq_s32(v, k); break;
+      case RTA_LT: m = vcltq_s32(v, k); break;
+      case RTA_GE: m = vcgeq_s32(v, k); break;
+      default:     m = vcleq_s32(v, k); break;
+    }
+    bits |= (unsigned long long) vaddvq_u32(vandq_u32(m, vld1q_u32(lanes)))
+      << i;
+  }
+  if (i < n)
+    bits |= scan_int(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+
+static unsigned long long
+neon_float(char *pd, int sr, int n, struct Sql_Val *pw)
+{
+  static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+  unsigned long long bits = 0;
+  float32x4_t k;           /* the value of the phrase */
+  float32x4_t v;           /* the column of four rows */
+  uint32x4_t m;            /* the result of the compare */
+  int      i;
+
+  k = vdupq_n_f32(pw->fval);
+  v = k;
+  for (i = 0; i + 4 <= n; i += 4, pd += 4 * sr) {
+    NEON_LOAD(vld1q_lane_f32, float32_t, v)
+    switch (pw->rel) {
+      case RTA_EQ: m = vceqq_f32(v, k); break;
+      case RTA_NE: m = vmvnq_u32(vceqq_f32(v, k)); break;
+      case RTA_GT: m = vcgtq_f32(v, k); break;
+      case RTA_LT: m = vcltq_f32(v, k); break;
+      case RTA_GE: m = vcgeq_f32(v, k); break;
+      default:     m = vcleq_f32(v, k); break;
+    }
+    bits |= (unsigned long long) vaddvq_u32(vandq_u32(m, vld1q_u32(lanes)))
+      << i;
+  }
+  if (i < n)
+    bits |= scan_float(pd, sr, n - i, pw) << i;
+  return (bits);
+}
+#endif /* SCAN_NEON */
+
+
+/***************************************************************
+ * rta_scan_fn(): - Give the scan function for a WHERE phrase on
+ * a column of the given type.  The vector version is given if
+ * the CPU can run it.
+ *
+ * Input:        The column type
+ * Output:       The scan function, or NULL if the type has none
+ * Effects:      None
+ ***************************************************************/
+ScanFn
+rta_scan_fn(int type)
+{
+  if (type < 0 || type > RTA_MXCOLTYPE)
+    return ((ScanFn) 0);
+#ifdef SCAN_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    switch (type) {
+      case RTA_INT:    return (avx2_int);
+      case RTA_LONG:   return (avx2_long);
+      case RTA_FLOAT:  return (avx2_float);
+      case RTA_DOUBLE: return (avx2_double);
+    }
+  }
+#endif
+#ifdef SCAN_NEON
+  switch (type) {
+    case RTA_INT:    return (neon_int);
+    case RTA_FLOAT:  return (neon_float);
+  }
+#endif
+  return (ScanC[type]);
+}
+
+/***************************************************************
+ * rta_scan_block(): - Test a block of rows against the WHERE
+ * phrases of rta_cmd that have a scan function.
+ *
+ * Input:        Pointer to the first row of the block
+ *               The number of rows, at most RTA_SCANBLK
+ * Output:       A bit for each row, set if the row may pass.
+ *               The first row is the low bit.
+ * Effects:      None
+ ***************************************************************/
+unsigned long long
+rta_scan_block(void *pr, int n)
+{
+  unsigned long long bits; /* rows that pass so far */
+  struct Sql_Val *pw;      /* a WHERE phrase */
+  int      sr;             /* the size of a row */
+  int      wx;             /* Where clause indeX */
+
+  sr = rta_cmd.ptbl->rowlen;
+  bits = (n >= RTA_SCANBLK) ? ~0ULL : (1ULL << n) - 1;
+  for (wx = 0; wx < rta_cmd.nwhrcols && bits; wx++) {
+    pw = &(rta_cmd.whr[wx]);
+    if (pw->scan)
+      bits &= (pw->scan) ((char *) pr + pw->pcol->offset, sr, n, pw);
+  }
+  return (bits);
+}
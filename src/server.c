@@ -0,0 +1,1705 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * server.c:  An optional, built-in server for Postgres clients.
+ * Programs that do not want to write their own select() loop
+ * call rta_serve(), or add the fd from rta_serve_open() to the
+ * loop they already have and call rta_serve_poll() when it is
+ * readable.  (Linux only)
+ *
+ *   All sockets are nonblocking and registered once with an
+ * edge-triggered epoll set.  An edge means "something changed",
+ * so each connection remembers whether it may still read and
+ * whether it may still write, and we loop over read, execute,
+ * and write until neither makes progress.  A wakeup costs time
+ * in proportion to the connections that are active, not to the
+ * number that are open.
+ *   When a client has no output waiting, the responses are sent
+ * with one sendmsg() and long strings go straight from the rows
+ * to the socket.  Whatever the socket does not take is copied
+ * into the output buffer before we return to the application.
+ * The io_uring backend sends after we return, so it always
+ * copies.
+ *   Local clients may use a Unix socket named as libpq expects,
+ * DIR/.s.PGSQL.PORT, which skips the TCP stack.  A DIR that
+ * starts with '@' names a Linux abstract socket.
+ *   After rta_serve_backend(RTA_SRV_URING) the server uses
+ * io_uring instead.  Each listener has one multishot accept,
+ * clients receive into a ring of buffers given to the kernel,
+ * and each response is sent with the next receive linked
+ * behind it.  All of the requests made while handling a batch
+ * of completions go to the kernel in one system call.  If the
+ * kernel or its headers are too old we stay with epoll.
+ *   Connections are kept in a list with the least recently
+ * active connection at the head.  This makes it cheap to find
+ * and close the connections that have been idle too long.
+ *   Clients take turns by deficit round robin.  Each poll is a
+ * round in which a client may produce SRV_QUANTUM bytes of
+ * output, four times that in the high class.  A client that
+ * uses up its quantum while it still has work waits for the
+ * next round, so a bulk export gets a slice of the output
+ * buffer per round while the other clients get theirs.  Bytes
+ * over the quantum are taken from the next round.  The clients
+ * of the high class, such as an operator's console on its own
+ * port, are run first in each round.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#ifdef IORING_ACCEPT_MULTISHOT  /* Linux 5.19 and later */
+#define SRV_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include "do_sql.h"
+
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+
+/* Max number of epoll events handled per call to epoll_wait() */
+#define SRV_MXEVENT     (64)
+
+/* Max number of iovec entries in one sendmsg(), as UIO_MAXIOV */
+#define SRV_MXIOV       (1024)
+
+/* io_uring queue size, and the number and size of the buffers
+   in the provided buffer ring.  SRV_NBUF is a power of two. */
+#define SRV_NSQE        (256)
+#define SRV_NBUF        (256)
+#define SRV_BUFSZ       (4096)
+#define SRV_BGID        (0)
+
+/* Bytes of output a client may produce per round, and the
+   multiple of that given to the high class */
+#define SRV_QUANTUM     (RTA_SRV_MXOUT)
+#define SRV_HIGHWT      (4)
+
+/* io_uring request types, in the low bits of user_data */
+#define SRV_OP_ACCEPT   (0)
+#define SRV_OP_RECV     (1)
+#define SRV_OP_SEND     (2)
+#define SRV_OP_MASK     (7)
+
+/* The state of one listen socket or client connection */
+struct SrvConn
+{
+  struct SrvConn *prev;    /* less recently active connection */
+  struct SrvConn *next;    /* more recently active connection */
+  int          fd;         /* socket of the listener or client */
+  int          islsn;      /* ==1 if this is a listen socket */
+  int          canrd;      /* ==1 until a read() would block */
+  int          canwr;      /* ==1 until a write() would block */
+  int          eof;        /* ==1 after the client closed its side */
+  int          closing;    /* ==1 to close once output is sent */
+  time_t       last;       /* time of the last read or write */
+  RTA_SESSION *sess;       /* prepared statements, etc */
+  char        *in;         /* input from the client */
+  int          insize;     /* size of in, RTA_SRV_MXIN or more */
+  int          ioff;       /* offset of the first unused input */
+  int          ilen;       /* bytes in the input buffer */
+  char        *out;        /* output to the client */
+  int          outsize;    /* size of out, RTA_SRV_MXOUT or more */
+  int          ooff;       /* offset of the first unsent output */
+  int          olen;       /* bytes in the output buffer */
+  char        *path;       /* Unix socket file to remove, or NULL */
+  int          nops;       /* io_uring requests in flight */
+  int          rdq;        /* ==1 while a receive is queued */
+  int          wrq;        /* ==1 while a send is queued */
+  int          dead;       /* ==1 if closed but requests remain */
+  int          yield;      /* ==1 to run again on the next poll */
+  int          prio;       /* RTA_SRV_NORMAL or RTA_SRV_HIGH */
+  int          hiwat;      /* unsent bytes that stop execution */
+  int          port;       /* port of a listener */
+  unsigned     round;      /* the last round that gave a quantum */
+  int          deficit;    /* bytes left in this round's quantum */
+};
+
+#ifdef SRV_URING
+/* The mapped queues of the io_uring and the provided buffers */
+struct SrvRing
+{
+  int          fd;         /* the io_uring, or -1 */
+  unsigned    *sqhead;     /* submission queue head (kernel's) */
+  unsigned    *sqtail;     /* submission queue tail (ours) */
+  unsigned     sqmask;     /* ring index mask */
+  unsigned     sqsize;     /* number of submission entries */
+  struct io_uring_sqe *sqes; /* submission queue entries */
+  unsigned    *cqhead;     /* completion queue head (ours) */
+  unsigned    *cqtail;     /* completion queue tail (kernel's) */
+  unsigned     cqmask;     /* ring index mask */
+  struct io_uring_cqe *cqes; /* completion queue entries */
+  void        *rmap;       /* the mapped queues */
+  size_t       rsize;      /* size of rmap */
+  size_t       ssize;      /* size of the mapped sqes */
+  struct io_uring_buf_ring *br; /* the provided buffer ring */
+  char        *bufs;       /* SRV_NBUF buffers of SRV_BUFSZ bytes */
+  unsigned short brtail;   /* our tail of the buffer ring */
+  int          nops;       /* requests in flight */
+};
+#endif
+
+/* Forward references */
+static int      srv_listen(int, int, int, int, int, char *);
+static void     srv_accept(struct SrvConn *);
+static void     srv_turn(struct SrvConn *);
+static void     srv_service(struct SrvConn *);
+static int      srv_run(struct SrvConn *);
+static int      srv_runv(struct SrvConn *, int *);
+static int      srv_bigmsg(struct SrvConn *);
+static void     srv_fitrow(struct SrvConn *);
+static void     srv_shrink(struct SrvConn *);
+static int      srv_resize(char **, int *, int);
+static void     srv_close(struct SrvConn *);
+static void     srv_touch(struct SrvConn *);
+static void     srv_wake(void);
+static void     srv_unyield(struct SrvConn *);
+static void     srv_syserr(char *, int, char *);
+static int      srv_epoll(int);
+static struct SrvConn *srv_add(int, struct SrvConn *);
+static void     srv_free(struct SrvConn *);
+#ifdef SRV_URING
+static int      srv_uopen(void);
+static void     srv_uclose(void);
+static void     srv_ucancel(void);
+static struct io_uring_sqe *srv_sqe(struct SrvConn *, int);
+static int      srv_enter(int, int);
+static int      srv_upoll(int);
+static void     srv_ucqe(struct io_uring_cqe *);
+static void     srv_ustep(struct SrvConn *);
+static void     srv_urecv(struct SrvConn *);
+static void     srv_uaccept(struct SrvConn *);
+static void     srv_ubuf(int);
+#endif
+
+/* The epoll set of all sockets, and the limits of rta_serve_open() */
+static int      EpFd = -1;
+static int      MxConn;       /* max # of clients, 0 for no limit */
+static int      Idle;         /* idle timeout in seconds, or 0 */
+static int      NConn;        /* number of open clients */
+static struct SrvConn *Oldest; /* least recently active client */
+static struct SrvConn *Newest; /* most recently active client */
+static struct SrvConn *Lsns;   /* listeners, linked by next */
+static int      Backend = RTA_SRV_EPOLL; /* RTA_SRV_EPOLL or _URING */
+static struct iovec Iov[SRV_MXIOV]; /* output of srv_runv() */
+static unsigned NQueued;       /* rta_ext_nqueued() at the last poll */
+static int      NYield;        /* clients to run on the next poll */
+static unsigned Round;         /* the current round, one per poll */
+#ifdef SRV_URING
+static struct SrvRing Ring = { -1 };
+static struct SrvConn *Dead;   /* closed clients, linked by next */
+static int      Stopping;      /* ==1 while rta_serve_close() waits */
+#endif
+
+
+/***************************************************************
+ * rta_serve_open(): - Listen for Postgres clients on a TCP port.
+ * The first call creates the epoll set.  Later calls add more
+ * listen ports to it.
+ *
+ * Input:        port -- the TCP port to listen on
+ *               backlog -- listen() backlog, 0 for SOMAXCONN
+ *               mxconn -- max # of clients, 0 for no limit
+ *               idle -- close clients idle this many seconds,
+ *                       0 to never close them
+ * Output:       The epoll fd to wait on, or -1 on error
+ * Effects:      None
+ ***************************************************************/
+int
+rta_serve_open(int port, int backlog, int mxconn, int idle)
+{
+  struct sockaddr_in srvskt; /* address we listen on */
+  int      fd;             /* listen socket */
+  int      one = 1;        /* for setsockopt() */
+
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    srv_syserr(LOC, "socket");
+    return (-1);
+  }
+  (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  (void) memset((void *) &srvskt, 0, sizeof(srvskt));
+  srvskt.sin_family = AF_INET;
+  srvskt.sin_addr.s_addr = htonl(INADDR_ANY);
+  srvskt.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *) &srvskt, sizeof(srvskt)) < 0) {
+    srv_syserr(LOC, "bind");
+    close(fd);
+    return (-1);
+  }
+  return (srv_listen(fd, port, backlog, mxconn, idle, (char *) 0));
+}
+
+/***************************************************************
+ * rta_serve_open_unix(): - Listen for Postgres clients on a
+ * Unix socket.  The socket is DIR/.s.PGSQL.PORT so that psql
+ * -h DIR -p PORT finds it.  If dir starts with '@' the socket
+ * is in the Linux abstract namespace, as libpq expects for a
+ * host that starts with '@', and there is no file to clean up.
+ * A stale socket file from an earlier run is removed.
+ *
+ * Input:        dir -- the directory of the socket, or '@name'
+ *               port -- the port number in the socket name
+ *               backlog, mxconn, idle -- as rta_serve_open()
+ * Output:       The epoll fd to wait on, or -1 on error
+ * Effects:      Creates the socket file
+ ***************************************************************/
+int
+rta_serve_open_unix(char *dir, int port, int backlog, int mxconn, int idle)
+{
+  struct sockaddr_un srvskt; /* address we listen on */
+  struct stat sb;          /* to see if the old file is a socket */
+  socklen_t len;           /* length of the address */
+  char    *path = (char *) 0; /* socket file to remove on close */
+  int      fd;             /* listen socket */
+  int      n;              /* length of the socket name */
+
+  (void) memset((void *) &srvskt, 0, sizeof(srvskt));
+  srvskt.sun_family = AF_UNIX;
+  n = snprintf(srvskt.sun_path, sizeof(srvskt.sun_path), "%s/.s.PGSQL.%d",
+               dir, port);
+  if (n < 0 || n >= (int) sizeof(srvskt.sun_path)) {
+    errno = ENAMETOOLONG;
+    srv_syserr(LOC, "bind");
+    return (-1);
+  }
+  len = offsetof(struct sockaddr_un, sun_path) + n;
+  if (srvskt.sun_path[0] == '@')
+    srvskt.sun_path[0] = 0;     /* abstract, not a file */
+  else {
+    len++;                      /* include the null */
+    if (lstat(srvskt.sun_path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+      (void) unlink(srvskt.sun_path);
+    path = strdup(srvskt.sun_path);
+    if (path == (char *) 0) {
+      srv_syserr(LOC, "strdup");
+      return (-1);
+    }
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    srv_syserr(LOC, "socket");
+    free(path);
+    return (-1);
+  }
+  if (bind(fd, (struct sockaddr *) &srvskt, len) < 0) {
+    srv_syserr(LOC, "bind");
+    close(fd);
+    free(path);
+    return (-1);
+  }
+  return (srv_listen(fd, port, backlog, mxconn, idle, path));
+}
+
+/***************************************************************
+ * rta_serve_backend(): - Choose epoll or io_uring for the
+ * server.  This must be called before the first listener is
+ * opened.  We fall back to epoll if io_uring does not work.
+ *
+ * Input:        RTA_SRV_EPOLL or RTA_SRV_URING
+ * Output:       The backend the server will use
+ * Effects:      Sets up the io_uring
+ ***************************************************************/
+int
+rta_serve_backend(int backend)
+{
+  /* An open server keeps its backend */
+  if (Lsns)
+    return (Backend);
+
+#ifdef SRV_URING
+  if (backend == RTA_SRV_URING && Ring.fd < 0 && srv_uopen() < 0)
+    backend = RTA_SRV_EPOLL;
+  if (backend == RTA_SRV_EPOLL && Ring.fd >= 0)
+    srv_uclose();
+  Backend = backend;
+#endif
+  return (Backend);
+}
+
+/***************************************************************
+ * rta_serve_class(): - Set the scheduling class and output
+ * high-water mark of the clients that connect to a port from
+ * now on.  Clients already connected keep theirs.
+ *
+ * Input:        port -- the port of the listeners to change
+ *               prio -- RTA_SRV_NORMAL or RTA_SRV_HIGH
+ *               hiwat -- unsent bytes of output at which the
+ *                        commands of a client wait, 0 for
+ *                        RTA_SRV_MXOUT
+ * Output:       The number of listeners changed, or -1 if the
+ *               class or high-water mark is not valid
+ * Effects:      None
+ ***************************************************************/
+int
+rta_serve_class(int port, int prio, int hiwat)
+{
+  struct SrvConn *pl;      /* a listener */
+  int      n = 0;          /* listeners changed */
+
+  if ((prio != RTA_SRV_NORMAL && prio != RTA_SRV_HIGH) ||
+      hiwat < 0 || hiwat > RTA_SRV_MXOUT)
+    return (-1);
+  for (pl = Lsns; pl; pl = pl->next) {
+    if (pl->port != port)
+      continue;
+    pl->prio = prio;
+    pl->hiwat = hiwat;
+    n++;
+  }
+  return (n);
+}
+
+/***************************************************************
+ * rta_serve_timeout(): - How long the caller may wait before
+ * it must call rta_serve_poll() to close idle clients, to
+ * send notifications, or to continue a SELECT that yielded or
+ * a client that used its quantum.
+ *
+ * Input:        None
+ * Output:       Milliseconds to wait, or -1 to wait forever
+ * Effects:      None
+ ***************************************************************/
+int
+rta_serve_timeout()
+{
+  time_t   now;            /* current time */
+  time_t   left;           /* seconds until the oldest is idle */
+
+  if (rta_ext_nqueued() != NQueued || NYield > 0)
+    return (0);                 /* notifications or rows to send */
+  if (Idle <= 0 || Oldest == (struct SrvConn *) 0)
+    return (-1);
+  now = time((time_t *) 0);
+  left = Oldest->last + Idle - now;
+  return ((left > 0) ? (int) left * 1000 : 0);
+}
+
+/***************************************************************
+ * rta_serve_poll(): - Wait for activity on the listen sockets
+ * and client connections and handle it.  New clients are
+ * accepted, commands executed, and responses sent.  Clients
+ * idle too long are closed.
+ *
+ * Input:        timeout -- max milliseconds to wait, -1 forever
+ * Output:       # of sockets handled, or -1 on error
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+int
+rta_serve_poll(int timeout)
+{
+  time_t   now;            /* current time */
+  int      nev;            /* number of sockets handled */
+
+  Round++;
+#ifdef SRV_URING
+  if (Backend == RTA_SRV_URING)
+    nev = srv_upoll(timeout);
+  else
+#endif
+    nev = srv_epoll(timeout);
+  if (nev < 0)
+    return (-1);
+
+  /* Send the notifications raised by commands or by the
+     application since the last poll, and give each SELECT that
+     yielded and each client that used its quantum the next slice */
+  if (rta_ext_nqueued() != NQueued || NYield > 0) {
+    NQueued = rta_ext_nqueued();
+    srv_wake();
+  }
+
+  /* Close the clients that have been idle too long */
+  if (Idle > 0) {
+    now = time((time_t *) 0);
+    while (Oldest && Oldest->last + Idle <= now)
+      srv_close(Oldest);
+  }
+  return (nev);
+}
+
+/***************************************************************
+ * srv_epoll(): - Wait for epoll events and handle them.
+ *
+ * Input:        timeout -- max milliseconds to wait, -1 forever
+ * Output:       # of sockets handled, or -1 on error
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+static int
+srv_epoll(int timeout)
+{
+  struct epoll_event evs[SRV_MXEVENT]; /* the ready sockets */
+  struct SrvConn *pc;      /* a listener or client */
+  int      nev;            /* number of ready sockets */
+  int      prio;           /* the class being run */
+  int      i;              /* loop counter */
+
+  if (EpFd < 0)
+    return (-1);
+  nev = epoll_wait(EpFd, evs, SRV_MXEVENT, timeout);
+  if (nev < 0) {
+    if (errno == EINTR)
+      return (0);
+    srv_syserr(LOC, "epoll_wait");
+    return (-1);
+  }
+
+  /* Note what each socket may do, then run the high class */
+  for (i = 0; i < nev; i++) {
+    pc = (struct SrvConn *) evs[i].data.ptr;
+    if (pc->islsn)
+      continue;
+    if (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      pc->canrd = 1;
+    if (evs[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+      pc->canwr = 1;
+  }
+  for (prio = RTA_SRV_HIGH; prio >= RTA_SRV_NORMAL; prio--) {
+    for (i = 0; i < nev; i++) {
+      pc = (struct SrvConn *) evs[i].data.ptr;
+      if (pc == (struct SrvConn *) 0 || pc->prio != prio)
+        continue;
+      evs[i].data.ptr = (void *) 0;   /* srv_service() may free it */
+      if (pc->islsn)
+        srv_accept(pc);
+      else
+        srv_service(pc);
+    }
+  }
+  return (nev);
+}
+
+/***************************************************************
+ * rta_serve(): - Listen on a TCP port and serve Postgres clients
+ * forever.
+ *
+ * Input:        port -- the TCP port to listen on
+ *               backlog -- listen() backlog, 0 for SOMAXCONN
+ * Output:       RTA_ERROR.  Returns only on error.
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+int
+rta_serve(int port, int backlog)
+{
+  if (rta_serve_open(port, backlog, 0, 0) < 0)
+    return (RTA_ERROR);
+  while (rta_serve_poll(rta_serve_timeout()) >= 0)
+    ;
+  return (RTA_ERROR);
+}
+
+/***************************************************************
+ * rta_serve_close(): - Close all listen sockets and clients and
+ * free the epoll set or io_uring.  Unix socket files are removed.
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      rta_serve_open() starts over after this
+ ***************************************************************/
+void
+rta_serve_close()
+{
+  struct SrvConn *pl;      /* a listener */
+
+#ifdef SRV_URING
+  /* Nothing may be left in flight when the buffers are freed */
+  if (Ring.fd >= 0) {
+    srv_ucancel();
+    while (Dead) {
+      pl = Dead;
+      Dead = pl->next;
+      srv_free(pl);
+    }
+  }
+#endif
+  while (Oldest)
+    srv_close(Oldest);
+  while (Lsns) {
+    pl = Lsns;
+    Lsns = pl->next;
+    close(pl->fd);
+    if (pl->path) {
+      (void) unlink(pl->path);
+      free(pl->path);
+    }
+    free(pl);
+  }
+  if (EpFd >= 0) {
+    close(EpFd);
+    EpFd = -1;
+  }
+#ifdef SRV_URING
+  if (Ring.fd >= 0)
+    srv_uclose();
+#endif
+}
+
+/***************************************************************
+ * srv_listen(): - Start listening on a bound socket and add it
+ * to the epoll set or give it a multishot accept.  The first
+ * call creates the epoll set or io_uring.
+ *
+ * Input:        The bound socket, its port, the listen()
+ *               backlog, the client limits of rta_serve_open(),
+ *               and the socket file to remove on close, or NULL
+ * Output:       The epoll fd, or -1 on error
+ * Effects:      The socket and path are closed and freed on error
+ ***************************************************************/
+static int
+srv_listen(int fd, int port, int backlog, int mxconn, int idle, char *path)
+{
+  struct SrvConn *pl;      /* the new listener */
+  struct epoll_event ev;   /* registers the listener */
+
+#ifdef SRV_URING
+  if (Backend == RTA_SRV_URING && Ring.fd < 0 && srv_uopen() < 0)
+    Backend = RTA_SRV_EPOLL;
+#endif
+  if (Backend == RTA_SRV_EPOLL && EpFd < 0) {
+    EpFd = epoll_create1(EPOLL_CLOEXEC);
+    if (EpFd < 0) {
+      srv_syserr(LOC, "epoll_create1");
+      close(fd);
+      free(path);
+      return (-1);
+    }
+  }
+  MxConn = mxconn;
+  Idle = idle;
+
+  if (listen(fd, (backlog > 0) ? backlog : SOMAXCONN) < 0) {
+    srv_syserr(LOC, "listen");
+    close(fd);
+    free(path);
+    return (-1);
+  }
+
+  pl = calloc(1, sizeof(struct SrvConn));
+  if (pl == (struct SrvConn *) 0) {
+    srv_syserr(LOC, "calloc");
+    close(fd);
+    free(path);
+    return (-1);
+  }
+  pl->fd = fd;
+  pl->islsn = 1;
+  pl->port = port;
+  pl->path = path;
+  pl->next = Lsns;
+  Lsns = pl;
+
+#ifdef SRV_URING
+  /* The kernel waits in the accept, so the socket must block */
+  if (Backend == RTA_SRV_URING) {
+    (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    srv_uaccept(pl);
+    return (Ring.fd);
+  }
+#endif
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = pl;
+  if (epoll_ctl(EpFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    srv_syserr(LOC, "epoll_ctl");
+    Lsns = pl->next;
+    close(fd);
+    free(path);
+    free(pl);
+    return (-1);
+  }
+  return (EpFd);
+}
+
+/***************************************************************
+ * srv_accept(): - Accept all pending connections on a listener.
+ * With an edge-triggered listener we must accept until the
+ * queue is empty.  Clients over the limit are closed at once.
+ *
+ * Input:        The listener
+ * Output:       None
+ * Effects:      Adds clients to the epoll set and the LRU list
+ ***************************************************************/
+static void
+srv_accept(struct SrvConn *pl)
+{
+  struct SrvConn *pc;      /* the new client */
+  struct epoll_event ev;   /* registers the client */
+  int      fd;             /* the new client socket */
+
+  while (1) {
+    fd = accept4(pl->fd, (struct sockaddr *) 0, (socklen_t *) 0,
+                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        srv_syserr(LOC, "accept4");
+      return;
+    }
+    pc = srv_add(fd, pl);
+    if (pc == (struct SrvConn *) 0)
+      continue;
+
+    /* Registering a socket that already has data sends an event */
+    pc->canwr = 1;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = pc;
+    if (epoll_ctl(EpFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      srv_syserr(LOC, "epoll_ctl");
+      srv_close(pc);
+    }
+  }
+}
+
+/***************************************************************
+ * srv_add(): - Set up a new client.  Clients over the limit are
+ * closed at once.  The client gets the class of its listener.
+ *
+ * Input:        The socket of the client, and its listener
+ * Output:       The client, or NULL if it was closed
+ * Effects:      Adds the client to the LRU list
+ ***************************************************************/
+static struct SrvConn *
+srv_add(int fd, struct SrvConn *pl)
+{
+  struct SrvConn *pc;      /* the new client */
+
+  if (MxConn > 0 && NConn >= MxConn) {
+    close(fd);
+    return ((struct SrvConn *) 0);
+  }
+
+  pc = calloc(1, sizeof(struct SrvConn));
+  if (pc) {
+    pc->in = malloc(RTA_SRV_MXIN);
+    pc->out = malloc(RTA_SRV_MXOUT);
+    pc->sess = rta_session_new();
+  }
+  if (!pc || !pc->in || !pc->out || !pc->sess) {
+    srv_syserr(LOC, "malloc");
+    if (pc) {
+      free(pc->in);
+      free(pc->out);
+      rta_session_free(pc->sess);
+      free(pc);
+    }
+    close(fd);
+    return ((struct SrvConn *) 0);
+  }
+  pc->fd = fd;
+  pc->insize = RTA_SRV_MXIN;
+  pc->outsize = RTA_SRV_MXOUT;
+  pc->prio = pl->prio;
+  pc->hiwat = (pl->hiwat > 0) ? pl->hiwat : RTA_SRV_MXOUT;
+  NConn++;
+  srv_touch(pc);
+  return (pc);
+}
+
+/***************************************************************
+ * srv_service(): - Read, execute, and write for one client until
+ * nothing more can be done without a new epoll event, or until
+ * a SELECT uses its budget or the client uses its quantum.
+ * Commands wait while the unsent output is at the client's
+ * high-water mark.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      May close and free the client
+ ***************************************************************/
+static void
+srv_service(struct SrvConn *pc)
+{
+  int      progress;       /* ==1 if a read or write moved data */
+  int      ret;            /* read(), write(), or srv_run() return */
+  int      nsent;          /* bytes sent by srv_runv() */
+
+  srv_unyield(pc);
+  srv_turn(pc);
+  do {
+    progress = 0;
+
+    /* Read what fits.  Move unused input to the front first. */
+    if (pc->canrd && !pc->eof) {
+      if (pc->ioff > 0) {
+        (void) memmove(pc->in, &pc->in[pc->ioff], pc->ilen - pc->ioff);
+        pc->ilen -= pc->ioff;
+        pc->ioff = 0;
+      }
+      if (pc->ilen < pc->insize) {
+        ret = read(pc->fd, &pc->in[pc->ilen], pc->insize - pc->ilen);
+        if (ret > 0) {
+          pc->ilen += ret;
+          progress = 1;
+        }
+        else if (ret == 0)
+          pc->eof = 1;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+          pc->canrd = 0;
+        else if (errno != EINTR) {
+          srv_close(pc);
+          return;
+        }
+      }
+    }
+
+    /* Execute the complete commands we have.  With no output
+       waiting we can send the responses straight from the rows. */
+    if (pc->canwr && pc->olen == 0) {
+      ret = srv_runv(pc, &nsent);
+      if (nsent > 0)
+        progress = 1;
+    }
+    else if (pc->olen - pc->ooff < pc->hiwat)
+      ret = srv_run(pc);
+    else
+      ret = RTA_NOBUF;          /* wait for the output to drain */
+    if (ret == RTA_CLOSE)
+      pc->closing = 1;
+    else if (ret == RTA_YIELD) {
+      pc->yield = 1;            /* continue on the next poll */
+      NYield++;
+    }
+    else if (ret == RTA_NOCMD && pc->ioff == 0 &&
+             pc->ilen == pc->insize) {
+      /* A message bigger than the input buffer */
+      if (srv_bigmsg(pc) < 0) {
+        srv_close(pc);
+        return;
+      }
+      progress = 1;             /* read the rest of it */
+    }
+
+    /* Send what we can */
+    if (pc->canwr && pc->olen > pc->ooff) {
+      ret = send(pc->fd, &pc->out[pc->ooff], pc->olen - pc->ooff,
+                 MSG_NOSIGNAL);
+      if (ret > 0) {
+        pc->ooff += ret;
+        if (pc->ooff == pc->olen)
+          pc->ooff = pc->olen = 0;
+        progress = 1;
+      }
+      else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        pc->canwr = 0;
+      else if (ret < 0 && errno != EINTR) {
+        srv_close(pc);
+        return;
+      }
+    }
+
+    /* Out of quantum.  Let the others run before we go on. */
+    if (progress && pc->deficit <= 0 && !pc->closing && !pc->yield) {
+      pc->yield = 1;
+      NYield++;
+    }
+  } while (progress && !pc->closing && !pc->yield);
+
+  /* Close after the last response, or after the client is gone
+     and no statement is stopped with more to send */
+  if (pc->olen == 0 && (pc->closing ||
+      (pc->eof && !pc->yield && !rta_ext_busy(pc->sess)))) {
+    srv_close(pc);
+    return;
+  }
+  srv_touch(pc);
+}
+
+/***************************************************************
+ * srv_run(): - Execute the commands in the input buffer of a
+ * client while there is room for the responses.
+ *
+ * Input:        The client
+ * Output:       The return of rta_session_dbbatch()
+ * Effects:      Many, via the table callbacks.  The output is
+ *               taken from the client's quantum.
+ ***************************************************************/
+static int
+srv_run(struct SrvConn *pc)
+{
+  int      nin;            /* unused bytes of input */
+  int      nfree;          /* free bytes of output */
+  int      ncmd;           /* commands executed */
+  int      ret;            /* rta_session_dbbatch() return */
+
+  /* Move unsent output to the front to make room */
+  if (pc->ooff > 0) {
+    (void) memmove(pc->out, &pc->out[pc->ooff], pc->olen - pc->ooff);
+    pc->olen -= pc->ooff;
+    pc->ooff = 0;
+  }
+  srv_fitrow(pc);
+
+  nin = pc->ilen - pc->ioff;
+  nfree = pc->outsize - pc->olen;
+  ret = rta_session_dbbatch(pc->sess, &pc->in[pc->ioff], &nin,
+                            &pc->out[pc->olen], &nfree, &ncmd);
+  pc->ioff = pc->ilen - nin;
+  pc->deficit -= pc->outsize - nfree - pc->olen;
+  pc->olen = pc->outsize - nfree;
+
+  if (pc->ioff == pc->ilen)
+    pc->ioff = pc->ilen = 0;
+  srv_shrink(pc);
+  return (ret);
+}
+
+/***************************************************************
+ * srv_runv(): - Execute the commands in the input buffer of a
+ * client and send the responses with one sendmsg().  Long
+ * strings are sent from the rows, not copied.  Strings that did
+ * not fit in the socket are copied into their holes in the
+ * output buffer before we return so that the application may
+ * change its tables while we wait to send the rest.
+ *
+ * Input:        The client, which has no output waiting
+ * Output:       The return of rta_session_dbbatchv(), and the
+ *               number of bytes sent
+ * Effects:      Many, via the table callbacks.  The output is
+ *               taken from the client's quantum.
+ ***************************************************************/
+static int
+srv_runv(struct SrvConn *pc, int *nsent)
+{
+  struct msghdr msg;       /* the list to send */
+  int      nin;            /* unused bytes of input */
+  int      nfree;          /* free bytes of output */
+  int      ncmd;           /* commands executed */
+  int      niov = SRV_MXIOV; /* entries in Iov */
+  int      ret;            /* rta_session_dbbatchv() return */
+  int      i;              /* loop counter */
+  char    *hole;           /* where a string goes in the buffer */
+  int      skip;           /* bytes of a string already sent */
+
+  srv_fitrow(pc);
+  nin = pc->ilen - pc->ioff;
+  nfree = pc->outsize;
+  ret = rta_session_dbbatchv(pc->sess, &pc->in[pc->ioff], &nin,
+                             pc->out, &nfree, &ncmd, Iov, &niov);
+  pc->ioff = pc->ilen - nin;
+  pc->olen = pc->outsize - nfree;
+  pc->deficit -= pc->olen;
+  if (pc->ioff == pc->ilen)
+    pc->ioff = pc->ilen = 0;
+
+  *nsent = 0;
+  if (niov == 0)
+    return (ret);
+  (void) memset((void *) &msg, 0, sizeof(msg));
+  msg.msg_iov = Iov;
+  msg.msg_iovlen = niov;
+  *nsent = sendmsg(pc->fd, &msg, MSG_NOSIGNAL);
+  if (*nsent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      pc->canwr = 0;
+    *nsent = 0;                 /* other errors show up on the retry */
+  }
+  if (*nsent == pc->olen) {
+    pc->ooff = pc->olen = 0;
+    srv_shrink(pc);
+    return (ret);
+  }
+
+  /* Copy the unsent part of each string into its hole.  Strings
+     follow a part of the buffer, so they are the odd entries. */
+  pc->ooff = *nsent;
+  for (i = 1; i < niov; i += 2) {
+    hole = (char *) Iov[i - 1].iov_base + Iov[i - 1].iov_len;
+    skip = pc->ooff - (int) (hole - pc->out);
+    if (skip < 0)
+      skip = 0;
+    if (skip < (int) Iov[i].iov_len)
+      (void) memcpy(hole + skip, (char *) Iov[i].iov_base + skip,
+                    Iov[i].iov_len - skip);
+  }
+  return (ret);
+}
+
+/***************************************************************
+ * srv_bigmsg(): - Grow the input buffer of a client for a
+ * message that does not fit in it.
+ *
+ * Input:        The client, whose input buffer is full
+ * Output:       0 if the buffer grew, -1 if the message is
+ *               bigger than RTA_SRV_MXMSG or out of memory
+ * Effects:      The input buffer
+ ***************************************************************/
+static int
+srv_bigmsg(struct SrvConn *pc)
+{
+  int      need;           /* bytes in the message */
+
+  need = rta_dbmsglen(pc->in, pc->ilen);
+  if (need <= pc->insize || need > RTA_SRV_MXMSG) {
+    rta_stat.nrtaerr++;
+    if (rta_dbg.rtaerr)
+      rta_log(LOC, Er_No_Space);
+    return (-1);
+  }
+  return (srv_resize(&pc->in, &pc->insize, need));
+}
+
+/***************************************************************
+ * srv_fitrow(): - Grow the output buffer of a client if the
+ * next row of its stopped SELECT can not fit even in an empty
+ * buffer.  On failure the SELECT gets an "Output buffer full"
+ * error.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      The output buffer
+ ***************************************************************/
+static void
+srv_fitrow(struct SrvConn *pc)
+{
+  int      need;           /* the most the row may need */
+
+  need = rta_ext_rowsize(pc->sess);
+  if (need > pc->outsize && need <= RTA_SRV_MXMSG)
+    (void) srv_resize(&pc->out, &pc->outsize, need);
+}
+
+/***************************************************************
+ * srv_shrink(): - Give back the memory of a grown buffer once
+ * the big message or row is done.  An input buffer must not
+ * shrink below a receive in flight.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      The input and output buffers
+ ***************************************************************/
+static void
+srv_shrink(struct SrvConn *pc)
+{
+  if (pc->insize > RTA_SRV_MXIN && pc->ilen == 0 && !pc->rdq)
+    (void) srv_resize(&pc->in, &pc->insize, RTA_SRV_MXIN);
+  if (pc->outsize > RTA_SRV_MXOUT && pc->olen == 0 &&
+      rta_ext_rowsize(pc->sess) <= RTA_SRV_MXOUT)
+    (void) srv_resize(&pc->out, &pc->outsize, RTA_SRV_MXOUT);
+}
+
+/***************************************************************
+ * srv_resize(): - Change the size of a buffer, keeping its data.
+ *
+ * Input:        The buffer, its size, and the new size, which
+ *               is not less than the data in it
+ * Output:       0 on success, -1 if out of memory
+ * Effects:      The buffer and its size
+ ***************************************************************/
+static int
+srv_resize(char **pbuf, int *psize, int size)
+{
+  char    *p;              /* the new buffer */
+
+  p = realloc(*pbuf, size);
+  if (p == (char *) 0) {
+    srv_syserr(LOC, "realloc");
+    return (-1);
+  }
+  *pbuf = p;
+  *psize = size;
+  return (0);
+}
+
+/***************************************************************
+ * srv_wake(): - Run the clients that have notifications to send,
+ * a SELECT that yielded, or work left over from their last
+ * quantum.  The high class goes first.  A client that cannot
+ * take its notifications now sends them when its output drains.
+ * A client that runs moves to the end of the list, so we stop
+ * at the client that was last when we started.  A client that
+ * used its quantum in this round, or yields again, waits for
+ * the next poll.
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      May close and free clients
+ ***************************************************************/
+static void
+srv_wake()
+{
+  struct SrvConn *pc;      /* a client */
+  struct SrvConn *next;    /* the client after it */
+  struct SrvConn *last;    /* the last client to look at */
+  int      prio;           /* the class being run */
+
+  for (prio = RTA_SRV_HIGH; prio >= RTA_SRV_NORMAL; prio--) {
+    last = Newest;
+    for (pc = Oldest; pc; pc = next) {
+      next = (pc == last) ? (struct SrvConn *) 0 : pc->next;
+      if (pc->prio != prio ||
+          (!pc->yield && rta_session_pending(pc->sess) == 0) ||
+          (pc->round == Round && pc->deficit <= 0))
+        continue;
+#ifdef SRV_URING
+      if (Backend == RTA_SRV_URING) {
+        srv_ustep(pc);
+        continue;
+      }
+#endif
+      srv_service(pc);
+    }
+  }
+#ifdef SRV_URING
+  /* Start the sends now, not on the next poll */
+  if (Backend == RTA_SRV_URING)
+    (void) srv_enter(0, 0);
+#endif
+}
+
+/***************************************************************
+ * srv_unyield(): - Clear the yielded mark of a client that is
+ * about to run, or to close.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      The count of yielded clients
+ ***************************************************************/
+static void
+srv_unyield(struct SrvConn *pc)
+{
+  if (pc->yield) {
+    pc->yield = 0;
+    NYield--;
+  }
+}
+
+/***************************************************************
+ * srv_turn(): - Give a client its quantum the first time it
+ * runs in a round.  Unused bytes are not saved up, but bytes
+ * over the last quantum are taken from this one.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      The client's deficit
+ ***************************************************************/
+static void
+srv_turn(struct SrvConn *pc)
+{
+  if (pc->round == Round)
+    return;
+  pc->round = Round;
+  if (pc->deficit > 0)
+    pc->deficit = 0;
+  pc->deficit += (pc->prio == RTA_SRV_HIGH) ?
+    SRV_QUANTUM * SRV_HIGHWT : SRV_QUANTUM;
+}
+
+/***************************************************************
+ * srv_close(): - Close a client connection and free it.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      Removes the client from the LRU list
+ ***************************************************************/
+static void
+srv_close(struct SrvConn *pc)
+{
+  srv_unyield(pc);
+  if (pc->prev)
+    pc->prev->next = pc->next;
+  else
+    Oldest = pc->next;
+  if (pc->next)
+    pc->next->prev = pc->prev;
+  else
+    Newest = pc->prev;
+  NConn--;
+
+#ifdef SRV_URING
+  /* Requests in flight still point at the client.  shutdown()
+     ends them and the last completion frees the client. */
+  if (pc->nops > 0) {
+    (void) shutdown(pc->fd, SHUT_RDWR);
+    close(pc->fd);
+    pc->dead = 1;
+    pc->next = Dead;
+    Dead = pc;
+    return;
+  }
+#endif
+
+  /* close() removes the fd from the epoll set */
+  close(pc->fd);
+  srv_free(pc);
+}
+
+/***************************************************************
+ * srv_free(): - Free a closed client
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      None
+ ***************************************************************/
+static void
+srv_free(struct SrvConn *pc)
+{
+  rta_session_free(pc->sess);
+  free(pc->in);
+  free(pc->out);
+  free(pc);
+}
+
+/***************************************************************
+ * srv_touch(): - Mark a client as the most recently active by
+ * moving it to the end of the LRU list.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      The LRU list
+ ***************************************************************/
+static void
+srv_touch(struct SrvConn *pc)
+{
+  pc->last = time((time_t *) 0);
+  if (Newest == pc)
+    return;
+
+  /* unlink, if in the list */
+  if (pc->prev)
+    pc->prev->next = pc->next;
+  else if (Oldest == pc)
+    Oldest = pc->next;
+  if (pc->next)
+    pc->next->prev = pc->prev;
+
+  /* add at the end */
+  pc->next = (struct SrvConn *) 0;
+  pc->prev = Newest;
+  if (Newest)
+    Newest->next = pc;
+  else
+    Oldest = pc;
+  Newest = pc;
+}
+
+#ifdef SRV_URING
+/***************************************************************
+ * srv_uopen(): - Set up the io_uring and the provided buffer
+ * ring.  We need the features of Linux 5.19: registering the
+ * buffer ring fails on older kernels.
+ *
+ * Input:        None
+ * Output:       0 on success, -1 if io_uring can not be used
+ * Effects:      The Ring
+ ***************************************************************/
+static int
+srv_uopen()
+{
+  struct io_uring_params p;    /* what the kernel gave us */
+  struct io_uring_buf_reg reg; /* registers the buffer ring */
+  unsigned *sqarray;       /* sqe index of each ring slot */
+  size_t   cqsize;         /* size of the completion queue */
+  unsigned i;              /* loop counter */
+  void    *map;            /* an mmap() result */
+
+  (void) memset((void *) &p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = 4 * SRV_NSQE;
+  Ring.fd = (int) syscall(__NR_io_uring_setup, SRV_NSQE, &p);
+  if (Ring.fd < 0) {
+    srv_syserr(LOC, "io_uring_setup");
+    return (-1);
+  }
+
+  /* One mmap for both queues, no lost completions, and waits
+     with a timeout */
+  if ((p.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+      (p.features & IORING_FEAT_NODROP) == 0 ||
+      (p.features & IORING_FEAT_EXT_ARG) == 0) {
+    errno = ENOSYS;
+    srv_syserr(LOC, "io_uring_setup");
+    srv_uclose();
+    return (-1);
+  }
+
+  Ring.rsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (cqsize > Ring.rsize)
+    Ring.rsize = cqsize;
+  map = mmap((void *) 0, Ring.rsize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, Ring.fd, IORING_OFF_SQ_RING);
+  Ring.rmap = (map == MAP_FAILED) ? (void *) 0 : map;
+  Ring.ssize = p.sq_entries * sizeof(struct io_uring_sqe);
+  map = mmap((void *) 0, Ring.ssize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, Ring.fd, IORING_OFF_SQES);
+  Ring.sqes = (map == MAP_FAILED) ? (struct io_uring_sqe *) 0 : map;
+  map = mmap((void *) 0, SRV_NBUF * sizeof(struct io_uring_buf),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  Ring.br = (map == MAP_FAILED) ? (struct io_uring_buf_ring *) 0 : map;
+  Ring.bufs = malloc(SRV_NBUF * SRV_BUFSZ);
+  if (!Ring.rmap || !Ring.sqes || !Ring.br || !Ring.bufs) {
+    srv_syserr(LOC, "mmap");
+    srv_uclose();
+    return (-1);
+  }
+
+  Ring.sqhead = (unsigned *) ((char *) Ring.rmap + p.sq_off.head);
+  Ring.sqtail = (unsigned *) ((char *) Ring.rmap + p.sq_off.tail);
+  Ring.sqmask = *(unsigned *) ((char *) Ring.rmap + p.sq_off.ring_mask);
+  Ring.sqsize = p.sq_entries;
+  Ring.cqhead = (unsigned *) ((char *) Ring.rmap + p.cq_off.head);
+  Ring.cqtail = (unsigned *) ((char *) Ring.rmap + p.cq_off.tail);
+  Ring.cqmask = *(unsigned *) ((char *) Ring.rmap + p.cq_off.ring_mask);
+  Ring.cqes = (struct io_uring_cqe *) ((char *) Ring.rmap + p.cq_off.cqes);
+
+  /* Slot i of the queue always holds sqe i */
+  sqarray = (unsigned *) ((char *) Ring.rmap + p.sq_off.array);
+  for (i = 0; i < p.sq_entries; i++)
+    sqarray[i] = i;
+
+  /* Register the buffer ring and give the kernel all of the buffers */
+  (void) memset((void *) &reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long) Ring.br;
+  reg.ring_entries = SRV_NBUF;
+  reg.bgid = SRV_BGID;
+  if (syscall(__NR_io_uring_register, Ring.fd, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0) {
+    srv_syserr(LOC, "io_uring_register");
+    srv_uclose();
+    return (-1);
+  }
+  Ring.brtail = 0;
+  for (i = 0; i < SRV_NBUF; i++)
+    srv_ubuf(i);
+  return (0);
+}
+
+/***************************************************************
+ * srv_uclose(): - Close the io_uring and free its memory.  No
+ * requests may be in flight.
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      The Ring
+ ***************************************************************/
+static void
+srv_uclose()
+{
+  if (Ring.fd >= 0)
+    close(Ring.fd);
+  if (Ring.rmap)
+    (void) munmap(Ring.rmap, Ring.rsize);
+  if (Ring.sqes)
+    (void) munmap((void *) Ring.sqes, Ring.ssize);
+  if (Ring.br)
+    (void) munmap((void *) Ring.br, SRV_NBUF * sizeof(struct io_uring_buf));
+  free(Ring.bufs);
+  (void) memset((void *) &Ring, 0, sizeof(Ring));
+  Ring.fd = -1;
+}
+
+/***************************************************************
+ * srv_ucancel(): - Cancel all requests and wait for them to
+ * complete.  Completions are counted but not acted on.
+ *
+ * Input:        None
+ * Output:       None
+ * Effects:      The Ring
+ ***************************************************************/
+static void
+srv_ucancel()
+{
+  struct io_uring_sqe *sqe;    /* the cancel request */
+  int      i;              /* loop counter */
+
+  Stopping = 1;
+  sqe = srv_sqe((struct SrvConn *) 0, 0);
+  if (sqe) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+  }
+  for (i = 0; i < 100 && Ring.nops > 0; i++) {
+    if (srv_upoll(100) < 0)
+      break;
+  }
+  Stopping = 0;
+}
+
+/***************************************************************
+ * srv_sqe(): - Get a cleared submission entry for a request.
+ * We make sure two entries are free so that a send and the
+ * receive linked to it go to the kernel together.
+ *
+ * Input:        The client or listener (may be NULL), and the
+ *               SRV_OP_ type of the request
+ * Output:       The entry, or NULL on error
+ * Effects:      Counts the request as in flight
+ ***************************************************************/
+static struct io_uring_sqe *
+srv_sqe(struct SrvConn *pc, int op)
+{
+  struct io_uring_sqe *sqe;    /* the entry */
+  unsigned tail;           /* our tail of the submission queue */
+
+  tail = *Ring.sqtail;
+  if (tail + 2 - __atomic_load_n(Ring.sqhead, __ATOMIC_ACQUIRE) >
+      Ring.sqsize && srv_enter(0, 0) < 0)
+    return ((struct io_uring_sqe *) 0);
+
+  /* The kernel reads the entry only in io_uring_enter() so the
+     caller can fill it in after we move the tail */
+  sqe = &Ring.sqes[tail & Ring.sqmask];
+  (void) memset((void *) sqe, 0, sizeof(*sqe));
+  sqe->user_data = (uintptr_t) pc | op;
+  __atomic_store_n(Ring.sqtail, tail + 1, __ATOMIC_RELEASE);
+  Ring.nops++;
+  if (pc)
+    pc->nops++;
+  return (sqe);
+}
+
+/***************************************************************
+ * srv_enter(): - Submit the queued requests and optionally wait
+ * for a completion.
+ *
+ * Input:        wait -- ==1 to wait for a completion
+ *               timeout -- max milliseconds to wait, -1 forever
+ * Output:       0 on success or timeout, -1 on error
+ * Effects:      The requests are started
+ ***************************************************************/
+static int
+srv_enter(int wait, int timeout)
+{
+  struct io_uring_getevents_arg arg;  /* the timeout */
+  struct __kernel_timespec ts;        /* timeout in seconds and ns */
+  unsigned flags = IORING_ENTER_EXT_ARG; /* io_uring_enter() flags */
+  unsigned tosubmit;       /* number of queued requests */
+
+  (void) memset((void *) &arg, 0, sizeof(arg));
+  if (wait) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout >= 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000;
+      arg.ts = (unsigned long) &ts;
+    }
+  }
+  tosubmit = *Ring.sqtail - __atomic_load_n(Ring.sqhead, __ATOMIC_ACQUIRE);
+  if (syscall(__NR_io_uring_enter, Ring.fd, tosubmit, (wait) ? 1 : 0,
+              flags, &arg, sizeof(arg)) < 0 &&
+      errno != ETIME && errno != EINTR && errno != EBUSY) {
+    srv_syserr(LOC, "io_uring_enter");
+    return (-1);
+  }
+  return (0);
+}
+
+/***************************************************************
+ * srv_upoll(): - Submit the queued requests, wait for
+ * completions, and handle them.
+ *
+ * Input:        timeout -- max milliseconds to wait, -1 forever
+ * Output:       # of completions handled, or -1 on error
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+static int
+srv_upoll(int timeout)
+{
+  struct io_uring_cqe cqe; /* copy of a completion */
+  unsigned head;           /* our head of the completion queue */
+  int      n = 0;          /* number of completions handled */
+
+  if (Ring.fd < 0 || srv_enter((timeout != 0), timeout) < 0)
+    return (-1);
+
+  /* Handling a completion may queue new requests but does not
+     touch the completion queue */
+  head = *Ring.cqhead;
+  while (head != __atomic_load_n(Ring.cqtail, __ATOMIC_ACQUIRE)) {
+    cqe = Ring.cqes[head & Ring.cqmask];
+    head++;
+    __atomic_store_n(Ring.cqhead, head, __ATOMIC_RELEASE);
+    srv_ucqe(&cqe);
+    n++;
+  }
+  return (n);
+}
+
+/***************************************************************
+ * srv_ucqe(): - Handle the completion of a request
+ *
+ * Input:        The completion
+ * Output:       None
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+static void
+srv_ucqe(struct io_uring_cqe *cqe)
+{
+  struct SrvConn *pc;      /* the client or listener */
+  int      op;             /* the SRV_OP_ type */
+  int      bid;            /* the buffer used by a receive */
+
+  pc = (struct SrvConn *) (uintptr_t) (cqe->user_data & ~SRV_OP_MASK);
+  op = (int) (cqe->user_data & SRV_OP_MASK);
+
+  /* A multishot accept stays in flight while F_MORE is set */
+  if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+    Ring.nops--;
+    if (pc)
+      pc->nops--;
+  }
+  if (pc == (struct SrvConn *) 0)
+    return;
+
+  /* Copy received data out of the buffer and give it back */
+  if (op == SRV_OP_RECV) {
+    pc->rdq = 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+      bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      if (cqe->res > 0 && !pc->dead && !Stopping) {
+        (void) memcpy(&pc->in[pc->ilen], &Ring.bufs[bid * SRV_BUFSZ],
+                      cqe->res);
+        pc->ilen += cqe->res;
+      }
+      srv_ubuf(bid);
+    }
+  }
+  else if (op == SRV_OP_SEND)
+    pc->wrq = 0;
+  if (Stopping)
+    return;
+
+  /* Free a closed client once its last request is done */
+  if (pc->dead) {
+    if (pc->nops == 0) {
+      struct SrvConn **ppc;    /* link to pc in the Dead list */
+
+      for (ppc = &Dead; *ppc != pc; ppc = &((*ppc)->next))
+        ;
+      *ppc = pc->next;
+      srv_free(pc);
+    }
+    return;
+  }
+
+  switch (op) {
+    case SRV_OP_ACCEPT:
+      if (cqe->res >= 0 &&
+          (pc = srv_add(cqe->res, pc)) != (struct SrvConn *) 0)
+        srv_urecv(pc);
+      else if (cqe->res < 0) {
+        errno = -cqe->res;
+        srv_syserr(LOC, "accept");
+      }
+      pc = (struct SrvConn *) (uintptr_t) (cqe->user_data & ~SRV_OP_MASK);
+      if ((cqe->flags & IORING_CQE_F_MORE) == 0 && cqe->res != -EINVAL)
+        srv_uaccept(pc);
+      break;
+
+    case SRV_OP_RECV:
+      if (cqe->res == -ENOBUFS) {
+        srv_urecv(pc);          /* all buffers busy, try again */
+        break;
+      }
+      if (cqe->res == -ECANCELED)
+        break;                  /* the send linked before it failed */
+      if (cqe->res <= 0)
+        pc->eof = 1;
+      srv_touch(pc);
+      srv_ustep(pc);
+      break;
+
+    case SRV_OP_SEND:
+      if (cqe->res < 0) {
+        srv_close(pc);
+        break;
+      }
+      pc->ooff += cqe->res;
+      if (pc->ooff == pc->olen)
+        pc->ooff = pc->olen = 0;
+      srv_touch(pc);
+      srv_ustep(pc);
+      break;
+  }
+}
+
+/***************************************************************
+ * srv_ustep(): - Execute the input of a client and queue the
+ * next send or receive.  A send that ends the work we can do
+ * now has the next receive linked behind it so that both go to
+ * the kernel at once.  A client that used its quantum in this
+ * round waits for the next poll.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      Many, via the table callbacks
+ ***************************************************************/
+static void
+srv_ustep(struct SrvConn *pc)
+{
+  struct io_uring_sqe *sqe;    /* the send */
+  int      ret;            /* srv_run() return */
+  int      more;           /* ==1 if there is more to execute */
+
+  if (pc->wrq)
+    return;                     /* wait for the send to finish */
+
+  srv_unyield(pc);
+  srv_turn(pc);
+  if (pc->deficit <= 0) {
+    pc->yield = 1;
+    NYield++;
+    return;
+  }
+  ret = srv_run(pc);
+  if (ret == RTA_CLOSE)
+    pc->closing = 1;
+  else if (ret == RTA_NOCMD && pc->ioff == 0 && pc->ilen == pc->insize &&
+           srv_bigmsg(pc) < 0) {
+    /* A message too big for the server */
+    srv_close(pc);
+    return;
+  }
+  more = (ret == RTA_MORE || ret == RTA_NOBUF || ret == RTA_YIELD);
+
+  /* A SELECT that yielded goes on when its output is sent, or on
+     the next poll if it has no output */
+  if (ret == RTA_YIELD && pc->olen == 0) {
+    pc->yield = 1;
+    NYield++;
+  }
+
+  if (pc->olen > 0) {
+    sqe = srv_sqe(pc, SRV_OP_SEND);
+    if (sqe == (struct io_uring_sqe *) 0) {
+      srv_close(pc);
+      return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = pc->fd;
+    sqe->addr = (unsigned long) pc->out;
+    sqe->len = pc->olen;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    pc->wrq = 1;
+    if (!more && !pc->closing && !pc->eof && !pc->rdq) {
+      sqe->flags |= IOSQE_IO_LINK;
+      srv_urecv(pc);
+    }
+    return;
+  }
+
+  /* Close after the last response, or after the client is gone
+     and no statement is stopped with more to send */
+  if (pc->closing ||
+      (pc->eof && !pc->yield && !rta_ext_busy(pc->sess))) {
+    srv_close(pc);
+    return;
+  }
+  if (!pc->rdq)
+    srv_urecv(pc);
+}
+
+/***************************************************************
+ * srv_urecv(): - Queue a receive into a provided buffer.  We ask
+ * for no more than fits in the client's input buffer.
+ *
+ * Input:        The client
+ * Output:       None
+ * Effects:      Moves unused input to the front of the buffer
+ ***************************************************************/
+static void
+srv_urecv(struct SrvConn *pc)
+{
+  struct io_uring_sqe *sqe;    /* the receive */
+  int      room;           /* free bytes in the input buffer */
+
+  if (pc->ioff > 0) {
+    (void) memmove(pc->in, &pc->in[pc->ioff], pc->ilen - pc->ioff);
+    pc->ilen -= pc->ioff;
+    pc->ioff = 0;
+  }
+  room = pc->insize - pc->ilen;
+  sqe = srv_sqe(pc, SRV_OP_RECV);
+  if (sqe == (struct io_uring_sqe *) 0) {
+    srv_close(pc);
+    return;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = pc->fd;
+  sqe->len = (room < SRV_BUFSZ) ? room : SRV_BUFSZ;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = SRV_BGID;
+  pc->rdq = 1;
+}
+
+/***************************************************************
+ * srv_uaccept(): - Queue a multishot accept on a listener
+ *
+ * Input:        The listener
+ * Output:       None
+ * Effects:      None
+ ***************************************************************/
+static void
+srv_uaccept(struct SrvConn *pl)
+{
+  struct io_uring_sqe *sqe;    /* the accept */
+
+  sqe = srv_sqe(pl, SRV_OP_ACCEPT);
+  if (sqe == (struct io_uring_sqe *) 0)
+    return;
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = pl->fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+/***************************************************************
+ * srv_ubuf(): - Give a receive buffer to the kernel
+ *
+ * Input:        The buffer ID
+ * Output:       None
+ * Effects:      The buffer ring
+ ***************************************************************/
+static void
+srv_ubuf(int bid)
+{
+  struct io_uring_buf *pb; /* the ring slot */
+
+  pb = &Ring.br->bufs[Ring.brtail & (SRV_NBUF - 1)];
+  pb->addr = (unsigned long) &Ring.bufs[bid * SRV_BUFSZ];
+  pb->len = SRV_BUFSZ;
+  pb->bid = bid;
+  Ring.brtail++;
+  __atomic_store_n(&Ring.br->tail, Ring.brtail, __ATOMIC_RELEASE);
+}
+#endif
+
+/***************************************************************
+ * srv_syserr(): - Count and log a failed system call.
+ *
+ * Input:        File and line of the failure, name of the call
+ * Output:       None
+ * Effects:      rta_stat.nsyserr
+ ***************************************************************/
+static void
+srv_syserr(char *file, int line, char *call)
+{
+  rta_stat.nsyserr++;
+  if (rta_dbg.syserr)
+    rta_log(file, line, Er_Sys_Call, call, strerror(errno));
+}
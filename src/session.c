@@ -0,0 +1,1667 @@
+/***************************************************************
+ * librta Library
+ * Copyright (C) 2003-2014 Robert W Smith (bsmith@linuxtoys.org)
+ *
+ *  This program is distributed under the terms of the MIT license.
+ *  See the file COPYING file.
+ **************************************************************/
+
+/***************************************************************
+ * session.c:  The subroutines in this file keep the state of
+ * one client connection and handle the messages of the Postgres
+ * extended query protocol: Parse, Bind, Describe, Execute,
+ * Close, Sync, and Flush.
+ *
+ *   A Parse message parses and verifies the SQL once and saves
+ * the result as the plan of a prepared statement.  Bind gives
+ * values to the statement's parameters and saves the result as
+ * the plan of a portal.  Execute loads the portal's plan into
+ * the rta_cmd structure and runs it without another parse.
+ *   After an error we ignore all messages until the next Sync,
+ * as a Postgres server does.
+ *   A SELECT that fills the output buffer stops and is saved in
+ * the session as a plan with its current row.  The next call to
+ * rta_session_dbcommand() continues the SELECT before it looks
+ * at any new input.
+ *   COPY FROM STDIN is saved the same way and then takes all of
+ * the client's messages until CopyDone or CopyFail.
+ *   A session that runs LISTEN is put on a list of listeners.
+ * rta_notify() queues a notification to each listener of the
+ * channel, and rta_session_dbcommand() sends the queue before
+ * it looks at new input.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "do_sql.h"
+
+extern struct Sql_Cmd rta_cmd;
+extern struct RtaStat rta_stat;
+extern struct RtaDbg rta_dbg;
+extern struct RtaLimit rta_limit;
+
+/* The session of rta_dbcommand() and of NULL session pointers */
+static RTA_SESSION DefSession;
+
+/* The session running the current command, for LISTEN */
+static RTA_SESSION *CurSess;
+
+/* Sessions that have run LISTEN, linked by lnext */
+static RTA_SESSION *Listeners;
+
+/* Number of notifications queued since we started */
+static unsigned NQueued;
+
+/* Sessions that have sent a start-up reply and so have a key,
+   linked by knext and kprev.  CancelRequests look here. */
+static RTA_SESSION *Keyed;
+
+/* The process ID of the last session given a key */
+static int      LastPid;
+
+/* Forward references */
+static void     do_parse(RTA_SESSION *, char *, int, char *, int *);
+static void     do_bind(RTA_SESSION *, char *, int, char *, int *);
+static void     do_describe(RTA_SESSION *, char *, int, char *, int *);
+static void     do_execute(RTA_SESSION *, char *, int, char *, int *);
+static void     do_close(RTA_SESSION *, char *, int, char *, int *);
+static void     do_sync(RTA_SESSION *, char *, int, char *, int *);
+static void     add_note(RTA_SESSION *, char *, char *, int);
+static void     drop_listener(RTA_SESSION *);
+static void     run_as(RTA_SESSION *);
+static int      do_copy(RTA_SESSION *, char, char *, int, char *, int *);
+static int      end_copy(RTA_SESSION *, char *, int *, int);
+static int      save_copy(RTA_SESSION *, char *, int);
+static struct Sql_Stmt **find_stmt(struct Sql_Stmt **, char *);
+static struct Sql_Stmt *new_stmt(struct Sql_Stmt **, char *,
+                  struct Sql_Plan *);
+static void     free_stmt(struct Sql_Stmt **);
+static int      save_cursor(struct Sql_Stmt *);
+static int      more_ret(RTA_SESSION *);
+static void     ad_reply(char *, int, char *, int *);
+static char    *get_str(char **, int *);
+static int      get_int2(char **, int *);
+static int      get_int4(char **, int *);
+static char    *param_text(RTA_COLDEF *, int, char *, int, char *);
+
+
+/***************************************************************
+ * rta_session_new(): - Allocate the state for one client
+ *
+ * Input:        None
+ * Output:       Pointer to the new session or NULL on error
+ * Effects:      None
+ ***************************************************************/
+RTA_SESSION *
+rta_session_new()
+{
+  RTA_SESSION *sess;   /* the new session */
+
+  sess = calloc(1, sizeof(RTA_SESSION));
+  if (sess == (RTA_SESSION *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+  }
+  return (sess);
+}
+
+/***************************************************************
+ * rta_session_free(): - Free a session, its prepared statements,
+ * its portals, and its channels and notifications.
+ *
+ * Input:        Pointer to the session
+ * Output:       void
+ * Effects:      None
+ ***************************************************************/
+void
+rta_session_free(RTA_SESSION *sess)
+{
+  struct Sql_Chan *pch;    /* a channel of LISTEN */
+  struct Sql_Note *pn;     /* a notification not sent */
+
+  if (sess == (RTA_SESSION *) 0 || sess == &DefSession)
+    return;
+
+  /* The plans may still be loaded into rta_cmd */
+  rta_dosql_init();
+  while (sess->stmts)
+    free_stmt(&(sess->stmts));
+  while (sess->portals)
+    free_stmt(&(sess->portals));
+  if (sess->query)
+    free_stmt(&(sess->query));
+  if (sess->rest)
+    free(sess->rest);
+  if (sess->cbuf)
+    free(sess->cbuf);
+  while (sess->chans) {
+    pch = sess->chans;
+    sess->chans = pch->next;
+    free(pch);
+  }
+  drop_listener(sess);
+  while (sess->notes) {
+    pn = sess->notes;
+    sess->notes = pn->next;
+    free(pn);
+  }
+  if (sess->pid) {
+    if (sess->kprev)
+      sess->kprev->knext = sess->knext;
+    else
+      Keyed = sess->knext;
+    if (sess->knext)
+      sess->knext->kprev = sess->kprev;
+  }
+  if (CurSess == sess)
+    run_as((RTA_SESSION *) 0);
+  free(sess);
+}
+
+/***************************************************************
+ * rta_ext_message(): - Handle one message of the extended query
+ * protocol.
+ *
+ * Input:        The session of the client
+ *               The message type, 'P', 'B', ...
+ *               The message body (after the length) and its size
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       RTA_SUCCESS, or RTA_NOBUF if the output buffer
+ *               is too small for a reply
+ * Effects:      The session and the output buffer
+ ***************************************************************/
+int
+rta_ext_message(RTA_SESSION *sess, char type, char *msg, int len,
+  char *out, int *nout)
+{
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+
+  /* Verify that the buffer has enough room for an error message or
+     a small reply.  Larger replies check for space themselves. */
+  if (*nout < 100) {
+    rta_stat.nsqlerr++;
+    if (rta_dbg.sqlerr)
+      rta_log(LOC, Er_No_Space);
+    return (RTA_NOBUF);
+  }
+
+  /* A COPY FROM STDIN gets every message until it ends */
+  if (sess->copy)
+    return (do_copy(sess, type, msg, len, out, nout));
+
+  /* After an error we skip everything up to the next Sync */
+  if (sess->xerr && type != 'S')
+    return (RTA_SUCCESS);
+
+  /* Error messages overwrite any reply to this message */
+  rta_cmd.out = out;
+  rta_cmd.nout = nout;
+  rta_cmd.errout = out;
+  rta_cmd.nerrout = *nout;
+  rta_cmd.err = 0;
+  rta_cmd.sqlcmd = "";
+
+  switch (type) {
+    case 'P':
+      do_parse(sess, msg, len, out, nout);
+      break;
+    case 'B':
+      do_bind(sess, msg, len, out, nout);
+      break;
+    case 'D':
+      do_describe(sess, msg, len, out, nout);
+      break;
+    case 'E':
+      do_execute(sess, msg, len, out, nout);
+      break;
+    case 'C':
+      do_close(sess, msg, len, out, nout);
+      break;
+    case 'S':
+      do_sync(sess, msg, len, out, nout);
+      break;
+    case 'H':                  /* Flush.  We never hold output. */
+      break;
+  }
+  if (rta_cmd.err)
+    sess->xerr = 1;
+
+  return (more_ret(sess));
+}
+
+/***************************************************************
+ * rta_ext_query(): - Execute the SQL of a simple query ('Q')
+ * message.  A SELECT that fills the output buffer or uses its
+ * budget is saved with the SQL that follows it so that
+ * rta_ext_resume() can finish the query.  A COPY FROM STDIN is
+ * saved the same way until the client sends its data.
+ *
+ * Input:        The session of the client
+ *               The SQL and its length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       RTA_SUCCESS, or RTA_MORE or RTA_YIELD if the
+ *               SELECT stopped
+ * Effects:      The session and the output buffer
+ ***************************************************************/
+int
+rta_ext_query(RTA_SESSION *sess, char *sql, int len, char *out, int *nout)
+{
+  int      used;       /* bytes of SQL used so far */
+  int      nstart;     /* free bytes in out on entry */
+  int      more;       /* why the command stopped */
+  int      ret;        /* rta_SQL_exec() return */
+
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+
+  /* A query in the middle of a COPY ends the COPY */
+  if (sess->copy)
+    return (rta_ext_message(sess, 'Q', sql, len, out, nout));
+
+  nstart = *nout;
+  run_as(sess);
+  ret = rta_SQL_exec(sql, len, out, nout, &used);
+  run_as((RTA_SESSION *) 0);
+  if (ret == 0)
+    return (RTA_SUCCESS);
+
+  /* Save the stopped SELECT or COPY and the rest of the SQL */
+  more = rta_cmd.more;
+  sess->rest = malloc(len - used + 1);
+  if (sess->rest) {
+    memcpy(sess->rest, &sql[used], len - used);
+    sess->nrest = len - used;
+    if (sess->query || new_stmt(&(sess->query), "", (struct Sql_Plan *) 0)) {
+      if (save_cursor(sess->query)) {
+        if (more == RTA_MORE_COPYIN) {
+          sess->copy = sess->query;
+          sess->copyhdr = 0;
+          return (RTA_SUCCESS);
+        }
+        sess->more = sess->query;
+        sess->yield = (more == RTA_MORE_YIELD);
+        return (more_ret(sess));
+      }
+    }
+    free(sess->rest);
+    sess->rest = (char *) 0;
+  }
+
+  /* Out of memory.  Fail the SELECT and end the query. */
+  rta_stat.nsyserr++;
+  if (rta_dbg.syserr)
+    rta_log(LOC, Er_No_Mem);
+  rta_dosql_init();
+  rta_send_error(LOC, E_FULLBUF);
+  ad_reply(&out[nstart - *nout], 'Z', "I", nout);
+  return (RTA_SUCCESS);
+}
+
+/***************************************************************
+ * rta_ext_resume(): - Continue a SELECT that stopped when the
+ * output buffer filled or its budget was used.  When a 'Q'
+ * SELECT is done we go on to the SQL that followed it.
+ *
+ * Input:        The session of the client
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       RTA_NOCMD if no SELECT is waiting, RTA_MORE or
+ *               RTA_YIELD if the SELECT stopped again, RTA_NOBUF if there is
+ *               not enough room to continue, else RTA_SUCCESS
+ * Effects:      The session and the output buffer
+ ***************************************************************/
+int
+rta_ext_resume(RTA_SESSION *sess, char *out, int *nout)
+{
+  struct Sql_Stmt *ps; /* the portal or query */
+  char    *rest;       /* SQL after the SELECT of a query */
+  int      nstart;     /* free bytes in out on entry */
+  int      more;       /* why the SELECT stopped, if it did */
+  int      ret;        /* return value */
+
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  if (sess->more == (struct Sql_Stmt *) 0) {
+    /* A CancelRequest only stops a command in progress */
+    if (sess->copy == (struct Sql_Stmt *) 0)
+      sess->cancel = 0;
+    return (RTA_NOCMD);
+  }
+  if (*nout < 100) {
+    rta_stat.nsqlerr++;
+    if (rta_dbg.sqlerr)
+      rta_log(LOC, Er_No_Space);
+    return (RTA_NOBUF);
+  }
+
+  ps = sess->more;
+  nstart = *nout;
+  rta_plan_load(ps->plan);
+  rta_cmd.out = out;
+  rta_cmd.nout = nout;
+  rta_cmd.errout = out;
+  rta_cmd.nerrout = *nout;
+  rta_cmd.canmore = 1;
+  run_as(sess);
+  rta_exec_sql(out, nout);
+  run_as((RTA_SESSION *) 0);
+  rta_cmd.canmore = 0;
+
+  /* Stopping again on a full buffer without sending a row means
+     a row is too big for the whole buffer.  A SELECT that used its
+     budget need not have sent anything. */
+  more = rta_cmd.more;
+  if (!rta_cmd.err && more == RTA_MORE_FULL && *nout == nstart)
+    rta_send_error(LOC, E_FULLBUF);
+  else if (!rta_cmd.err &&
+           (more == RTA_MORE_FULL || more == RTA_MORE_YIELD) &&
+           save_cursor(ps)) {
+    sess->yield = (more == RTA_MORE_YIELD);
+    return (more_ret(sess));
+  }
+  sess->more = (struct Sql_Stmt *) 0;
+
+  /* A portal stays open.  It may have stopped at its row count. */
+  if (ps != sess->query) {
+    ret = rta_cmd.err;
+    if (!ret && rta_cmd.more == RTA_MORE_SUSPEND && save_cursor(ps))
+      ad_reply(&out[nstart - *nout], 's', (char *) 0, nout);
+    else
+      ps->done = 1;
+    rta_dosql_init();
+    if (ret)
+      sess->xerr = 1;
+    return (RTA_SUCCESS);
+  }
+
+  /* The SELECT of a query is done.  Go on to the rest of the SQL
+     unless the SELECT failed. */
+  ret = rta_cmd.err;
+  rta_dosql_init();
+  free_stmt(&(sess->query));
+  rest = sess->rest;
+  sess->rest = (char *) 0;
+  if (ret)
+    ad_reply(&out[nstart - *nout], 'Z', "I", nout);
+  else
+    ret = rta_ext_query(sess, rest, sess->nrest, &out[nstart - *nout], nout);
+  free(rest);
+  return (more_ret(sess));
+}
+
+/***************************************************************
+ * rta_ext_rowsize(): - Give the most output the next row of a
+ * stopped SELECT can need, with room for the reply that ends
+ * the SELECT.  Text COPY escapes can double a row.
+ *
+ * Input:        The session of the client
+ * Output:       The number of bytes, or 0 if no SELECT stopped
+ * Effects:      None
+ ***************************************************************/
+int
+rta_ext_rowsize(RTA_SESSION *sess)
+{
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  if (sess->more == (struct Sql_Stmt *) 0 || sess->more->plan == 0)
+    return (0);
+  return (2 * sess->more->plan->nlineout + 200);
+}
+
+/***************************************************************
+ * rta_ext_busy(): - Tell if a statement of a session stopped
+ * and will go on without more input from the client.  A SELECT
+ * or COPY TO STDOUT that filled the buffer or yielded does so.
+ * A COPY FROM STDIN waits for input and is not counted.
+ *
+ * Input:        The session of the client
+ * Output:       1 if a statement is stopped, else 0
+ * Effects:      None
+ ***************************************************************/
+int
+rta_ext_busy(RTA_SESSION *sess)
+{
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  return (sess->more != (struct Sql_Stmt *) 0);
+}
+
+/***************************************************************
+ * rta_ext_listen(): - Add or remove a channel of the session
+ * running the current command.
+ *
+ * Input:        The channel, and 1 for LISTEN or 0 for UNLISTEN.
+ *               UNLISTEN of "*" removes all channels.
+ * Output:       0 on success, -1 if out of memory
+ * Effects:      The channels of the session and the list of
+ *               sessions that listen
+ ***************************************************************/
+int
+rta_ext_listen(char *chan, int on)
+{
+  RTA_SESSION *sess;   /* the session */
+  struct Sql_Chan **ppch;  /* link to a channel */
+  struct Sql_Chan *pch;    /* the channel */
+
+  sess = (CurSess) ? CurSess : &DefSession;
+  ppch = &(sess->chans);
+  while ((pch = *ppch) != (struct Sql_Chan *) 0) {
+    if (on && !strcmp(pch->name, chan))
+      return (0);               /* already listening */
+    if (!on && (!strcmp(chan, "*") || !strcmp(pch->name, chan))) {
+      *ppch = pch->next;
+      free(pch);
+    }
+    else
+      ppch = &(pch->next);
+  }
+  if (!on) {
+    if (sess->chans == (struct Sql_Chan *) 0)
+      drop_listener(sess);
+    return (0);
+  }
+
+  pch = malloc(sizeof(struct Sql_Chan) + strlen(chan) + 1);
+  if (pch == (struct Sql_Chan *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return (-1);
+  }
+  pch->name = (char *) (pch + 1);
+  strcpy(pch->name, chan);
+  if (sess->chans == (struct Sql_Chan *) 0) {
+    sess->lnext = Listeners;
+    Listeners = sess;
+  }
+  pch->next = sess->chans;
+  sess->chans = pch;
+  return (0);
+}
+
+/***************************************************************
+ * rta_notify(): - Queue a notification to every session that
+ * listens on a channel.
+ *
+ * Input:        The channel and the payload, which may be NULL
+ * Output:       The number of sessions that will get it, or
+ *               RTA_ERROR if a string is too long
+ * Effects:      The notifications of the sessions
+ ***************************************************************/
+int
+rta_notify(char *chan, char *payload)
+{
+  RTA_SESSION *sess;   /* a session that listens */
+  struct Sql_Chan *pch;    /* a channel of the session */
+  int      pid;            /* process ID of the sender */
+  int      n = 0;          /* sessions that get it */
+
+  if (Listeners == (RTA_SESSION *) 0)
+    return (0);                 /* the usual case */
+  if (payload == (char *) 0)
+    payload = "";
+  if (strlen(chan) >= RTA_MXTBLNAME || strlen(payload) >= RTA_MX_PAYLOAD)
+    return (RTA_ERROR);
+
+  /* The sender is the client running the command, if any */
+  pid = (CurSess) ? CurSess->pid : 0;
+  for (sess = Listeners; sess; sess = sess->lnext) {
+    for (pch = sess->chans; pch; pch = pch->next) {
+      if (!strcmp(pch->name, chan)) {
+        add_note(sess, chan, payload, pid);
+        n++;
+        break;
+      }
+    }
+  }
+  return (n);
+}
+
+/***************************************************************
+ * rta_session_pending(): - Give the number of notifications
+ * waiting to be sent to a client.
+ *
+ * Input:        The session
+ * Output:       The number of notifications
+ * Effects:      None
+ ***************************************************************/
+int
+rta_session_pending(RTA_SESSION *sess)
+{
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  return (sess->nnotes);
+}
+
+/***************************************************************
+ * rta_ext_nqueued(): - Give the number of notifications queued
+ * so far.  A server that sees this change runs the clients with
+ * notifications to send.
+ *
+ * Input:        None
+ * Output:       The count, which may wrap around
+ * Effects:      None
+ ***************************************************************/
+unsigned
+rta_ext_nqueued()
+{
+  return (NQueued);
+}
+
+/***************************************************************
+ * rta_ext_notify(): - Send the notifications of a session that
+ * fit in the output buffer as NotificationResponse messages.
+ * Nothing is sent during a COPY FROM STDIN.
+ *
+ * Input:        The session of the client
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of bytes added to the buffer
+ * Effects:      The notifications of the session
+ ***************************************************************/
+int
+rta_ext_notify(RTA_SESSION *sess, char *out, int *nout)
+{
+  struct Sql_Note *pn;     /* the next notification */
+  char    *start;          /* start of the output */
+  int      len;            /* length of the message */
+
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  if (sess->notes == (struct Sql_Note *) 0 || sess->copy)
+    return (0);
+
+  start = out;
+  while ((pn = sess->notes) != (struct Sql_Note *) 0) {
+    len = 4 + 4 + strlen(pn->chan) + 1 + strlen(pn->payload) + 1;
+    if (len + 1 > *nout)
+      break;
+    *out++ = 'A';
+    rta_ad_int4(&out, len);
+    rta_ad_int4(&out, pn->pid);
+    strcpy(out, pn->chan);
+    out += strlen(pn->chan) + 1;
+    strcpy(out, pn->payload);
+    out += strlen(pn->payload) + 1;
+    *nout -= len + 1;
+
+    sess->notes = pn->next;
+    sess->nnotes--;
+    free(pn);
+  }
+  return ((int) (out - start));
+}
+
+/***************************************************************
+ * rta_ext_keys(): - Give the BackendKeyData of a session.  The
+ * process ID is unique among the sessions of this program and
+ * the secret key is random, so that a CancelRequest can name
+ * the session and only its own client can send one.
+ *
+ * Input:        The session of the client, and where to put the
+ *               process ID and the secret key
+ * Output:       None
+ * Effects:      Gives the session a key if it has none
+ ***************************************************************/
+void
+rta_ext_keys(RTA_SESSION *sess, int *pid, int *key)
+{
+  int      fd;             /* /dev/urandom */
+
+  if (sess == (RTA_SESSION *) 0)
+    sess = &DefSession;
+  if (sess->pid == 0) {
+    do
+      LastPid = (LastPid + 1) & 0x7fffffff;
+    while (LastPid == 0);
+    sess->pid = LastPid;
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0 || read(fd, &(sess->key), sizeof(int)) != sizeof(int))
+      sess->key = (int) (random() ^ time((time_t *) 0));
+    if (fd >= 0)
+      close(fd);
+
+    sess->kprev = (RTA_SESSION *) 0;
+    sess->knext = Keyed;
+    if (Keyed)
+      Keyed->kprev = sess;
+    Keyed = sess;
+  }
+  *pid = sess->pid;
+  *key = sess->key;
+}
+
+/***************************************************************
+ * rta_ext_cancel(): - Handle a CancelRequest.  The session with
+ * the key given stops its command at the next row.  A request
+ * with a wrong key, or for a session that is not running a
+ * command, is ignored.
+ *
+ * Input:        The process ID and secret key of the request
+ * Output:       None
+ * Effects:      The cancel flag of the session
+ ***************************************************************/
+void
+rta_ext_cancel(int pid, int key)
+{
+  RTA_SESSION *sess;   /* a session with a key */
+
+  for (sess = Keyed; sess; sess = sess->knext) {
+    if (sess->pid == pid) {
+      if (sess->key == key && (sess->more || sess->copy))
+        sess->cancel = 1;
+      return;
+    }
+  }
+}
+
+/***************************************************************
+ * rta_ext_set(): - Change a setting of the session running the
+ * current command.
+ *
+ * Input:        The RTA_SET_* of the setting
+ *               The value, or -1 for the default in rta_limit
+ * Output:       None
+ * Effects:      The settings of the session
+ ***************************************************************/
+void
+rta_ext_set(int bit, int val)
+{
+  if (CurSess == (RTA_SESSION *) 0)
+    return;
+  if (val < 0)
+    CurSess->sets &= ~bit;
+  else
+    CurSess->sets |= bit;
+  if (bit == RTA_SET_TIMEOUT)
+    CurSess->timeout = val;
+  else if (bit == RTA_SET_MAXSCAN)
+    CurSess->maxscan = val;
+
+  /* The rest of a simple query uses the new value */
+  run_as(CurSess);
+}
+
+/***************************************************************
+ * do_parse(): - Parse and verify a command and save it as a
+ * prepared statement.  The unnamed statement is replaced by
+ * each Parse.  We ignore the parameter types the client sends
+ * since the type of a parameter is that of its column.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The list of prepared statements
+ ***************************************************************/
+static void
+do_parse(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  struct Sql_Stmt **pps;   /* statement with the same name */
+  struct Sql_Plan *pplan;  /* the new plan */
+  char    *name;       /* name of the statement */
+  char    *query;      /* the SQL */
+  int      ret;        /* return value */
+
+  name = get_str(&msg, &len);
+  query = get_str(&msg, &len);
+  (void) get_int2(&msg, &len);  /* # of parameter types */
+  if (len < 0) {
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  /* Each Parse of the unnamed statement destroys the old one */
+  pps = find_stmt(&(sess->stmts), name);
+  if (*pps && name[0]) {
+    rta_send_error(LOC, E_DUPSTMT, name);
+    return;
+  }
+  if (*pps) {
+    rta_dosql_init();
+    free_stmt(pps);
+    sess->nstmts--;
+  }
+  if (sess->nstmts >= RTA_MX_STMT) {
+    rta_send_error(LOC, E_MAXSTMT);
+    return;
+  }
+
+  ret = rta_SQL_prepare(query, strlen(query), out, nout);
+  if (ret < 0)
+    return;
+  pplan = (struct Sql_Plan *) 0;  /* an empty query */
+  if (ret == 0) {
+    pplan = rta_plan_save();
+    if (pplan == (struct Sql_Plan *) 0)
+      return;
+  }
+  rta_dosql_init();
+
+  if (new_stmt(&(sess->stmts), name, pplan))
+    sess->nstmts++;
+  else {
+    if (pplan)
+      free(pplan);
+    rta_cmd.err = 1;
+    return;
+  }
+
+  ad_reply(out, '1', (char *) 0, nout);     /* ParseComplete */
+}
+
+/***************************************************************
+ * do_bind(): - Give values to the parameters of a prepared
+ * statement and save the result as a portal.  Values may be in
+ * text or binary format.  Binary values are converted to text
+ * using the type of the parameter's column.  The result format
+ * codes select text or binary output for each column of a
+ * SELECT.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The list of portals
+ ***************************************************************/
+static void
+do_bind(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  struct Sql_Stmt **pps;   /* the statement or portal */
+  struct Sql_Plan *pstmt;  /* the statement's plan */
+  struct Sql_Plan *pplan;  /* the bound plan */
+  RTA_COLDEF *pcol;    /* column of a parameter */
+  char    *portal;     /* name of the portal */
+  char    *name;       /* name of the statement */
+  char    *fmts;       /* parameter format codes */
+  char    *pfmt;       /* format code of one parameter */
+  int      nfmts;      /* number of format codes */
+  int      fmt;        /* format of one parameter */
+  int      nvals;      /* number of parameter values */
+  char    *rfmts;      /* result format codes */
+  int      nrfmts;     /* number of result format codes */
+  char    *pval;       /* a value in the message */
+  int      vlen;       /* length of a value in the message */
+  char   **vals;       /* parameter values as text */
+  char    *pstr;       /* next free byte in the value text */
+  int      i, j;       /* loop index */
+
+  portal = get_str(&msg, &len);
+  name = get_str(&msg, &len);
+  nfmts = get_int2(&msg, &len);
+  fmts = msg;
+  for (i = 0; i < nfmts; i++)
+    (void) get_int2(&msg, &len);
+  nvals = get_int2(&msg, &len);
+  if (len < 0 || nfmts < 0 || nvals < 0) {
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  pps = find_stmt(&(sess->stmts), name);
+  if (*pps == (struct Sql_Stmt *) 0) {
+    rta_send_error(LOC, E_NOSTMT, name);
+    return;
+  }
+  pstmt = (*pps)->plan;
+  if (nvals != ((pstmt) ? pstmt->nparams : 0) ||
+    (nfmts > 1 && nfmts != nvals)) {
+    rta_send_error(LOC, E_NPARAMS, name);
+    return;
+  }
+  pps = find_stmt(&(sess->portals), portal);
+  if (*pps && portal[0]) {
+    rta_send_error(LOC, E_DUPPORTAL, portal);
+    return;
+  }
+
+  /* Copy the values to one block of memory as text.  A value in
+     text format can be no longer than it is in the message, and
+     the binary formats take at most 32 bytes as text. */
+  vals = malloc(nvals * sizeof(char *) + len + 32 * nvals + 1);
+  if (vals == (char **) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    rta_cmd.err = 1;
+    return;
+  }
+  pstr = (char *) (vals + nvals);
+  for (i = 0; i < nvals; i++) {
+    vlen = get_int4(&msg, &len);
+    pval = msg;
+    if (vlen == -1) {
+      free(vals);
+      rta_send_error(LOC, E_NULLPARM);
+      return;
+    }
+    if (vlen < 0 || vlen > len) {
+      free(vals);
+      rta_send_error(LOC, E_BADMSG);
+      return;
+    }
+    msg += vlen;
+    len -= vlen;
+
+    /* Find the column of the parameter to get its type */
+    pcol = (RTA_COLDEF *) 0;
+    for (j = 0; j < pstmt->ncols && !pcol; j++)
+      if (pstmt->cols[j].parm == i + 1)
+        pcol = pstmt->cols[j].pcol;
+    for (j = 0; j < pstmt->nwhrcols && !pcol; j++)
+      if (pstmt->whr[j].parm == i + 1)
+        pcol = pstmt->whr[j].pcol;
+
+    fmt = 0;
+    if (nfmts > 0) {
+      pfmt = fmts + 2 * ((nfmts == 1) ? 0 : i);
+      fmt = ((pfmt[0] & 0xff) << 8) | (pfmt[1] & 0xff);
+    }
+    vals[i] = param_text(pcol, fmt, pval, vlen, pstr);
+    if (vals[i] == (char *) 0) {
+      free(vals);
+      rta_send_error(LOC, E_BADPARSE);
+      return;
+    }
+    pstr += strlen(pstr) + 1;
+  }
+
+  /* The result format codes follow the values */
+  nrfmts = get_int2(&msg, &len);
+  rfmts = msg;
+  for (i = 0; i < nrfmts; i++) {
+    fmt = get_int2(&msg, &len);
+    if (fmt != 0 && fmt != 1)
+      len = -1;
+  }
+  if (len < 0 || nrfmts < 0 ||
+    (nrfmts > 1 && (!pstmt || nrfmts != pstmt->ncols))) {
+    free(vals);
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  pplan = (struct Sql_Plan *) 0;  /* an empty query */
+  if (pstmt) {
+    pplan = rta_plan_bind(pstmt, vals);
+    if (pplan == (struct Sql_Plan *) 0) {
+      free(vals);
+      return;
+    }
+
+    /* Give each column of the result its format */
+    for (j = 0; j < pplan->ncols && nrfmts > 0; j++) {
+      pfmt = rfmts + 2 * ((nrfmts == 1) ? 0 : j);
+      pplan->cols[j].fmt = pfmt[1] & 0xff;
+    }
+  }
+  rta_dosql_init();
+  free(vals);
+
+  /* Replace the unnamed portal or add a new one */
+  if (*pps) {
+    if ((*pps)->plan)
+      free((*pps)->plan);
+    (*pps)->plan = pplan;
+  }
+  else if (!new_stmt(&(sess->portals), portal, pplan)) {
+    if (pplan)
+      free(pplan);
+    rta_cmd.err = 1;
+    return;
+  }
+
+  ad_reply(out, '2', (char *) 0, nout);     /* BindComplete */
+}
+
+/***************************************************************
+ * do_describe(): - Describe a prepared statement or a portal.
+ * A statement is described by the types of its parameters then
+ * its rows.  Commands other than SELECT return no rows.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The output buffer
+ ***************************************************************/
+static void
+do_describe(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  struct Sql_Stmt **pps;   /* the statement or portal */
+  struct Sql_Plan *pplan;  /* its plan */
+  RTA_COLDEF *pcol;    /* column of a parameter */
+  char    *start;      /* start of the reply */
+  char    *name;       /* name of the statement or portal */
+  char     kind;       /* 'S'tatement or 'P'ortal */
+  int      nparams;    /* number of parameters */
+  int      i, j;       /* loop index */
+
+  kind = (len > 0) ? msg[0] : 0;
+  msg++;
+  len--;
+  name = get_str(&msg, &len);
+  if (len < 0 || (kind != 'S' && kind != 'P')) {
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  pps = find_stmt((kind == 'S') ? &(sess->stmts) : &(sess->portals), name);
+  if (*pps == (struct Sql_Stmt *) 0) {
+    rta_send_error(LOC, (kind == 'S') ? E_NOSTMT : E_NOPORTAL, name);
+    return;
+  }
+  pplan = (*pps)->plan;
+
+  /* ParameterDescription gives the OID of each parameter */
+  if (kind == 'S') {
+    nparams = (pplan) ? pplan->nparams : 0;
+    if (*nout < 100 + 4 * nparams) {
+      rta_send_error(LOC, E_FULLBUF);
+      return;
+    }
+    start = out;
+    *out++ = 't';
+    out += 4;                   /* put pkt length here later */
+    rta_ad_int2(&out, nparams);
+    for (i = 1; i <= nparams; i++) {
+      pcol = (RTA_COLDEF *) 0;
+      for (j = 0; j < pplan->ncols && !pcol; j++)
+        if (pplan->cols[j].parm == i)
+          pcol = pplan->cols[j].pcol;
+      for (j = 0; j < pplan->nwhrcols && !pcol; j++)
+        if (pplan->whr[j].parm == i)
+          pcol = pplan->whr[j].pcol;
+      rta_ad_int4(&out, (pcol) ? rta_type_oid(pcol->type) : RTA_OID_TEXT);
+    }
+    i = (int) (out - start);
+    *nout -= i;
+    start++;                    /* skip over the 't' */
+    rta_ad_int4(&start, i - 1);
+    rta_cmd.errout = out;       /* keep this if the next part fails */
+    rta_cmd.nerrout = *nout;
+  }
+
+  /* RowDescription for SELECT, NoData for everything else */
+  if (pplan && pplan->command == RTA_SELECT) {
+    rta_plan_load(pplan);
+    (void) rta_send_row_description(out, nout);
+    rta_dosql_init();
+  }
+  else
+    ad_reply(out, 'n', (char *) 0, nout);   /* NoData */
+}
+
+/***************************************************************
+ * do_execute(): - Run the plan of a portal.  A SELECT sends
+ * only its data rows here since the row description comes from
+ * Describe.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      Lots.  This is where the read and write
+ *               callbacks are executed.
+ ***************************************************************/
+static void
+do_execute(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  struct Sql_Stmt **pps;   /* the portal */
+  char    *name;       /* name of the portal */
+  int      maxrows;    /* max rows to return, 0 for all */
+  int      more;       /* why the SELECT stopped, if it did */
+  int      nstart;     /* free bytes in out on entry */
+
+  name = get_str(&msg, &len);
+  maxrows = get_int4(&msg, &len);  /* max rows, 0 for all */
+  if (len < 0 || maxrows < 0) {
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  pps = find_stmt(&(sess->portals), name);
+  if (*pps == (struct Sql_Stmt *) 0) {
+    rta_send_error(LOC, E_NOPORTAL, name);
+    return;
+  }
+
+  if ((*pps)->plan == (struct Sql_Plan *) 0) {
+    ad_reply(out, 'I', (char *) 0, nout);   /* EmptyQueryResponse */
+    return;
+  }
+
+  /* A portal that has sent all of its rows sends no more */
+  if ((*pps)->done) {
+    ad_reply(out, 'C', "SELECT", nout);     /* CommandComplete */
+    return;
+  }
+
+  nstart = *nout;
+  rta_plan_load((*pps)->plan);
+  rta_cmd.maxrows = maxrows;
+  rta_cmd.canmore = 1;
+  run_as(sess);
+  rta_guard_arm();
+  rta_exec_sql(out, nout);
+  run_as((RTA_SESSION *) 0);
+  rta_cmd.canmore = 0;
+  if (rta_cmd.err)
+    return;
+
+  /* A SELECT that stopped saves its place in the portal.  If it
+     stopped at the row count we tell the client the portal is
+     suspended.  If the buffer filled we continue on the next call. */
+  more = rta_cmd.more;
+  if (more && !save_cursor(*pps))
+    return;
+  if (more == RTA_MORE_SUSPEND)
+    ad_reply(&out[nstart - *nout], 's', (char *) 0, nout);
+  else if (more == RTA_MORE_FULL || more == RTA_MORE_YIELD) {
+    sess->more = *pps;
+    sess->yield = (more == RTA_MORE_YIELD);
+  }
+  else if (more == RTA_MORE_COPYIN) {
+    sess->copy = *pps;
+    sess->copyhdr = 0;
+  }
+  else if (rta_cmd.command == RTA_SELECT)
+    (*pps)->done = 1;
+
+  /* Otherwise we leave the plan loaded until the next rta_dosql_init()
+     so that rta_cmd is valid after the command for debugging. */
+}
+
+/***************************************************************
+ * do_close(): - Close a prepared statement or a portal.  It is
+ * not an error to close one that does not exist.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The list of statements or portals
+ ***************************************************************/
+static void
+do_close(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  struct Sql_Stmt **pps;   /* the statement or portal */
+  char    *name;       /* name of the statement or portal */
+  char     kind;       /* 'S'tatement or 'P'ortal */
+
+  kind = (len > 0) ? msg[0] : 0;
+  msg++;
+  len--;
+  name = get_str(&msg, &len);
+  if (len < 0 || (kind != 'S' && kind != 'P')) {
+    rta_send_error(LOC, E_BADMSG);
+    return;
+  }
+
+  /* The plan may still be loaded in rta_cmd */
+  rta_dosql_init();
+
+  pps = find_stmt((kind == 'S') ? &(sess->stmts) : &(sess->portals), name);
+  if (*pps) {
+    free_stmt(pps);
+    if (kind == 'S')
+      sess->nstmts--;
+  }
+
+  ad_reply(out, '3', (char *) 0, nout);     /* CloseComplete */
+}
+
+/***************************************************************
+ * do_sync(): - End an extended query.  We clear any error, drop
+ * the portals, and tell the client we are ready.
+ *
+ * Input:        The session, message body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The list of portals
+ ***************************************************************/
+static void
+do_sync(RTA_SESSION *sess, char *msg, int len, char *out, int *nout)
+{
+  rta_dosql_init();
+  while (sess->portals)
+    free_stmt(&(sess->portals));
+  sess->xerr = 0;
+
+  ad_reply(out, 'Z', "I", nout);            /* ReadyForQuery */
+}
+
+/***************************************************************
+ * do_copy(): - Handle a message during COPY FROM STDIN.  The
+ * rows of CopyData messages are inserted as they arrive and a
+ * partial row is kept for the next message.  CopyDone ends the
+ * COPY.  CopyFail, an error, or any other message aborts it.
+ * Sync and Flush are ignored.
+ *
+ * Input:        The session, message type, body, body length
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer
+ * Output:       RTA_SUCCESS, or RTA_MORE or RTA_YIELD if the SQL
+ *               after the COPY stopped
+ * Effects:      The table, the session, and the output buffer
+ ***************************************************************/
+static int
+do_copy(RTA_SESSION *sess, char type, char *msg, int len, char *out,
+  int *nout)
+{
+  struct Sql_Stmt *ps; /* the portal or query */
+  char    *data;       /* the COPY data to insert */
+  int      ndata;      /* number of bytes in data */
+  int      used;       /* bytes of data used */
+  int      nstart;     /* free bytes in out on entry */
+
+  if (type == 'S' || type == 'H')
+    return (RTA_SUCCESS);
+
+  ps = sess->copy;
+  nstart = *nout;
+  rta_plan_load(ps->plan);
+  rta_cmd.out = out;
+  rta_cmd.nout = nout;
+  rta_cmd.errout = out;
+  rta_cmd.nerrout = *nout;
+
+  switch (type) {
+    case 'd':                  /* CopyData */
+      if (sess->cancel) {
+        rta_send_error(LOC, E_CANCEL);
+        break;
+      }
+
+      /* Add to a partial row from the last message */
+      data = msg;
+      ndata = len;
+      if (sess->ncbuf) {
+        if (!save_copy(sess, msg, len))
+          break;
+        data = sess->cbuf;
+        ndata = sess->ncbuf;
+      }
+      used = rta_copy_in(data, ndata, &(sess->copyhdr));
+      if (used < 0)
+        break;
+
+      /* Keep the rest for the next CopyData */
+      sess->ncbuf = 0;
+      if (used < ndata && !save_copy(sess, &data[used], ndata - used))
+        break;
+      ps->plan->npr = rta_cmd.npr;
+      rta_dosql_init();
+      return (RTA_SUCCESS);
+
+    case 'c':                  /* CopyDone */
+      /* The last text line need not end with a newline */
+      if (sess->ncbuf && !rta_cmd.copyfmt && sess->copyhdr != 2) {
+        if (!save_copy(sess, "\n", 1) ||
+          rta_copy_in(sess->cbuf, sess->ncbuf, &(sess->copyhdr)) < 0)
+          break;
+        sess->ncbuf = 0;
+      }
+      if (sess->ncbuf && sess->copyhdr != 2) {
+        rta_send_error(LOC, E_BADMSG);
+        break;
+      }
+      rta_copy_done(out, nout);
+      break;
+
+    case 'f':                  /* CopyFail */
+      data = get_str(&msg, &len);
+      rta_send_error(LOC, E_COPYFAIL, (len < 0) ? "" : data);
+      break;
+
+    default:
+      rta_send_error(LOC, E_BADMSG);
+      break;
+  }
+  return (end_copy(sess, out, nout, nstart));
+}
+
+/***************************************************************
+ * end_copy(): - End a COPY FROM STDIN.  A query goes on to the
+ * SQL after the COPY unless the COPY failed.  A portal is done
+ * and on error we skip messages until the next Sync.
+ *
+ * Input:        The session
+ *               A buffer to store the output
+ *               The number of free bytes in the buffer, and the
+ *               number that were free at the start of the reply
+ * Output:       RTA_SUCCESS, or RTA_MORE or RTA_YIELD if the SQL
+ *               after the COPY stopped
+ * Effects:      The session and the output buffer
+ ***************************************************************/
+static int
+end_copy(RTA_SESSION *sess, char *out, int *nout, int nstart)
+{
+  struct Sql_Stmt *ps; /* the portal or query */
+  char    *rest;       /* SQL after the COPY of a query */
+  int      err;        /* ==1 if the COPY failed */
+
+  ps = sess->copy;
+  sess->copy = (struct Sql_Stmt *) 0;
+  sess->ncbuf = 0;
+  err = rta_cmd.err;
+  if (rta_cmd.npr > 0) {        /* rows stay even if the COPY failed */
+    run_as(sess);
+    (void) rta_notify(rta_cmd.ptbl->name, "COPY");
+    run_as((RTA_SESSION *) 0);
+  }
+  rta_dosql_init();
+
+  if (ps != sess->query) {
+    ps->done = 1;
+    if (err)
+      sess->xerr = 1;
+    return (RTA_SUCCESS);
+  }
+
+  free_stmt(&(sess->query));
+  rest = sess->rest;
+  sess->rest = (char *) 0;
+  if (err)
+    ad_reply(&out[nstart - *nout], 'Z', "I", nout);
+  else
+    (void) rta_ext_query(sess, rest, sess->nrest, &out[nstart - *nout], nout);
+  free(rest);
+  return (more_ret(sess));
+}
+
+/***************************************************************
+ * save_copy(): - Add COPY data to the partial row buffer
+ *
+ * Input:        The session, the data and its length
+ * Output:       1 on success, 0 if out of memory
+ * Effects:      Sends the error message on failure
+ ***************************************************************/
+static int
+save_copy(RTA_SESSION *sess, char *data, int len)
+{
+  char    *pbuf;       /* the larger buffer */
+
+  if (sess->ncbuf + len > sess->szcbuf) {
+    pbuf = realloc(sess->cbuf, sess->ncbuf + len);
+    if (pbuf == (char *) 0) {
+      rta_stat.nsyserr++;
+      if (rta_dbg.syserr)
+        rta_log(LOC, Er_No_Mem);
+      rta_send_error(LOC, E_FULLBUF);
+      return (0);
+    }
+    sess->cbuf = pbuf;
+    sess->szcbuf = sess->ncbuf + len;
+  }
+  memmove(&(sess->cbuf[sess->ncbuf]), data, len);
+  sess->ncbuf += len;
+  return (1);
+}
+
+/***************************************************************
+ * add_note(): - Add a notification to the end of the queue of a
+ * session.  A notification just like one already waiting is not
+ * added again, and a full queue drops new notifications.
+ *
+ * Input:        The session, the channel, the payload, and the
+ *               process ID of the sender
+ * Output:       void
+ * Effects:      The notifications of the session
+ ***************************************************************/
+static void
+add_note(RTA_SESSION *sess, char *chan, char *payload, int pid)
+{
+  struct Sql_Note **ppn;   /* link to the end of the queue */
+  struct Sql_Note *pn;     /* the new notification */
+
+  ppn = &(sess->notes);
+  while ((pn = *ppn) != (struct Sql_Note *) 0) {
+    if (!strcmp(pn->chan, chan) && !strcmp(pn->payload, payload))
+      return;
+    ppn = &(pn->next);
+  }
+  if (sess->nnotes >= RTA_MX_NOTIFY)
+    return;
+
+  pn = malloc(sizeof(struct Sql_Note) + strlen(chan) + 1 +
+    strlen(payload) + 1);
+  if (pn == (struct Sql_Note *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return;
+  }
+  pn->chan = (char *) (pn + 1);
+  strcpy(pn->chan, chan);
+  pn->payload = pn->chan + strlen(chan) + 1;
+  strcpy(pn->payload, payload);
+  pn->pid = pid;
+  pn->next = (struct Sql_Note *) 0;
+  *ppn = pn;
+  sess->nnotes++;
+  NQueued++;
+}
+
+/***************************************************************
+ * drop_listener(): - Remove a session from the list of sessions
+ * that listen.  It is not an error if it is not in the list.
+ *
+ * Input:        The session
+ * Output:       void
+ * Effects:      The list of sessions that listen
+ ***************************************************************/
+static void
+drop_listener(RTA_SESSION *sess)
+{
+  RTA_SESSION **pps;   /* link to a session */
+
+  for (pps = &Listeners; *pps; pps = &((*pps)->lnext)) {
+    if (*pps == sess) {
+      *pps = sess->lnext;
+      sess->lnext = (RTA_SESSION *) 0;
+      return;
+    }
+  }
+}
+
+/***************************************************************
+ * run_as(): - Note the session that runs the commands that
+ * follow, or NULL when they are done.  LISTEN, rta_notify(),
+ * and the row loops of do_sql.c use this.
+ *
+ * Input:        The session, or NULL
+ * Output:       void
+ * Effects:      CurSess, and the cancel flag and the limits in
+ *               rta_cmd
+ ***************************************************************/
+static void
+run_as(RTA_SESSION *sess)
+{
+  CurSess = sess;
+  if (sess == (RTA_SESSION *) 0) {
+    rta_cmd.cancel = (volatile int *) 0;
+    rta_cmd.guard = (struct Sql_Guard *) 0;
+    return;
+  }
+  rta_cmd.cancel = &(sess->cancel);
+  rta_cmd.guard = &(sess->guard);
+
+  /* SET overrides the defaults in rta_limit */
+  sess->guard.timeout = (sess->sets & RTA_SET_TIMEOUT) ?
+    sess->timeout : rta_limit.timeout;
+  sess->guard.maxscan = (sess->sets & RTA_SET_MAXSCAN) ?
+    sess->maxscan : rta_limit.maxscan;
+}
+
+/***************************************************************
+ * find_stmt(): - Find a statement or portal by name
+ *
+ * Input:        Pointer to the head of the list, and the name
+ * Output:       Pointer to the link that points to the statement
+ *               or to the NULL at the end of the list
+ * Effects:      None
+ ***************************************************************/
+static struct Sql_Stmt **
+find_stmt(struct Sql_Stmt **pps, char *name)
+{
+  while (*pps && strcmp((*pps)->name, name))
+    pps = &((*pps)->next);
+  return (pps);
+}
+
+/***************************************************************
+ * new_stmt(): - Add a statement or portal to a list
+ *
+ * Input:        Pointer to the head of the list, the name, and
+ *               the plan of the new statement
+ * Output:       Pointer to the new statement or NULL on error
+ * Effects:      The list
+ ***************************************************************/
+static struct Sql_Stmt *
+new_stmt(struct Sql_Stmt **pps, char *name, struct Sql_Plan *pplan)
+{
+  struct Sql_Stmt *ps; /* the new statement */
+
+  ps = malloc(sizeof(struct Sql_Stmt) + strlen(name) + 1);
+  if (ps == (struct Sql_Stmt *) 0) {
+    rta_stat.nsyserr++;
+    if (rta_dbg.syserr)
+      rta_log(LOC, Er_No_Mem);
+    return (ps);
+  }
+  ps->name = (char *) (ps + 1);
+  strcpy(ps->name, name);
+  ps->plan = pplan;
+  ps->done = 0;
+  ps->next = *pps;
+  *pps = ps;
+  return (ps);
+}
+
+/***************************************************************
+ * free_stmt(): - Remove a statement or portal from its list and
+ * free it and its plan.
+ *
+ * Input:        Pointer to the link that points to the statement
+ * Output:       void
+ * Effects:      The list
+ ***************************************************************/
+static void
+free_stmt(struct Sql_Stmt **pps)
+{
+  struct Sql_Stmt *ps; /* the statement to free */
+
+  ps = *pps;
+  *pps = ps->next;
+  if (ps->plan)
+    free(ps->plan);
+  free(ps);
+}
+
+/***************************************************************
+ * save_cursor(): - Save the SELECT in rta_cmd, with its current
+ * row, as the new plan of a portal or query.
+ *
+ * Input:        The portal or query
+ * Output:       1 on success, 0 if out of memory
+ * Effects:      The plan of the portal or query; rta_cmd is
+ *               cleared
+ ***************************************************************/
+static int
+save_cursor(struct Sql_Stmt *ps)
+{
+  struct Sql_Plan *pplan;  /* the new plan */
+
+  pplan = rta_plan_save();
+  if (pplan == (struct Sql_Plan *) 0)
+    return (0);
+
+  /* rta_cmd may point into the old plan so we clear it first */
+  rta_dosql_init();
+  if (ps->plan)
+    free(ps->plan);
+  ps->plan = pplan;
+  return (1);
+}
+
+/***************************************************************
+ * more_ret(): - Give the return for a session that may have a
+ * stopped SELECT.
+ *
+ * Input:        The session
+ * Output:       RTA_YIELD if the SELECT used its budget, RTA_MORE
+ *               if it filled the buffer, else RTA_SUCCESS
+ * Effects:      None
+ ***************************************************************/
+static int
+more_ret(RTA_SESSION *sess)
+{
+  if (sess->more == (struct Sql_Stmt *) 0)
+    return (RTA_SUCCESS);
+  return ((sess->yield) ? RTA_YIELD : RTA_MORE);
+}
+
+/***************************************************************
+ * ad_reply(): - Add a small reply message to the output buffer.
+ *
+ * Input:        The buffer, the message type, the body of the
+ *               message as a string (may be NULL), and the number
+ *               of free bytes in the buffer
+ * Output:       The number of free bytes in the buffer
+ * Effects:      The output buffer
+ ***************************************************************/
+static void
+ad_reply(char *out, int type, char *body, int *nout)
+{
+  int      len;        /* length of the body */
+
+  len = (body) ? strlen(body) : 0;
+  if (type == 'C')
+    len++;                      /* the command tag ends with a null */
+  *out++ = (char) type;
+  rta_ad_int4(&out, len + 4);
+  if (len)
+    memcpy(out, body, len);
+  *nout -= len + 5;
+}
+
+/***************************************************************
+ * get_str(), get_int2(), get_int4(): - Get a null terminated
+ * string, or a two or four byte integer from a message.  We set
+ * the remaining length to -1 if the message is too short.
+ *
+ * Input:        A **char to the message, and the number of bytes
+ *               left in the message
+ * Output:       The string or integer
+ * Effects:      Increments the **char past the field
+ ***************************************************************/
+static char *
+get_str(char **pmsg, int *plen)
+{
+  char    *str;        /* the string */
+  char    *end;        /* its terminating null */
+
+  str = *pmsg;
+  end = (*plen > 0) ? memchr(str, 0, *plen) : (char *) 0;
+  if (end == (char *) 0) {
+    *plen = -1;
+    return ("");
+  }
+  *plen -= (int) (end - str) + 1;
+  *pmsg = end + 1;
+  return (str);
+}
+
+static int
+get_int2(char **pmsg, int *plen)
+{
+  unsigned char *p;    /* the bytes of the integer */
+
+  if (*plen < 2) {
+    *plen = -1;
+    return (0);
+  }
+  p = (unsigned char *) *pmsg;
+  *pmsg += 2;
+  *plen -= 2;
+  return ((short) ((p[0] << 8) | p[1]));
+}
+
+static int
+get_int4(char **pmsg, int *plen)
+{
+  unsigned char *p;    /* the bytes of the integer */
+
+  if (*plen < 4) {
+    *plen = -1;
+    return (0);
+  }
+  p = (unsigned char *) *pmsg;
+  *pmsg += 4;
+  *plen -= 4;
+  return ((int) (((unsigned int) p[0] << 24) | (p[1] << 16) |
+      (p[2] << 8) | p[3]));
+}
+
+/***************************************************************
+ * param_text(): - Convert a parameter value to text.  Binary
+ * values are in network byte order and their size must match
+ * an integer or float type.
+ *
+ * Input:        The column of the parameter (may be NULL), the
+ *               format (0=text, 1=binary), the value and its
+ *               length, and where to put the text
+ * Output:       Pointer to the text, or NULL on error
+ * Effects:      None
+ ***************************************************************/
+static char *
+param_text(RTA_COLDEF *pcol, int fmt, char *val, int vlen, char *text)
+{
+  unsigned char *p;    /* the bytes of the value */
+  unsigned long long ull;  /* binary value as an integer */
+  union {
+    unsigned int i;
+    float    f;
+  } u4;                /* 4 byte float */
+  union {
+    unsigned long long l;
+    double   d;
+  } u8;                /* 8 byte double */
+  int      i;          /* loop index */
+
+  /* Text format, or a string in binary format, is just copied */
+  if (fmt == 0 || pcol == (RTA_COLDEF *) 0 ||
+    pcol->type == RTA_STR || pcol->type == RTA_PSTR) {
+    if (memchr(val, 0, vlen))
+      return ((char *) 0);
+    memcpy(text, val, vlen);
+    text[vlen] = (char) 0;
+    return (text);
+  }
+  if (fmt != 1 || (vlen != 2 && vlen != 4 && vlen != 8))
+    return ((char *) 0);
+
+  p = (unsigned char *) val;
+  ull = 0;
+  for (i = 0; i < vlen; i++)
+    ull = (ull << 8) | p[i];
+
+  switch (pcol->type) {
+    case RTA_FLOAT:
+    case RTA_PFLOAT:
+    case RTA_DOUBLE:
+      if (vlen == 4) {
+        u4.i = (unsigned int) ull;
+        (void) sprintf(text, "%.9g", u4.f);
+      }
+      else if (vlen == 8) {
+        u8.l = ull;
+        (void) sprintf(text, "%.17g", u8.d);
+      }
+      else
+        return ((char *) 0);
+      break;
+    default:
+      /* Sign extend 2 and 4 byte integers */
+      if (vlen == 2)
+        (void) sprintf(text, "%d", (short) ull);
+      else if (vlen == 4)
+        (void) sprintf(text, "%d", (int) ull);
+      else
+        (void) sprintf(text, "%lld", (long long) ull);
+      break;
+  }
+  return (text);
+}
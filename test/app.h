@@ -18,9 +18,13 @@
     /* Maximum number of UI/Posgres connections */
 #define MX_UI     (20)
 
-    /* Max size of a Postgres packet from/to the UI's */
+    /* Size of the input buffer of a UI connection, and the
+       most it may grow to hold one big Postgres packet */
 #define MXCMD      (1000)
-#define MXRSP     (50000)
+#define MXMSG      (67108864)
+
+    /* Max number of output chunks sent in one writev() */
+#define MXIOV        (16)
 
     /* Note length and number of rows in the "mydata" table. */
 #define NOTE_LEN   20
@@ -48,15 +52,18 @@ typedef struct ui
   struct ui  *nextconn;   /* Points to next conn in linked list */
   int      fd;         /* FD of TCP conn (=-1 if not in use) */
   int      cmdindx;    /* Index of next location in cmd buffer */
-  char     cmd[MXCMD]; /* SQL command from UI program */
-  int      rspfree;    /* Number of free bytes in rsp buffer */
-  char     rsp[MXRSP]; /* SQL response to the UI program */
+  int      cmdsize;    /* Size of the cmd buffer */
+  char    *cmd;        /* SQL command from UI program */
+  RTA_OUTBUF *rsp;     /* SQL response to the UI program */
   int      o_port;     /* Other-end TCP port number */
   int      o_ip;       /* Other-end IP address */
   llong    nbytin;     /* number of bytes read in */
   llong    nbytout;    /* number of bytes sent out */
   int      ctm;        /* connect time (==time();) */
   int      cdur;       /* duration time (== now()-ctm;) */
+  RTA_SESSION *sess;   /* prepared statements, etc of the conn */
+  int      more;       /* ==1 if librta has more output for us */
+  int      yield;      /* ==1 if a SELECT used its budget */
 } UI;
 
 
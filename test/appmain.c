@@ -26,6 +26,7 @@
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>            /* for writev() */
 #include <sys/syslog.h>
 #include <netinet/in.h>
 #include <string.h>
@@ -42,6 +43,7 @@ void     accept_ui_session(int srvfd);
 int      compute_cdur(char *tbl, char *col, char *sql, void *pr, int rowid);
 void     handle_ui_output(UI *pui);
 void     handle_ui_request(UI *pui);
+void     run_ui_commands(UI *pui);
 void     init_ui();
 int      listen_on_port(int port);
 int      reverse_str(char *tbl, char *col, char *sql, void *pr, int rowid,
@@ -77,6 +79,8 @@ main()
   int      i;          /* generic loop counter */
   UI      *pui;        /* pointer to a UI struct */
   UI      *nextpui;    /* points to next UI in list */
+  struct timeval tv;   /* zero timeout to poll for I/O */
+  struct timeval *ptv; /* select() timeout, NULL to block */
 
 
 
@@ -89,6 +93,10 @@ main()
     rta_add_table(&UITables[i]);
   }
 
+  /* Do not let one big SELECT hold up the loop for more than
+     about a millisecond */
+  rta_budget(0, 1000);
+
   while (1)
   {
     /* Build the fd_set for the select call.  This includes the listen
@@ -98,6 +106,7 @@ main()
     FD_ZERO(&rfds);
     FD_ZERO(&wfds);
     mxfd = 0;
+    ptv = (struct timeval *) 0;
 
     /* open UI/DB/manager listener if needed */
     if (newui_fd < 0)
@@ -111,7 +120,20 @@ main()
     pui = ConnHead;
     while (pui)
     {
-      if (pui->rspfree < MXRSP) /* Data to send? */
+      /* Queue any notifications for a client that has LISTENed,
+         and continue a SELECT that yielded with nothing to send */
+      if (rta_outbuf_len(pui->rsp) == 0 &&
+          (rta_session_pending(pui->sess) || pui->yield))
+        run_ui_commands(pui);
+
+      /* Poll, do not block, if it yielded again */
+      if (rta_outbuf_len(pui->rsp) == 0 && pui->yield)
+      {
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+        ptv = &tv;
+      }
+      if (rta_outbuf_len(pui->rsp) > 0) /* Data to send? */
       {
         FD_SET(pui->fd, &wfds);
         mxfd = (pui->fd > mxfd) ? pui->fd : mxfd;
@@ -125,8 +147,7 @@ main()
     }
 
     /* Wait for some something to do */
-    (void) select(mxfd + 1, &rfds, &wfds,
-      (fd_set *) 0, (struct timeval *) 0);
+    (void) select(mxfd + 1, &rfds, &wfds, (fd_set *) 0, ptv);
 
     /* ....after the select call.  We have activity. Search through
        the open fd's to find what to do. */
@@ -198,6 +219,9 @@ accept_ui_session(int srvfd)
        promote next oldest to the top of the linked list.  */
     close(ConnHead->fd);
     pui = ConnHead->nextconn;  
+    rta_session_free(ConnHead->sess);
+    rta_outbuf_free(ConnHead->rsp);
+    free(ConnHead->cmd);
     free(ConnHead);
     nui--;
     ConnHead = pui;
@@ -213,6 +237,20 @@ accept_ui_session(int srvfd)
     close(newuifd);
     return;
   }
+  pnew->sess = rta_session_new();
+  pnew->rsp = rta_outbuf_new();
+  pnew->cmd = malloc(MXCMD);
+  if (pnew->sess == (RTA_SESSION *) NULL || pnew->rsp == (RTA_OUTBUF *) NULL ||
+      pnew->cmd == (char *) NULL) 
+  {
+    syslog(LOG_ERR, "Unable to allocate memory");
+    rta_session_free(pnew->sess);
+    rta_outbuf_free(pnew->rsp);
+    free(pnew->cmd);
+    free(pnew);
+    close(newuifd);
+    return;
+  }
   nui++;       /* increment number of UI structs alloc'ed */
 
   /* OK, we've got the UI struct, now add it to end of list */
@@ -240,10 +278,12 @@ accept_ui_session(int srvfd)
   pnew->o_ip = (int) cliskt.sin_addr.s_addr;
   pnew->o_port = (int) ntohs(cliskt.sin_port);
   pnew->cmdindx = 0;
-  pnew->rspfree = MXRSP;
+  pnew->cmdsize = MXCMD;
   pnew->ctm = (int) time((time_t *) 0);
   pnew->nbytin = 0;
   pnew->nbytout = 0;
+  pnew->more = 0;
+  pnew->yield = 0;
 }
 
 /***************************************************************
@@ -287,13 +327,28 @@ void
 handle_ui_request(UI *pui)
 {
   int      ret;        /* a return value */
-  int      dbstat;     /* a return value */
-  int      t;          /* a temp int */
+  int      need;       /* size of a packet too big for the buffer */
+  char    *pcmd;       /* the grown buffer */
+
+  /* Grow the buffer if it is full with part of one big packet.
+     If we can not, the read below fails and we close the conn. */
+  if (pui->cmdindx == pui->cmdsize)
+  {
+    need = rta_dbmsglen(pui->cmd, pui->cmdindx);
+    pcmd = (need > pui->cmdsize && need <= MXMSG) ?
+      realloc(pui->cmd, need) : (char *) NULL;
+    if (pcmd)
+    {
+      pui->cmd = pcmd;
+      pui->cmdsize = need;
+    }
+  }
 
   /* We read data from the connection into the buffer in the ui struct. 
      Once we've read all of the data we can, we call the DB routine to
      parse out the SQL command and to execute it. */
-  ret = read(pui->fd, &(pui->cmd[pui->cmdindx]), (MXCMD - pui->cmdindx));
+  ret = read(pui->fd, &(pui->cmd[pui->cmdindx]),
+             (pui->cmdsize - pui->cmdindx));
 
   /* shutdown manager conn on error or on zero bytes read */
   if (ret <= 0)
@@ -308,6 +363,9 @@ handle_ui_request(UI *pui)
       ConnHead = pui->nextconn;
     if (pui->nextconn)
       (pui->nextconn)->prevconn = pui->prevconn;
+    rta_session_free(pui->sess);
+    rta_outbuf_free(pui->rsp);
+    free(pui->cmd);
     free(pui);
     nui--;
     return;
@@ -317,22 +375,46 @@ handle_ui_request(UI *pui)
 
   /* The commands are in the buffer. Call the DB to parse and execute
      them */
-  t = pui->cmdindx;                        /* packet in length */
-  do
-  {
-    dbstat = rta_dbcommand(pui->cmd,         /* packet in */
-      &(pui->cmdindx),                       /* packet in length */
-      &(pui->rsp[MXRSP - pui->rspfree]),     /* ptr to out buf */
-      &(pui->rspfree));                      /* N bytes at out */
-    t -= pui->cmdindx;                       /* t = # bytes consumed */
-    /* move any trailing SQL cmd text up in the buffer */
-    (void) memmove(pui->cmd, &(pui->cmd[t]), t);
-  } while (dbstat == RTA_SUCCESS);
+  run_ui_commands(pui);
+
   /* the command is done (including side effects).  Send any reply back 
      to the UI.  You may want to check for RTA_CLOSE here. */
   handle_ui_output(pui);
 }
 
+/***************************************************************
+ * run_ui_commands(): - Execute the commands in the input buffer
+ * of a UI connection.  The output buffer grows as needed, but
+ * a very large SELECT stops and returns RTA_MORE.  We call
+ * again once the output is sent.  A SELECT that used its budget
+ * returns RTA_YIELD and goes on the same way, or on the next
+ * pass of the main loop if it has nothing to send.
+ *
+ * Input:        pointer to UI struct with commands to run
+ * Output:       none
+ * Effects:      many, many side effects via table callbacks
+ ***************************************************************/
+void
+run_ui_commands(UI *pui)
+{
+  int      dbstat;     /* a return value */
+  int      t;          /* a temp int */
+  int      ncmd;       /* number of commands executed */
+
+  t = pui->cmdindx;                          /* packet in length */
+  dbstat = rta_session_dbout(pui->sess,      /* client's session */
+    pui->cmd,                                /* packets in */
+    &(pui->cmdindx),                         /* packet in length */
+    pui->rsp,                                /* output buffer */
+    &ncmd);                                  /* N commands run */
+  t -= pui->cmdindx;                         /* t = # bytes consumed */
+  /* move any trailing SQL cmd text up in the buffer */
+  if (t > 0 && pui->cmdindx > 0)
+    (void) memmove(pui->cmd, &(pui->cmd[t]), pui->cmdindx);
+  pui->more = (dbstat == RTA_MORE || dbstat == RTA_YIELD);
+  pui->yield = (dbstat == RTA_YIELD);
+}
+
 /***************************************************************
  * handle_ui_output() - This routine is called to write data
  * to the TCP connection to the UI programs.  It is useful for
@@ -345,11 +427,14 @@ handle_ui_request(UI *pui)
 void
 handle_ui_output(UI *pui)
 {
-  int      ret;        /* write() return value */
+  int      ret;        /* writev() return value */
+  struct iovec iov[MXIOV]; /* the chunks of output */
+  int      niov;       /* number of chunks to send */
 
-  if (pui->rspfree < MXRSP)
+  if (rta_outbuf_len(pui->rsp) > 0)
   {
-    ret = write(pui->fd, pui->rsp, (MXRSP - pui->rspfree));
+    niov = rta_outbuf_iov(pui->rsp, iov, MXIOV);
+    ret = writev(pui->fd, iov, niov);
     if (ret < 0)
     {
       /* log a failure to talk to a DB/UI connection */
@@ -364,23 +449,21 @@ handle_ui_output(UI *pui)
         ConnHead = pui->nextconn;
       if (pui->nextconn)
         (pui->nextconn)->prevconn = pui->prevconn;
+      rta_session_free(pui->sess);
+      rta_outbuf_free(pui->rsp);
+      free(pui->cmd);
       free(pui);
       nui--;
       return;
     }
-    else if (ret == (MXRSP - pui->rspfree))
-    {
-      pui->rspfree = MXRSP;
-      pui->nbytout += ret;
-    }
-    else
-    {
-      /* we had a partial write.  Adjust the buffer */
-      (void) memmove(pui->rsp, &(pui->rsp[ret]),
-        (MXRSP - pui->rspfree - ret));
-      pui->rspfree += ret;
-      pui->nbytout += ret;  /* # bytes sent on conn */
-    }
+
+    /* Remove what was sent.  A partial write leaves the rest. */
+    rta_outbuf_drain(pui->rsp, ret);
+    pui->nbytout += ret;  /* # bytes sent on conn */
+
+    /* Let librta continue a SELECT that filled the buffer */
+    if (rta_outbuf_len(pui->rsp) == 0 && pui->more)
+      run_ui_commands(pui);
   }
 }
 
@@ -107,7 +107,7 @@ RTA_COLDEF   dlcolumns[] = {
       RTA_STR,                  /* it is a string */
       NOTE_LEN,                 /* number of bytes */
       offsetof(DEMOLIST, dlstr), /* location in struct */
-      RTA_DISKSAVE,             /* save to disk */
+      RTA_DISKSAVE | RTA_INDEXED, /* save to disk, index it */
       (int (*)()) 0,            /* called before read */
       (int (*)()) 0,            /* called after write */
     "A note string in a demo linked list table"},
@@ -138,7 +138,7 @@ RTA_COLDEF   dlcolumns[] = {
       RTA_LONG,                 /* it is a long */
       sizeof(llong),            /* number of bytes */
       offsetof(DEMOLIST, dllong), /* location in struct */
-      RTA_DISKSAVE,             /* Save updates to disk */
+      RTA_DISKSAVE | RTA_INDEXED | RTA_ORDERED, /* Save, index, order */
       (int (*)()) 0,            /* called before read */
       (int (*)()) 0,            /* called after write */
     "A long integer.  No meaning is assigned to this long."},
@@ -208,7 +208,7 @@ RTA_COLDEF   dlcolumns[] = {
       RTA_UCHAR,                /* it is an unsigned char */
       sizeof(unsigned char),    /* number of bytes */
       offsetof(DEMOLIST, dluchar), /* location in struct */
-      0,                        /* Read/write, don't save */
+      RTA_BITMAP,               /* Read/write, bitmap of values */
       (int (*)()) 0,            /* called before read */
       (int (*)()) 0,            /* called after write */
     "An unsigned char."},